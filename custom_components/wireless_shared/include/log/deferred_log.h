@@ -0,0 +1,40 @@
+#pragma once
+#include "esp_err.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <stdint.h>
+
+// Logging for latency-sensitive code (CONFIG_WIRELESS_DEFERRED_LOG).
+// A call stores the format string's address and up to DLOG_MAX_ARGS raw 32-bit
+// arguments in a lock-free ring; a low-priority task formats them later, or emits
+// them as binary records for tools/dlog_decode.py to format on the host.
+//
+// Arguments are stored as uint32_t and handed back to printf as such: numbers only,
+// no pointers and so no %s, which would only hold where pointers are 32 bits (not on
+// the linux target). No 64-bit arguments either. Log a string with ESP_LOG* instead.
+// The ring survives a panic or watchdog reset and is saved to NVS on the next boot.
+// Each call wakes the drain task, so log from tasks only, never from an ISR or a
+// critical section.
+
+#define DLOG_MAX_ARGS 4
+
+#if CONFIG_WIRELESS_DEFERRED_LOG
+#define DLOG_LEVEL(level, tag, fmt, ...) do {                                                   \
+        const uint32_t _dlog_args[] = { 0, ##__VA_ARGS__ };                                      \
+        _Static_assert(sizeof(_dlog_args) <= (DLOG_MAX_ARGS + 1) * sizeof(uint32_t),             \
+                       "too many deferred log arguments");                                     \
+        dlog_write((level), (tag), (fmt), _dlog_args + 1, sizeof(_dlog_args) / sizeof(uint32_t) - 1); \
+    } while (0)
+#else
+#define DLOG_LEVEL(level, tag, fmt, ...) ESP_LOG_LEVEL_LOCAL((level), (tag), fmt, ##__VA_ARGS__)
+#endif
+
+#define DLOGE(tag, fmt, ...) DLOG_LEVEL(ESP_LOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define DLOGW(tag, fmt, ...) DLOG_LEVEL(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define DLOGI(tag, fmt, ...) DLOG_LEVEL(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+
+void dlog_write(esp_log_level_t level, const char* tag, const char* fmt, const uint32_t* args, uint32_t num_args);
+
+// Save the tail left by a crash to NVS, print the last saved tail and start the drain task.
+// Call once NVS is initialised and before anything logs through DLOG.
+esp_err_t begin_deferred_log(void);
@@ -0,0 +1,16 @@
+#pragma once
+#include "esp_attr.h"
+#include "sdkconfig.h"
+
+// Functions and constants on the input hot path (CONFIG_WIRELESS_HOT_PATH_IRAM).
+// The build fails if a function named in an app's hot_path.txt is linked into flash,
+// e.g. because it lost its HOT_PATH_ATTR.
+#if CONFIG_WIRELESS_HOT_PATH_IRAM
+#define HOT_PATH_ATTR IRAM_ATTR
+#define HOT_PATH_DATA DRAM_ATTR
+#define HOT_PATH_PLACEMENT "IRAM"
+#else
+#define HOT_PATH_ATTR
+#define HOT_PATH_DATA
+#define HOT_PATH_PLACEMENT "flash"
+#endif
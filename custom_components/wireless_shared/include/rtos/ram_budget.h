@@ -0,0 +1,82 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Statically allocated tasks and queues, registered for the RAM budget report.
+// Sizes come from each app's device_config.h so the whole budget lives in one table.
+
+#define RAM_BUDGET_MAX_TASKS 20
+#define RAM_BUDGET_MAX_QUEUES 8
+
+typedef struct {
+    const char* name;
+    uint32_t stack_size;     // bytes (ESP-IDF stack depths are in bytes)
+    UBaseType_t priority;
+    StackType_t* stack;
+    StaticTask_t* tcb;
+    TaskHandle_t handle;
+} static_task_t;
+
+typedef struct {
+    const char* name;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    uint8_t* storage;
+    StaticQueue_t* buffer;
+    QueueHandle_t handle;
+    portMUX_TYPE lock;       // guards peak and dropped against senders on both cores
+    UBaseType_t peak;        // most items ever waiting
+    uint32_t dropped;        // sends refused because the queue was full
+} static_queue_t;
+
+// Declare the storage for a task: STATIC_TASK(mouse_task_mem, "mouse", MOUSE_TASK_STACK, MOUSE_TASK_PRIORITY);
+#define STATIC_TASK(var, task_name, stack_bytes, prio)                      \
+    static StackType_t var##_stack[(stack_bytes) / sizeof(StackType_t)];    \
+    static StaticTask_t var##_tcb;                                          \
+    static static_task_t var = {                                            \
+        .name = (task_name), .stack_size = (stack_bytes), .priority = (prio), \
+        .stack = var##_stack, .tcb = &var##_tcb                             \
+    }
+
+// Declare the storage for a queue: STATIC_QUEUE(mouse_queue_mem, "mouse", MOUSE_QUEUE_LEN, mouse_event_t);
+#define STATIC_QUEUE(var, queue_name, len, item_type)                       \
+    static uint8_t var##_storage[(len) * sizeof(item_type)];                \
+    static StaticQueue_t var##_buf;                                         \
+    static static_queue_t var = {                                           \
+        .name = (queue_name), .length = (len), .item_size = sizeof(item_type), \
+        .storage = var##_storage, .buffer = &var##_buf,                     \
+        .lock = portMUX_INITIALIZER_UNLOCKED                                \
+    }
+
+// Create the task in its static storage; returns NULL on failure
+TaskHandle_t create_static_task(static_task_t* task, TaskFunction_t fn, void* arg);
+
+// As create_static_task(), running only on the given core
+TaskHandle_t create_static_task_pinned(static_task_t* task, TaskFunction_t fn, void* arg, BaseType_t core);
+
+// Create the queue in its static storage; returns NULL on failure
+QueueHandle_t create_static_queue(static_queue_t* queue);
+
+// Report a task created elsewhere (IDF components, esp_timer) alongside our own
+void ram_budget_watch_task(const char* name, TaskHandle_t handle, uint32_t stack_size);
+
+// Record queue occupancy after a send attempt; cheap enough for the input path
+static inline void ram_budget_note_send(static_queue_t* queue, bool sent){
+    UBaseType_t waiting = sent ? uxQueueMessagesWaiting(queue->handle) : 0;
+    portENTER_CRITICAL(&queue->lock);
+    if (!sent)
+        queue->dropped++;
+    else if (waiting > queue->peak)
+        queue->peak = waiting;
+    portEXIT_CRITICAL(&queue->lock);
+}
+
+// Log stack high-water marks, queue peaks and heap usage
+void ram_budget_report(void);
+
+// Log the report every period_us
+esp_err_t begin_ram_budget_report(uint64_t period_us);
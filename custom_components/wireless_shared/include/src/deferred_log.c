@@ -0,0 +1,242 @@
+#include "log/deferred_log.h"
+#include "rtos/ram_budget.h"
+#include "rtos/hot_path.h"
+#include "esp_attr.h"
+#include "esp_app_desc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DLOG_RING_LEN 64                 // power of two
+#define DLOG_RING_MAGIC 0x444C4F47       // "DLOG"
+#define DLOG_TAIL_KEY "dlog_tail"
+#define DLOG_TAIL_ELF_KEY "dlog_elf"     // firmware the saved tail belongs to
+#define ELF_SHA_LEN 17
+#define DLOG_TASK_STACK 3072
+#define DLOG_TASK_PRIORITY 1
+
+// Layout shared with tools/dlog_decode.py -- everything after seq is emitted as-is
+typedef struct {
+    volatile uint32_t seq;      // write index + 1 once complete, 0 while being written
+    uint32_t timestamp_us;
+    const char* tag;
+    const char* fmt;
+    uint8_t level;
+    uint8_t num_args;
+    uint16_t reserved;
+    uint32_t args[DLOG_MAX_ARGS];
+} dlog_record_t;
+
+#if CONFIG_WIRELESS_DEFERRED_LOG
+static const char* TAG = "WIRELESS_SHARED // deferred_log.c";
+
+// Not cleared at boot, so a panic or watchdog reset leaves the last records behind
+static __NOINIT_ATTR struct {
+    uint32_t magic;
+    dlog_record_t records[DLOG_RING_LEN];
+} ring;
+
+static atomic_uint head = 0;    // next write index
+static uint32_t tail = 0;       // next read index, drain task only
+static uint32_t lost = 0;
+static TaskHandle_t dlog_task_handle = NULL;
+
+STATIC_TASK(dlog_task_mem, "dlog", DLOG_TASK_STACK, DLOG_TASK_PRIORITY);
+
+void HOT_PATH_ATTR dlog_write(esp_log_level_t level, const char* tag, const char* fmt, const uint32_t* args, uint32_t num_args){
+    uint32_t index = atomic_fetch_add_explicit(&head, 1, memory_order_relaxed);
+    dlog_record_t* record = &ring.records[index & (DLOG_RING_LEN - 1)];
+    // The oldest record is overwritten; the drain task notices and counts it lost
+    record->seq = 0;
+    atomic_thread_fence(memory_order_release);
+    record->timestamp_us = (uint32_t)esp_timer_get_time();
+    record->tag = tag;
+    record->fmt = fmt;
+    record->level = level;
+    record->num_args = num_args;
+    for (uint32_t i = 0; i < num_args; i++)
+        record->args[i] = args[i];
+    atomic_thread_fence(memory_order_release);
+    record->seq = index + 1;
+    // Only once the record is complete, so a drain it wakes never stops short of it
+    if (dlog_task_handle)
+        xTaskNotifyGive(dlog_task_handle);
+}
+
+// One line per record: "DLOG " + hex bytes from timestamp_us on
+static void emit_binary(const dlog_record_t* record){
+    const uint8_t* bytes = (const uint8_t*)&record->timestamp_us;
+    printf("DLOG ");
+    for (size_t i = 0; i < sizeof(*record) - offsetof(dlog_record_t, timestamp_us); i++)
+        printf("%02x", bytes[i]);
+    printf("\n");
+}
+
+#if !CONFIG_WIRELESS_DEFERRED_LOG_BINARY
+static char level_letter(uint8_t level){
+    switch (level){
+        case ESP_LOG_ERROR:
+            return 'E';
+        case ESP_LOG_WARN:
+            return 'W';
+        case ESP_LOG_INFO:
+            return 'I';
+        default:
+            return 'D';
+    }
+}
+
+// Only for records written by this firmware -- tag and format are pointers into it
+static void emit_text(const dlog_record_t* record){
+    printf("%c (%" PRIu32 ") %s: ", level_letter(record->level), record->timestamp_us / 1000, record->tag);
+    // Unused arguments are ignored; every argument is a 32-bit number (see deferred_log.h)
+    printf(record->fmt, record->args[0], record->args[1], record->args[2], record->args[3]);
+    printf("\n");
+}
+#endif
+
+static void emit_record(const dlog_record_t* record){
+#if CONFIG_WIRELESS_DEFERRED_LOG_BINARY
+    emit_binary(record);
+#else
+    emit_text(record);
+#endif
+}
+
+// Copy the record at index if it is complete and was not overwritten while copying
+static bool read_record(uint32_t index, dlog_record_t* out){
+    const dlog_record_t* record = &ring.records[index & (DLOG_RING_LEN - 1)];
+    uint32_t seq = record->seq;
+    atomic_thread_fence(memory_order_acquire);
+    *out = *record;
+    atomic_thread_fence(memory_order_acquire);
+    return seq == index + 1 && record->seq == seq;
+}
+
+static void drain(void){
+    dlog_record_t record;
+    while (tail != atomic_load_explicit(&head, memory_order_relaxed)){
+        uint32_t written = atomic_load_explicit(&head, memory_order_relaxed);
+        // Writers lapped us: skip to the oldest record still in the ring
+        if (written - tail > DLOG_RING_LEN){
+            lost += written - DLOG_RING_LEN - tail;
+            tail = written - DLOG_RING_LEN;
+        }
+        if (!read_record(tail, &record)){
+            uint32_t seq = ring.records[tail & (DLOG_RING_LEN - 1)].seq;
+            // Reserved but not yet written (or still the previous lap's record): its writer wakes us again
+            if (seq == 0 || seq <= tail)
+                break;
+            // Overwritten while we copied it
+            lost++;
+            tail++;
+            continue;
+        }
+        emit_record(&record);
+        tail++;
+    }
+    if (lost){
+        ESP_LOGW(TAG, "%" PRIu32 " deferred log records lost", lost);
+        lost = 0;
+    }
+}
+
+static void dlog_task(void* arg){
+    while (true){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        drain();
+    }
+}
+
+// esp_restart() (ESP_RST_SW) is always intentional here (an OTA update) and would
+// replace the tail of the last real crash
+static bool reset_by_crash(void){
+    switch (esp_reset_reason()){
+        case ESP_RST_PANIC:
+        case ESP_RST_INT_WDT:
+        case ESP_RST_TASK_WDT:
+        case ESP_RST_WDT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Move the records a crash left in the ring to NVS, oldest first
+static void save_crash_tail(dlog_record_t* records, const char* elf_sha){
+    size_t count = 0;
+    for (int i = 0; i < DLOG_RING_LEN; i++){
+        if (ring.records[i].seq != 0 && ring.records[i].num_args <= DLOG_MAX_ARGS)
+            records[count++] = ring.records[i];
+    }
+    // Insertion sort by sequence number; at most DLOG_RING_LEN records
+    for (size_t i = 1; i < count; i++){
+        dlog_record_t record = records[i];
+        size_t j = i;
+        for (; j > 0 && records[j - 1].seq > record.seq; j--)
+            records[j] = records[j - 1];
+        records[j] = record;
+    }
+    nvs_handle_t nvs_handle;
+    if (count == 0 || nvs_open("storage", NVS_READWRITE, &nvs_handle) != ESP_OK)
+        return;
+    if (nvs_set_blob(nvs_handle, DLOG_TAIL_KEY, records, count * sizeof(dlog_record_t)) == ESP_OK &&
+        nvs_set_str(nvs_handle, DLOG_TAIL_ELF_KEY, elf_sha) == ESP_OK)
+        nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+    ESP_LOGW(TAG, "Saved %u deferred log records from before the reset", (unsigned)count);
+}
+
+// Printed on every boot until the next crash replaces it. Records from other firmware
+// are only printed as binary, for tools/dlog_decode.py with that firmware's ELF.
+static void print_saved_tail(dlog_record_t* records, const char* elf_sha){
+    nvs_handle_t nvs_handle;
+    if (nvs_open("storage", NVS_READONLY, &nvs_handle) != ESP_OK)
+        return;
+    char saved_sha[ELF_SHA_LEN] = {0};
+    size_t sha_len = sizeof(saved_sha);
+    size_t len = DLOG_RING_LEN * sizeof(dlog_record_t);
+    bool found = nvs_get_blob(nvs_handle, DLOG_TAIL_KEY, records, &len) == ESP_OK &&
+                 nvs_get_str(nvs_handle, DLOG_TAIL_ELF_KEY, saved_sha, &sha_len) == ESP_OK;
+    nvs_close(nvs_handle);
+    if (!found)
+        return;
+    bool same_firmware = strcmp(saved_sha, elf_sha) == 0;
+    ESP_LOGW(TAG, "Deferred log tail of the last crash (firmware %s):", saved_sha);
+    for (size_t i = 0; i < len / sizeof(dlog_record_t); i++){
+        if (same_firmware)
+            emit_record(&records[i]);
+        else
+            emit_binary(&records[i]);
+    }
+}
+
+esp_err_t begin_deferred_log(void){
+    char elf_sha[ELF_SHA_LEN];
+    esp_app_get_elf_sha256(elf_sha, sizeof(elf_sha));
+    dlog_record_t* records = malloc(DLOG_RING_LEN * sizeof(dlog_record_t));
+    if (records != NULL){
+        if (ring.magic == DLOG_RING_MAGIC && reset_by_crash())
+            save_crash_tail(records, elf_sha);
+        print_saved_tail(records, elf_sha);
+        free(records);
+    }
+    memset(&ring, 0, sizeof(ring));
+    ring.magic = DLOG_RING_MAGIC;
+    dlog_task_handle = create_static_task(&dlog_task_mem, dlog_task, NULL);
+    return dlog_task_handle ? ESP_OK : ESP_FAIL;
+}
+#else
+void dlog_write(esp_log_level_t level, const char* tag, const char* fmt, const uint32_t* args, uint32_t num_args){
+    (void)level; (void)tag; (void)fmt; (void)args; (void)num_args;
+}
+
+esp_err_t begin_deferred_log(void){
+    return ESP_OK;
+}
+#endif
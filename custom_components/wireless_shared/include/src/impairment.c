@@ -0,0 +1,71 @@
+#include "wifi/impairment.h"
+#include <math.h>
+#include <string.h>
+
+// xorshift64*: fast, and the same sequence on every target for a given seed
+uint32_t impairment_random(impairment_t* link){
+    link->rng ^= link->rng >> 12;
+    link->rng ^= link->rng << 25;
+    link->rng ^= link->rng >> 27;
+    return (uint32_t)((link->rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static inline bool chance(impairment_t* link, uint16_t per_scale){
+    return per_scale && (impairment_random(link) % IMPAIRMENT_SCALE) < per_scale;
+}
+
+// Uniform in (0, 1]
+static inline double unit(impairment_t* link){
+    return (impairment_random(link) + 1.0) / 4294967296.0;
+}
+
+static uint32_t draw_delay(impairment_t* link){
+    const impairment_config_t* config = &link->config;
+    double extra = 0;
+    if (config->jitter_us){
+        switch (config->delay_dist){
+            case IMPAIRMENT_DELAY_EXPONENTIAL:
+                extra = -log(unit(link)) * config->jitter_us;
+                break;
+            case IMPAIRMENT_DELAY_NORMAL:
+                // Box-Muller, folded to positive
+                extra = fabs(sqrt(-2.0 * log(unit(link))) * cos(2.0 * M_PI * unit(link))) * config->jitter_us;
+                break;
+            default:
+                extra = impairment_random(link) % config->jitter_us;
+                break;
+        }
+    }
+    return config->delay_us + (uint32_t)extra;
+}
+
+void impairment_init(impairment_t* link, const impairment_config_t* config){
+    memset(link, 0, sizeof(*link));
+    link->config = *config;
+    // A zero state would stay zero
+    link->rng = ((uint64_t)config->seed << 32 | config->seed) ^ 0x9E3779B97F4A7C15ULL;
+}
+
+int impairment_apply(impairment_t* link, uint32_t delay_us[IMPAIRMENT_MAX_COPIES]){
+    const impairment_config_t* config = &link->config;
+    link->stats.frames++;
+    // The state changes before the frame, so a burst starts with the frame that entered it
+    if (link->bad ? chance(link, config->bad_to_good) : chance(link, config->good_to_bad))
+        link->bad = !link->bad;
+    if (chance(link, link->bad ? config->loss_bad : config->loss_good)){
+        link->stats.lost++;
+        return 0;
+    }
+
+    int copies = chance(link, config->duplicate) ? 2 : 1;
+    if (copies == 2)
+        link->stats.duplicated++;
+    for (int i = 0; i < copies; i++){
+        delay_us[i] = draw_delay(link);
+        if (chance(link, config->reorder)){
+            delay_us[i] += config->reorder_us;
+            link->stats.reordered++;
+        }
+    }
+    return copies;
+}
@@ -0,0 +1,222 @@
+#include "wifi/link_power.h"
+#include "sdkconfig.h"
+
+#if CONFIG_WIRELESS_POWER_MANAGEMENT
+#include "wifi/transport.h"
+#include "wifi/wifi.h"
+#include "rtos/ram_budget.h"
+#include "rtos/hot_path.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <inttypes.h>
+
+#define LINK_POWER_TASK_STACK 3072
+#define LINK_POWER_TASK_PRIORITY 5          // wakes the radio ahead of the device tasks
+#define IDLE_CHECK_MS 100
+#define LINK_POWER_LOG_INTERVAL_US (60000000LL)
+#define TIMED_SENDS 8                       // sends in flight timed at once
+
+static const char* TAG = "WIRELESS_SHARED // link_power.c";
+
+STATIC_TASK(link_power_task_mem, "link_power", LINK_POWER_TASK_STACK, LINK_POWER_TASK_PRIORITY);
+static TaskHandle_t HOT_PATH_DATA link_power_task_handle = NULL;
+static portMUX_TYPE link_power_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// NULL without CONFIG_PM_ENABLE: only the radio is managed
+static esp_pm_lock_handle_t HOT_PATH_DATA cpu_lock = NULL;
+static esp_pm_lock_handle_t HOT_PATH_DATA apb_lock = NULL;
+
+// Which way the locks are; the radio follows from the task
+static link_power_mode_t HOT_PATH_DATA mode = LINK_POWER_ACTIVE;
+static volatile bool HOT_PATH_DATA radio_dozing = false;
+static int64_t HOT_PATH_DATA last_input_us = 0;
+static int64_t HOT_PATH_DATA wake_start_us = 0;    // first input after idle, until the radio is awake
+static uint64_t idle_release_us = 0;
+
+// Sends in flight, found again by their send token: a completion may belong to any of
+// them, not just the oldest (a frame the transport refused, a relay hop, a lost frame)
+typedef struct {
+    uint32_t token;             // SEND_TOKEN_NONE when free
+    int64_t start_us;
+    link_power_mode_t mode;
+} timed_send_t;
+
+static timed_send_t HOT_PATH_DATA timed_sends[TIMED_SENDS];
+static link_power_stats_t HOT_PATH_DATA stats = {0};
+
+static void HOT_PATH_ATTR take_locks(void){
+    if (cpu_lock)
+        esp_pm_lock_acquire(cpu_lock);
+    if (apb_lock)
+        esp_pm_lock_acquire(apb_lock);
+}
+
+static void release_locks(void){
+    if (cpu_lock)
+        esp_pm_lock_release(cpu_lock);
+    if (apb_lock)
+        esp_pm_lock_release(apb_lock);
+}
+
+// Input at now_us; takes the locks back if they were released
+static void HOT_PATH_ATTR wake(int64_t now_us){
+    bool woke = false;
+    portENTER_CRITICAL(&link_power_lock);
+    last_input_us = now_us;
+    if (mode == LINK_POWER_IDLE){
+        mode = LINK_POWER_ACTIVE;
+        wake_start_us = now_us;
+        woke = true;
+    }
+    portEXIT_CRITICAL(&link_power_lock);
+    if (woke){
+        take_locks();
+        xTaskNotifyGive(link_power_task_handle);
+    }
+}
+
+void HOT_PATH_ATTR link_power_note_input(void){
+    wake(esp_timer_get_time());
+}
+
+// Releases the locks once input stops, and sets the radio's power save to match
+static void link_power_task(void* arg){
+    const transport_t* transport = get_transport();
+    int64_t last_log_us = esp_timer_get_time();
+    while (true){
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IDLE_CHECK_MS));
+        int64_t now_us = esp_timer_get_time();
+        bool release = false;
+        portENTER_CRITICAL(&link_power_lock);
+        if (mode == LINK_POWER_ACTIVE && idle_release_us && now_us - last_input_us >= (int64_t)idle_release_us){
+            mode = LINK_POWER_IDLE;
+            release = true;
+        }
+        bool doze = mode == LINK_POWER_IDLE;
+        portEXIT_CRITICAL(&link_power_lock);
+        if (release)
+            release_locks();
+
+        if (doze != radio_dozing && (transport->set_power_save == NULL || transport->set_power_save(doze) == ESP_OK))
+            radio_dozing = doze;
+        if (!doze){
+            int64_t awake_us = esp_timer_get_time();
+            portENTER_CRITICAL(&link_power_lock);
+            if (wake_start_us){
+                uint32_t wake_us = (uint32_t)(awake_us - wake_start_us);
+                stats.wakes++;
+                stats.wake_sum_us += wake_us;
+                if (wake_us > stats.wake_max_us)
+                    stats.wake_max_us = wake_us;
+                wake_start_us = 0;
+            }
+            portEXIT_CRITICAL(&link_power_lock);
+        }
+        if (now_us - last_log_us >= LINK_POWER_LOG_INTERVAL_US){
+            log_link_power_stats();
+            last_log_us = now_us;
+        }
+    }
+}
+
+void HOT_PATH_ATTR link_power_frame_queued(uint32_t token){
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&link_power_lock);
+    // A free slot, or else the oldest send, whose completion got lost
+    timed_send_t* send = &timed_sends[0];
+    for (int i = 0; i < TIMED_SENDS && send->token != SEND_TOKEN_NONE; i++){
+        if (timed_sends[i].token == SEND_TOKEN_NONE || timed_sends[i].start_us < send->start_us)
+            send = &timed_sends[i];
+    }
+    send->token = token;
+    send->start_us = now_us;
+    // Still dozing until the task has woken the radio
+    send->mode = (radio_dozing || wake_start_us) ? LINK_POWER_IDLE : LINK_POWER_ACTIVE;
+    portEXIT_CRITICAL(&link_power_lock);
+}
+
+void HOT_PATH_ATTR link_power_frame_sent(uint32_t token, bool success){
+    int64_t now_us = esp_timer_get_time();
+    if (token == SEND_TOKEN_NONE)
+        return;
+    portENTER_CRITICAL(&link_power_lock);
+    for (int i = 0; i < TIMED_SENDS; i++){
+        timed_send_t* send = &timed_sends[i];
+        if (send->token != token)
+            continue;
+        if (success){
+            uint32_t send_us = (uint32_t)(now_us - send->start_us);
+            stats.sends[send->mode]++;
+            stats.send_sum_us[send->mode] += send_us;
+            if (send_us > stats.send_max_us[send->mode])
+                stats.send_max_us[send->mode] = send_us;
+        }
+        send->token = SEND_TOKEN_NONE;
+        break;
+    }
+    portEXIT_CRITICAL(&link_power_lock);
+}
+
+void set_link_power_idle(uint64_t idle_us){
+    portENTER_CRITICAL(&link_power_lock);
+    idle_release_us = idle_us;
+    portEXIT_CRITICAL(&link_power_lock);
+    if (idle_us == 0)
+        wake(esp_timer_get_time());
+}
+
+link_power_mode_t get_link_power_mode(void){
+    return mode;
+}
+
+void get_link_power_stats(link_power_stats_t* out){
+    portENTER_CRITICAL(&link_power_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&link_power_lock);
+}
+
+void log_link_power_stats(void){
+    link_power_stats_t taken;
+    get_link_power_stats(&taken);
+    ESP_LOGI(TAG, "Power %s: %" PRIu32 " wakes, avg %" PRIu32 " max %" PRIu32 " US to an awake radio",
+             mode == LINK_POWER_IDLE ? "idle" : "active", taken.wakes,
+             taken.wakes ? (uint32_t)(taken.wake_sum_us / taken.wakes) : 0, taken.wake_max_us);
+    for (int i = 0; i < NUM_LINK_POWER_MODES; i++){
+        if (taken.sends[i] == 0)
+            continue;
+        ESP_LOGI(TAG, "Send to ack, radio %s: avg %" PRIu32 " max %" PRIu32 " US over %" PRIu32 " frames",
+                 i == LINK_POWER_IDLE ? "dozing" : "awake", (uint32_t)(taken.send_sum_us[i] / taken.sends[i]),
+                 taken.send_max_us[i], taken.sends[i]);
+    }
+}
+
+esp_err_t init_link_power(uint64_t idle_us){
+#if CONFIG_PM_ENABLE
+    // Light sleep would stop USB, so only the clocks scale
+    const esp_pm_config_t config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_XTAL_FREQ,
+        .light_sleep_enable = false
+    };
+    esp_err_t err = esp_pm_configure(&config);
+    if (err == ESP_OK)
+        err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "link_cpu", &cpu_lock);
+    if (err == ESP_OK)
+        err = esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "link_apb", &apb_lock);
+    if (err != ESP_OK){
+        ESP_LOGE(TAG, "Power management locks: %s", esp_err_to_name(err));
+        return err;
+    }
+#else
+    ESP_LOGI(TAG, "CONFIG_PM_ENABLE is off, managing the radio only");
+#endif
+    idle_release_us = idle_us;
+    last_input_us = esp_timer_get_time();
+    take_locks();
+    link_power_task_handle = create_static_task(&link_power_task_mem, link_power_task, NULL);
+    return link_power_task_handle ? ESP_OK : ESP_FAIL;
+}
+#endif
@@ -0,0 +1,447 @@
+#include "wifi/link_security.h"
+#include "wifi/msg_types.h"
+#include "rtos/ram_budget.h"
+#include "rtos/hot_path.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "wifi/transport.h"
+#include "nvs.h"
+#include "esp_random.h"
+#include "mbedtls/ccm.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/md.h"
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#define LINK_KEY_STORAGE_KEY "peer_lmk"     // peer MAC followed by its LMK
+#define TX_COUNTER_KEY "link_tx_ctr"        // first counter not yet reserved
+#define RX_COUNTER_KEY "link_rx_ctr"        // replay floor for the peer's frames
+#define LINK_KEY_LABEL "wireless adapter lmk"
+#define CONFIRM_LABEL "wireless adapter confirm"
+#define RELAY_KEY_LABEL "wireless adapter relay"
+#define RELAY_NONCE_LEN 13
+#define DEFAULT_PMK "WirelessAdapter!"      // the Kconfig default
+#define LINK_TASK_STACK 3072
+#define LINK_TASK_PRIORITY 1
+#define BENCHMARK_ITERATIONS 2000
+
+static const char* TAG = "WIRELESS_SHARED // link_security.c";
+
+static atomic_uint tx_next = 1;
+static volatile uint32_t tx_limit = 0;      // tx_next may not reach it
+static replay_window_t rx_window = {0};     // only touched by the WiFi task
+static volatile uint32_t rx_saved = 0;
+
+// NVS writes block, so counter reservations are made from their own task
+STATIC_TASK(link_task_mem, "link_ctr", LINK_TASK_STACK, LINK_TASK_PRIORITY);
+static TaskHandle_t link_task_handle = NULL;
+
+// Sealing runs in whichever task sends; opening only in the receiving one
+static mbedtls_ccm_context seal_ccm;
+static mbedtls_ccm_context open_ccm;
+static SemaphoreHandle_t seal_lock = NULL;
+static StaticSemaphore_t seal_lock_mem;
+static bool relay_key_set = false;
+
+static uint32_t load_counter(const char* key){
+    nvs_handle_t nvs_handle;
+    uint32_t value = 0;
+    if (nvs_open("storage", NVS_READONLY, &nvs_handle) == ESP_OK){
+        nvs_get_u32(nvs_handle, key, &value);
+        nvs_close(nvs_handle);
+    }
+    return value;
+}
+
+static esp_err_t store_counter(const char* key, uint32_t value){
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK)
+        return err;
+    err = nvs_set_u32(nvs_handle, key, value);
+    if (err == ESP_OK)
+        err = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+    return err;
+}
+
+// Move tx_limit a block past tx_next (or past itself); counters below the stored value
+// are never used again
+static void reserve_tx_block(void){
+    static bool exhausted = false;
+    uint32_t limit = tx_limit;
+    uint32_t next = atomic_load_explicit(&tx_next, memory_order_relaxed);
+    if (next > limit)
+        limit = next;
+    if (limit > UINT32_MAX - LINK_COUNTER_BLOCK){
+        if (!exhausted)
+            ESP_LOGE(TAG, "Frame counter exhausted, pair again to continue");
+        exhausted = true;
+        return;
+    }
+    if (store_counter(TX_COUNTER_KEY, limit + LINK_COUNTER_BLOCK) == ESP_OK)
+        tx_limit = limit + LINK_COUNTER_BLOCK;
+    else
+        ESP_LOGW(TAG, "Could not reserve frame counters");
+}
+
+static void link_task(void* arg){
+    while (true){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint32_t next = atomic_load_explicit(&tx_next, memory_order_relaxed);
+        // Past the limit after link_skip_tx_counters()
+        if (next >= tx_limit || tx_limit - next <= LINK_COUNTER_BLOCK / 2)
+            reserve_tx_block();
+        uint32_t highest = rx_window.highest;
+        if (highest - rx_saved >= LINK_COUNTER_BLOCK && store_counter(RX_COUNTER_KEY, highest) == ESP_OK)
+            rx_saved = highest;
+    }
+}
+
+static inline void notify_link_task(void){
+    if (link_task_handle)
+        xTaskNotifyGive(link_task_handle);
+}
+
+bool HOT_PATH_ATTR link_next_tx_counter(uint32_t* counter){
+    uint32_t value = atomic_load_explicit(&tx_next, memory_order_relaxed);
+    do {
+        if (value >= tx_limit){
+            notify_link_task();
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&tx_next, &value, value + 1, memory_order_relaxed, memory_order_relaxed));
+    // Halfway through the block: reserve the next one well before it is needed
+    if (tx_limit - value == LINK_COUNTER_BLOCK / 2)
+        notify_link_task();
+    *counter = value;
+    return true;
+}
+
+void link_skip_tx_counters(void){
+    uint32_t value = atomic_load_explicit(&tx_next, memory_order_relaxed);
+    do {
+        if (value > UINT32_MAX - LINK_COUNTER_BLOCK)
+            return;     // exhausted; reserve_tx_block() already said so
+    } while (!atomic_compare_exchange_weak_explicit(&tx_next, &value, value + LINK_COUNTER_BLOCK, memory_order_relaxed, memory_order_relaxed));
+    notify_link_task();
+}
+
+// Frames sent from different tasks may reach the air out of counter order, hence the window
+bool HOT_PATH_ATTR replay_window_accept(replay_window_t* window, uint32_t counter){
+    if (counter > window->highest){
+        uint32_t shift = counter - window->highest;
+        window->seen = (shift >= LINK_REPLAY_WINDOW) ? 1 : (window->seen << shift) | 1;
+        window->highest = counter;
+        return true;
+    }
+    uint32_t age = window->highest - counter;
+    if (age >= LINK_REPLAY_WINDOW || (window->seen & (1ULL << age)))
+        return false;
+    window->seen |= 1ULL << age;
+    return true;
+}
+
+bool HOT_PATH_ATTR link_accept_rx_counter(uint32_t counter){
+    if (!replay_window_accept(&rx_window, counter))
+        return false;
+    if (rx_window.highest - rx_saved >= LINK_COUNTER_BLOCK)
+        notify_link_task();
+    return true;
+}
+
+// Start the replay window at floor; everything at or below it counts as seen
+static void reset_rx_window(uint32_t floor){
+    rx_window.highest = floor;
+    rx_window.seen = UINT64_MAX;
+    rx_saved = floor;
+}
+
+static int fill_random(void* ctx, unsigned char* buf, size_t len){
+    esp_fill_random(buf, len);
+    return 0;
+}
+
+esp_err_t link_generate_keypair(uint8_t private_key[LINK_ECDH_KEY_LEN], uint8_t public_key[LINK_ECDH_KEY_LEN]){
+    mbedtls_ecp_group group;
+    mbedtls_mpi secret;
+    mbedtls_ecp_point point;
+    size_t len;
+    mbedtls_ecp_group_init(&group);
+    mbedtls_mpi_init(&secret);
+    mbedtls_ecp_point_init(&point);
+    int ret = mbedtls_ecp_group_load(&group, MBEDTLS_ECP_DP_CURVE25519);
+    if (ret == 0)
+        ret = mbedtls_ecdh_gen_public(&group, &secret, &point, fill_random, NULL);
+    if (ret == 0)
+        ret = mbedtls_mpi_write_binary_le(&secret, private_key, LINK_ECDH_KEY_LEN);
+    if (ret == 0)
+        ret = mbedtls_ecp_point_write_binary(&group, &point, MBEDTLS_ECP_PF_UNCOMPRESSED, &len, public_key, LINK_ECDH_KEY_LEN);
+    mbedtls_ecp_point_free(&point);
+    mbedtls_mpi_free(&secret);
+    mbedtls_ecp_group_free(&group);
+    return ret == 0 ? ESP_OK : ESP_FAIL;
+}
+
+// X25519 of our private key and the peer's public key; fails on a low-order peer key,
+// which would make the secret all zeros whatever our key
+static esp_err_t shared_secret(const uint8_t private_key[LINK_ECDH_KEY_LEN], const uint8_t peer_public_key[LINK_ECDH_KEY_LEN],
+                               uint8_t secret[LINK_ECDH_KEY_LEN]){
+    mbedtls_ecp_group group;
+    mbedtls_mpi own, shared;
+    mbedtls_ecp_point peer;
+    mbedtls_ecp_group_init(&group);
+    mbedtls_mpi_init(&own);
+    mbedtls_mpi_init(&shared);
+    mbedtls_ecp_point_init(&peer);
+    int ret = mbedtls_ecp_group_load(&group, MBEDTLS_ECP_DP_CURVE25519);
+    if (ret == 0)
+        ret = mbedtls_mpi_read_binary_le(&own, private_key, LINK_ECDH_KEY_LEN);
+    if (ret == 0)
+        ret = mbedtls_ecp_point_read_binary(&group, &peer, peer_public_key, LINK_ECDH_KEY_LEN);
+    if (ret == 0)
+        ret = mbedtls_ecdh_compute_shared(&group, &shared, &peer, &own, fill_random, NULL);
+    if (ret == 0)
+        ret = mbedtls_mpi_write_binary_le(&shared, secret, LINK_ECDH_KEY_LEN);
+    mbedtls_ecp_point_free(&peer);
+    mbedtls_mpi_free(&shared);
+    mbedtls_mpi_free(&own);
+    mbedtls_ecp_group_free(&group);
+    uint8_t bits = 0;
+    for (int i = 0; i < LINK_ECDH_KEY_LEN; i++)
+        bits |= secret[i];
+    return ret == 0 && bits != 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t derive_link_key(const uint8_t private_key[LINK_ECDH_KEY_LEN], const uint8_t peer_public_key[LINK_ECDH_KEY_LEN],
+                          const uint8_t peer_mac[6], const uint8_t* transcript, size_t len, uint8_t lmk[LINK_KEY_LEN]){
+    uint8_t own_mac[6];
+    uint8_t secret[LINK_ECDH_KEY_LEN];
+    uint8_t message[sizeof(LINK_KEY_LABEL) + LINK_KEY_LEN + 12 + LINK_TRANSCRIPT_MAX_LEN];
+    if (len > LINK_TRANSCRIPT_MAX_LEN)
+        return ESP_ERR_INVALID_SIZE;
+    esp_err_t err = get_transport()->get_addr(own_mac);
+    if (err != ESP_OK)
+        return err;
+    err = shared_secret(private_key, peer_public_key, secret);
+    if (err != ESP_OK)
+        return err;
+    // Both ends must build the same message: MACs in ascending order. The PMK makes a
+    // kit built with its own reject anyone answering with the default one.
+    bool own_first = memcmp(own_mac, peer_mac, 6) < 0;
+    size_t offset = 0;
+    memcpy(message + offset, LINK_KEY_LABEL, sizeof(LINK_KEY_LABEL));
+    offset += sizeof(LINK_KEY_LABEL);
+    memcpy(message + offset, CONFIG_WIRELESS_LINK_PMK, LINK_KEY_LEN);
+    offset += LINK_KEY_LEN;
+    memcpy(message + offset, own_first ? own_mac : peer_mac, 6);
+    offset += 6;
+    memcpy(message + offset, own_first ? peer_mac : own_mac, 6);
+    offset += 6;
+    memcpy(message + offset, transcript, len);
+    offset += len;
+
+    uint8_t digest[32];
+    int ret = mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), secret, sizeof(secret), message, offset, digest);
+    memset(secret, 0, sizeof(secret));
+    if (ret != 0)
+        return ESP_FAIL;
+    memcpy(lmk, digest, LINK_KEY_LEN);
+    return ESP_OK;
+}
+
+bool link_pmk_is_default(void){
+    return strcmp(CONFIG_WIRELESS_LINK_PMK, DEFAULT_PMK) == 0;
+}
+
+esp_err_t store_link_key(const uint8_t peer_mac[6], const uint8_t lmk[LINK_KEY_LEN]){
+    uint8_t record[6 + LINK_KEY_LEN];
+    memcpy(record, peer_mac, 6);
+    memcpy(record + 6, lmk, LINK_KEY_LEN);
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK)
+        return err;
+    err = nvs_set_blob(nvs_handle, LINK_KEY_STORAGE_KEY, record, sizeof(record));
+    if (err == ESP_OK)
+        err = nvs_set_u32(nvs_handle, RX_COUNTER_KEY, 0);
+    if (err == ESP_OK)
+        err = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+    if (err == ESP_OK)
+        reset_rx_window(0);
+    return err;
+}
+
+void forget_link_key(void){
+    nvs_handle_t nvs_handle;
+    if (nvs_open("storage", NVS_READWRITE, &nvs_handle) != ESP_OK)
+        return;
+    nvs_erase_key(nvs_handle, LINK_KEY_STORAGE_KEY);
+    nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+}
+
+esp_err_t link_confirm_tag(const uint8_t lmk[LINK_KEY_LEN], uint8_t role, const uint8_t* transcript, size_t len, uint8_t* tag, size_t tag_len){
+    uint8_t message[sizeof(CONFIRM_LABEL) + 1 + LINK_TRANSCRIPT_MAX_LEN];
+    uint8_t digest[32];
+    if (len > LINK_TRANSCRIPT_MAX_LEN || tag_len > sizeof(digest))
+        return ESP_ERR_INVALID_SIZE;
+    memcpy(message, CONFIRM_LABEL, sizeof(CONFIRM_LABEL));
+    message[sizeof(CONFIRM_LABEL)] = role;
+    memcpy(message + sizeof(CONFIRM_LABEL) + 1, transcript, len);
+    if (mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), lmk, LINK_KEY_LEN,
+                        message, sizeof(CONFIRM_LABEL) + 1 + len, digest) != 0)
+        return ESP_FAIL;
+    memcpy(tag, digest, tag_len);
+    return ESP_OK;
+}
+
+esp_err_t get_link_key(const uint8_t peer_mac[6], uint8_t lmk[LINK_KEY_LEN]){
+    uint8_t record[6 + LINK_KEY_LEN];
+    size_t len = sizeof(record);
+    nvs_handle_t nvs_handle;
+    bool found = false;
+    if (nvs_open("storage", NVS_READONLY, &nvs_handle) == ESP_OK){
+        found = nvs_get_blob(nvs_handle, LINK_KEY_STORAGE_KEY, record, &len) == ESP_OK &&
+                len == sizeof(record) && memcmp(record, peer_mac, 6) == 0;
+        nvs_close(nvs_handle);
+    }
+    if (!found)
+        return ESP_ERR_NOT_FOUND;
+    memcpy(lmk, record + 6, LINK_KEY_LEN);
+    return ESP_OK;
+}
+
+// Its own key: the LMK already keys CCMP in the radio, under a different nonce layout
+esp_err_t link_set_relay_key(const uint8_t lmk[LINK_KEY_LEN]){
+    uint8_t digest[32];
+    if (mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), lmk, LINK_KEY_LEN,
+                        (const uint8_t*)RELAY_KEY_LABEL, sizeof(RELAY_KEY_LABEL) - 1, digest) != 0)
+        return ESP_FAIL;
+    xSemaphoreTake(seal_lock, portMAX_DELAY);
+    relay_key_set = mbedtls_ccm_setkey(&seal_ccm, MBEDTLS_CIPHER_ID_AES, digest, LINK_KEY_LEN * 8) == 0 &&
+                    mbedtls_ccm_setkey(&open_ccm, MBEDTLS_CIPHER_ID_AES, digest, LINK_KEY_LEN * 8) == 0;
+    xSemaphoreGive(seal_lock);
+    return relay_key_set ? ESP_OK : ESP_FAIL;
+}
+
+static inline void HOT_PATH_ATTR relay_nonce(uint8_t nonce[RELAY_NONCE_LEN], const uint8_t sender_mac[6], uint32_t counter){
+    memset(nonce, 0, RELAY_NONCE_LEN);
+    memcpy(nonce, sender_mac, 6);
+    memcpy(nonce + 6, &counter, sizeof(counter));
+}
+
+esp_err_t HOT_PATH_ATTR link_seal(const uint8_t sender_mac[6], uint32_t counter, const uint8_t* aad, size_t aad_len,
+                                  const uint8_t* plain, uint8_t* sealed, size_t len, uint8_t* tag){
+    uint8_t nonce[RELAY_NONCE_LEN];
+    if (!relay_key_set)
+        return ESP_ERR_INVALID_STATE;
+    relay_nonce(nonce, sender_mac, counter);
+    xSemaphoreTake(seal_lock, portMAX_DELAY);
+    int ret = mbedtls_ccm_encrypt_and_tag(&seal_ccm, len, nonce, sizeof(nonce), aad, aad_len,
+                                          plain, sealed, tag, ESPNOW_RELAY_TAG_LEN);
+    xSemaphoreGive(seal_lock);
+    return ret == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t HOT_PATH_ATTR link_open(const uint8_t sender_mac[6], uint32_t counter, const uint8_t* aad, size_t aad_len,
+                                  const uint8_t* sealed, uint8_t* plain, size_t len, const uint8_t* tag){
+    uint8_t nonce[RELAY_NONCE_LEN];
+    if (!relay_key_set)
+        return ESP_ERR_INVALID_STATE;
+    relay_nonce(nonce, sender_mac, counter);
+    return mbedtls_ccm_auth_decrypt(&open_ccm, len, nonce, sizeof(nonce), aad, aad_len,
+                                    sealed, plain, tag, ESPNOW_RELAY_TAG_LEN) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t init_link_security(void){
+    if (strlen(CONFIG_WIRELESS_LINK_PMK) != LINK_KEY_LEN){
+        ESP_LOGE(TAG, "CONFIG_WIRELESS_LINK_PMK must be %d characters", LINK_KEY_LEN);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (link_pmk_is_default())
+        ESP_LOGE(TAG, "CONFIG_WIRELESS_LINK_PMK is the default: anyone in range can pair while a window is open");
+    const transport_t* transport = get_transport();
+    if (transport->set_pmk){
+        esp_err_t err = transport->set_pmk((const uint8_t*)CONFIG_WIRELESS_LINK_PMK);
+        if (err != ESP_OK)
+            return err;
+    }
+
+    // Skip whatever the last boot reserved, used or not
+    uint32_t reserved = load_counter(TX_COUNTER_KEY);
+    atomic_store(&tx_next, reserved ? reserved : 1);
+    tx_limit = reserved ? reserved : 1;
+    reserve_tx_block();
+    // The stored floor lags the newest accepted counter by up to a block, so frames
+    // above it may already have been accepted: start a block higher. The peer skips
+    // ahead when the connection drops (link_skip_tx_counters()).
+    uint32_t floor = load_counter(RX_COUNTER_KEY);
+    floor = floor > UINT32_MAX - LINK_COUNTER_BLOCK ? UINT32_MAX : floor + LINK_COUNTER_BLOCK;
+    if (store_counter(RX_COUNTER_KEY, floor) != ESP_OK)
+        ESP_LOGW(TAG, "Could not store the replay floor");
+    reset_rx_window(floor);
+    mbedtls_ccm_init(&seal_ccm);
+    mbedtls_ccm_init(&open_ccm);
+    seal_lock = xSemaphoreCreateMutexStatic(&seal_lock_mem);
+    link_task_handle = create_static_task(&link_task_mem, link_task, NULL);
+    if (link_task_handle == NULL)
+        return ESP_FAIL;
+    ESP_LOGI(TAG, "Link encryption on, frame counter %" PRIu32 ", replay floor %" PRIu32,
+             (uint32_t)atomic_load(&tx_next), rx_window.highest);
+    return ESP_OK;
+}
+
+// CCMP itself runs in the WiFi MAC and costs no CPU time; its end-to-end cost shows in the
+// RTT benchmark with CONFIG_WIRELESS_LINK_ENCRYPTION on and off
+void benchmark_link_security(void){
+    static const size_t frame_sizes[] = { sizeof(espnow_msg_mouse_t), ESPNOW_BUNDLE_MAX_LEN };
+    static uint8_t plain[ESPNOW_FRAME_MAX_LEN], frame[ESPNOW_FRAME_MAX_LEN];
+    replay_window_t window = {0};
+    uint32_t counter = 0;
+    int64_t start;
+
+    for (size_t s = 0; s < sizeof(frame_sizes) / sizeof(frame_sizes[0]); s++){
+        size_t size = frame_sizes[s];
+        start = esp_timer_get_time();
+        for (int i = 0; i < BENCHMARK_ITERATIONS; i++){
+            counter++;
+            memcpy(frame, plain, size);
+            memcpy(frame + size, &counter, ESPNOW_COUNTER_LEN);
+            memcpy(&counter, frame + size, ESPNOW_COUNTER_LEN);
+            replay_window_accept(&window, counter);
+        }
+        ESP_LOGI(TAG, "Counter framing, %3u byte frame: %.2f US", (unsigned)size,
+                 (double)(esp_timer_get_time() - start) / BENCHMARK_ITERATIONS);
+    }
+
+    // What the application-layer alternative would cost: AES-CCM with an 8 byte tag
+    mbedtls_ccm_context ccm;
+    uint8_t key[LINK_KEY_LEN] = {0}, nonce[13] = {0}, tag[8];
+    mbedtls_ccm_init(&ccm);
+    if (mbedtls_ccm_setkey(&ccm, MBEDTLS_CIPHER_ID_AES, key, LINK_KEY_LEN * 8) == 0){
+        for (size_t s = 0; s < sizeof(frame_sizes) / sizeof(frame_sizes[0]); s++){
+            size_t size = frame_sizes[s];
+            start = esp_timer_get_time();
+            for (int i = 0; i < BENCHMARK_ITERATIONS; i++){
+                memcpy(nonce, &i, sizeof(i));
+                mbedtls_ccm_encrypt_and_tag(&ccm, size, nonce, sizeof(nonce), NULL, 0, plain, frame, tag, sizeof(tag));
+                mbedtls_ccm_auth_decrypt(&ccm, size, nonce, sizeof(nonce), NULL, 0, frame, plain, tag, sizeof(tag));
+            }
+            ESP_LOGI(TAG, "AES-CCM seal + open, %3u byte frame: %.2f US", (unsigned)size,
+                     (double)(esp_timer_get_time() - start) / BENCHMARK_ITERATIONS);
+        }
+    }
+    mbedtls_ccm_free(&ccm);
+
+    uint8_t private_key[LINK_ECDH_KEY_LEN], public_key[LINK_ECDH_KEY_LEN], lmk[LINK_KEY_LEN];
+    start = esp_timer_get_time();
+    link_generate_keypair(private_key, public_key);
+    ESP_LOGI(TAG, "X25519 key pair: %" PRId64 " US", esp_timer_get_time() - start);
+    start = esp_timer_get_time();
+    derive_link_key(private_key, public_key, plain, nonce, sizeof(nonce), lmk);
+    ESP_LOGI(TAG, "LMK derivation (X25519 + HMAC): %" PRId64 " US", esp_timer_get_time() - start);
+}
@@ -0,0 +1,398 @@
+#include "wifi/pairing.h"
+#include "wifi/wifi.h"
+#include "wifi/link_security.h"
+#include "wifi/msg_types.h"
+#include "timer/timer_service.h"
+#include "rtos/ram_budget.h"
+#include "rtos/hot_path.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include <inttypes.h>
+#include <string.h>
+#if CONFIG_WIRELESS_PAIRING_BUTTON_GPIO >= 0
+#include "driver/gpio.h"
+#endif
+
+#define PAIRING_TASK_STACK 6144             // X25519 and HMAC-SHA256 for key and confirm tags
+#define PAIRING_TASK_PRIORITY 2
+#define PAIRING_QUEUE_LEN 8
+#define PAIRING_WINDOW_US (30000000ULL)
+#define CHANNEL_DWELL_US (20000ULL)         // all 13 channels in ~260 ms
+#define CONFIRM_TIMEOUT_US (50000ULL)
+#define CONFIRM_ATTEMPTS 3
+#define FIRST_CHANNEL 1
+#define LAST_CHANNEL 13
+#define BUTTON_POLL_US (50000ULL)
+#define BUTTON_HOLD_US (1000000ULL)
+
+static const char* TAG = "WIRELESS_SHARED // pairing.c";
+
+typedef enum {
+    PAIRING_IDLE,
+    PAIRING_SEARCHING,      // initiator: hopping; responder: waiting for a request or confirm
+    PAIRING_CONFIRMING      // initiator: answered, waiting for the responder's confirm
+} pairing_state_t;
+
+typedef enum {
+    EVENT_START,
+    EVENT_FRAME,
+    EVENT_STEP,             // next channel, or confirm timeout
+    EVENT_WINDOW            // pairing window closed
+} pairing_event_kind_t;
+
+typedef struct {
+    uint8_t kind;
+    uint8_t channel;        // frame: channel it arrived on
+    uint8_t mac[6];
+    uint8_t len;
+    uint8_t data[sizeof(espnow_msg_pair_response_t)];
+} pairing_event_t;
+
+// Only touched by the pairing task
+static struct {
+    pairing_state_t state;
+    pairing_role_t role;
+    // Initiator nonce, responder nonce, initiator public key, responder public key
+    uint8_t transcript[2 * ESPNOW_PAIR_NONCE_LEN + 2 * ESPNOW_PAIR_KEY_LEN];
+    uint8_t private_key[LINK_ECDH_KEY_LEN];         // this window's X25519 key
+    uint8_t peer_mac[6];
+    bool has_peer;
+    uint8_t lmk[LINK_KEY_LEN];
+    uint8_t channel;
+    int confirm_attempts;
+    int64_t start_us;
+} session = {0};
+
+// Responder: the confirm it sent last, repeated if the initiator missed it
+static struct {
+    bool valid;
+    uint8_t peer_mac[6];
+    uint8_t expected_tag[ESPNOW_PAIR_TAG_LEN];
+    espnow_msg_pair_confirm_t reply;
+} last_confirm = {0};
+
+STATIC_TASK(pairing_task_mem, "pairing", PAIRING_TASK_STACK, PAIRING_TASK_PRIORITY);
+STATIC_QUEUE(pairing_queue_mem, "pairing", PAIRING_QUEUE_LEN, pairing_event_t);
+
+static QueueHandle_t pairing_queue = NULL;
+static service_timer_t step_timer = NULL;
+static service_timer_t window_timer = NULL;
+static service_timer_t button_timer = NULL;
+static volatile bool pairing_active = false;
+
+static inline uint8_t* initiator_nonce(void){ return session.transcript; }
+static inline uint8_t* responder_nonce(void){ return session.transcript + ESPNOW_PAIR_NONCE_LEN; }
+static inline uint8_t* own_nonce(void){ return session.role == PAIRING_INITIATOR ? initiator_nonce() : responder_nonce(); }
+static inline uint8_t* initiator_key(void){ return session.transcript + 2 * ESPNOW_PAIR_NONCE_LEN; }
+static inline uint8_t* responder_key(void){ return initiator_key() + ESPNOW_PAIR_KEY_LEN; }
+static inline uint8_t* own_key(void){ return session.role == PAIRING_INITIATOR ? initiator_key() : responder_key(); }
+static inline uint8_t* peer_key(void){ return session.role == PAIRING_INITIATOR ? responder_key() : initiator_key(); }
+
+static void post_event(uint8_t kind){
+    const pairing_event_t event = { .kind = kind };
+    if (pairing_queue)
+        xQueueSend(pairing_queue, &event, 0);
+}
+
+static void step_timer_cb(void* arg){ post_event(EVENT_STEP); }
+static void window_timer_cb(void* arg){ post_event(EVENT_WINDOW); }
+
+void begin_pairing(void){ post_event(EVENT_START); }
+
+bool is_pairing(void){ return pairing_active; }
+
+bool HOT_PATH_ATTR is_pairing_frame(const uint8_t* data, int len){
+    switch (data[0]){
+        case ESPNOW_MSG_PAIR_REQUEST:
+            return len == sizeof(espnow_msg_pair_request_t);
+        case ESPNOW_MSG_PAIR_RESPONSE:
+            return len == sizeof(espnow_msg_pair_response_t);
+        case ESPNOW_MSG_PAIR_CONFIRM:
+            return len == sizeof(espnow_msg_pair_confirm_t);
+        default:
+            return false;
+    }
+}
+
+void process_pairing_frame(const transport_rx_info_t* info, const uint8_t* data, int len){
+    pairing_event_t event = {
+        .kind = EVENT_FRAME,
+        .channel = info->channel,
+        .len = len
+    };
+    if (!pairing_active && !last_confirm.valid)
+        return;
+    memcpy(event.mac, info->src_addr, 6);
+    memcpy(event.data, data, len);
+    xQueueSend(pairing_queue, &event, 0);
+}
+
+// Hopping is a no-op on transports without channels; pairing finds the peer on the first
+static void set_channel(uint8_t channel){
+    session.channel = channel;
+    if (get_transport()->set_channel)
+        get_transport()->set_channel(channel);
+}
+
+static void send_request(void){
+    espnow_msg_pair_request_t request = { .msg_type = ESPNOW_MSG_PAIR_REQUEST };
+    memcpy(request.nonce, initiator_nonce(), ESPNOW_PAIR_NONCE_LEN);
+    memcpy(request.public_key, initiator_key(), ESPNOW_PAIR_KEY_LEN);
+    send_broadcast((const uint8_t*)&request, sizeof(request));
+}
+
+static bool derive_key(void){
+    return derive_link_key(session.private_key, peer_key(), session.peer_mac, session.transcript,
+                           sizeof(session.transcript), session.lmk) == ESP_OK;
+}
+
+static bool make_tag(pairing_role_t role, uint8_t tag[ESPNOW_PAIR_TAG_LEN]){
+    return link_confirm_tag(session.lmk, role, session.transcript, sizeof(session.transcript), tag, ESPNOW_PAIR_TAG_LEN) == ESP_OK;
+}
+
+static bool send_confirm(void){
+    espnow_msg_pair_confirm_t confirm = { .msg_type = ESPNOW_MSG_PAIR_CONFIRM };
+    if (!make_tag(session.role, confirm.tag))
+        return false;
+    send_broadcast((const uint8_t*)&confirm, sizeof(confirm));
+    if (session.role == PAIRING_RESPONDER)
+        last_confirm.reply = confirm;
+    return true;
+}
+
+static bool valid_confirm(const espnow_msg_pair_confirm_t* confirm){
+    uint8_t expected[ESPNOW_PAIR_TAG_LEN];
+    pairing_role_t peer_role = session.role == PAIRING_INITIATOR ? PAIRING_RESPONDER : PAIRING_INITIATOR;
+    if (!make_tag(peer_role, expected))
+        return false;
+    // Constant time: the tag is a secret until the peer has sent it
+    uint8_t diff = 0;
+    for (int i = 0; i < ESPNOW_PAIR_TAG_LEN; i++)
+        diff |= expected[i] ^ confirm->tag[i];
+    return diff == 0;
+}
+
+static void search(void){
+    session.state = PAIRING_SEARCHING;
+    session.has_peer = false;
+    if (session.role == PAIRING_INITIATOR)
+        service_timer_start_periodic(step_timer, CHANNEL_DWELL_US);
+}
+
+static void stop(void){
+    service_timer_cancel(step_timer);
+    service_timer_cancel(window_timer);
+    session.state = PAIRING_IDLE;
+    memset(session.private_key, 0, sizeof(session.private_key));
+    pairing_active = false;
+}
+
+static void start(void){
+    if (session.state != PAIRING_IDLE)
+        return;
+    session.start_us = esp_timer_get_time();
+    session.confirm_attempts = 0;
+    esp_fill_random(own_nonce(), ESPNOW_PAIR_NONCE_LEN);
+    if (link_generate_keypair(session.private_key, own_key()) != ESP_OK){
+        ESP_LOGE(TAG, "Pairing: could not generate a key pair");
+        return;
+    }
+    // Without a PMK of its own, nothing stops a device in the middle of the exchange
+    if (link_pmk_is_default())
+        ESP_LOGE(TAG, "Pairing with the default CONFIG_WIRELESS_LINK_PMK: set your own so only your kits can pair");
+    session.state = PAIRING_SEARCHING;
+    pairing_active = true;
+    last_confirm.valid = false;
+    // Off the old peer for the window; paired_status_updated_cb(false) calls back into begin_pairing()
+    release_peer();
+    if (session.role == PAIRING_INITIATOR){
+        ESP_LOGI(TAG, "Pairing: scanning channels %d-%d", FIRST_CHANNEL, LAST_CHANNEL);
+        set_channel(FIRST_CHANNEL);
+        send_request();
+    }
+    else
+        ESP_LOGI(TAG, "Pairing: window open");
+    search();
+    service_timer_start_once(window_timer, PAIRING_WINDOW_US);
+}
+
+static void complete(void){
+    stop();
+    if (store_link_key(session.peer_mac, session.lmk) != ESP_OK){
+        ESP_LOGE(TAG, "Could not store the link key");
+        restore_saved_peer();
+        return;
+    }
+    set_new_peer(session.peer_mac, session.channel);
+    ESP_LOGI(TAG, "Paired with " MACSTR " on channel %d in %" PRId64 " ms", MAC2STR(session.peer_mac),
+             session.channel, (esp_timer_get_time() - session.start_us) / 1000);
+}
+
+// Initiator: a responder answered our nonce -- stay on its channel and prove the key
+static void handle_response(const pairing_event_t* event){
+    const espnow_msg_pair_response_t* response = (const espnow_msg_pair_response_t*)event->data;
+    if (session.role != PAIRING_INITIATOR || session.state != PAIRING_SEARCHING ||
+        memcmp(response->request_nonce, initiator_nonce(), ESPNOW_PAIR_NONCE_LEN) != 0)
+        return;
+    service_timer_cancel(step_timer);
+    // The hop timer may have moved us on since the response arrived
+    if (event->channel >= FIRST_CHANNEL && event->channel <= LAST_CHANNEL && event->channel != session.channel)
+        set_channel(event->channel);
+    memcpy(session.peer_mac, event->mac, 6);
+    memcpy(responder_nonce(), response->nonce, ESPNOW_PAIR_NONCE_LEN);
+    memcpy(responder_key(), response->public_key, ESPNOW_PAIR_KEY_LEN);
+    if (!derive_key() || !send_confirm()){
+        search();
+        return;
+    }
+    session.state = PAIRING_CONFIRMING;
+    session.confirm_attempts = 1;
+    service_timer_start_once(step_timer, CONFIRM_TIMEOUT_US);
+}
+
+// Responder: answer the newest request; the pairing is only kept once it is confirmed.
+// The key is derived after answering, while the initiator derives its own.
+static void handle_request(const pairing_event_t* event){
+    const espnow_msg_pair_request_t* request = (const espnow_msg_pair_request_t*)event->data;
+    if (session.role != PAIRING_RESPONDER || session.state != PAIRING_SEARCHING)
+        return;
+    memcpy(session.peer_mac, event->mac, 6);
+    memcpy(initiator_nonce(), request->nonce, ESPNOW_PAIR_NONCE_LEN);
+    memcpy(initiator_key(), request->public_key, ESPNOW_PAIR_KEY_LEN);
+    espnow_msg_pair_response_t response = { .msg_type = ESPNOW_MSG_PAIR_RESPONSE };
+    memcpy(response.request_nonce, request->nonce, ESPNOW_PAIR_NONCE_LEN);
+    memcpy(response.nonce, responder_nonce(), ESPNOW_PAIR_NONCE_LEN);
+    memcpy(response.public_key, responder_key(), ESPNOW_PAIR_KEY_LEN);
+    send_broadcast((const uint8_t*)&response, sizeof(response));
+    session.has_peer = derive_key();
+}
+
+static void handle_confirm(const pairing_event_t* event){
+    const espnow_msg_pair_confirm_t* confirm = (const espnow_msg_pair_confirm_t*)event->data;
+    // Responder, already paired: the initiator missed our confirm
+    if (session.state == PAIRING_IDLE){
+        if (last_confirm.valid && memcmp(event->mac, last_confirm.peer_mac, 6) == 0 &&
+            memcmp(confirm->tag, last_confirm.expected_tag, ESPNOW_PAIR_TAG_LEN) == 0)
+            send_broadcast((const uint8_t*)&last_confirm.reply, sizeof(last_confirm.reply));
+        return;
+    }
+    if (memcmp(event->mac, session.peer_mac, 6) != 0)
+        return;
+    if (session.role == PAIRING_RESPONDER){
+        if (!session.has_peer || !valid_confirm(confirm) || !send_confirm())
+            return;
+        last_confirm.valid = true;
+        memcpy(last_confirm.peer_mac, session.peer_mac, 6);
+        memcpy(last_confirm.expected_tag, confirm->tag, ESPNOW_PAIR_TAG_LEN);
+        session.channel = get_transport()->get_channel ? get_transport()->get_channel() : 0;
+        complete();
+    }
+    else if (session.state == PAIRING_CONFIRMING && valid_confirm(confirm))
+        complete();
+}
+
+static void handle_step(void){
+    if (session.role != PAIRING_INITIATOR)
+        return;
+    if (session.state == PAIRING_SEARCHING){
+        set_channel(session.channel >= LAST_CHANNEL ? FIRST_CHANNEL : session.channel + 1);
+        send_request();
+    }
+    else if (session.state == PAIRING_CONFIRMING){
+        if (session.confirm_attempts++ < CONFIRM_ATTEMPTS){
+            send_confirm();
+            service_timer_start_once(step_timer, CONFIRM_TIMEOUT_US);
+        }
+        else
+            search();
+    }
+}
+
+// Window closed: back to the saved peer, or keep looking if there is none
+static void handle_window(void){
+    if (session.state == PAIRING_IDLE)
+        return;
+    stop();
+    if (!restore_saved_peer()){
+        ESP_LOGI(TAG, "Pairing: no peer found yet, still looking");
+        start();
+        return;
+    }
+    ESP_LOGI(TAG, "Pairing: no new peer found, keeping the saved one");
+}
+
+static void pairing_task(void* arg){
+    pairing_event_t event;
+    while (true){
+        if (xQueueReceive(pairing_queue, &event, portMAX_DELAY) != pdTRUE)
+            continue;
+        switch (event.kind){
+            case EVENT_START:
+                start();
+                break;
+            case EVENT_STEP:
+                handle_step();
+                break;
+            case EVENT_WINDOW:
+                handle_window();
+                break;
+            case EVENT_FRAME:
+                if (event.data[0] == ESPNOW_MSG_PAIR_REQUEST)
+                    handle_request(&event);
+                else if (event.data[0] == ESPNOW_MSG_PAIR_RESPONSE)
+                    handle_response(&event);
+                else if (event.data[0] == ESPNOW_MSG_PAIR_CONFIRM)
+                    handle_confirm(&event);
+                break;
+        }
+    }
+}
+
+#if CONFIG_WIRELESS_PAIRING_BUTTON_GPIO >= 0
+// Active low with pull-up, like the BOOT button; held for BUTTON_HOLD_US
+static void button_timer_cb(void* arg){
+    static uint64_t held_us = 0;
+    if (gpio_get_level(CONFIG_WIRELESS_PAIRING_BUTTON_GPIO) != 0){
+        held_us = 0;
+        return;
+    }
+    held_us += BUTTON_POLL_US;
+    if (held_us == BUTTON_HOLD_US)
+        begin_pairing();
+}
+
+static esp_err_t init_pairing_button(void){
+    const gpio_config_t config = {
+        .pin_bit_mask = 1ULL << CONFIG_WIRELESS_PAIRING_BUTTON_GPIO,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+    };
+    esp_err_t err = gpio_config(&config);
+    if (err == ESP_OK)
+        err = service_timer_create(&button_timer, "pair_button", button_timer_cb, NULL);
+    if (err == ESP_OK)
+        err = service_timer_start_periodic(button_timer, BUTTON_POLL_US);
+    return err;
+}
+#else
+static esp_err_t init_pairing_button(void){
+    (void)button_timer;
+    return ESP_OK;
+}
+#endif
+
+esp_err_t init_pairing(pairing_role_t role){
+    session.role = role;
+    pairing_queue = create_static_queue(&pairing_queue_mem);
+    if (pairing_queue == NULL)
+        return ESP_FAIL;
+    if (service_timer_create(&step_timer, "pair_step", step_timer_cb, NULL) != ESP_OK ||
+        service_timer_create(&window_timer, "pair_window", window_timer_cb, NULL) != ESP_OK)
+        return ESP_FAIL;
+    if (create_static_task(&pairing_task_mem, pairing_task, NULL) == NULL)
+        return ESP_FAIL;
+    return init_pairing_button();
+}
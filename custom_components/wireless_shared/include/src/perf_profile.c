@@ -0,0 +1,102 @@
+#include "wifi/perf_profile.h"
+#include "wifi/wifi.h"
+#include "rtos/ram_budget.h"
+#include "rtos/hot_path.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+#define PROFILE_STORAGE_KEY "perf_profile"
+#define PROFILE_TASK_STACK 3072             // NVS write
+#define PROFILE_TASK_PRIORITY 5             // a switch lands before the next report is handled
+
+static const char* TAG = "WIRELESS_SHARED // perf_profile.c";
+
+extern void perf_profile_applied_cb(const perf_profile_t* profile);
+
+static const perf_profile_t profiles[NUM_PERF_PROFILES] = {
+    [PERF_PROFILE_COMPETITIVE] = {
+        .name = "Competitive", .rate = LINK_RATE_FAST, .tx_power = 80, .keepalive_us = 1000000,
+        .coalesce_us = 0, .light_sleep_s = 0, .deep_sleep_s = 0, .power_idle_ms = 0,
+        .jitter_buffer = false
+    },
+    [PERF_PROFILE_OFFICE] = {
+        .name = "Office", .rate = LINK_RATE_DEFAULT, .tx_power = 80, .keepalive_us = 4999000,
+        .coalesce_us = 1000, .light_sleep_s = 120, .deep_sleep_s = 600, .power_idle_ms = 10000,
+        .jitter_buffer = true
+    },
+    [PERF_PROFILE_BATTERY] = {
+        .name = "Battery", .rate = LINK_RATE_FAST, .tx_power = 44, .keepalive_us = 10000000,
+        .coalesce_us = 4000, .light_sleep_s = 30, .deep_sleep_s = 120, .power_idle_ms = 2000,
+        .jitter_buffer = true
+    }
+};
+
+STATIC_TASK(profile_task_mem, "perf_profile", PROFILE_TASK_STACK, PROFILE_TASK_PRIORITY);
+static TaskHandle_t profile_task_handle = NULL;
+static volatile perf_profile_id_t requested = PERF_PROFILE_DEFAULT;
+static perf_profile_id_t active = NUM_PERF_PROFILES;    // nothing applied yet
+
+static void save_profile(perf_profile_id_t id){
+    nvs_handle_t nvs_handle;
+    if (nvs_open("storage", NVS_READWRITE, &nvs_handle) != ESP_OK)
+        return;
+    if (nvs_set_u8(nvs_handle, PROFILE_STORAGE_KEY, id) == ESP_OK)
+        nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+}
+
+// Radio settings and the application's callback from one task, so a switch never
+// runs inside the WiFi task and two switches never interleave
+static void profile_task(void* arg){
+    while (true){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        perf_profile_id_t id = requested;
+        if (id == active)
+            continue;
+        const perf_profile_t* profile = &profiles[id];
+        set_link_rate(profile->rate);
+        set_link_tx_power(profile->tx_power);
+        set_keepalive_interval(profile->keepalive_us);
+        perf_profile_applied_cb(profile);
+        ESP_LOGI(TAG, "Profile: %s", profile->name);
+        // The first came from NVS or is the default; switches are saved once applied
+        if (active != NUM_PERF_PROFILES)
+            save_profile(id);
+        active = id;
+    }
+}
+
+esp_err_t init_perf_profile(void){
+    nvs_handle_t nvs_handle;
+    uint8_t saved;
+    if (nvs_open("storage", NVS_READONLY, &nvs_handle) == ESP_OK){
+        if (nvs_get_u8(nvs_handle, PROFILE_STORAGE_KEY, &saved) == ESP_OK && saved < NUM_PERF_PROFILES)
+            requested = saved;
+        nvs_close(nvs_handle);
+    }
+    profile_task_handle = create_static_task(&profile_task_mem, profile_task, NULL);
+    if (profile_task_handle == NULL)
+        return ESP_FAIL;
+    xTaskNotifyGive(profile_task_handle);
+    return ESP_OK;
+}
+
+void HOT_PATH_ATTR set_perf_profile(perf_profile_id_t id){
+    if (id >= NUM_PERF_PROFILES)
+        return;
+    requested = id;
+    if (profile_task_handle)
+        xTaskNotifyGive(profile_task_handle);
+}
+
+void HOT_PATH_ATTR next_perf_profile(void){
+    set_perf_profile((requested + 1) % NUM_PERF_PROFILES);
+}
+
+perf_profile_id_t get_perf_profile_id(void){
+    return requested;
+}
+
+const perf_profile_t* get_perf_profile(void){
+    return &profiles[requested];
+}
@@ -0,0 +1,105 @@
+#include "rtos/ram_budget.h"
+#include "timer/timer_service.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <inttypes.h>
+
+static const char* TAG = "WIRELESS_SHARED // ram_budget.c";
+
+typedef struct {
+    const char* name;
+    TaskHandle_t handle;
+    uint32_t stack_size;
+    bool is_static;
+} watched_task_t;
+
+static watched_task_t tasks[RAM_BUDGET_MAX_TASKS];
+static size_t num_tasks = 0;
+static static_queue_t* queues[RAM_BUDGET_MAX_QUEUES];
+static size_t num_queues = 0;
+static service_timer_t report_timer = NULL;
+
+static void watch_task(const char* name, TaskHandle_t handle, uint32_t stack_size, bool is_static){
+    if (handle == NULL)
+        return;
+    if (num_tasks >= RAM_BUDGET_MAX_TASKS){
+        ESP_LOGW(TAG, "Task table full, %s not reported", name);
+        return;
+    }
+    tasks[num_tasks++] = (watched_task_t){ name, handle, stack_size, is_static };
+}
+
+TaskHandle_t create_static_task(static_task_t* task, TaskFunction_t fn, void* arg){
+    task->handle = xTaskCreateStatic(fn, task->name, task->stack_size, arg, task->priority, task->stack, task->tcb);
+    if (task->handle == NULL)
+        ESP_LOGE(TAG, "Failed to create task %s", task->name);
+    watch_task(task->name, task->handle, task->stack_size, true);
+    return task->handle;
+}
+
+TaskHandle_t create_static_task_pinned(static_task_t* task, TaskFunction_t fn, void* arg, BaseType_t core){
+    task->handle = xTaskCreateStaticPinnedToCore(fn, task->name, task->stack_size, arg, task->priority,
+                                                 task->stack, task->tcb, core);
+    if (task->handle == NULL)
+        ESP_LOGE(TAG, "Failed to create task %s", task->name);
+    watch_task(task->name, task->handle, task->stack_size, true);
+    return task->handle;
+}
+
+QueueHandle_t create_static_queue(static_queue_t* queue){
+    queue->handle = xQueueCreateStatic(queue->length, queue->item_size, queue->storage, queue->buffer);
+    if (queue->handle == NULL){
+        ESP_LOGE(TAG, "Failed to create queue %s", queue->name);
+        return NULL;
+    }
+    if (num_queues < RAM_BUDGET_MAX_QUEUES)
+        queues[num_queues++] = queue;
+    else
+        ESP_LOGW(TAG, "Queue table full, %s not reported", queue->name);
+    return queue->handle;
+}
+
+void ram_budget_watch_task(const char* name, TaskHandle_t handle, uint32_t stack_size){
+    watch_task(name, handle, stack_size, false);
+}
+
+void ram_budget_report(void){
+    uint32_t static_bytes = 0;
+    ESP_LOGI(TAG, "%-14s %8s %8s %8s", "task", "stack", "min free", "static");
+    for (size_t i = 0; i < num_tasks; i++){
+        // ESP-IDF reports the high-water mark in bytes
+        uint32_t min_free = uxTaskGetStackHighWaterMark(tasks[i].handle);
+        ESP_LOGI(TAG, "%-14s %8" PRIu32 " %8" PRIu32 " %8s", tasks[i].name, tasks[i].stack_size, min_free,
+                 tasks[i].is_static ? "yes" : "no");
+        if (min_free < 256)
+            ESP_LOGW(TAG, "%s is within %" PRIu32 " bytes of overflowing its stack", tasks[i].name, min_free);
+        if (tasks[i].is_static)
+            static_bytes += tasks[i].stack_size + sizeof(StaticTask_t);
+    }
+    ESP_LOGI(TAG, "%-14s %8s %8s %8s %8s", "queue", "length", "item", "peak", "dropped");
+    for (size_t i = 0; i < num_queues; i++){
+        static_queue_t* queue = queues[i];
+        portENTER_CRITICAL(&queue->lock);
+        UBaseType_t peak = queue->peak;
+        uint32_t dropped = queue->dropped;
+        portEXIT_CRITICAL(&queue->lock);
+        ESP_LOGI(TAG, "%-14s %8u %8u %8u %8" PRIu32, queue->name, (unsigned)queue->length,
+                 (unsigned)queue->item_size, (unsigned)peak, dropped);
+        static_bytes += queue->length * queue->item_size + sizeof(StaticQueue_t);
+    }
+    ESP_LOGI(TAG, "static pipeline RAM: %" PRIu32 " B, heap free: %" PRIu32 " B (min %" PRIu32 " B)",
+             static_bytes, esp_get_free_heap_size(), esp_get_minimum_free_heap_size());
+}
+
+static void report_timer_cb(void* arg){
+    ram_budget_report();
+}
+
+esp_err_t begin_ram_budget_report(uint64_t period_us){
+    // Non-deferred timer callbacks run on the esp_timer task
+    ram_budget_watch_task("esp_timer", xTaskGetHandle("esp_timer"), CONFIG_ESP_TIMER_TASK_STACK_SIZE);
+    if (report_timer == NULL && service_timer_create_deferred(&report_timer, "ram_budget", report_timer_cb, NULL) != ESP_OK)
+        return ESP_FAIL;
+    return service_timer_start_periodic(report_timer, period_us);
+}
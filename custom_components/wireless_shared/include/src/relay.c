@@ -0,0 +1,33 @@
+#include "wifi/relay.h"
+#include "rtos/hot_path.h"
+#include <string.h>
+
+bool HOT_PATH_ATTR relay_seq_accept(replay_window_t* window, uint32_t seq, bool authenticated){
+    if (seq < window->highest && window->highest - seq >= LINK_REPLAY_WINDOW){
+        if (!authenticated)
+            return false;
+        window->highest = seq;
+        window->seen = 1;
+        return true;
+    }
+    return replay_window_accept(window, seq);
+}
+
+int HOT_PATH_ATTR relay_open(const uint8_t origin[6], const uint8_t* data, int len, uint8_t frame[ESPNOW_FRAME_MAX_LEN],
+                             espnow_msg_relay_t* header){
+    int sealed_len = len - (int)sizeof(*header) - ESPNOW_COUNTER_LEN;
+    if (sealed_len < 1 || len > ESPNOW_FRAME_MAX_LEN || data[0] != ESPNOW_MSG_RELAY)
+        return -1;
+    memcpy(header, data, sizeof(*header));
+    if (memcmp(header->origin, origin, 6) != 0)
+        return -1;
+    // The counter goes in clear after the sealed frame, and seq has to match it
+    uint32_t counter;
+    memcpy(&counter, data + len - ESPNOW_COUNTER_LEN, ESPNOW_COUNTER_LEN);
+    if (header->seq != counter)
+        return -1;
+    if (link_open(origin, counter, data, RELAY_AAD_LEN, data + sizeof(*header), frame, sealed_len, header->tag) != ESP_OK)
+        return -1;
+    memcpy(frame + sealed_len, &counter, ESPNOW_COUNTER_LEN);
+    return sealed_len + ESPNOW_COUNTER_LEN;
+}
@@ -0,0 +1,105 @@
+#include "timer/timer_service.h"
+#include "rtos/ram_budget.h"
+#include "esp_log.h"
+
+#define TIMER_WORK_TASK_STACK 4096          // sends frames and formats logs
+#define TIMER_WORK_TASK_PRIORITY 4          // below the input path, above OTA and logging
+#define MAX_DEFERRED_TIMERS 16
+
+static const char* TAG = "WIRELESS_SHARED // timer_service.c";
+
+typedef struct {
+    service_timer_cb_t cb;
+    void* arg;
+    bool pending;
+} deferred_timer_t;
+
+STATIC_TASK(timer_work_task_mem, "timer_work", TIMER_WORK_TASK_STACK, TIMER_WORK_TASK_PRIORITY);
+static TaskHandle_t timer_work_task_handle = NULL;
+static deferred_timer_t deferred_timers[MAX_DEFERRED_TIMERS];
+static int num_deferred_timers = 0;
+static portMUX_TYPE deferred_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// On the esp_timer task: mark the work and wake the task that runs it
+static void deferred_dispatch_cb(void* arg){
+    deferred_timer_t* work = (deferred_timer_t*)arg;
+    portENTER_CRITICAL(&deferred_lock);
+    work->pending = true;
+    portEXIT_CRITICAL(&deferred_lock);
+    xTaskNotifyGive(timer_work_task_handle);
+}
+
+static void timer_work_task(void* arg){
+    while (true){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        portENTER_CRITICAL(&deferred_lock);
+        int count = num_deferred_timers;
+        portEXIT_CRITICAL(&deferred_lock);
+        for (int i = 0; i < count; i++){
+            deferred_timer_t* work = &deferred_timers[i];
+            portENTER_CRITICAL(&deferred_lock);
+            bool pending = work->pending;
+            work->pending = false;
+            portEXIT_CRITICAL(&deferred_lock);
+            if (pending)
+                work->cb(work->arg);
+        }
+    }
+}
+
+esp_err_t service_timer_create(service_timer_t* timer, const char* name, service_timer_cb_t cb, void* arg){
+    const esp_timer_create_args_t timer_args = {
+        .callback = cb,
+        .arg = arg,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = name
+    };
+    esp_err_t err = esp_timer_create(&timer_args, timer);
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "Failed to create timer %s: %s", name, esp_err_to_name(err));
+    return err;
+}
+
+esp_err_t service_timer_create_deferred(service_timer_t* timer, const char* name, service_timer_cb_t cb, void* arg){
+    // Timers are created during start-up, one task at a time
+    if (timer_work_task_handle == NULL){
+        timer_work_task_handle = create_static_task(&timer_work_task_mem, timer_work_task, NULL);
+        if (timer_work_task_handle == NULL)
+            return ESP_FAIL;
+    }
+    deferred_timer_t* work = NULL;
+    portENTER_CRITICAL(&deferred_lock);
+    if (num_deferred_timers < MAX_DEFERRED_TIMERS){
+        work = &deferred_timers[num_deferred_timers];
+        *work = (deferred_timer_t){ .cb = cb, .arg = arg, .pending = false };
+        num_deferred_timers++;
+    }
+    portEXIT_CRITICAL(&deferred_lock);
+    if (work == NULL){
+        ESP_LOGE(TAG, "Too many deferred timers, %s not created", name);
+        return ESP_ERR_NO_MEM;
+    }
+    return service_timer_create(timer, name, deferred_dispatch_cb, work);
+}
+
+esp_err_t service_timer_start_once(service_timer_t timer, uint64_t timeout_us){
+    service_timer_cancel(timer);
+    return esp_timer_start_once(timer, timeout_us);
+}
+
+esp_err_t service_timer_start_periodic(service_timer_t timer, uint64_t period_us){
+    service_timer_cancel(timer);
+    return esp_timer_start_periodic(timer, period_us);
+}
+
+esp_err_t service_timer_cancel(service_timer_t timer){
+    if (timer == NULL)
+        return ESP_ERR_INVALID_ARG;
+    esp_err_t err = esp_timer_stop(timer);
+    // esp_timer reports stopping an idle timer as an invalid state
+    return (err == ESP_ERR_INVALID_STATE) ? ESP_OK : err;
+}
+
+bool service_timer_is_active(service_timer_t timer){
+    return timer && esp_timer_is_active(timer);
+}
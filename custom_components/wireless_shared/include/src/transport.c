@@ -0,0 +1,14 @@
+#include "wifi/transport.h"
+#include "sdkconfig.h"
+
+// Apart from wifi.c, so the relay firmware can pick up the transport without the
+// single-peer link logic
+const transport_t* get_transport(void){
+#if CONFIG_WIRELESS_TRANSPORT_UART
+    return &uart_transport;
+#elif CONFIG_WIRELESS_TRANSPORT_UDP
+    return &udp_transport;
+#else
+    return &espnow_transport;
+#endif
+}
@@ -0,0 +1,186 @@
+#include "wifi/transport.h"
+#include "sdkconfig.h"
+
+#if CONFIG_WIRELESS_TRANSPORT_ESPNOW
+#include "esp_log.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "esp_now.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "rtos/hot_path.h"
+#include "constants.h"
+#include <string.h>
+
+#define DEBUG_ESPNOW DISABLED
+// Radio duty cycle while power save is allowed: awake for the window once per interval
+#define PS_WAKE_INTERVAL_MS 100
+#define PS_WAKE_WINDOW_MS 50
+#define SEND_TOKEN_SLOTS 32             // frames esp_now_send() took that have not completed
+
+static const char* TAG = "WIRELESS_SHARED // transport_espnow.c";
+
+static const uint8_t broadcast_addr[TRANSPORT_ADDR_LEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static transport_recv_cb_t HOT_PATH_DATA recv_handler = NULL;
+static transport_send_cb_t HOT_PATH_DATA send_handler = NULL;
+
+// esp_now_send() takes no token, but every frame it accepts completes exactly once, in
+// the order sent, broadcasts included. Tokens wait here meanwhile, oldest first; sends
+// are serialized so this order is the radio's.
+static uint32_t HOT_PATH_DATA send_tokens[SEND_TOKEN_SLOTS];
+static uint32_t HOT_PATH_DATA tokens_head = 0;
+static uint32_t HOT_PATH_DATA tokens_count = 0;
+static portMUX_TYPE send_tokens_lock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t send_lock = NULL;
+static StaticSemaphore_t send_lock_mem;
+
+static void HOT_PATH_ATTR espnow_recv_cb(const esp_now_recv_info_t* recv_info, const uint8_t* data, int len){
+    transport_rx_info_t info = {
+        .src_addr = recv_info->src_addr,
+        .channel = recv_info->rx_ctrl ? recv_info->rx_ctrl->channel : 0,
+        .rssi = recv_info->rx_ctrl ? recv_info->rx_ctrl->rssi : 0
+    };
+    recv_handler(&info, data, len);
+}
+
+// Listed before the frame is handed over, as its completion may come before
+// esp_now_send() returns; a frame it did not take is the newest listed
+static esp_err_t HOT_PATH_ATTR espnow_send(const uint8_t addr[TRANSPORT_ADDR_LEN], const uint8_t* data, size_t len, uint32_t token){
+    xSemaphoreTake(send_lock, portMAX_DELAY);
+    portENTER_CRITICAL(&send_tokens_lock);
+    bool full = tokens_count == SEND_TOKEN_SLOTS;
+    if (!full)
+        send_tokens[(tokens_head + tokens_count++) % SEND_TOKEN_SLOTS] = token;
+    portEXIT_CRITICAL(&send_tokens_lock);
+    esp_err_t err = full ? ESP_ERR_ESPNOW_NO_MEM : esp_now_send(addr, data, len);
+    if (err != ESP_OK && !full){
+        portENTER_CRITICAL(&send_tokens_lock);
+        tokens_count--;
+        portEXIT_CRITICAL(&send_tokens_lock);
+    }
+    xSemaphoreGive(send_lock);
+    return err;
+}
+
+// Invoked when a frame left the radio (acked by the peer, or given up on); it is the
+// oldest listed
+static void HOT_PATH_ATTR espnow_send_cb(const wifi_tx_info_t* tx_info, esp_now_send_status_t status){
+    #if (DEBUG_ESPNOW)
+        if (status == ESP_NOW_SEND_SUCCESS) ESP_LOGI(TAG, "Message Sent Successfully");
+        else ESP_LOGI(TAG, "Message Failed to Send");
+    #endif
+    uint32_t token = TRANSPORT_TOKEN_NONE;
+    portENTER_CRITICAL(&send_tokens_lock);
+    if (tokens_count){
+        token = send_tokens[tokens_head];
+        tokens_head = (tokens_head + 1) % SEND_TOKEN_SLOTS;
+        tokens_count--;
+    }
+    portEXIT_CRITICAL(&send_tokens_lock);
+    // Broadcasts are never acked and nobody waits on them
+    if (token != TRANSPORT_TOKEN_NONE)
+        send_handler(tx_info ? tx_info->des_addr : NULL, token, status == ESP_NOW_SEND_SUCCESS);
+}
+
+// Initializes WiFi (required for ESP-NOW) and ESP-NOW
+static esp_err_t espnow_start(transport_recv_cb_t recv_cb, transport_send_cb_t send_cb, transport_link_cb_t link_cb){
+    (void)link_cb;
+    recv_handler = recv_cb;
+    send_handler = send_cb;
+    send_lock = xSemaphoreCreateMutexStatic(&send_lock_mem);
+
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_start());
+    // STA mode defaults to modem sleep, which holds back reception; the link power
+    // control (wifi/link_power.h) allows it again while the device is idle
+    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE));
+
+    // Set long range mode (better range at the cost of speed)
+    ESP_ERROR_CHECK(esp_wifi_set_protocol(ESP_IF_WIFI_STA, WIFI_PROTOCOL_11B|WIFI_PROTOCOL_11G|WIFI_PROTOCOL_11N|WIFI_PROTOCOL_LR));
+
+    ESP_ERROR_CHECK(esp_now_init());
+    ESP_ERROR_CHECK(esp_now_register_recv_cb(espnow_recv_cb));
+    ESP_ERROR_CHECK(esp_now_register_send_cb(espnow_send_cb));
+
+    // Pairing frames always go out as broadcasts
+    esp_now_peer_info_t broadcast_peer = { .channel = 0, .ifidx = ESP_IF_WIFI_STA, .encrypt = false };
+    memcpy(broadcast_peer.peer_addr, broadcast_addr, TRANSPORT_ADDR_LEN);
+    return esp_now_add_peer(&broadcast_peer);
+}
+
+static esp_err_t espnow_add_peer(const uint8_t addr[TRANSPORT_ADDR_LEN], const uint8_t* lmk, bool* encrypted){
+    esp_now_peer_info_t peer_info = {
+        .channel = 0,
+        .ifidx = ESP_IF_WIFI_STA,
+        .encrypt = lmk != NULL
+    };
+    if (lmk)
+        memcpy(peer_info.lmk, lmk, ESP_NOW_KEY_LEN);
+    memcpy(peer_info.peer_addr, addr, TRANSPORT_ADDR_LEN);
+    esp_err_t err = esp_now_is_peer_exist(addr) ? esp_now_mod_peer(&peer_info) : esp_now_add_peer(&peer_info);
+    *encrypted = err == ESP_OK && peer_info.encrypt;
+    return err;
+}
+
+static void espnow_del_peer(const uint8_t addr[TRANSPORT_ADDR_LEN]){
+    if (memcmp(addr, broadcast_addr, TRANSPORT_ADDR_LEN) != 0 && esp_now_is_peer_exist(addr))
+        esp_now_del_peer(addr);
+}
+
+static esp_err_t espnow_get_addr(uint8_t addr[TRANSPORT_ADDR_LEN]){
+    return esp_wifi_get_mac(WIFI_IF_STA, addr);
+}
+
+static esp_err_t espnow_set_channel(uint8_t channel){
+    return esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+}
+
+static uint8_t espnow_get_channel(void){
+    uint8_t channel = 0;
+    wifi_second_chan_t second;
+    esp_wifi_get_channel(&channel, &second);
+    return channel;
+}
+
+static esp_err_t espnow_set_rate(const uint8_t addr[TRANSPORT_ADDR_LEN], link_rate_t rate){
+    esp_now_rate_config_t config = { .phymode = WIFI_PHY_MODE_11B, .rate = WIFI_PHY_RATE_1M_L, .ersu = false, .dcm = false };
+    if (rate == LINK_RATE_FAST){
+        config.phymode = WIFI_PHY_MODE_11G;
+        config.rate = WIFI_PHY_RATE_24M;
+    }
+    return esp_now_set_peer_rate_config(addr, &config);
+}
+
+// Without an access point, modem sleep follows the connectionless wake interval and window
+static esp_err_t espnow_set_power_save(bool enabled){
+    if (!enabled)
+        return esp_wifi_set_ps(WIFI_PS_NONE);
+    esp_err_t err = esp_wifi_connectionless_module_set_wake_interval(PS_WAKE_INTERVAL_MS);
+    if (err == ESP_OK)
+        err = esp_now_set_wake_window(PS_WAKE_WINDOW_MS);
+    if (err == ESP_OK)
+        err = esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+    return err;
+}
+
+const transport_t HOT_PATH_DATA espnow_transport = {
+    .name = "ESP-NOW",
+    .start = espnow_start,
+    .send = espnow_send,
+    .add_peer = espnow_add_peer,
+    .del_peer = espnow_del_peer,
+    .get_addr = espnow_get_addr,
+    .set_pmk = esp_now_set_pmk,
+    .set_channel = espnow_set_channel,
+    .get_channel = espnow_get_channel,
+    .set_rate = espnow_set_rate,
+    .set_tx_power = esp_wifi_set_max_tx_power,
+    .set_power_save = espnow_set_power_save
+};
+#endif
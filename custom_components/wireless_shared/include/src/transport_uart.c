@@ -0,0 +1,256 @@
+#include "wifi/transport.h"
+#include "sdkconfig.h"
+
+#if CONFIG_WIRELESS_TRANSPORT_UART
+#include "driver/uart.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "rtos/ram_budget.h"
+#include "rtos/hot_path.h"
+#include <inttypes.h>
+#include <string.h>
+
+// Frame on the wire: SYNC, type, payload length, payload, CRC-16 (little endian) over
+// type, length and payload. A bad CRC or length drops back to hunting for SYNC.
+#define UART_SYNC 0xA5
+#define UART_FRAME_DATA 0x01
+#define UART_FRAME_HELLO 0x02               // payload: the sender's address
+#define UART_HEADER_LEN 3
+#define UART_CRC_LEN 2
+#define UART_MAX_PAYLOAD 250                // ESPNOW_FRAME_MAX_LEN, so frames carry over unchanged
+#define UART_RX_BUFFER 1024
+#define UART_TX_BUFFER 1024
+#define UART_EVENT_QUEUE_LEN 16
+#define UART_TASK_STACK 3072
+#define UART_TASK_PRIORITY 6                // above the device tasks, like the WiFi task
+#define HELLO_INTERVAL_US (200000ULL)
+#define LINK_TIMEOUT_US (3 * HELLO_INTERVAL_US)
+
+static const char* TAG = "WIRELESS_SHARED // transport_uart.c";
+
+typedef enum { RX_SYNC, RX_TYPE, RX_LEN, RX_PAYLOAD, RX_CRC } rx_state_t;
+
+typedef struct {
+    rx_state_t state;
+    uint8_t type;
+    uint8_t len;
+    uint8_t crc_pos;
+    uint16_t pos;
+    uint8_t crc[UART_CRC_LEN];
+    uint8_t payload[UART_MAX_PAYLOAD];
+} rx_parser_t;
+
+STATIC_TASK(uart_task_mem, "uart_link", UART_TASK_STACK, UART_TASK_PRIORITY);
+
+static transport_recv_cb_t recv_handler = NULL;
+static transport_send_cb_t send_handler = NULL;
+static transport_link_cb_t link_handler = NULL;
+static QueueHandle_t uart_events = NULL;
+static rx_parser_t parser;
+static uint8_t own_addr[TRANSPORT_ADDR_LEN];
+// Learned from the other end's HELLO; frames are reported as coming from it
+static uint8_t cable_addr[TRANSPORT_ADDR_LEN];
+static bool link_up = false;
+static int64_t last_hello_us = 0;
+static uint32_t crc_errors = 0;
+
+static uint16_t HOT_PATH_ATTR frame_crc(uint8_t type, uint8_t len, const uint8_t* payload){
+    uint8_t header[2] = { type, len };
+    uint16_t crc = esp_rom_crc16_le(0, header, sizeof(header));
+    return esp_rom_crc16_le(crc, payload, len);
+}
+
+// One write per frame, so frames from different tasks never interleave
+static esp_err_t HOT_PATH_ATTR write_frame(uint8_t type, const uint8_t* payload, size_t len){
+    uint8_t frame[UART_HEADER_LEN + UART_MAX_PAYLOAD + UART_CRC_LEN];
+    if (len > UART_MAX_PAYLOAD)
+        return ESP_ERR_INVALID_SIZE;
+    uint16_t crc = frame_crc(type, len, payload);
+    frame[0] = UART_SYNC;
+    frame[1] = type;
+    frame[2] = len;
+    memcpy(frame + UART_HEADER_LEN, payload, len);
+    frame[UART_HEADER_LEN + len] = crc & 0xFF;
+    frame[UART_HEADER_LEN + len + 1] = crc >> 8;
+    int total = UART_HEADER_LEN + len + UART_CRC_LEN;
+    return uart_write_bytes(CONFIG_WIRELESS_UART_PORT, frame, total) == total ? ESP_OK : ESP_FAIL;
+}
+
+static void set_link(bool up){
+    if (link_up == up)
+        return;
+    link_up = up;
+    ESP_LOGI(TAG, "Cable link %s (%" PRIu32 " bad frames so far)", up ? "up" : "down", crc_errors);
+    if (link_handler)
+        link_handler(up);
+}
+
+static void HOT_PATH_ATTR deliver_frame(const rx_parser_t* frame){
+    if (frame->type == UART_FRAME_HELLO){
+        if (frame->len != TRANSPORT_ADDR_LEN)
+            return;
+        memcpy(cable_addr, frame->payload, TRANSPORT_ADDR_LEN);
+        last_hello_us = esp_timer_get_time();
+        set_link(true);
+        return;
+    }
+    // Nothing is addressed until the other end has introduced itself
+    if (frame->type != UART_FRAME_DATA || !link_up)
+        return;
+    transport_rx_info_t info = { .src_addr = cable_addr, .channel = 0, .rssi = 0 };
+    recv_handler(&info, frame->payload, frame->len);
+}
+
+static void HOT_PATH_ATTR parse_bytes(const uint8_t* bytes, int count){
+    for (int i = 0; i < count; i++){
+        uint8_t byte = bytes[i];
+        switch (parser.state){
+            case RX_SYNC:
+                if (byte == UART_SYNC)
+                    parser.state = RX_TYPE;
+                break;
+            case RX_TYPE:
+                parser.type = byte;
+                parser.state = RX_LEN;
+                break;
+            case RX_LEN:
+                parser.len = byte;
+                parser.pos = 0;
+                parser.crc_pos = 0;
+                if (byte > UART_MAX_PAYLOAD)
+                    parser.state = RX_SYNC;
+                else
+                    parser.state = byte ? RX_PAYLOAD : RX_CRC;
+                break;
+            case RX_PAYLOAD:
+                parser.payload[parser.pos++] = byte;
+                if (parser.pos == parser.len)
+                    parser.state = RX_CRC;
+                break;
+            case RX_CRC:
+                parser.crc[parser.crc_pos++] = byte;
+                if (parser.crc_pos < UART_CRC_LEN)
+                    break;
+                parser.state = RX_SYNC;
+                if ((parser.crc[0] | parser.crc[1] << 8) == frame_crc(parser.type, parser.len, parser.payload))
+                    deliver_frame(&parser);
+                else
+                    crc_errors++;
+                break;
+        }
+    }
+}
+
+// Reads the UART as the driver reports data; introduces this end and watches the
+// other end's HELLOs in between
+static void HOT_PATH_ATTR uart_link_task(void* arg){
+    uart_event_t event;
+    uint8_t bytes[128];
+    int64_t next_hello_us = 0;
+    while (true){
+        int64_t now_us = esp_timer_get_time();
+        if (now_us >= next_hello_us){
+            write_frame(UART_FRAME_HELLO, own_addr, TRANSPORT_ADDR_LEN);
+            next_hello_us = now_us + HELLO_INTERVAL_US;
+            if (link_up && now_us - last_hello_us > (int64_t)LINK_TIMEOUT_US)
+                set_link(false);
+        }
+        TickType_t wait = pdMS_TO_TICKS((next_hello_us - now_us) / 1000) + 1;
+        if (xQueueReceive(uart_events, &event, wait) != pdTRUE)
+            continue;
+        switch (event.type){
+            case UART_DATA:
+                for (size_t left = event.size; left > 0;){
+                    int count = uart_read_bytes(CONFIG_WIRELESS_UART_PORT, bytes, left < sizeof(bytes) ? left : sizeof(bytes), 0);
+                    if (count <= 0)
+                        break;
+                    parse_bytes(bytes, count);
+                    left -= count;
+                }
+                break;
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                ESP_LOGW(TAG, "UART overflow, dropping buffered input");
+                uart_flush_input(CONFIG_WIRELESS_UART_PORT);
+                xQueueReset(uart_events);
+                parser.state = RX_SYNC;
+                break;
+            case UART_FRAME_ERR:
+            case UART_PARITY_ERR:
+                crc_errors++;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static esp_err_t uart_start(transport_recv_cb_t recv_cb, transport_send_cb_t send_cb, transport_link_cb_t link_cb){
+    recv_handler = recv_cb;
+    send_handler = send_cb;
+    link_handler = link_cb;
+    esp_err_t err = esp_read_mac(own_addr, ESP_MAC_WIFI_STA);
+    if (err != ESP_OK)
+        return err;
+
+    const uart_config_t config = {
+        .baud_rate = CONFIG_WIRELESS_UART_BAUD,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT
+    };
+    ESP_ERROR_CHECK(uart_driver_install(CONFIG_WIRELESS_UART_PORT, UART_RX_BUFFER, UART_TX_BUFFER, UART_EVENT_QUEUE_LEN, &uart_events, 0));
+    ESP_ERROR_CHECK(uart_param_config(CONFIG_WIRELESS_UART_PORT, &config));
+    ESP_ERROR_CHECK(uart_set_pin(CONFIG_WIRELESS_UART_PORT, CONFIG_WIRELESS_UART_TX_GPIO, CONFIG_WIRELESS_UART_RX_GPIO, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+    // Report a frame as soon as the line goes quiet for a few bits, not after a full FIFO
+    ESP_ERROR_CHECK(uart_set_rx_timeout(CONFIG_WIRELESS_UART_PORT, 2));
+    ESP_ERROR_CHECK(uart_set_rx_full_threshold(CONFIG_WIRELESS_UART_PORT, 64));
+    if (create_static_task(&uart_task_mem, uart_link_task, NULL) == NULL)
+        return ESP_ERR_NO_MEM;
+    ESP_LOGI(TAG, "Wired link on UART%d at %d baud (TX %d, RX %d)", CONFIG_WIRELESS_UART_PORT,
+             CONFIG_WIRELESS_UART_BAUD, CONFIG_WIRELESS_UART_TX_GPIO, CONFIG_WIRELESS_UART_RX_GPIO);
+    return ESP_OK;
+}
+
+// A cable has one other end: peer and broadcast frames go the same way. The wire does
+// not drop frames, so a frame counts as sent once it is in the driver's TX buffer.
+static esp_err_t HOT_PATH_ATTR uart_send(const uint8_t addr[TRANSPORT_ADDR_LEN], const uint8_t* data, size_t len, uint32_t token){
+    esp_err_t err = write_frame(UART_FRAME_DATA, data, len);
+    if (err == ESP_OK && token != TRANSPORT_TOKEN_NONE)
+        send_handler(addr, token, true);
+    return err;
+}
+
+// Nobody else can be on the cable: nothing to set up, and not encrypted
+static esp_err_t uart_add_peer(const uint8_t addr[TRANSPORT_ADDR_LEN], const uint8_t* lmk, bool* encrypted){
+    *encrypted = false;
+    return ESP_OK;
+}
+
+static void uart_del_peer(const uint8_t addr[TRANSPORT_ADDR_LEN]){
+}
+
+static esp_err_t uart_get_addr(uint8_t addr[TRANSPORT_ADDR_LEN]){
+    memcpy(addr, own_addr, TRANSPORT_ADDR_LEN);
+    return ESP_OK;
+}
+
+const transport_t HOT_PATH_DATA uart_transport = {
+    .name = "UART",
+    .start = uart_start,
+    .send = uart_send,
+    .add_peer = uart_add_peer,
+    .del_peer = uart_del_peer,
+    .get_addr = uart_get_addr,
+    .set_pmk = NULL,
+    .set_channel = NULL,
+    .get_channel = NULL,
+    .set_rate = NULL,
+    .set_tx_power = NULL,
+    .set_power_save = NULL
+};
+#endif
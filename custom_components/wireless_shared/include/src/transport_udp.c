@@ -0,0 +1,127 @@
+#include "wifi/transport.h"
+#include "sdkconfig.h"
+
+#if CONFIG_WIRELESS_TRANSPORT_UDP && defined(__linux__)
+#include "esp_log.h"
+#include "rtos/ram_budget.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Datagram: the sender's address followed by the frame. Addresses are made up from
+// the local port (locally administered, 02:57:41:00:<port>), so two instances on one
+// workstation are two devices.
+#define UDP_MAX_FRAME 250                   // ESPNOW_FRAME_MAX_LEN
+#define UDP_TASK_STACK 4096
+#define UDP_TASK_PRIORITY 6
+#define UDP_IDLE_TICKS 1                    // poll interval while the socket is empty
+
+static const char* TAG = "WIRELESS_SHARED // transport_udp.c";
+
+STATIC_TASK(udp_task_mem, "udp_link", UDP_TASK_STACK, UDP_TASK_PRIORITY);
+
+static transport_recv_cb_t recv_handler = NULL;
+static transport_send_cb_t send_handler = NULL;
+static int sock = -1;
+static struct sockaddr_in remote;
+static uint8_t own_addr[TRANSPORT_ADDR_LEN];
+
+// A blocking recv() would stall the simulated scheduler, so the socket is polled
+static void udp_link_task(void* arg){
+    uint8_t datagram[TRANSPORT_ADDR_LEN + UDP_MAX_FRAME];
+    while (true){
+        ssize_t len = recv(sock, datagram, sizeof(datagram), MSG_DONTWAIT);
+        if (len < 0){
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                ESP_LOGW(TAG, "recv failed: %s", strerror(errno));
+            vTaskDelay(UDP_IDLE_TICKS);
+            continue;
+        }
+        if (len <= TRANSPORT_ADDR_LEN)
+            continue;
+        transport_rx_info_t info = { .src_addr = datagram, .channel = 0, .rssi = 0 };
+        recv_handler(&info, datagram + TRANSPORT_ADDR_LEN, len - TRANSPORT_ADDR_LEN);
+    }
+}
+
+static esp_err_t udp_start(transport_recv_cb_t recv_cb, transport_send_cb_t send_cb, transport_link_cb_t link_cb){
+    (void)link_cb;
+    recv_handler = recv_cb;
+    send_handler = send_cb;
+    const uint8_t addr[TRANSPORT_ADDR_LEN] = {
+        0x02, 0x57, 0x41, 0x00, CONFIG_WIRELESS_UDP_LOCAL_PORT >> 8, CONFIG_WIRELESS_UDP_LOCAL_PORT & 0xFF
+    };
+    memcpy(own_addr, addr, TRANSPORT_ADDR_LEN);
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+        return ESP_FAIL;
+    struct sockaddr_in local = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_WIRELESS_UDP_LOCAL_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+    remote = (struct sockaddr_in){ .sin_family = AF_INET, .sin_port = htons(CONFIG_WIRELESS_UDP_REMOTE_PORT) };
+    if (bind(sock, (struct sockaddr*)&local, sizeof(local)) != 0 ||
+        inet_pton(AF_INET, CONFIG_WIRELESS_UDP_REMOTE_HOST, &remote.sin_addr) != 1){
+        ESP_LOGE(TAG, "Cannot use port %d -> %s:%d", CONFIG_WIRELESS_UDP_LOCAL_PORT,
+                 CONFIG_WIRELESS_UDP_REMOTE_HOST, CONFIG_WIRELESS_UDP_REMOTE_PORT);
+        close(sock);
+        sock = -1;
+        return ESP_FAIL;
+    }
+    if (create_static_task(&udp_task_mem, udp_link_task, NULL) == NULL)
+        return ESP_ERR_NO_MEM;
+    ESP_LOGI(TAG, "UDP link on port %d -> %s:%d", CONFIG_WIRELESS_UDP_LOCAL_PORT,
+             CONFIG_WIRELESS_UDP_REMOTE_HOST, CONFIG_WIRELESS_UDP_REMOTE_PORT);
+    return ESP_OK;
+}
+
+// Everything goes to the one remote endpoint, peer or not; loopback does not lose
+// datagrams, so a frame counts as sent once the kernel took it
+static esp_err_t udp_send(const uint8_t addr[TRANSPORT_ADDR_LEN], const uint8_t* data, size_t len, uint32_t token){
+    uint8_t datagram[TRANSPORT_ADDR_LEN + UDP_MAX_FRAME];
+    if (len > UDP_MAX_FRAME)
+        return ESP_ERR_INVALID_SIZE;
+    memcpy(datagram, own_addr, TRANSPORT_ADDR_LEN);
+    memcpy(datagram + TRANSPORT_ADDR_LEN, data, len);
+    ssize_t sent = sendto(sock, datagram, TRANSPORT_ADDR_LEN + len, 0, (struct sockaddr*)&remote, sizeof(remote));
+    if (sent < 0)
+        return ESP_FAIL;
+    if (token != TRANSPORT_TOKEN_NONE)
+        send_handler(addr, token, true);
+    return ESP_OK;
+}
+
+// Nothing to set up; wifi.c filters senders itself
+static esp_err_t udp_add_peer(const uint8_t addr[TRANSPORT_ADDR_LEN], const uint8_t* lmk, bool* encrypted){
+    *encrypted = false;
+    return ESP_OK;
+}
+
+static void udp_del_peer(const uint8_t addr[TRANSPORT_ADDR_LEN]){
+}
+
+static esp_err_t udp_get_addr(uint8_t addr[TRANSPORT_ADDR_LEN]){
+    memcpy(addr, own_addr, TRANSPORT_ADDR_LEN);
+    return ESP_OK;
+}
+
+const transport_t udp_transport = {
+    .name = "UDP",
+    .start = udp_start,
+    .send = udp_send,
+    .add_peer = udp_add_peer,
+    .del_peer = udp_del_peer,
+    .get_addr = udp_get_addr,
+    .set_pmk = NULL,
+    .set_channel = NULL,
+    .get_channel = NULL,
+    .set_rate = NULL,
+    .set_tx_power = NULL,
+    .set_power_save = NULL
+};
+#endif
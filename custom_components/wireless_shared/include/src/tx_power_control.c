@@ -0,0 +1,101 @@
+#include "wifi/tx_power_control.h"
+#include <math.h>
+#include <string.h>
+
+static inline int8_t clamp_power(const tx_power_config_t* config, int32_t power){
+    if (power > config->ceiling)
+        power = config->ceiling;
+    if (power < config->floor)
+        power = config->floor;
+    return (int8_t)power;
+}
+
+// Within what the radio takes, and what stats.frames_at counts
+static inline int8_t clamp_level(int32_t power){
+    if (power > TX_POWER_MAX)
+        return TX_POWER_MAX;
+    if (power < TX_POWER_MIN)
+        return TX_POWER_MIN;
+    return (int8_t)power;
+}
+
+void tx_power_init(tx_power_ctl_t* ctl, const tx_power_config_t* config){
+    memset(ctl, 0, sizeof(*ctl));
+    ctl->config = *config;
+    ctl->config.floor = clamp_level(config->floor);
+    ctl->config.ceiling = clamp_level(config->ceiling);
+    if (ctl->config.ceiling < ctl->config.floor)
+        ctl->config.ceiling = ctl->config.floor;
+    ctl->power = ctl->config.ceiling;
+}
+
+int8_t tx_power_on_report(tx_power_ctl_t* ctl, int8_t peer_rssi){
+    const tx_power_config_t* config = &ctl->config;
+    int32_t error_db = peer_rssi - config->target_rssi;
+    ctl->stats.reports++;
+    ctl->unanswered_since_us = 0;
+    if (error_db < 0)
+        ctl->power = clamp_power(config, ctl->power - error_db * 4);
+    else if (error_db > config->hysteresis_db){
+        int32_t step_db = error_db - config->hysteresis_db;
+        if (step_db > config->step_down_db)
+            step_db = config->step_down_db;
+        ctl->power = clamp_power(config, ctl->power - step_db * 4);
+    }
+    return ctl->power;
+}
+
+int8_t tx_power_on_send(tx_power_ctl_t* ctl, bool success, int64_t now_us){
+    const tx_power_config_t* config = &ctl->config;
+    if (ctl->unanswered_since_us == 0)
+        ctl->unanswered_since_us = now_us;
+    ctl->stats.frames++;
+    ctl->stats.frames_at[ctl->power]++;
+    if (success){
+        ctl->failures_in_row = 0;
+        return ctl->power;
+    }
+    ctl->stats.failures++;
+    if (++ctl->failures_in_row >= config->fail_burst){
+        ctl->failures_in_row = 0;
+        if (ctl->power < config->ceiling){
+            ctl->power = clamp_power(config, ctl->power + config->fade_step_db * 4);
+            ctl->stats.fades++;
+        }
+    }
+    return ctl->power;
+}
+
+int8_t tx_power_on_tick(tx_power_ctl_t* ctl, int64_t now_us){
+    // Sending without feedback: the peer may not hear us at this power
+    if (ctl->unanswered_since_us && now_us - ctl->unanswered_since_us > (int64_t)ctl->config.report_timeout_us){
+        ctl->power = ctl->config.ceiling;
+        ctl->unanswered_since_us = now_us;
+    }
+    return ctl->power;
+}
+
+// Kept within [floor, TX_POWER_MAX], so power always indexes stats.frames_at
+int8_t tx_power_set_ceiling(tx_power_ctl_t* ctl, int8_t ceiling){
+    ceiling = clamp_level(ceiling);
+    ctl->config.ceiling = ceiling < ctl->config.floor ? ctl->config.floor : ceiling;
+    ctl->power = clamp_power(&ctl->config, ctl->power);
+    return ctl->power;
+}
+
+int32_t tx_power_mean(const tx_power_stats_t* stats){
+    uint64_t sum = 0;
+    for (int level = 0; level < TX_POWER_LEVELS; level++)
+        sum += (uint64_t)stats->frames_at[level] * level;
+    return stats->frames ? (int32_t)(sum / stats->frames) : 0;
+}
+
+int32_t tx_power_energy_saved(const tx_power_stats_t* stats, int8_t reference){
+    double used = 0;
+    for (int level = 0; level < TX_POWER_LEVELS; level++){
+        if (stats->frames_at[level])
+            used += stats->frames_at[level] * pow(10.0, level / 40.0);
+    }
+    double full = stats->frames * pow(10.0, reference / 40.0);
+    return full > 0 ? (int32_t)((1.0 - used / full) * 10000.0) : 0;
+}
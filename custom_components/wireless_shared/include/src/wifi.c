@@ -1,94 +1,712 @@
 #include "esp_log.h"
-#include "esp_wifi.h"
-#include "esp_now.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
 #include "nvs_flash.h"
 #include "wifi/msg_types.h"
 #include "esp_err.h"
+#include <inttypes.h>
 #include <string.h>
 #include "wifi/wifi.h"
-#include "esp_timer.h"
+#include "wifi/link_security.h"
+#include "wifi/pairing.h"
+#include "wifi/impairment.h"
+#include "wifi/transport.h"
+#include "wifi/tx_power_control.h"
+#include "wifi/relay.h"
+#include "wifi/link_power.h"
+#include "rtos/ram_budget.h"
+#include "log/deferred_log.h"
+#include <stddef.h>
+#include "timer/timer_service.h"
 #include "constants.h"
+#include "rtos/hot_path.h"
 
 #define DEBUG_WIFI DISABLED
-#define UPDATE_CONN_INTERVAL_MS (4999ULL)
+#define UPDATE_CONN_INTERVAL_US (4999000ULL)
 #define CONNECTION_TIMEOUT_US (1000000ULL)
 #define PEER_MAC_STORAGE_KEY "peer_mac"
+#define PEER_CHANNEL_STORAGE_KEY "peer_chan"
 
 static const char* TAG = "WIRELESS_SHARED // wifi.c";
 
+static const uint8_t broadcast_mac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static const transport_t* HOT_PATH_DATA transport = NULL;
 static uint8_t peer_mac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+// Frames to and from peer_mac are encrypted and end with a frame counter
+static volatile bool link_secured = false;
 
 extern void process_message_cb(const espnow_message_t* msg);
 extern void connection_status_cb(bool connection_status);
 extern void paired_status_updated_cb(bool paired_status);
+extern void send_status_cb(uint32_t token, bool success);
+extern bool handshake_piggyback_cb(espnow_msg_output_t* output);
+extern void send_link_report_cb(const espnow_msg_link_report_t* report);
 
 static tristate_bool_t paired_status = TRISTATE_UNINIT;
 static tristate_bool_t connection_status = TRISTATE_UNINIT;
-static esp_timer_handle_t connection_timer = NULL;
+static service_timer_t connection_timer = NULL;
+static service_timer_t heartbeat_timer = NULL;
+static uint64_t heartbeat_interval_us = UPDATE_CONN_INTERVAL_US;
+static link_rate_t link_rate = LINK_RATE_DEFAULT;
+
+static inline bool is_recognized_sender(const uint8_t sender_mac[6]){ return (memcmp(sender_mac, peer_mac, 6) == 0); }
 
 static void set_connection_status(tristate_bool_t status){
-    if (connection_timer && esp_timer_is_active(connection_timer))
-        esp_timer_stop(connection_timer);
+    if (service_timer_is_active(connection_timer))
+        service_timer_cancel(connection_timer);
     if (connection_status != status){
+#if CONFIG_WIRELESS_LINK_ENCRYPTION
+        // The peer may have rebooted and raised its replay floor
+        if (connection_status == TRISTATE_TRUE && link_secured)
+            link_skip_tx_counters();
+#endif
         connection_status = status;
         connection_status_cb(connection_status == TRISTATE_TRUE);
     }
 }
 
-static inline bool is_recognized_sender(uint8_t sender_mac[6]){ return (memcmp(sender_mac, peer_mac, 6) == 0); }
+#if CONFIG_WIRELESS_TX_POWER_CONTROL
+#define POWER_TASK_STACK 3072
+#define POWER_TASK_PRIORITY 5
+#define LINK_REPORT_INTERVAL_US (250000LL)
+#define POWER_LOG_INTERVAL_US (60000000LL)
+
+STATIC_TASK(power_task_mem, "tx_power", POWER_TASK_STACK, POWER_TASK_PRIORITY);
+static TaskHandle_t power_task_handle = NULL;
+static tx_power_ctl_t power_ctl;
+static portMUX_TYPE power_lock = portMUX_INITIALIZER_UNLOCKED;
+static int32_t rx_rssi_sum = 0;
+static uint32_t rx_rssi_frames = 0;
+
+// RSSI of every frame from the peer, averaged into the next link report
+static inline void HOT_PATH_ATTR measure_rssi(int8_t rssi){
+    if (rssi == 0)
+        return;     // transport without a radio
+    portENTER_CRITICAL(&power_lock);
+    rx_rssi_sum += rssi;
+    rx_rssi_frames++;
+    portEXIT_CRITICAL(&power_lock);
+}
+
+// A fade shows as failed sends long before the next report
+static void HOT_PATH_ATTR power_frame_sent(bool success){
+    portENTER_CRITICAL(&power_lock);
+    int8_t before = power_ctl.power;
+    bool raised = tx_power_on_send(&power_ctl, success, esp_timer_get_time()) > before;
+    portEXIT_CRITICAL(&power_lock);
+    if (raised && power_task_handle)
+        xTaskNotifyGive(power_task_handle);
+}
+
+static void HOT_PATH_ATTR process_link_report(const espnow_msg_link_report_t* report){
+    portENTER_CRITICAL(&power_lock);
+    int8_t before = power_ctl.power;
+    bool changed = tx_power_on_report(&power_ctl, report->rssi) != before;
+    portEXIT_CRITICAL(&power_lock);
+    if (changed && power_task_handle)
+        xTaskNotifyGive(power_task_handle);
+}
+
+void get_tx_power_stats(tx_power_stats_t* stats){
+    portENTER_CRITICAL(&power_lock);
+    *stats = power_ctl.stats;
+    portEXIT_CRITICAL(&power_lock);
+}
+
+void log_tx_power_stats(void){
+    static tx_power_stats_t stats;     // 350 bytes, off the caller's stack
+    portENTER_CRITICAL(&power_lock);
+    stats = power_ctl.stats;
+    int8_t power = power_ctl.power;
+    int8_t ceiling = power_ctl.config.ceiling;
+    portEXIT_CRITICAL(&power_lock);
+    int32_t mean = tx_power_mean(&stats);
+    int32_t saved = tx_power_energy_saved(&stats, ceiling);
+    ESP_LOGI(TAG, "TX power %d.%02d dBm, mean %" PRId32 ".%02" PRId32 " dBm over %" PRIu32 " frames "
+             "(%" PRIu32 " failed, %" PRIu32 " fades, %" PRIu32 " reports)", power / 4, (power % 4) * 25,
+             mean / 4, (mean % 4) * 25, stats.frames, stats.failures, stats.fades, stats.reports);
+    ESP_LOGI(TAG, "Radiated energy %" PRId32 ".%02" PRId32 "%% below %d.%02d dBm", saved / 100,
+             (saved < 0 ? -saved : saved) % 100, ceiling / 4, (ceiling % 4) * 25);
+}
+
+// Applies the controller's power (esp_wifi calls stay out of the WiFi task) and
+// sends the peer how its frames arrive
+static void power_task(void* arg){
+    int8_t applied = 0;
+    int64_t last_report_us = 0;
+    int64_t last_log_us = esp_timer_get_time();
+    while (true){
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LINK_REPORT_INTERVAL_US / 1000));
+        int64_t now_us = esp_timer_get_time();
+        espnow_msg_link_report_t report = { .msg_type = ESPNOW_MSG_LINK_REPORT };
+        bool report_due = now_us - last_report_us >= LINK_REPORT_INTERVAL_US;
+        portENTER_CRITICAL(&power_lock);
+        int8_t power = tx_power_on_tick(&power_ctl, now_us);
+        if (report_due && rx_rssi_frames){
+            report.rssi = rx_rssi_sum / (int32_t)rx_rssi_frames;
+            report.frames = rx_rssi_frames > UINT8_MAX ? UINT8_MAX : rx_rssi_frames;
+            rx_rssi_sum = 0;
+            rx_rssi_frames = 0;
+        }
+        portEXIT_CRITICAL(&power_lock);
+
+        if (power != applied && transport->set_tx_power(power) == ESP_OK)
+            applied = power;
+        if (report.frames && connection_status == TRISTATE_TRUE){
+            send_link_report_cb(&report);
+            last_report_us = now_us;
+        }
+        if (now_us - last_log_us >= POWER_LOG_INTERVAL_US && power_ctl.stats.frames){
+            log_tx_power_stats();
+            last_log_us = now_us;
+        }
+    }
+}
+
+static void init_tx_power_control(void){
+    const tx_power_config_t config = {
+        .target_rssi = CONFIG_WIRELESS_TX_POWER_TARGET_RSSI,
+        .hysteresis_db = 6,
+        .step_down_db = 2,
+        .fade_step_db = 6,
+        .fail_burst = 2,
+        .floor = CONFIG_WIRELESS_TX_POWER_FLOOR,
+        .ceiling = TX_POWER_MAX,
+        .report_timeout_us = 1000000
+    };
+    if (!transport->set_tx_power)
+        return;
+    tx_power_init(&power_ctl, &config);
+    power_task_handle = create_static_task(&power_task_mem, power_task, NULL);
+    if (power_task_handle == NULL)
+        ESP_LOGE(TAG, "TX power control not started");
+}
+#else
+static inline void HOT_PATH_ATTR measure_rssi(int8_t rssi){ (void)rssi; }
+static inline void HOT_PATH_ATTR power_frame_sent(bool success){ (void)success; }
+#endif
+
+static void process_peer_frame(const uint8_t* data, int len);
+
+static uint32_t HOT_PATH_DATA last_token = SEND_TOKEN_NONE;
+static portMUX_TYPE send_token_lock = portMUX_INITIALIZER_UNLOCKED;
+
+uint32_t HOT_PATH_ATTR new_send_token(void){
+    portENTER_CRITICAL(&send_token_lock);
+    if (++last_token == SEND_TOKEN_NONE)
+        ++last_token;
+    uint32_t token = last_token;
+    portEXIT_CRITICAL(&send_token_lock);
+    return token;
+}
+
+// Straight to the peer; timed for the power management's send penalty, from before the
+// send, as its completion may come first
+static inline esp_err_t HOT_PATH_ATTR send_direct(const uint8_t* data, size_t size, uint32_t token){
+#if CONFIG_WIRELESS_POWER_MANAGEMENT
+    link_power_frame_queued(token);
+#endif
+    esp_err_t err = transport->send(peer_mac, data, size, token);
+#if CONFIG_WIRELESS_POWER_MANAGEMENT
+    if (err != ESP_OK)
+        link_power_frame_sent(token, false);
+#endif
+    return err;
+}
+
+#if CONFIG_WIRELESS_RELAY
+static uint8_t own_mac[6];
+static uint8_t relay_mac[6];                // the relay heard most recently, see note_relay()
+static uint8_t registered_relay[6];         // the relay frames can be sent to
+static volatile bool HOT_PATH_DATA relay_ready = false;
+static volatile bool HOT_PATH_DATA via_relay = false;
+static int64_t relay_seen_us = 0;
+static uint8_t direct_fails = 0;
+static uint8_t probe_acks = 0;
+static replay_window_t relay_rx_window = {0};   // only touched by the receive callback
+static relay_stats_t relay_stats = {0};
+static portMUX_TYPE relay_lock = portMUX_INITIALIZER_UNLOCKED;
+static service_timer_t relay_timer = NULL;
+
+_Static_assert(sizeof(espnow_msg_relay_t) == ESPNOW_RELAY_HEADER_LEN, "ESPNOW_RELAY_HEADER_LEN is out of date");
+
+static inline bool HOT_PATH_ATTR is_relay_addr(const uint8_t* addr){
+    return addr && relay_ready && memcmp(addr, registered_relay, 6) == 0;
+}
+
+// Stay with one relay while it is heard; the first beacon after it went quiet picks the next
+static void HOT_PATH_ATTR note_relay(const transport_rx_info_t* info){
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&relay_lock);
+    if (memcmp(info->src_addr, relay_mac, 6) == 0 || now_us - relay_seen_us > RELAY_TIMEOUT_US){
+        memcpy(relay_mac, info->src_addr, 6);
+        relay_seen_us = now_us;
+    }
+    portEXIT_CRITICAL(&relay_lock);
+}
+
+// Wrap a frame for the relay, sealed all but the counter, which doubles as the seq
+static esp_err_t HOT_PATH_ATTR send_relayed(const uint8_t* data, size_t size, uint32_t token){
+    uint8_t envelope[ESPNOW_FRAME_MAX_LEN];
+    espnow_msg_relay_t* header = (espnow_msg_relay_t*)envelope;
+    uint8_t* payload = envelope + sizeof(*header);
+    if (!link_secured || size <= ESPNOW_COUNTER_LEN)
+        return ESP_ERR_INVALID_STATE;
+    if (size + sizeof(*header) > ESPNOW_FRAME_MAX_LEN)
+        return ESP_ERR_INVALID_SIZE;
+    uint32_t counter;
+    size_t sealed_len = size - ESPNOW_COUNTER_LEN;
+    memcpy(&counter, data + sealed_len, ESPNOW_COUNTER_LEN);
+    header->msg_type = ESPNOW_MSG_RELAY;
+    memcpy(header->origin, own_mac, 6);
+    memcpy(header->dest, peer_mac, 6);
+    header->seq = counter;
+    header->hops = 0;
+    header->relay_us = 0;
+    memset(header->tag, 0, ESPNOW_RELAY_TAG_LEN);
+    esp_err_t err = link_seal(own_mac, counter, envelope, RELAY_AAD_LEN, data, payload, sealed_len, header->tag);
+    if (err != ESP_OK)
+        return err;
+    memcpy(payload + sealed_len, &counter, ESPNOW_COUNTER_LEN);
+    portENTER_CRITICAL(&relay_lock);
+    relay_stats.relayed_tx++;
+    portEXIT_CRITICAL(&relay_lock);
+    return transport->send(registered_relay, envelope, sizeof(*header) + size, token);
+}
+
+// A frame from the peer that came through a relay: opened, checked for repeats and then
+// handled like one that came direct. Only sealed frames open, so only a frame the peer
+// sent moves the duplicate window.
+static void HOT_PATH_ATTR receive_relayed(const uint8_t* data, int len){
+    static uint8_t frame[ESPNOW_FRAME_MAX_LEN];     // only the receive callback uses it
+    espnow_msg_relay_t header;
+    if (paired_status != TRISTATE_TRUE || !link_secured)
+        return;
+    int size = relay_open(peer_mac, data, len, frame, &header);
+    if (size < 0)
+        return;
+    portENTER_CRITICAL(&relay_lock);
+    bool fresh = relay_seq_accept(&relay_rx_window, header.seq, true);
+    if (fresh){
+        relay_stats.relayed_rx++;
+        relay_stats.relay_us_sum += header.relay_us;
+        if (header.relay_us > relay_stats.relay_us_max)
+            relay_stats.relay_us_max = header.relay_us;
+    }
+    else
+        relay_stats.duplicates++;
+    portEXIT_CRITICAL(&relay_lock);
+    if (fresh)
+        process_peer_frame(frame, size);
+}
+
+// Completion of a direct send; false for probes, which the application did not send
+static bool HOT_PATH_ATTR direct_frame_sent(bool success){
+    if (via_relay){
+        probe_acks = success ? probe_acks + 1 : 0;
+        if (probe_acks >= RELAY_RECOVER_PROBES){
+            via_relay = false;
+            relay_stats.recoveries++;
+            DLOGI(TAG, "Direct link back");
+        }
+        return false;
+    }
+    direct_fails = success ? 0 : direct_fails + 1;
+    // Relayed frames have to be sealed, which takes an encrypted link
+    if (direct_fails >= RELAY_FAILOVER_FAILS && relay_ready && link_secured){
+        direct_fails = 0;
+        probe_acks = 0;
+        via_relay = true;
+        relay_stats.failovers++;
+        DLOGW(TAG, "Direct link failing, sending through the relay");
+    }
+    return true;
+}
+
+// Registers the relay in use, drops one gone quiet, and probes the direct link while
+// frames take the relay
+static void relay_timer_cb(void* arg){
+    static const espnow_msg_blank_t probe = { .msg_type = ESPNOW_MSG_LINK_PROBE };
+    uint8_t heard[6];
+    portENTER_CRITICAL(&relay_lock);
+    memcpy(heard, relay_mac, 6);
+    bool alive = relay_seen_us && esp_timer_get_time() - relay_seen_us <= RELAY_TIMEOUT_US;
+    portEXIT_CRITICAL(&relay_lock);
+
+    if (relay_ready && (!alive || memcmp(heard, registered_relay, 6) != 0)){
+        relay_ready = false;
+        via_relay = false;
+        transport->del_peer(registered_relay);
+        ESP_LOGI(TAG, "Relay " MACSTR " gone", MAC2STR(registered_relay));
+    }
+    if (!relay_ready && alive){
+        bool encrypted;
+        if (transport->add_peer(heard, NULL, &encrypted) == ESP_OK){
+            memcpy(registered_relay, heard, 6);
+            relay_ready = true;
+            ESP_LOGI(TAG, "Relay " MACSTR " available", MAC2STR(heard));
+        }
+    }
+    if (via_relay && paired_status == TRISTATE_TRUE)
+        transport->send(peer_mac, (const uint8_t*)&probe, sizeof(probe), new_send_token());
+}
+
+void get_relay_stats(relay_stats_t* stats){
+    portENTER_CRITICAL(&relay_lock);
+    *stats = relay_stats;
+    portEXIT_CRITICAL(&relay_lock);
+}
+
+bool is_link_relayed(void){
+    return via_relay;
+}
+
+static void init_relay(void){
+    ESP_ERROR_CHECK(transport->get_addr(own_mac));
+    ESP_ERROR_CHECK(service_timer_create_deferred(&relay_timer, "relay", relay_timer_cb, NULL));
+    service_timer_start_periodic(relay_timer, RELAY_PROBE_INTERVAL_US);
+}
 
-// Send message to the set peer device
+static inline esp_err_t HOT_PATH_ATTR send_frame(const uint8_t* data, size_t size, uint32_t token){
+    if (via_relay)
+        return send_relayed(data, size, token);
+    return send_direct(data, size, token);
+}
+#else
+static inline esp_err_t HOT_PATH_ATTR send_frame(const uint8_t* data, size_t size, uint32_t token){
+    return send_direct(data, size, token);
+}
+#endif
+
+// Completion of the send with this token, from the transport or the impairment model
+static void HOT_PATH_ATTR send_completed(const uint8_t addr[TRANSPORT_ADDR_LEN], uint32_t token, bool success){
+#if CONFIG_WIRELESS_RELAY
+    // The hop to the relay says nothing about the direct link
+    if (is_relay_addr(addr)){
+        send_status_cb(token, success);
+        return;
+    }
+#endif
+    power_frame_sent(success);
+#if CONFIG_WIRELESS_POWER_MANAGEMENT
+    link_power_frame_sent(token, success);
+#endif
+#if CONFIG_WIRELESS_RELAY
+    if (!direct_frame_sent(success))
+        return;
+#endif
+    send_status_cb(token, success);
+}
+
+#if CONFIG_WIRELESS_IMPAIRMENT
+#define IMPAIRMENT_SLOTS 16
+#define SEND_FAIL_DELAY_US (1000)   // about when the MAC gives up on a frame
+
+// Frames held back by the impairment model, or the failed send callback of a lost one
+typedef struct {
+    bool used;
+    bool lost;
+    uint32_t token;
+    int64_t due_us;
+    uint8_t len;
+    uint8_t data[ESPNOW_FRAME_MAX_LEN];
+} delayed_frame_t;
+
+static impairment_t impairment;
+static delayed_frame_t delay_line[IMPAIRMENT_SLOTS];
+static portMUX_TYPE impairment_lock = portMUX_INITIALIZER_UNLOCKED;
+static service_timer_t impairment_timer = NULL;
+static uint32_t delay_line_overflows = 0;
+
+// Arm the timer for the earliest held frame; called with impairment_lock held
+static int64_t next_due_us(void){
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < IMPAIRMENT_SLOTS; i++){
+        if (delay_line[i].used && delay_line[i].due_us < next)
+            next = delay_line[i].due_us;
+    }
+    return next;
+}
+
+static void hold_frame(const uint8_t* data, size_t len, uint32_t token, uint32_t delay_us, bool lost){
+    int64_t now_us = esp_timer_get_time();
+    int64_t next = INT64_MAX;
+    portENTER_CRITICAL(&impairment_lock);
+    int slot = -1;
+    for (int i = 0; i < IMPAIRMENT_SLOTS && slot < 0; i++){
+        if (!delay_line[i].used)
+            slot = i;
+    }
+    if (slot >= 0){
+        delay_line[slot].used = true;
+        delay_line[slot].lost = lost;
+        delay_line[slot].token = token;
+        delay_line[slot].due_us = now_us + delay_us;
+        delay_line[slot].len = len;
+        if (len)
+            memcpy(delay_line[slot].data, data, len);
+        next = next_due_us();
+    }
+    else
+        delay_line_overflows++;
+    portEXIT_CRITICAL(&impairment_lock);
+    if (next != INT64_MAX)
+        service_timer_start_once(impairment_timer, next > now_us ? next - now_us : 0);
+}
+
+// Release held frames in due order
+static void impairment_timer_cb(void* arg){
+    delayed_frame_t frame;
+    while (true){
+        int64_t now_us = esp_timer_get_time();
+        int64_t next = INT64_MAX;
+        int slot = -1;
+        portENTER_CRITICAL(&impairment_lock);
+        for (int i = 0; i < IMPAIRMENT_SLOTS; i++){
+            if (delay_line[i].used && delay_line[i].due_us <= now_us &&
+                (slot < 0 || delay_line[i].due_us < delay_line[slot].due_us))
+                slot = i;
+        }
+        if (slot >= 0){
+            frame = delay_line[slot];
+            delay_line[slot].used = false;
+        }
+        else
+            next = next_due_us();
+        portEXIT_CRITICAL(&impairment_lock);
+
+        if (slot < 0){
+            if (next != INT64_MAX)
+                service_timer_start_once(impairment_timer, next - now_us);
+            return;
+        }
+        if (frame.lost)
+            send_completed(peer_mac, frame.token, false);
+        else
+            send_frame(frame.data, frame.len, frame.token);
+    }
+}
+
+// Frames to the peer pass through the model: dropped (reported as a failed send),
+// held back, or sent twice
+static esp_err_t HOT_PATH_ATTR transmit(const uint8_t* data, size_t size, uint32_t token){
+    uint32_t delay_us[IMPAIRMENT_MAX_COPIES];
+    portENTER_CRITICAL(&impairment_lock);
+    int copies = impairment_apply(&impairment, delay_us);
+    portEXIT_CRITICAL(&impairment_lock);
+    if (copies == 0){
+        hold_frame(NULL, 0, token, SEND_FAIL_DELAY_US, true);
+        return ESP_OK;
+    }
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < copies; i++){
+        if (delay_us[i] == 0)
+            err = send_frame(data, size, token);
+        else
+            hold_frame(data, size, token, delay_us[i], false);
+    }
+    return err;
+}
+
+void set_link_impairment(const impairment_config_t* config){
+    portENTER_CRITICAL(&impairment_lock);
+    impairment_init(&impairment, config);
+    delay_line_overflows = 0;
+    portEXIT_CRITICAL(&impairment_lock);
+}
+
+void get_link_impairment_stats(impairment_stats_t* stats){
+    portENTER_CRITICAL(&impairment_lock);
+    *stats = impairment.stats;
+    portEXIT_CRITICAL(&impairment_lock);
+}
+
+static void init_impairment(void){
+    const impairment_config_t config = {
+        .seed = CONFIG_WIRELESS_IMPAIRMENT_SEED,
+        .good_to_bad = CONFIG_WIRELESS_IMPAIRMENT_GOOD_TO_BAD,
+        .bad_to_good = CONFIG_WIRELESS_IMPAIRMENT_BAD_TO_GOOD,
+        .loss_good = CONFIG_WIRELESS_IMPAIRMENT_LOSS_GOOD,
+        .loss_bad = CONFIG_WIRELESS_IMPAIRMENT_LOSS_BAD,
+        .delay_us = CONFIG_WIRELESS_IMPAIRMENT_DELAY_US,
+        .jitter_us = CONFIG_WIRELESS_IMPAIRMENT_JITTER_US,
+#if CONFIG_WIRELESS_IMPAIRMENT_DELAY_EXPONENTIAL
+        .delay_dist = IMPAIRMENT_DELAY_EXPONENTIAL,
+#elif CONFIG_WIRELESS_IMPAIRMENT_DELAY_NORMAL
+        .delay_dist = IMPAIRMENT_DELAY_NORMAL,
+#else
+        .delay_dist = IMPAIRMENT_DELAY_UNIFORM,
+#endif
+        .reorder = CONFIG_WIRELESS_IMPAIRMENT_REORDER,
+        .reorder_us = CONFIG_WIRELESS_IMPAIRMENT_REORDER_US,
+        .duplicate = CONFIG_WIRELESS_IMPAIRMENT_DUPLICATE
+    };
+    set_link_impairment(&config);
+    ESP_ERROR_CHECK(service_timer_create_deferred(&impairment_timer, "impairment", impairment_timer_cb, NULL));
+    ESP_LOGW(TAG, "Link impairment on: seed %" PRIu32 ", loss transitions %u/%u, delay %" PRIu32 "+%" PRIu32 " US",
+             config.seed, config.good_to_bad, config.bad_to_good, config.delay_us, config.jitter_us);
+}
+#else
+static inline esp_err_t HOT_PATH_ATTR transmit(const uint8_t* data, size_t size, uint32_t token){
+    return send_frame(data, size, token);
+}
+#endif
+
+// Send message to the set peer device under token (new_send_token())
 // Returns esp_err_t on failure
-esp_err_t send_message(const uint8_t *data, size_t size){
-    return esp_now_send(peer_mac, data, size);
+esp_err_t HOT_PATH_ATTR send_message_tagged(const uint8_t *data, size_t size, uint32_t token){
+#if CONFIG_WIRELESS_LINK_ENCRYPTION
+    if (link_secured){
+        uint8_t frame[ESPNOW_FRAME_MAX_LEN];
+        uint32_t counter;
+        if (size > ESPNOW_BUNDLE_MAX_LEN)
+            return ESP_ERR_INVALID_SIZE;
+        if (!link_next_tx_counter(&counter))
+            return ESP_ERR_INVALID_STATE;
+        memcpy(frame, data, size);
+        memcpy(frame + size, &counter, ESPNOW_COUNTER_LEN);
+        return transmit(frame, size + ESPNOW_COUNTER_LEN, token);
+    }
+#endif
+    return transmit(data, size, token);
 }
 
-static void espnow_recv_cb(const esp_now_recv_info_t* recv_info, const uint8_t* data, int len){
+esp_err_t HOT_PATH_ATTR send_message(const uint8_t *data, size_t size){
+    return send_message_tagged(data, size, new_send_token());
+}
+
+// Send to every device in range on the current channel, unencrypted and without a frame counter
+esp_err_t send_broadcast(const uint8_t *data, size_t size){
+    return transport->send(broadcast_mac, data, size, SEND_TOKEN_NONE);
+}
+
+// Send a SYN / SYNACK / ACK, attaching a pending output report if the application has one
+static esp_err_t send_handshake(uint8_t msg_type){
+    espnow_msg_handshake_t handshake = { .msg_type = msg_type };
+    size_t size = sizeof(handshake.msg_type);
+    if (handshake_piggyback_cb(&handshake.output))
+        size = sizeof(handshake);
+    return send_message((uint8_t*)&handshake, size);
+}
+
+// Hand a piggybacked output report to the application as if it arrived on its own
+static void process_handshake_payload(const uint8_t* data, int len){
+    const espnow_msg_handshake_t* handshake = (const espnow_msg_handshake_t*)data;
+    if (len >= (int)sizeof(*handshake) && handshake->output.msg_type == ESPNOW_MSG_OUTPUT)
+        process_message_cb((const espnow_message_t*)&handshake->output);
+}
+
+// Link reports are for the power controller, everything else for the application
+static void HOT_PATH_ATTR deliver_message(const espnow_message_t* msg){
+#if CONFIG_WIRELESS_TX_POWER_CONTROL
+    if (msg->msg_type == ESPNOW_MSG_LINK_REPORT){
+        process_link_report(&msg->link_report_msg);
+        return;
+    }
+#endif
+    process_message_cb(msg);
+}
+
+// Unpack a bundle, handing each message over as if it arrived in its own frame
+static void HOT_PATH_ATTR process_bundle(const uint8_t* data, int len){
+    const espnow_msg_bundle_t* bundle = (const espnow_msg_bundle_t*)data;
+    int offset = sizeof(*bundle);
+    for (int i = 0; i < bundle->count && offset < len; i++){
+        uint8_t entry_len = data[offset++];
+        if (entry_len < 1 || entry_len > sizeof(espnow_message_t) || offset + entry_len > len)
+            return;
+        // Entries are unaligned and may be shorter than their message type; handlers read
+        // whole structs, so each gets a zeroed copy
+        espnow_message_t msg = {0};
+        memcpy(&msg, data + offset, entry_len);
+        // Bundles only carry application messages, and no firmware chunks
+        if (msg.msg_type != ESPNOW_MSG_BUNDLE && msg.msg_type != ESPNOW_MSG_SYN &&
+            msg.msg_type != ESPNOW_MSG_SYNACK && msg.msg_type != ESPNOW_MSG_ACK &&
+            msg.msg_type != ESPNOW_MSG_OTA_CHUNK)
+            deliver_message(&msg);
+        offset += entry_len;
+    }
+}
+
+// Every frame the transport receives
+static void HOT_PATH_ATTR receive_frame(const transport_rx_info_t* info, const uint8_t* data, int len){
     // Drop bad message format
     #if DEBUG_WIFI
     ESP_LOGI(TAG, "A Message has been Received");
     #endif
-    // Ignore malformed report
-    if (len < 1 || len > sizeof(espnow_message_t))
-        return;
-    if (paired_status == TRISTATE_TRUE && is_recognized_sender(recv_info->src_addr)){
-        switch (((espnow_message_t*)data)->msg_type){
-            case ESPNOW_MSG_SYN:
-                static const espnow_msg_blank_t synack = { .msg_type = ESPNOW_MSG_SYNACK };
-                send_message((uint8_t*)&synack, sizeof(synack));
-                break;
-            case ESPNOW_MSG_SYNACK:
-                static const espnow_msg_blank_t ack = { .msg_type = ESPNOW_MSG_ACK };
-                if (send_message((uint8_t*)&ack, sizeof(ack)) == ESP_OK)
-                    set_connection_status(TRISTATE_TRUE);
-                break;
-            case ESPNOW_MSG_ACK:
-                break;
-            default:
-                process_message_cb((espnow_message_t*)data);
-                break;
-        }
+    if (len < 1)
+        return;
+    // Pairing frames may come from anyone; pairing.c decides whether they are wanted
+    if (is_pairing_frame(data, len)){
+        process_pairing_frame(info, data, len);
+        return;
     }
-    else if (paired_status == TRISTATE_FALSE){
-        switch (((espnow_message_t*)data)->msg_type){
-            case ESPNOW_MSG_PAIR_REQUEST:
-                static const espnow_msg_blank_t pair_request = { .msg_type = ESPNOW_MSG_PAIR_REQUEST };
-                if (send_message((uint8_t*)&pair_request, sizeof(pair_request)) == ESP_OK)
-                break;
-        }
+#if CONFIG_WIRELESS_RELAY
+    // Relays announce themselves, and carry the peer's frames when it cannot reach us
+    if (data[0] == ESPNOW_MSG_RELAY_BEACON){
+        note_relay(info);
+        return;
+    }
+    if (data[0] == ESPNOW_MSG_RELAY){
+        receive_relayed(data, len);
+        return;
     }
+#endif
+    if (paired_status != TRISTATE_TRUE || !is_recognized_sender(info->src_addr))
+        return;
+    measure_rssi(info->rssi);
+    process_peer_frame(data, len);
 }
 
-// ESP-NOW Callbacks
-// ESP-NOW send callback -- invoked when data is sent
-static void espnow_send_cb(const wifi_tx_info_t* tx_info, esp_now_send_status_t status){
-    #if (DEBUG_WIFI)
-        if (status == (esp_now_send_status_t)WIFI_SEND_SUCCESS) ESP_LOGI(TAG, "Message Sent Successfully");
-        else ESP_LOGI(TAG, "Message Failed to Send");
-    #else
-        (void)status;
-    #endif
-    (void)tx_info;
+// A frame from the peer, direct or unwrapped from a relay
+static void HOT_PATH_ATTR process_peer_frame(const uint8_t* data, int len){
+#if CONFIG_WIRELESS_LINK_ENCRYPTION
+    // Strip the frame counter and drop anything already seen
+    if (link_secured){
+        uint32_t counter;
+        if (len < 1 + ESPNOW_COUNTER_LEN)
+            return;
+        len -= ESPNOW_COUNTER_LEN;
+        memcpy(&counter, data + len, ESPNOW_COUNTER_LEN);
+        if (!link_accept_rx_counter(counter))
+            return;
+    }
+#endif
+    // Ignore malformed report
+    if (len < 1 || len > ESPNOW_BUNDLE_MAX_LEN)
+        return;
+    if (len > (int)sizeof(espnow_message_t) && data[0] != ESPNOW_MSG_BUNDLE && data[0] != ESPNOW_MSG_OTA_CHUNK)
+        return;
+    switch (((espnow_message_t*)data)->msg_type){
+        case ESPNOW_MSG_SYN:
+            process_handshake_payload(data, len);
+            send_handshake(ESPNOW_MSG_SYNACK);
+            break;
+        case ESPNOW_MSG_SYNACK:
+            process_handshake_payload(data, len);
+            if (send_handshake(ESPNOW_MSG_ACK) == ESP_OK)
+                set_connection_status(TRISTATE_TRUE);
+            break;
+        case ESPNOW_MSG_ACK:
+            process_handshake_payload(data, len);
+            break;
+        case ESPNOW_MSG_BUNDLE:
+            if (len >= (int)sizeof(espnow_msg_bundle_t))
+                process_bundle(data, len);
+            break;
+        case ESPNOW_MSG_LINK_PROBE:
+            break;      // only its MAC ack matters
+        case ESPNOW_MSG_OTA_CHUNK:
+            // Handed over in place, so its length is checked against the frame
+            if (len >= (int)offsetof(espnow_msg_ota_chunk_t, data) &&
+                ((const espnow_msg_ota_chunk_t*)data)->len <= len - (int)offsetof(espnow_msg_ota_chunk_t, data))
+                deliver_message((espnow_message_t*)data);
+            break;
+        default:
+            deliver_message((espnow_message_t*)data);
+            break;
+    }
 }
 
 static void connection_timer_cb(void* arg){
@@ -96,37 +714,72 @@ static void connection_timer_cb(void* arg){
 }
 
 // Keep connection_status up-to-date
-static void connection_task(void* arg){
-    const esp_timer_create_args_t timer_args = {
-        .callback = connection_timer_cb,
-        .arg = NULL
-    };
-    esp_timer_create(&timer_args, &connection_timer);
+static void heartbeat_timer_cb(void* arg){
+    // wait for timer to finish before checking connection
+    if (service_timer_is_active(connection_timer))
+        return;
+    // No point in checking connection if device is not yet paired
+    if (paired_status != TRISTATE_TRUE)
+        return;
+    // begin handshake
+    send_handshake(ESPNOW_MSG_SYN);
+    service_timer_start_once(connection_timer, CONNECTION_TIMEOUT_US);
+}
 
-    while(true){
-        vTaskDelay(pdMS_TO_TICKS(UPDATE_CONN_INTERVAL_MS));
-        // wait for timer to finish before checking connection
-        if (esp_timer_is_active(connection_timer))
-            continue;
-        // No point in checking connection if device is not yet paired
-        if (paired_status != TRISTATE_TRUE)
-            continue;
-        // begin handshake
-        static const espnow_msg_blank_t syn = { .msg_type = ESPNOW_MSG_SYN };
-        send_message((uint8_t*)&syn, sizeof(syn));
-        esp_timer_start_once(connection_timer, CONNECTION_TIMEOUT_US);
-    }
+// A cable going down is a lost connection now, not at the next heartbeat; coming up,
+// the handshake starts right away
+static void link_status_cb(bool up){
+    if (!up)
+        set_connection_status(TRISTATE_FALSE);
+    else
+        heartbeat_timer_cb(NULL);
+}
+
+// Initialize connection timers & maintain connection_status
+static void begin_connection_heartbeat(void){
+    service_timer_create(&connection_timer, "conn_timeout", connection_timer_cb, NULL);
+    service_timer_create_deferred(&heartbeat_timer, "conn_heartbeat", heartbeat_timer_cb, NULL);
+    service_timer_start_periodic(heartbeat_timer, heartbeat_interval_us);
+}
+
+// How often the connection is checked; a lost peer is noticed within this plus CONNECTION_TIMEOUT_US
+void set_keepalive_interval(uint64_t interval_us){
+    heartbeat_interval_us = interval_us;
+    if (heartbeat_timer)
+        service_timer_start_periodic(heartbeat_timer, heartbeat_interval_us);
+}
+
+// PHY rate for frames to the peer, kept across re-pairing; ignored by transports without one
+void set_link_rate(link_rate_t rate){
+    link_rate = rate;
+    if (transport && transport->set_rate && memcmp(peer_mac, broadcast_mac, 6) != 0)
+        transport->set_rate(peer_mac, link_rate);
 }
 
-// Initialize connection timer & maintain connection_status
-static void begin_connection_task(void){
-    xTaskCreate(connection_task, "connection_task", 4096, NULL, 3, NULL);
+// Radio TX power ceiling in 0.25 dBm steps (8 = 2 dBm ... 84 = 21 dBm)
+void set_link_tx_power(int8_t quarter_dbm){
+#if CONFIG_WIRELESS_TX_POWER_CONTROL
+    // The controller stays at or below it
+    if (power_task_handle){
+        portENTER_CRITICAL(&power_lock);
+        tx_power_set_ceiling(&power_ctl, quarter_dbm);
+        portEXIT_CRITICAL(&power_lock);
+        xTaskNotifyGive(power_task_handle);
+        return;
+    }
+#endif
+    if (transport && transport->set_tx_power && transport->set_tx_power(quarter_dbm) != ESP_OK)
+        ESP_LOGW(TAG, "TX power %d not accepted", quarter_dbm);
 }
 
-static void store_peer_mac(uint8_t mac[6]){
+// Remember the peer and the channel it was paired on
+static void store_peer(const uint8_t mac[6], uint8_t channel){
     nvs_handle_t nvs_handle;
-    nvs_open("storage", NVS_READWRITE, &nvs_handle);
+    if (nvs_open("storage", NVS_READWRITE, &nvs_handle) != ESP_OK)
+        return;
     nvs_set_blob(nvs_handle, PEER_MAC_STORAGE_KEY, mac, 6);
+    nvs_set_u8(nvs_handle, PEER_CHANNEL_STORAGE_KEY, channel);
+    nvs_commit(nvs_handle);
     nvs_close(nvs_handle);
 }
 // Initialize non-volitile storage for ESPNOW and Saved Config
@@ -146,72 +799,126 @@ void set_paired_status(tristate_bool_t status){
     }
 }
 
-void register_peer(uint8_t mac[6]){
-    esp_now_peer_info_t peer_info = {
-        .channel = 0,
-        .ifidx = ESP_IF_WIFI_STA,
-        .encrypt = false
-    };
-    memcpy(peer_info.peer_addr, mac, 6);
+// ESP_ERR_NOT_FOUND without a link key for mac (encrypted builds only pair with one)
+esp_err_t register_peer(uint8_t mac[6]){
+    const uint8_t* lmk = NULL;
+    bool encrypted = false;
+#if CONFIG_WIRELESS_LINK_ENCRYPTION
+    uint8_t link_key[LINK_KEY_LEN];
+    if (get_link_key(mac, link_key) != ESP_OK)
+        return ESP_ERR_NOT_FOUND;
+    lmk = link_key;
+#if CONFIG_WIRELESS_RELAY
+    if (lmk && link_set_relay_key(lmk) != ESP_OK)
+        ESP_LOGW(TAG, "Relayed frames cannot be sealed");
+#endif
+#endif
     memcpy(peer_mac, mac, 6);
-    ESP_ERROR_CHECK(esp_now_add_peer(&peer_info));
+    ESP_ERROR_CHECK(transport->add_peer(mac, lmk, &encrypted));
+    link_secured = encrypted;
+    if (transport->set_rate)
+        transport->set_rate(mac, link_rate);
+    if (!link_secured)
+        ESP_LOGW(TAG, "Link to " MACSTR " is not encrypted", MAC2STR(mac));
+    return ESP_OK;
+}
+
+bool is_link_encrypted(void){
+    return link_secured;
+}
+
+// Channel 0 (or a transport without channels) leaves it alone
+static void set_channel(uint8_t channel){
+    if (channel && transport->set_channel)
+        ESP_ERROR_CHECK(transport->set_channel(channel));
 }
 
-// Registers mac address saved in NVS as a peer
-// If no address is found, the broadcast address will be registered instead 
-static void set_peer_if_exists(void){
+// Registers the peer saved in NVS on its channel
+// Returns false (and stays unpaired) if there is none
+bool restore_saved_peer(void){
     nvs_handle_t nvs_handle;
+    uint8_t saved_peer_mac[6];
+    uint8_t channel = CONFIG_WIRELESS_CHANNEL;
+    bool found = false;
     if (nvs_open("storage", NVS_READONLY, &nvs_handle) == ESP_OK){
-        uint8_t saved_peer_mac[6];
-        size_t data_len;
-        if (nvs_get_blob(nvs_handle, PEER_MAC_STORAGE_KEY, saved_peer_mac, &data_len)){
-            register_peer(saved_peer_mac);
-            set_paired_status(TRISTATE_TRUE);
-        }
+        size_t data_len = sizeof(saved_peer_mac);
+        found = nvs_get_blob(nvs_handle, PEER_MAC_STORAGE_KEY, saved_peer_mac, &data_len) == ESP_OK && data_len == 6;
+        nvs_get_u8(nvs_handle, PEER_CHANNEL_STORAGE_KEY, &channel);
+        nvs_close(nvs_handle);
     }
-    if (paired_status != TRISTATE_TRUE){
-        register_peer(peer_mac);
+    set_channel(channel);
+    if (!found){
         set_paired_status(TRISTATE_FALSE);
+        return false;
     }
-    if (nvs_handle)
-        nvs_close(nvs_handle);
+    if (register_peer(saved_peer_mac) != ESP_OK){
+        ESP_LOGE(TAG, "No link key for " MACSTR ", pair again", MAC2STR(saved_peer_mac));
+        set_paired_status(TRISTATE_FALSE);
+        return false;
+    }
+    set_paired_status(TRISTATE_TRUE);
+    return true;
 }
 
-static void pairing_task(void* arg){
-    espnow_msg_blank_t pair_request = { .msg_type = ESPNOW_MSG_PAIR_REQUEST };
-    while (!paired_status){
-        vTaskDelay(pdMS_TO_TICKS(5000));
-        send_message((uint8_t*)&pair_request, sizeof(pair_request));
+// Stop talking to the peer without forgetting it (pairing in progress)
+void release_peer(void){
+    if (memcmp(peer_mac, broadcast_mac, 6) != 0)
+        transport->del_peer(peer_mac);
+    link_secured = false;
+    memcpy(peer_mac, broadcast_mac, 6);
+#if CONFIG_WIRELESS_RELAY
+    via_relay = false;
+    relay_rx_window = (replay_window_t){0};
+#endif
+    set_connection_status(TRISTATE_FALSE);
+    set_paired_status(TRISTATE_FALSE);
+}
+
+// Forget the peer; the device stays unpaired until pairing finds a new one
+void unpair(void){
+    nvs_handle_t nvs_handle;
+    release_peer();
+    if (nvs_open("storage", NVS_READWRITE, &nvs_handle) == ESP_OK){
+        nvs_erase_key(nvs_handle, PEER_MAC_STORAGE_KEY);
+        nvs_erase_key(nvs_handle, PEER_CHANNEL_STORAGE_KEY);
+        nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
     }
-    vTaskDelete(NULL);
+    forget_link_key();
 }
 
-void begin_pairing_task(void){
-    xTaskCreate(pairing_task, "pairing task", 4096, NULL, 3, NULL);
+// Called by pairing once both sides confirmed the link key (already stored)
+void set_new_peer(uint8_t mac[6], uint8_t channel){
+    release_peer();
+    store_peer(mac, channel);
+    set_channel(channel);
+    if (register_peer(mac) != ESP_OK){
+        ESP_LOGE(TAG, "No link key for " MACSTR, MAC2STR(mac));
+        return;
+    }
+    set_paired_status(TRISTATE_TRUE);
 }
 
-// Initializes NVS, WIFI, ESP-NOW, and connects to peer
-void start_espnow(void){
-    // NVS preferred by ESP_NOW
+// Initializes NVS and the transport, and connects to the saved peer
+void start_link(void){
+    // Peer, link key and frame counters live in NVS
     ESP_ERROR_CHECK(start_nvs());
-    
-    // Initialize WiFi (required for ESP-NOW)
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_start());
-    
-    // Set long range mode (better range at the cost of speed)
-    ESP_ERROR_CHECK(esp_wifi_set_protocol(ESP_IF_WIFI_STA, WIFI_PROTOCOL_11B|WIFI_PROTOCOL_11G|WIFI_PROTOCOL_11N|WIFI_PROTOCOL_LR));
-    
-    // Initialize ESP-NOW & Register Callbacks
-    ESP_ERROR_CHECK(esp_now_init());
-    ESP_ERROR_CHECK(esp_now_register_recv_cb(espnow_recv_cb));
-    ESP_ERROR_CHECK(esp_now_register_send_cb(espnow_send_cb));
-    set_peer_if_exists();
-    begin_connection_task();
-}
 
+    transport = get_transport();
+    ESP_ERROR_CHECK(transport->start(receive_frame, send_completed, link_status_cb));
+    ESP_LOGI(TAG, "Link over %s", transport->name);
+#if CONFIG_WIRELESS_TX_POWER_CONTROL
+    init_tx_power_control();
+#endif
+#if CONFIG_WIRELESS_RELAY
+    init_relay();
+#endif
+#if CONFIG_WIRELESS_IMPAIRMENT
+    init_impairment();
+#endif
+#if CONFIG_WIRELESS_LINK_ENCRYPTION
+    ESP_ERROR_CHECK(init_link_security());
+#endif
+    restore_saved_peer();
+    begin_connection_heartbeat();
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "esp_err.h"
+#include "esp_timer.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Deadline-driven work shared by both apps.
+// Timers from service_timer_create() are dispatched from the single esp_timer task, so
+// their callbacks must be short and must never block (queue sends with 0 timeout,
+// notifies, GPIO). Anything more (logging, sending frames, peer table changes) belongs
+// on a timer from service_timer_create_deferred().
+
+typedef esp_timer_handle_t service_timer_t;
+typedef void (*service_timer_cb_t)(void* arg);
+
+// Create a stopped timer; name shows up in esp_timer_dump()
+esp_err_t service_timer_create(service_timer_t* timer, const char* name, service_timer_cb_t cb, void* arg);
+
+// Like service_timer_create(), but cb runs on the timer service's own task, where it may
+// block. A callback still waiting to run when its timer fires again runs once, and
+// cancelling the timer does not withdraw one already handed to the task.
+esp_err_t service_timer_create_deferred(service_timer_t* timer, const char* name, service_timer_cb_t cb, void* arg);
+
+// Fire once after timeout_us, restarting the deadline if already armed
+esp_err_t service_timer_start_once(service_timer_t timer, uint64_t timeout_us);
+
+// Fire every period_us, restarting the period if already armed
+esp_err_t service_timer_start_periodic(service_timer_t timer, uint64_t period_us);
+
+// Cancel a pending timer; cancelling an idle timer is not an error
+esp_err_t service_timer_cancel(service_timer_t timer);
+
+bool service_timer_is_active(service_timer_t timer);
@@ -0,0 +1,57 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Link impairment model (CONFIG_WIRELESS_IMPAIRMENT): decides the fate of each frame --
+// Gilbert-Elliott burst loss, a delay drawn from a distribution, reordering by holding
+// frames back, and duplication -- from a seeded RNG, so a run can be repeated exactly.
+// Plain C without ESP-IDF dependencies so it also builds for the linux target;
+// wifi.c applies it to every frame sent to the peer.
+
+#define IMPAIRMENT_SCALE 10000      // probabilities are per IMPAIRMENT_SCALE frames
+#define IMPAIRMENT_MAX_COPIES 2
+
+typedef enum {
+    IMPAIRMENT_DELAY_UNIFORM,       // delay_us + [0, jitter_us)
+    IMPAIRMENT_DELAY_EXPONENTIAL,   // delay_us + exponential with mean jitter_us
+    IMPAIRMENT_DELAY_NORMAL         // delay_us + |normal| with std dev jitter_us
+} impairment_delay_dist_t;
+
+typedef struct {
+    uint32_t seed;
+    // Gilbert-Elliott: state changes per frame, and the loss rate in each state.
+    // Mean burst length is IMPAIRMENT_SCALE / bad_to_good frames; the long-run loss
+    // is loss_bad * good_to_bad / (good_to_bad + bad_to_good) with loss_good = 0.
+    uint16_t good_to_bad;
+    uint16_t bad_to_good;
+    uint16_t loss_good;
+    uint16_t loss_bad;
+    uint32_t delay_us;
+    uint32_t jitter_us;
+    impairment_delay_dist_t delay_dist;
+    uint16_t reorder;               // held back an extra reorder_us, behind later frames
+    uint32_t reorder_us;
+    uint16_t duplicate;             // second copy, after its own delay
+} impairment_config_t;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t lost;
+    uint32_t reordered;
+    uint32_t duplicated;
+} impairment_stats_t;
+
+typedef struct {
+    impairment_config_t config;
+    uint64_t rng;
+    bool bad;                       // Gilbert-Elliott state
+    impairment_stats_t stats;
+} impairment_t;
+
+void impairment_init(impairment_t* link, const impairment_config_t* config);
+
+// Fate of one frame: number of copies delivered (0 = lost) and the delay of each
+int impairment_apply(impairment_t* link, uint32_t delay_us[IMPAIRMENT_MAX_COPIES]);
+
+// Next value of the link's RNG
+uint32_t impairment_random(impairment_t* link);
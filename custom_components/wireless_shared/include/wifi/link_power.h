@@ -0,0 +1,52 @@
+#pragma once
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Power management around input (CONFIG_WIRELESS_POWER_MANAGEMENT). While input flows
+// the device holds esp_pm locks -- CPU and APB at their maximum -- and keeps the radio
+// out of modem sleep, so frequency scaling and WiFi power save add nothing to the
+// input path. After idle_release_us without input the locks are released and modem
+// sleep is allowed; the next input takes the locks back at once, and the radio is
+// woken from a task (esp_wifi calls must stay out of the WiFi task).
+//
+// What idling costs is measured per mode and logged every minute:
+//  - wake-up: from the first input after idle until the radio is awake again
+//  - send: from handing a frame to the transport until its send completed (the MAC
+//    ack), split by whether the radio was awake or dozing when it went out
+
+#if CONFIG_WIRELESS_POWER_MANAGEMENT
+typedef enum {
+    LINK_POWER_ACTIVE,          // locks held, radio awake
+    LINK_POWER_IDLE,            // locks released, modem sleep allowed
+    NUM_LINK_POWER_MODES
+} link_power_mode_t;
+
+typedef struct {
+    uint32_t wakes;
+    uint64_t wake_sum_us;
+    uint32_t wake_max_us;
+    uint32_t sends[NUM_LINK_POWER_MODES];
+    uint64_t send_sum_us[NUM_LINK_POWER_MODES];
+    uint32_t send_max_us[NUM_LINK_POWER_MODES];
+} link_power_stats_t;
+
+// Starts active; idle_release_us of 0 holds the locks for good. After start_link()
+esp_err_t init_link_power(uint64_t idle_release_us);
+
+// Change the idle period (performance profiles); 0 wakes an idle device
+void set_link_power_idle(uint64_t idle_release_us);
+
+// Every input report; any task or the receive callback
+void link_power_note_input(void);
+
+link_power_mode_t get_link_power_mode(void);
+void get_link_power_stats(link_power_stats_t* stats);
+void log_link_power_stats(void);
+
+// From wifi.c: a frame to the peer went to the transport under its send token, and the
+// send with that token completed; completions may come in any order
+void link_power_frame_queued(uint32_t token);
+void link_power_frame_sent(uint32_t token, bool success);
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+#include "esp_err.h"
+#include "wifi/transport.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Encryption and replay protection for the link between paired devices
+// (CONFIG_WIRELESS_LINK_ENCRYPTION).
+//
+// Over ESP-NOW, frames to and from the paired peer are encrypted with CCMP, done by the
+// WiFi MAC hardware, under a per-peer LMK agreed by an X25519 exchange while pairing and
+// bound to the PMK (menuconfig); transports that cannot encrypt (a cable, UDP) still
+// agree the key for pairing. Every such
+// frame also ends with the sender's 32-bit frame counter (ESPNOW_COUNTER_LEN) that the
+// receiver checks against a sliding window, so a recorded frame cannot be played back.
+// Counters are reserved in NVS a block at a time and never repeat across reboots; the
+// replay floor is saved the same way and raised a block at boot.
+
+#define LINK_REPLAY_WINDOW 64   // How far a frame may arrive behind the newest one
+#define LINK_COUNTER_BLOCK (1UL << 18)  // Counters reserved per NVS write, ~4 min at 1 kHz
+#define LINK_KEY_LEN TRANSPORT_KEY_LEN
+#define LINK_ECDH_KEY_LEN 32            // X25519 keys and shared secret
+#define LINK_TRANSCRIPT_MAX_LEN 128     // Pairing nonces and public keys
+
+typedef struct {
+    uint32_t highest;   // newest counter accepted
+    uint64_t seen;      // bit n: highest - n was accepted
+} replay_window_t;
+
+// Set the PMK and restore the frame counters; before the first peer is registered
+esp_err_t init_link_security(void);
+
+// Ephemeral X25519 key pair for one pairing exchange
+esp_err_t link_generate_keypair(uint8_t private_key[LINK_ECDH_KEY_LEN], uint8_t public_key[LINK_ECDH_KEY_LEN]);
+
+// LMK for a peer: from the X25519 secret shared with its public key, bound to the PMK,
+// both MACs and the pairing transcript (nonces and public keys). Fails on a public key
+// that forces a known secret.
+esp_err_t derive_link_key(const uint8_t private_key[LINK_ECDH_KEY_LEN], const uint8_t peer_public_key[LINK_ECDH_KEY_LEN],
+                          const uint8_t peer_mac[6], const uint8_t* transcript, size_t len, uint8_t lmk[LINK_KEY_LEN]);
+
+// Still the PMK every kit ships with: pairing is then unauthenticated
+bool link_pmk_is_default(void);
+
+// Keep the LMK agreed while pairing; a new peer starts with a fresh replay window
+esp_err_t store_link_key(const uint8_t peer_mac[6], const uint8_t lmk[LINK_KEY_LEN]);
+
+// Drop the stored LMK (unpair)
+void forget_link_key(void);
+
+// Pairing proof of the LMK: HMAC over role and transcript
+esp_err_t link_confirm_tag(const uint8_t lmk[LINK_KEY_LEN], uint8_t role, const uint8_t* transcript, size_t len, uint8_t* tag, size_t tag_len);
+
+// The LMK stored for peer_mac; ESP_ERR_NOT_FOUND if it was not paired with this firmware
+esp_err_t get_link_key(const uint8_t peer_mac[6], uint8_t lmk[LINK_KEY_LEN]);
+
+// Counter for the next outgoing frame; false once the reserved block is used up
+bool link_next_tx_counter(uint32_t* counter);
+
+// Jump the outgoing counters a block ahead, past the floor a rebooted peer starts at
+void link_skip_tx_counters(void);
+
+// True if counter has not been seen and is inside the window of the peer's frames
+bool link_accept_rx_counter(uint32_t counter);
+
+// Window check on its own, for any replay_window_t
+bool replay_window_accept(replay_window_t* window, uint32_t counter);
+
+// Frames through a relay are sealed end to end (the radio only encrypts each hop):
+// AES-CCM with an ESPNOW_RELAY_TAG_LEN tag under a key derived from the peer's LMK,
+// nonce from the sender's MAC and the frame's counter. Set the key with the peer.
+esp_err_t link_set_relay_key(const uint8_t lmk[LINK_KEY_LEN]);
+esp_err_t link_seal(const uint8_t sender_mac[6], uint32_t counter, const uint8_t* aad, size_t aad_len,
+                    const uint8_t* plain, uint8_t* sealed, size_t len, uint8_t* tag);
+// Only from the task receiving frames
+esp_err_t link_open(const uint8_t sender_mac[6], uint32_t counter, const uint8_t* aad, size_t aad_len,
+                    const uint8_t* sealed, uint8_t* plain, size_t len, const uint8_t* tag);
+
+// Per-frame cost of counter framing and key derivation, and of an application-layer
+// AES-CCM alternative on the AES peripheral (BENCHMARK)
+void benchmark_link_security(void);
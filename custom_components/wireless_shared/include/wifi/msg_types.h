@@ -14,9 +14,60 @@ typedef enum {
     ESPNOW_MSG_START_RTT,
     ESPNOW_MSG_END_RTT,
     ESPNOW_MSG_PAIR_REQUEST,
+    ESPNOW_MSG_OUTPUT,
+    ESPNOW_MSG_OUTPUT_ACK,
+    ESPNOW_MSG_DESC_INFO,
+    ESPNOW_MSG_DESC_REQUEST,
+    ESPNOW_MSG_DESC_CHUNK,
+    ESPNOW_MSG_DESC_READY,
+    ESPNOW_MSG_RAW_REPORT,
+    ESPNOW_MSG_BUNDLE,
+    ESPNOW_MSG_PAIR_RESPONSE,
+    ESPNOW_MSG_PAIR_CONFIRM,
+    ESPNOW_MSG_PROFILE,
+    ESPNOW_MSG_LINK_REPORT,
+    ESPNOW_MSG_RELAY,
+    ESPNOW_MSG_RELAY_BEACON,
+    ESPNOW_MSG_LINK_PROBE,
+    ESPNOW_MSG_OTA_BEGIN,
+    ESPNOW_MSG_OTA_CHUNK,
+    ESPNOW_MSG_OTA_ACK,
+    ESPNOW_MSG_MOUSE_POSITION,
     ESPNOW_MSG_BLANK
 } __espnow_msg_type_t;
 
+// Devices an output report (host -> device) is addressed to
+typedef enum {
+    OUTPUT_TARGET_KEYBOARD,  // Caps/Num/Scroll Lock LEDs
+    OUTPUT_TARGET_GAMEPAD,   // Rumble / force feedback
+    NUM_OUTPUT_TARGETS
+} __espnow_output_target_t;
+
+// Where the transmitter is with a firmware update
+typedef enum {
+    OTA_STATE_IDLE,
+    OTA_STATE_RECEIVING,
+    OTA_STATE_DONE,          // image verified and set to boot
+    OTA_STATE_FAILED
+} __espnow_ota_state_t;
+
+#define ESPNOW_OUTPUT_MAX_LEN 8
+#define ESPNOW_DESC_MAX_LEN 512     // Largest report descriptor accepted for passthrough
+#define ESPNOW_DESC_CHUNK_LEN 48
+#define ESPNOW_RAW_REPORT_MAX_LEN 32
+#define ESPNOW_PAIR_NONCE_LEN 16
+#define ESPNOW_PAIR_TAG_LEN 16
+#define ESPNOW_PAIR_KEY_LEN 32      // X25519 public key
+#define ESPNOW_FRAME_MAX_LEN 250    // ESP_NOW_MAX_DATA_LEN
+#define ESPNOW_COUNTER_LEN 4        // Frame counter ending every frame between paired devices
+#define ESPNOW_RELAY_TAG_LEN 8
+#define ESPNOW_RELAY_HEADER_LEN 28  // sizeof(espnow_msg_relay_t)
+// Leaves room for the relay header, so every frame can take the relayed path
+#define ESPNOW_BUNDLE_MAX_LEN (ESPNOW_FRAME_MAX_LEN - ESPNOW_COUNTER_LEN - ESPNOW_RELAY_HEADER_LEN)
+#define ESPNOW_OTA_HASH_LEN 32      // SHA-256
+#define ESPNOW_OTA_CHUNK_LEN 200    // Fits ESPNOW_BUNDLE_MAX_LEN with the chunk header
+#define ESPNOW_OTA_WINDOW 32        // Chunks in flight, one bit each in espnow_msg_ota_ack_t
+
 // Message types choose to follow HID spec as defined by HID.h
 typedef struct {
     uint8_t msg_type;   // ESPNOW_MSG_MOUSE
@@ -25,8 +76,24 @@ typedef struct {
     int8_t y;           // Vertical Movement Dy
     int8_t wheel;
     int8_t pan;
+    uint32_t timestamp_us; // Sender time of the newest motion in this message
 } espnow_msg_mouse_t;
 
+// Mouse with loss-tolerant motion: wrapping sums of every delta since the transmitter
+// started instead of the deltas, so the next message that arrives carries the motion of
+// any lost before it. Buttons sit where espnow_msg_mouse_t has them.
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_MOUSE_POSITION
+    uint8_t buttons;
+    uint16_t seq;       // Per message; a resent or late one the receiver already passed is dropped
+    uint32_t epoch;     // Random per transmitter boot; a new one means the counters started over
+    uint32_t x;
+    uint32_t y;
+    uint32_t wheel;
+    uint32_t pan;
+    uint32_t timestamp_us; // Sender time of the newest motion in this message
+} espnow_msg_mouse_position_t;
+
 typedef struct {
     uint8_t msg_type;   // ESPNOW_MSG_KEYBOARD
     uint8_t modifiers;  // Ctrl, Shift, Alt, etc.
@@ -46,6 +113,133 @@ typedef struct {
     uint32_t buttons;   // Buttons mask for currently pressed buttons
 } espnow_msg_gamepad_t;
 
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_OUTPUT
+    uint8_t target;     // __espnow_output_target_t
+    uint8_t seq;        // Echoed by ESPNOW_MSG_OUTPUT_ACK once applied
+    uint8_t len;
+    uint8_t data[ESPNOW_OUTPUT_MAX_LEN]; // Output report without its report ID
+} espnow_msg_output_t;
+
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_OUTPUT_ACK
+    uint8_t target;
+    uint8_t seq;
+} espnow_msg_output_ack_t;
+
+// Passthrough device announcement (TX -> RX) and descriptor-cached reply (RX -> TX)
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_DESC_INFO or ESPNOW_MSG_DESC_READY
+    uint16_t vid;
+    uint16_t pid;
+    uint16_t desc_len;
+    uint32_t crc;       // CRC-32 of the report descriptor
+} espnow_msg_desc_info_t;
+
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_DESC_REQUEST
+    uint16_t vid;       // 0:0 asks the transmitter to announce its passthrough device again
+    uint16_t pid;
+    uint16_t offset;    // Send the descriptor from this byte onwards
+} espnow_msg_desc_request_t;
+
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_DESC_CHUNK
+    uint16_t vid;
+    uint16_t pid;
+    uint16_t offset;
+    uint8_t len;
+    uint8_t data[ESPNOW_DESC_CHUNK_LEN];
+} espnow_msg_desc_chunk_t;
+
+// Input report of the passthrough device, exactly as the device sent it
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_RAW_REPORT
+    uint8_t len;
+    uint8_t data[ESPNOW_RAW_REPORT_MAX_LEN]; // Only len bytes are sent
+} espnow_msg_raw_report_t;
+
+// Several messages sharing one frame -- followed by count entries of [length][message]
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_BUNDLE
+    uint8_t count;
+} espnow_msg_bundle_t;
+
+// SYN / SYNACK / ACK -- may carry an output report so retransmits cost no extra frames
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_SYN, ESPNOW_MSG_SYNACK or ESPNOW_MSG_ACK
+    espnow_msg_output_t output; // Only present when the frame is longer than msg_type
+} espnow_msg_handshake_t;
+
+// Pairing (broadcast, unencrypted): request from the device scanning channels ...
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_PAIR_REQUEST
+    uint8_t nonce[ESPNOW_PAIR_NONCE_LEN];
+    uint8_t public_key[ESPNOW_PAIR_KEY_LEN];    // Ephemeral, new every pairing window
+} espnow_msg_pair_request_t;
+
+// ... answered by a device with its pairing window open ...
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_PAIR_RESPONSE
+    uint8_t request_nonce[ESPNOW_PAIR_NONCE_LEN]; // Echoed, so a stale response is ignored
+    uint8_t nonce[ESPNOW_PAIR_NONCE_LEN];
+    uint8_t public_key[ESPNOW_PAIR_KEY_LEN];
+} espnow_msg_pair_response_t;
+
+// ... and each side proves it derived the same link key from the X25519 exchange
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_PAIR_CONFIRM
+    uint8_t tag[ESPNOW_PAIR_TAG_LEN];
+} espnow_msg_pair_confirm_t;
+
+// Performance profile chosen on the transmitter (wifi/perf_profile.h)
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_PROFILE
+    uint8_t profile;    // perf_profile_id_t
+} espnow_msg_profile_t;
+
+// How well the peer's frames arrive, so it can trim its TX power (wifi/tx_power_control.h)
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_LINK_REPORT
+    int8_t rssi;        // dBm, mean over the frames since the last report
+    uint8_t frames;     // frames it was measured on (saturates at 255)
+} espnow_msg_link_report_t;
+
+// A frame between paired devices carried by a relay (wifi/relay.h), followed by the
+// frame itself -- sealed end to end when the link is encrypted
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_RELAY
+    uint8_t origin[6];
+    uint8_t dest[6];
+    uint32_t seq;       // the counter of the frame inside; repeats are dropped
+    uint8_t hops;       // relays passed, updated on the way
+    uint16_t relay_us;  // time spent inside relays, updated on the way
+    uint8_t tag[ESPNOW_RELAY_TAG_LEN]; // AES-CCM tag over the header up to seq and the frame
+} espnow_msg_relay_t;
+
+// Firmware update of the transmitter, streamed to it by the receiver
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_OTA_BEGIN
+    uint32_t size;      // Image bytes
+    uint8_t sha256[ESPNOW_OTA_HASH_LEN];
+} espnow_msg_ota_begin_t;
+
+// Larger than espnow_message_t, like a bundle, so never queued; only len data bytes are sent
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_OTA_CHUNK
+    uint32_t index;     // Image offset / ESPNOW_OTA_CHUNK_LEN
+    uint8_t len;
+    uint8_t data[ESPNOW_OTA_CHUNK_LEN];
+} espnow_msg_ota_chunk_t;
+
+// Selective ack: everything before written is in flash, received shows what is held after it
+typedef struct {
+    uint8_t msg_type;   // ESPNOW_MSG_OTA_ACK
+    uint8_t state;      // __espnow_ota_state_t
+    uint32_t written;   // Chunks written
+    uint32_t received;  // Bit i set: chunk written + i is held, waiting for the ones before it
+} espnow_msg_ota_ack_t;
+
 typedef struct {
     uint8_t msg_type;   // (ESPNOW_MSG_BLANK)
 } espnow_msg_blank_t;
@@ -54,8 +248,24 @@ typedef struct {
 typedef union {
     uint8_t msg_type; // Acts as a header
     espnow_msg_mouse_t mouse_msg;
+    espnow_msg_mouse_position_t mouse_position_msg;
     espnow_msg_keyboard_t keyboard_msg;
     espnow_msg_gamepad_t gamepad_msg;
+    espnow_msg_output_t output_msg;
+    espnow_msg_output_ack_t output_ack_msg;
+    espnow_msg_handshake_t handshake_msg;
+    espnow_msg_desc_info_t desc_info_msg;
+    espnow_msg_desc_request_t desc_request_msg;
+    espnow_msg_desc_chunk_t desc_chunk_msg;
+    espnow_msg_raw_report_t raw_report_msg;
+    espnow_msg_pair_request_t pair_request_msg;
+    espnow_msg_pair_response_t pair_response_msg;
+    espnow_msg_pair_confirm_t pair_confirm_msg;
+    espnow_msg_profile_t profile_msg;
+    espnow_msg_link_report_t link_report_msg;
+    espnow_msg_relay_t relay_msg;
+    espnow_msg_ota_begin_t ota_begin_msg;
+    espnow_msg_ota_ack_t ota_ack_msg;
     espnow_msg_blank_t blank_msg;
 } espnow_message_t;
 
@@ -0,0 +1,33 @@
+#pragma once
+#include "esp_err.h"
+#include "wifi/transport.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Pairing without MAC addresses: the initiator (transmitter) hops through the WiFi
+// channels broadcasting a nonce and an ephemeral X25519 public key until a responder
+// (receiver) with its pairing window open answers with its own. Both derive the link
+// key from the X25519 shared secret and the PMK, prove it to each other with a confirm
+// tag over the whole exchange, and store the peer, key and channel in NVS. With the
+// default PMK the exchange is unauthenticated, and an error is logged.
+//
+// Started by holding the pairing button (CONFIG_WIRELESS_PAIRING_BUTTON_GPIO), by the
+// application (transmitter hotkey), or automatically while a device has no saved peer.
+// A paired device keeps its old peer if no new one is found within the window.
+
+typedef enum {
+    PAIRING_INITIATOR,  // scans channels
+    PAIRING_RESPONDER   // listens on its own channel
+} pairing_role_t;
+
+// Create the pairing task and watch the button; before start_link()
+esp_err_t init_pairing(pairing_role_t role);
+
+// Open a pairing window; safe from any task or timer callback
+void begin_pairing(void);
+
+bool is_pairing(void);
+
+// Pairing frames are broadcast without a frame counter -- routed here by wifi.c
+bool is_pairing_frame(const uint8_t* data, int len);
+void process_pairing_frame(const transport_rx_info_t* info, const uint8_t* data, int len);
@@ -0,0 +1,46 @@
+#pragma once
+#include "esp_err.h"
+#include "wifi/transport.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Named bundles of the latency / power trade-offs, switched at runtime without a
+// reboot. The transmitter picks the profile (keyboard hotkey) and sends it to the
+// receiver (ESPNOW_MSG_PROFILE); both keep it in NVS.
+//
+// Link settings (PHY rate, TX power, keepalive) are applied here; the rest is up to
+// each application in perf_profile_applied_cb(), called from the profile task.
+
+typedef enum {
+    PERF_PROFILE_COMPETITIVE,   // lowest latency, full power, no sleep
+    PERF_PROFILE_OFFICE,        // robust rate, motion coalesced, smoothed playout
+    PERF_PROFILE_BATTERY,       // reduced TX power, long keepalive, early sleep
+    NUM_PERF_PROFILES
+} perf_profile_id_t;
+
+#define PERF_PROFILE_DEFAULT PERF_PROFILE_COMPETITIVE   // until one is chosen
+
+typedef struct {
+    const char* name;
+    link_rate_t rate;
+    int8_t tx_power;            // 0.25 dBm steps
+    uint32_t keepalive_us;      // connection heartbeat
+    uint32_t coalesce_us;       // transmitter: how long mouse motion may wait to share a frame
+    uint32_t light_sleep_s;     // transmitter idle tiers, 0 = never
+    uint32_t deep_sleep_s;
+    uint32_t power_idle_ms;     // transmitter: input-free time before power locks are released, 0 = never
+    bool jitter_buffer;         // receiver: mouse playout buffer
+} perf_profile_t;
+
+// Apply the saved profile; after start_link()
+esp_err_t init_perf_profile(void);
+
+// Switch profiles; safe from any task and from the receive callback. The profile task
+// applies it at once (ahead of the device tasks) and saves it afterwards.
+void set_perf_profile(perf_profile_id_t id);
+
+// Cycle to the next profile (hotkey)
+void next_perf_profile(void);
+
+perf_profile_id_t get_perf_profile_id(void);
+const perf_profile_t* get_perf_profile(void);
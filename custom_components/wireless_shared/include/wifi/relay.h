@@ -0,0 +1,51 @@
+#pragma once
+#include "wifi/link_security.h"
+#include "wifi/msg_types.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Relays (wireless_relay-2.0) extend the range of a paired transmitter and receiver
+// that cannot reach each other reliably (CONFIG_WIRELESS_RELAY).
+//  - A relay sits on the pair's channel and broadcasts ESPNOW_MSG_RELAY_BEACON.
+//  - Each device sends direct while the direct link works. After RELAY_FAILOVER_FAILS
+//    failed sends in a row it wraps frames in ESPNOW_MSG_RELAY and sends them to the
+//    relay, which forwards them to the destination straight from its receive callback.
+//  - Meanwhile a probe goes direct every RELAY_PROBE_INTERVAL_US; RELAY_RECOVER_PROBES
+//    acked in a row and the device is back on the direct link.
+// The radio encrypts each hop on its own, so the relayed frame is sealed end to end
+// (AES-CCM, link_seal()) and the relay only sees the header; a device without an
+// encrypted link neither relays nor takes relayed frames. The header's seq is the
+// frame counter of the frame inside, so it never repeats, across reboots either.
+// Pairing still needs both devices in range of each other once.
+
+#define RELAY_BEACON_INTERVAL_US (500000ULL)
+#define RELAY_TIMEOUT_US (2000000LL)        // a relay not heard from for this long is gone
+#define RELAY_PROBE_INTERVAL_US (500000ULL)
+#define RELAY_FAILOVER_FAILS 3
+#define RELAY_RECOVER_PROBES 2
+#define RELAY_HOP_BUDGET_US 1000            // latency a relay may add per hop
+
+typedef struct {
+    uint32_t failovers;         // switches to the relay
+    uint32_t recoveries;        // switches back to the direct link
+    uint32_t relayed_tx;
+    uint32_t relayed_rx;
+    uint32_t duplicates;
+    uint32_t relay_us_max;      // time inside relays, from the frames received
+    uint64_t relay_us_sum;
+} relay_stats_t;
+
+// Authenticated along with the frame; hops and relay_us change on the way
+#define RELAY_AAD_LEN offsetof(espnow_msg_relay_t, hops)
+
+// Duplicate check on a relay sequence number. One far behind the newest means the
+// sender lost its counters; only an authenticated frame may start the window again
+// there, or a forged header could reopen it for old frames.
+bool relay_seq_accept(replay_window_t* window, uint32_t seq, bool authenticated);
+
+// Open a relayed frame of len bytes from origin into frame: the frame inside, counter
+// included, if the header names origin and the seal authenticates; -1 otherwise.
+// Unsealed frames never open. From the task receiving frames (link_open()).
+int relay_open(const uint8_t origin[6], const uint8_t* data, int len, uint8_t frame[ESPNOW_FRAME_MAX_LEN],
+               espnow_msg_relay_t* header);
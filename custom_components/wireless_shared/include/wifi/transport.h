@@ -0,0 +1,69 @@
+#pragma once
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// How frames get between the two devices (CONFIG_WIRELESS_TRANSPORT). wifi.c runs the
+// same protocol -- pairing, handshake heartbeat, frame counters, bundles -- over
+// whichever transport is built in:
+//  - ESP-NOW: the radio link (default)
+//  - UART: a cable between the boards at a high baud rate, for seats where a wire is
+//    acceptable; no air time, retries or channel contention in the latency
+//  - UDP: sockets on the linux target, so the whole stack runs on a workstation
+// Every transport addresses devices by a 6-byte address (the MAC, or a stand-in).
+
+#define TRANSPORT_ADDR_LEN 6
+#define TRANSPORT_KEY_LEN 16
+
+// PHY rate policy for frames to the peer
+typedef enum {
+    LINK_RATE_DEFAULT,          // ESP-NOW's 1 Mbps 802.11b: most robust
+    LINK_RATE_FAST              // 24 Mbps 802.11g: a fraction of the air time, needs a clean channel
+} link_rate_t;
+
+typedef struct {
+    const uint8_t* src_addr;
+    uint8_t channel;            // WiFi channel the frame arrived on, 0 where there is none
+    int8_t rssi;                // dBm, 0 where there is none
+} transport_rx_info_t;
+
+// A send nobody waits on: no completion is reported for it
+#define TRANSPORT_TOKEN_NONE 0
+
+// Every received frame, from the transport's receive task / callback; must not block
+typedef void (*transport_recv_cb_t)(const transport_rx_info_t* info, const uint8_t* data, int len);
+// Completion of a send, with the token it was sent under; addr is where it went. Every
+// transport reports exactly one per accepted send with a token, in whatever order the
+// frames complete, and none for a send() that failed.
+typedef void (*transport_send_cb_t)(const uint8_t addr[TRANSPORT_ADDR_LEN], uint32_t token, bool success);
+// Physical link up / down, from transports that can tell (a cable); may be NULL
+typedef void (*transport_link_cb_t)(bool up);
+
+typedef struct {
+    const char* name;
+    esp_err_t (*start)(transport_recv_cb_t recv_cb, transport_send_cb_t send_cb, transport_link_cb_t link_cb);
+    // Queue a frame for addr (the peer, or the broadcast address); ESP_OK does not mean
+    // delivered. A token other than TRANSPORT_TOKEN_NONE comes back in its completion.
+    esp_err_t (*send)(const uint8_t addr[TRANSPORT_ADDR_LEN], const uint8_t* data, size_t len, uint32_t token);
+    // Accept frames from addr; with a key the transport encrypts the link itself if it can
+    // and returns true in *encrypted
+    esp_err_t (*add_peer)(const uint8_t addr[TRANSPORT_ADDR_LEN], const uint8_t* lmk, bool* encrypted);
+    void (*del_peer)(const uint8_t addr[TRANSPORT_ADDR_LEN]);
+    esp_err_t (*get_addr)(uint8_t addr[TRANSPORT_ADDR_LEN]);
+    // Optional (NULL): only ESP-NOW has a PMK, channels, PHY rates, TX power and a radio
+    // that can doze between frames
+    esp_err_t (*set_pmk)(const uint8_t pmk[TRANSPORT_KEY_LEN]);
+    esp_err_t (*set_channel)(uint8_t channel);
+    uint8_t (*get_channel)(void);
+    esp_err_t (*set_rate)(const uint8_t addr[TRANSPORT_ADDR_LEN], link_rate_t rate);
+    esp_err_t (*set_tx_power)(int8_t quarter_dbm);
+    esp_err_t (*set_power_save)(bool enabled);
+} transport_t;
+
+extern const transport_t espnow_transport;
+extern const transport_t uart_transport;
+extern const transport_t udp_transport;
+
+// The transport selected in menuconfig
+const transport_t* get_transport(void);
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Closed-loop TX power (CONFIG_WIRELESS_TX_POWER_CONTROL): holds the RSSI the peer
+// measures of our frames (reported back in ESPNOW_MSG_LINK_REPORT) at a target --
+// the receiver's sensitivity plus a margin -- instead of always sending at full power.
+//  - A report below target raises power by the whole shortfall at once; one above
+//    target + hysteresis lowers it by at most step_down_db, so power creeps down
+//    and jumps up.
+//  - A burst of failed sends (a fade faster than the reports) raises power by
+//    fade_step_db without waiting for a report.
+//  - Frames sent with no report for report_timeout_us send it back to the ceiling.
+//    An idle link sends nothing and so keeps its power.
+// Plain C without ESP-IDF dependencies so it also builds for the linux target;
+// wifi.c feeds it and applies the power. Powers are in 0.25 dBm steps, as
+// esp_wifi_set_max_tx_power() takes them.
+
+#define TX_POWER_MIN 8          // 2 dBm
+#define TX_POWER_MAX 84         // 21 dBm
+#define TX_POWER_LEVELS (TX_POWER_MAX + 1)
+
+typedef struct {
+    int8_t target_rssi;         // dBm at the peer
+    uint8_t hysteresis_db;      // no change from target to target + hysteresis
+    uint8_t step_down_db;       // largest decrease per report
+    uint8_t fade_step_db;       // increase on a burst of failed sends
+    uint8_t fail_burst;         // consecutive failed sends taken as a fade
+    int8_t floor;               // 0.25 dBm
+    int8_t ceiling;             // 0.25 dBm
+    uint32_t report_timeout_us;
+} tx_power_config_t;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t failures;
+    uint32_t reports;
+    uint32_t fades;             // raises on failed sends
+    uint32_t frames_at[TX_POWER_LEVELS];    // sends by power level
+} tx_power_stats_t;
+
+typedef struct {
+    tx_power_config_t config;
+    int8_t power;
+    uint8_t failures_in_row;
+    int64_t unanswered_since_us;    // first send since the last report, 0 = none
+    tx_power_stats_t stats;
+} tx_power_ctl_t;
+
+// Starts at the ceiling; floor and ceiling are kept within TX_POWER_MIN..TX_POWER_MAX
+void tx_power_init(tx_power_ctl_t* ctl, const tx_power_config_t* config);
+
+// Each returns the power to use from now on
+int8_t tx_power_on_report(tx_power_ctl_t* ctl, int8_t peer_rssi);
+int8_t tx_power_on_send(tx_power_ctl_t* ctl, bool success, int64_t now_us);
+int8_t tx_power_on_tick(tx_power_ctl_t* ctl, int64_t now_us);
+int8_t tx_power_set_ceiling(tx_power_ctl_t* ctl, int8_t ceiling);
+
+// Mean power (0.25 dBm) of the frames counted in stats
+int32_t tx_power_mean(const tx_power_stats_t* stats);
+
+// Share of radiated energy saved against sending every frame at reference (0.25 dBm),
+// in 0.01 %. PA current falls by less than radiated power, so battery savings are smaller.
+int32_t tx_power_energy_saved(const tx_power_stats_t* stats, int8_t reference);
@@ -2,10 +2,49 @@
 #include "esp_err.h"
 #include <stdbool.h>
 #include "constants.h"
+#include "sdkconfig.h"
+#include "wifi/impairment.h"
+#include "wifi/transport.h"
+#include "wifi/tx_power_control.h"
+#include "wifi/relay.h"
+
+// Frames to the peer complete through the application's send_status_cb(token, success),
+// token telling them apart; broadcasts have no completion
+#define SEND_TOKEN_NONE TRANSPORT_TOKEN_NONE
 
 esp_err_t send_message(const uint8_t *data, size_t size);
-void start_espnow(void);
-void begin_pairing_task(void);
-void register_peer(uint8_t mac[6]);
+// Like send_message(), for a frame whose completion the caller waits for: take the token
+// first, as the completion may come before the send returns
+uint32_t new_send_token(void);
+esp_err_t send_message_tagged(const uint8_t *data, size_t size, uint32_t token);
+esp_err_t send_broadcast(const uint8_t *data, size_t size);
+void start_link(void);
+esp_err_t register_peer(uint8_t mac[6]);
 void set_paired_status(tristate_bool_t status);
-void set_new_peer(uint8_t mac[6]);
+void set_new_peer(uint8_t mac[6], uint8_t channel);
+bool restore_saved_peer(void);
+void release_peer(void);
+void unpair(void);
+void set_keepalive_interval(uint64_t interval_us);
+void set_link_rate(link_rate_t rate);
+void set_link_tx_power(int8_t quarter_dbm);
+// Whether the transport encrypts frames to and from the registered peer
+bool is_link_encrypted(void);
+
+#if CONFIG_WIRELESS_IMPAIRMENT
+// Replace the impairment model applied to frames sent to the peer (restarts its RNG)
+void set_link_impairment(const impairment_config_t* config);
+void get_link_impairment_stats(impairment_stats_t* stats);
+#endif
+
+#if CONFIG_WIRELESS_TX_POWER_CONTROL
+// Sends counted by the power each went out at, and the radiated energy that saved
+void get_tx_power_stats(tx_power_stats_t* stats);
+void log_tx_power_stats(void);
+#endif
+
+#if CONFIG_WIRELESS_RELAY
+// Whether frames to the peer currently go through a relay
+bool is_link_relayed(void);
+void get_relay_stats(relay_stats_t* stats);
+#endif
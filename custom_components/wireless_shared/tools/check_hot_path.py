@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""Fail the build if an input hot-path function was linked into flash, or is missing.
+
+usage: check_hot_path.py <app.elf> <hot_path.txt> [sdkconfig | device_config.h ...]
+
+hot_path.txt lists one function per line ('#' starts a comment):
+
+    name                          must be in the image, and only in IRAM
+    name inline                   may be inlined into all its callers instead
+    name if OPTION                only checked while OPTION is set
+    name if !OPTION               only checked while OPTION is not set
+    name if A || B && !C          '&&' binds tighter than '||', as in C
+
+OPTION is a Kconfig symbol (CONFIG_..=y in sdkconfig) or a feature flag set to
+ENABLED or a non-zero number in a device_config.h; both are passed after the list.
+
+The ELF symbol table is read rather than the link map: it keeps static functions,
+which the map only shows for flash ('.text.<name>' sections), never for IRAM
+('.iram1.N'). Clones (name.constprop.0, name.isra.0, ...) count as name.
+"""
+import re
+import struct
+import sys
+
+FLASH_SECTIONS = ('.flash.text',)
+IRAM_SECTIONS = ('.iram0.text',)
+
+SHT_SYMTAB = 2
+STT_FUNC = 2
+SHN_LORESERVE = 0xff00
+
+line_re = re.compile(r'^(\w+)(\s+inline)?(?:\s+if\s+(.+))?$')
+condition_re = re.compile(r'^(!?)(\w+)$')
+kconfig_re = re.compile(r'^(CONFIG_\w+)=(.*)$')
+define_re = re.compile(r'^\s*#define\s+(\w+)\s+\(?(\w+)\)?')
+
+
+def read_options(paths):
+    options = set()
+    for path in paths:
+        with open(path) as f:
+            for line in f:
+                m = kconfig_re.match(line.strip())
+                if m:
+                    if m.group(2) not in ('n', '""', '0'):
+                        options.add(m.group(1))
+                    continue
+                m = define_re.match(line)
+                if m and (m.group(2) == 'ENABLED' or (m.group(2).isdigit() and int(m.group(2)) != 0)):
+                    options.add(m.group(1))
+    return options
+
+
+def condition_holds(condition, options, where):
+    def option_holds(term):
+        m = condition_re.match(term.strip())
+        if not m:
+            sys.exit(f'{where}: cannot parse condition "{condition}"')
+        return (m.group(2) in options) != bool(m.group(1))
+    return any(all(option_holds(term) for term in alternative.split('&&'))
+               for alternative in condition.split('||'))
+
+
+def read_hot_path(path, options):
+    """Names to check, and those of them allowed to be inlined away."""
+    names, may_inline = set(), set()
+    with open(path) as f:
+        for number, line in enumerate(f, 1):
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+            m = line_re.match(line)
+            if not m:
+                sys.exit(f'{path}:{number}: cannot parse "{line}"')
+            name, inline, condition = m.groups()
+            if condition and not condition_holds(condition, options, f'{path}:{number}'):
+                continue
+            names.add(name)
+            if inline:
+                may_inline.add(name)
+    return names, may_inline
+
+
+def base_name(symbol):
+    # foo.constprop.0 / foo.isra.0 / foo.part.0 are still foo
+    return symbol.split('.', 1)[0]
+
+
+def read_functions(path):
+    """Map each function symbol, local ones included, to the sections holding a copy."""
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[:4] != b'\x7fELF' or data[5] != 1:
+        sys.exit(f'{path}: not a little-endian ELF file')
+    if data[4] == 1:
+        shoff, = struct.unpack_from('<I', data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from('<HHH', data, 0x2e)
+        section_fmt, symbol_fmt, symbol_size = '<IIIIIIIIII', '<IIIBBH', 16
+    else:
+        # 64-bit, so the script can be tried on a host build
+        shoff, = struct.unpack_from('<Q', data, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from('<HHH', data, 0x3a)
+        section_fmt, symbol_fmt, symbol_size = '<IIQQQQIIQQ', '<IBBHQQ', 24
+    # (name, type, flags, addr, offset, size, link, info, addralign, entsize)
+    sections = [struct.unpack_from(section_fmt, data, shoff + i * shentsize) for i in range(shnum)]
+
+    def string(table_offset, offset):
+        start = table_offset + offset
+        return data[start:data.index(b'\0', start)].decode()
+
+    section_names = [string(sections[shstrndx][4], s[0]) for s in sections]
+    functions = {}
+    for s in sections:
+        if s[1] != SHT_SYMTAB:
+            continue
+        strtab = sections[s[6]][4]
+        for offset in range(s[4], s[4] + s[5], symbol_size):
+            if data[4] == 1:
+                st_name, _, _, st_info, _, st_shndx = struct.unpack_from(symbol_fmt, data, offset)
+            else:
+                st_name, st_info, _, st_shndx, _, _ = struct.unpack_from(symbol_fmt, data, offset)
+            if st_info & 0xf != STT_FUNC or st_shndx == 0 or st_shndx >= SHN_LORESERVE:
+                continue
+            functions.setdefault(base_name(string(strtab, st_name)), set()).add(section_names[st_shndx])
+    return functions
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+    names, may_inline = read_hot_path(sys.argv[2], read_options(sys.argv[3:]))
+    functions = read_functions(sys.argv[1])
+    errors = in_iram = 0
+    for name in sorted(names):
+        sections = functions.get(name)
+        if sections is None:
+            if name not in may_inline:
+                print(f'error: hot-path function {name} is not in the image '
+                      f'(renamed, removed, compiled out or inlined everywhere)')
+                errors += 1
+            continue
+        flash = sorted(sections.intersection(FLASH_SECTIONS))
+        if flash:
+            print(f'error: hot-path function {name} is in flash ({", ".join(flash)})')
+            errors += 1
+        elif sections.issubset(IRAM_SECTIONS):
+            in_iram += 1
+    print(f'hot path: {len(names)} functions, {in_iram} confirmed in IRAM, {errors} errors')
+    sys.exit(1 if errors else 0)
+
+
+if __name__ == '__main__':
+    main()
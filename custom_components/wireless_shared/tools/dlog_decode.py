@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Format binary deferred-log records (CONFIG_WIRELESS_DEFERRED_LOG_BINARY).
+
+usage: dlog_decode.py <firmware.elf> [log file]
+
+Reads a serial log (default stdin), replaces every "DLOG <hex>" line with the
+formatted message and passes all other lines through, so it can sit behind
+`idf.py monitor` or decode a saved crash tail. The tag, format string and %s
+arguments of a record are addresses into the firmware, so the ELF must be the
+exact build that wrote the records.
+"""
+import re
+import struct
+import sys
+
+RECORD = struct.Struct('<IIIBBH4I')   # dlog_record_t from timestamp_us on
+LEVELS = {1: 'E', 2: 'W', 3: 'I', 4: 'D', 5: 'V'}
+SPEC_RE = re.compile(r'%([-+ 0#]*)(\d*)(?:\.(\d+))?(hh|h|ll|l|z|j|t)?([diouxXcsp%])')
+
+
+class Firmware:
+    """Allocated sections of an ELF32 image, to read strings by address"""
+
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.image = f.read()
+        if self.image[:4] != b'\x7fELF' or self.image[4] != 1:
+            sys.exit(f'{path}: not an ELF32 file')
+        shoff, = struct.unpack_from('<I', self.image, 0x20)
+        shentsize, shnum = struct.unpack_from('<HH', self.image, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            _, sh_type, flags, addr, offset, size = struct.unpack_from('<IIIIII', self.image, shoff + i * shentsize)
+            # SHT_PROGBITS with SHF_ALLOC
+            if sh_type == 1 and flags & 0x2 and size:
+                self.sections.append((addr, size, offset))
+
+    def string(self, addr):
+        for start, size, offset in self.sections:
+            if start <= addr < start + size:
+                begin = offset + addr - start
+                end = self.image.find(b'\0', begin, offset + size)
+                return self.image[begin:end if end >= 0 else offset + size].decode(errors='replace')
+        return None
+
+
+def format_message(firmware, fmt, args):
+    args = list(args)
+    out = []
+    pos = 0
+    for m in SPEC_RE.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        flags, width, precision, _, conv = m.groups()
+        if conv == '%':
+            out.append('%')
+            continue
+        value = args.pop(0) if args else 0
+        spec = '%' + flags + width + ('.' + precision if precision else '')
+        if conv in 'di':
+            out.append((spec + 'd') % (value - (1 << 32) if value & 0x80000000 else value))
+        elif conv in 'uoxX':
+            out.append((spec + ('d' if conv == 'u' else conv)) % value)
+        elif conv == 'c':
+            out.append((spec + 'c') % chr(value & 0xFF))
+        elif conv == 's':
+            text = firmware.string(value)
+            out.append((spec + 's') % (text if text is not None else f'<0x{value:08x}>'))
+        else:
+            out.append(f'0x{value:08x}')
+    out.append(fmt[pos:])
+    return ''.join(out)
+
+
+def decode(firmware, hex_record):
+    try:
+        fields = RECORD.unpack(bytes.fromhex(hex_record))
+    except (ValueError, struct.error):
+        return None
+    timestamp_us, tag_addr, fmt_addr, level, num_args, _, *args = fields
+    fmt = firmware.string(fmt_addr)
+    if fmt is None:
+        return f'? ({timestamp_us // 1000}) unknown format at 0x{fmt_addr:08x}, args {args[:num_args]}'
+    tag = firmware.string(tag_addr) or f'0x{tag_addr:08x}'
+    return f'{LEVELS.get(level, "D")} ({timestamp_us // 1000}) {tag}: {format_message(firmware, fmt, args[:num_args])}'
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.exit(__doc__)
+    firmware = Firmware(sys.argv[1])
+    stream = open(sys.argv[2], errors='replace') if len(sys.argv) == 3 else sys.stdin
+    for line in stream:
+        m = re.search(r'DLOG ([0-9a-f]+)\s*$', line)
+        message = decode(firmware, m.group(1)) if m else None
+        print(message if message is not None else line, end='\n' if message is not None else '')
+
+
+if __name__ == '__main__':
+    main()
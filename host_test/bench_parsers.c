@@ -0,0 +1,27 @@
+#include "device_config.h"
+#include "devices.h"
+#include "tx_scheduler.h"
+#include "wifi/pairing.h"
+#include "wifi/perf_profile.h"
+#include "timer/timer_service.h"
+
+// The transmitter's parser benchmark and malformed-report sweep (parser_benchmark.c),
+// which the firmware only builds with BENCHMARK, run on the workstation. The numbers
+// are the workstation's, not the chip's: they compare parser changes, nothing more.
+// device_config.h is already in, so the override stands.
+#undef BENCHMARK
+#define BENCHMARK ENABLED
+#include "devices/parser_benchmark.c"
+
+// keyboard.c's watchdog, hotkeys and auto-release are not under benchmark
+esp_err_t service_timer_create_deferred(service_timer_t* timer, const char* name, service_timer_cb_t cb, void* arg){ return ESP_OK; }
+esp_err_t service_timer_start_once(service_timer_t timer, uint64_t timeout_us){ return ESP_OK; }
+esp_err_t service_timer_cancel(service_timer_t timer){ return ESP_OK; }
+esp_err_t tx_scheduler_submit(const espnow_message_t* msg, size_t length){ return ESP_OK; }
+void begin_pairing(void){}
+void next_perf_profile(void){}
+
+int main(void){
+    benchmark_report_parsers();
+    return 0;
+}
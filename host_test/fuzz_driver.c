@@ -0,0 +1,24 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Stand-in for libFuzzer where the compiler has none (gcc): feeds the target random
+// inputs from a fixed seed. Usage: fuzz_<target> [runs] [seed]
+
+#define MAX_INPUT_LEN 64
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+int main(int argc, char** argv){
+    const long runs = argc > 1 ? atol(argv[1]) : 100000;
+    srandom(argc > 2 ? (unsigned)atol(argv[2]) : 1);
+    uint8_t input[MAX_INPUT_LEN];
+    for (long n = 0; n < runs; n++){
+        size_t size = (size_t)random() % (MAX_INPUT_LEN + 1);
+        for (size_t i = 0; i < size; i++)
+            input[i] = (uint8_t)random();
+        LLVMFuzzerTestOneInput(input, size);
+    }
+    printf("%ld inputs, no failures\n", runs);
+    return 0;
+}
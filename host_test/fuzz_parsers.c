@@ -0,0 +1,67 @@
+#include "devices.h"
+#include "usb/hid_usage_keyboard.h"
+#include "usb/hid_usage_mouse.h"
+#include "tx_scheduler.h"
+#include "wifi/pairing.h"
+#include "wifi/perf_profile.h"
+#include "timer/timer_service.h"
+#include "controller_profile_table.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Fuzz target for the transmitter's report parsers (keyboard, mouse, every gamepad
+// profile). The first input byte picks the parser and profile, the rest is the report,
+// copied into a heap block of exactly its length so AddressSanitizer reports any read
+// past the end. Each parser must either reject the report and leave the message
+// untouched, or accept it exactly when it is long enough and format the message.
+
+#define UNTOUCHED 0xA5
+
+// keyboard.c's watchdog, hotkeys and auto-release are not under test
+esp_err_t service_timer_create_deferred(service_timer_t* timer, const char* name, service_timer_cb_t cb, void* arg){ return ESP_OK; }
+esp_err_t service_timer_start_once(service_timer_t timer, uint64_t timeout_us){ return ESP_OK; }
+esp_err_t service_timer_cancel(service_timer_t timer){ return ESP_OK; }
+esp_err_t tx_scheduler_submit(const espnow_message_t* msg, size_t length){ return ESP_OK; }
+void begin_pairing(void){}
+void next_perf_profile(void){}
+
+static void check(bool ok){
+    if (!ok)
+        abort();
+}
+
+static void check_result(esp_err_t err, const espnow_message_t* msg, bool long_enough, uint8_t msg_type){
+    check((err == ESP_OK) == long_enough);
+    check(msg->msg_type == (long_enough ? msg_type : UNTOUCHED));
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size){
+    if (size == 0)
+        return 0;
+    const uint8_t selector = data[0];
+    const size_t length = size - 1;
+    uint8_t* report = malloc(length);
+    memcpy(report, data + 1, length);
+
+    espnow_message_t msg;
+    memset(&msg, UNTOUCHED, sizeof(msg));
+    const size_t num_profiles = sizeof(controller_profiles) / sizeof(controller_profiles[0]);
+    switch (selector % 3){
+        case 0:
+            check_result(process_keyboard_report(report, length, &msg.keyboard_msg), &msg,
+                         length >= sizeof(hid_keyboard_input_report_boot_t), ESPNOW_MSG_KEYBOARD);
+            break;
+        case 1:
+            check_result(process_mouse_report(report, length, &msg.mouse_msg), &msg,
+                         length >= sizeof(hid_mouse_input_report_boot_t), ESPNOW_MSG_MOUSE);
+            break;
+        default: {
+            const controller_profile_t* profile = &controller_profiles[(selector / 3) % num_profiles];
+            check_result(process_gamepad_report(profile, report, length, &msg.gamepad_msg), &msg,
+                         length >= profile->min_report_len, ESPNOW_MSG_GAMEPAD);
+            break;
+        }
+    }
+    free(report);
+    return 0;
+}
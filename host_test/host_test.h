@@ -0,0 +1,24 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Unit tests stop at the first failed check, naming it; ctest reports the exit status
+
+#define CHECK(cond) do {                                                        \
+        if (!(cond)){                                                           \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1);                                                            \
+        }                                                                       \
+    } while (0)
+
+// Poll cond, free of side effects, for up to timeout_ms; for state another task updates
+#define CHECK_SOON(cond, timeout_ms) do {                                       \
+        int _waited_ms = 0;                                                     \
+        while (!(cond) && _waited_ms < (timeout_ms)){                           \
+            vTaskDelay(1);                                                      \
+            _waited_ms += portTICK_PERIOD_MS;                                   \
+        }                                                                       \
+        CHECK(cond);                                                            \
+    } while (0)
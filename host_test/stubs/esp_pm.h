@@ -0,0 +1,6 @@
+#pragma once
+#include "esp_err.h"
+// No frequency scaling on the host (CONFIG_PM_ENABLE is off), so no lock is ever created
+typedef struct esp_pm_lock* esp_pm_lock_handle_t;
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle);
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle);
@@ -0,0 +1,95 @@
+#define _GNU_SOURCE
+#include "esp_app_desc.h"
+#include "esp_err.h"
+#include "esp_pm.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Stand-ins for the ESP-IDF services the shared code uses outside FreeRTOS
+
+int64_t esp_timer_get_time(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+uint32_t esp_random(void){
+    return ((uint32_t)random() << 16) ^ (uint32_t)random();
+}
+
+void esp_fill_random(void* buf, size_t len){
+    uint8_t* out = buf;
+    for (size_t i = 0; i < len; i++)
+        out[i] = (uint8_t)esp_random();
+}
+
+const char* esp_err_to_name(esp_err_t err){
+    static __thread char name[16];
+    snprintf(name, sizeof(name), "0x%x", err);
+    return err == ESP_OK ? "ESP_OK" : name;
+}
+
+// Every spinlock maps onto one recursive mutex: critical sections are short and tests
+// only need them to exclude each other
+static pthread_mutex_t critical_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+void vPortEnterCritical(portMUX_TYPE* mux){
+    (void)mux;
+    pthread_mutex_lock(&critical_mutex);
+}
+
+void vPortExitCritical(portMUX_TYPE* mux){
+    (void)mux;
+    pthread_mutex_unlock(&critical_mutex);
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle){
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle){
+    return ESP_OK;
+}
+
+uint32_t esp_get_free_heap_size(void){
+    return 0;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void){
+    return 0;
+}
+
+esp_reset_reason_t esp_reset_reason(void){
+    return ESP_RST_POWERON;
+}
+
+void esp_restart(void){
+    exit(0);
+}
+
+int esp_app_get_elf_sha256(char* dst, size_t size){
+    if (size == 0)
+        return 0;
+    strncpy(dst, "host", size - 1);
+    dst[size - 1] = '\0';
+    return (int)strlen(dst);
+}
+
+// The ROM's little-endian CRC-32, the one zlib computes
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len){
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++){
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
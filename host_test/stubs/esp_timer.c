@@ -0,0 +1,136 @@
+#include "esp_timer.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+// esp_timer on one dispatch thread, as on the chip: callbacks run one at a time, in
+// deadline order, and must not block
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    int64_t due_us;             // 0 while stopped
+    uint64_t period_us;         // 0 for one-shot
+    struct esp_timer* next;
+};
+
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timers_changed;
+static pthread_once_t started = PTHREAD_ONCE_INIT;
+static struct esp_timer* timers = NULL;
+
+static struct esp_timer* earliest(void){
+    struct esp_timer* first = NULL;
+    for (struct esp_timer* timer = timers; timer; timer = timer->next){
+        if (timer->due_us && (first == NULL || timer->due_us < first->due_us))
+            first = timer;
+    }
+    return first;
+}
+
+static void* dispatch_thread(void* arg){
+    pthread_mutex_lock(&timer_lock);
+    while (true){
+        struct esp_timer* timer = earliest();
+        if (timer == NULL){
+            pthread_cond_wait(&timers_changed, &timer_lock);
+            continue;
+        }
+        int64_t wait_us = timer->due_us - esp_timer_get_time();
+        if (wait_us > 0){
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            int64_t ns = deadline.tv_nsec + wait_us * 1000;
+            deadline.tv_sec += ns / 1000000000;
+            deadline.tv_nsec = ns % 1000000000;
+            pthread_cond_timedwait(&timers_changed, &timer_lock, &deadline);
+            continue;
+        }
+        timer->due_us = timer->period_us ? timer->due_us + timer->period_us : 0;
+        esp_timer_cb_t callback = timer->callback;
+        void* callback_arg = timer->arg;
+        pthread_mutex_unlock(&timer_lock);
+        callback(callback_arg);
+        pthread_mutex_lock(&timer_lock);
+    }
+    return NULL;
+}
+
+static void start_dispatch(void){
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timers_changed, &attr);
+    pthread_t thread;
+    pthread_create(&thread, NULL, dispatch_thread, NULL);
+    pthread_detach(thread);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle){
+    pthread_once(&started, start_dispatch);
+    struct esp_timer* timer = calloc(1, sizeof(*timer));
+    if (timer == NULL)
+        return ESP_ERR_NO_MEM;
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    pthread_mutex_lock(&timer_lock);
+    timer->next = timers;
+    timers = timer;
+    pthread_mutex_unlock(&timer_lock);
+    *handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us, bool restart){
+    pthread_mutex_lock(&timer_lock);
+    if (timer->due_us && !restart){
+        pthread_mutex_unlock(&timer_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Never 0, which means stopped
+    timer->due_us = esp_timer_get_time() + (int64_t)timeout_us + 1;
+    timer->period_us = period_us;
+    pthread_cond_broadcast(&timers_changed);
+    pthread_mutex_unlock(&timer_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us){
+    return start(timer, timeout_us, 0, false);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us){
+    return start(timer, period_us, period_us, false);
+}
+
+esp_err_t esp_timer_restart(esp_timer_handle_t timer, uint64_t timeout_us){
+    return start(timer, timeout_us, timer->period_us ? timeout_us : 0, true);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer){
+    pthread_mutex_lock(&timer_lock);
+    bool active = timer->due_us != 0;
+    timer->due_us = 0;
+    pthread_mutex_unlock(&timer_lock);
+    return active ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer){
+    pthread_mutex_lock(&timer_lock);
+    for (struct esp_timer** link = &timers; *link; link = &(*link)->next){
+        if (*link == timer){
+            *link = timer->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&timer_lock);
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer){
+    pthread_mutex_lock(&timer_lock);
+    bool active = timer->due_us != 0;
+    pthread_mutex_unlock(&timer_lock);
+    return active;
+}
@@ -0,0 +1,341 @@
+#define _GNU_SOURCE
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// FreeRTOS tasks, notifications and queues on pthreads. Every task is a thread, so
+// priorities and cores are ignored; tests must not rely on one task preempting another.
+
+struct tskTaskControlBlock {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notify_value;
+    const char* name;
+    TaskFunction_t fn;
+    void* arg;
+};
+
+struct QueueDefinition {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;           // index of the oldest item
+    uint8_t* items;
+};
+
+static __thread TaskHandle_t current_task = NULL;
+
+// Absolute CLOCK_REALTIME deadline ticks from now, for the pthread timed waits
+static struct timespec deadline_after(TickType_t ticks){
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    uint64_t ns = (uint64_t)ticks * (1000000000ULL / configTICK_RATE_HZ) + deadline.tv_nsec;
+    deadline.tv_sec += ns / 1000000000ULL;
+    deadline.tv_nsec = ns % 1000000000ULL;
+    return deadline;
+}
+
+// Wait on cond until woken or the deadline; false on timeout. ticks 0 never waits.
+static bool wait_until(pthread_cond_t* cond, pthread_mutex_t* lock, TickType_t ticks, const struct timespec* deadline){
+    if (ticks == 0)
+        return false;
+    if (ticks == portMAX_DELAY)
+        return pthread_cond_wait(cond, lock) == 0;
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+static TaskHandle_t new_task(const char* name, TaskFunction_t fn, void* arg){
+    TaskHandle_t task = calloc(1, sizeof(*task));
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->notified, NULL);
+    task->name = name;
+    task->fn = fn;
+    task->arg = arg;
+    return task;
+}
+
+static void* task_entry(void* arg){
+    TaskHandle_t task = arg;
+    current_task = task;
+    task->fn(task->arg);
+    return NULL;
+}
+
+static TaskHandle_t start_task(TaskFunction_t fn, const char* name, void* arg){
+    TaskHandle_t task = new_task(name, fn, arg);
+    if (pthread_create(&task->thread, NULL, task_entry, task) != 0){
+        free(task);
+        return NULL;
+    }
+    pthread_detach(task->thread);
+    return task;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stack, void* arg, UBaseType_t prio, TaskHandle_t* handle){
+    TaskHandle_t task = start_task(fn, name, arg);
+    if (handle)
+        *handle = task;
+    return task ? pdPASS : pdFAIL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack, void* arg, UBaseType_t prio,
+                                   TaskHandle_t* handle, BaseType_t core){
+    return xTaskCreate(fn, name, stack, arg, prio, handle);
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char* name, uint32_t stack, void* arg, UBaseType_t prio,
+                               StackType_t* stack_mem, StaticTask_t* tcb){
+    return start_task(fn, name, arg);
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack, void* arg, UBaseType_t prio,
+                                           StackType_t* stack_mem, StaticTask_t* tcb, BaseType_t core){
+    return start_task(fn, name, arg);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void){
+    // The test's main thread, or any thread the shim did not start, gets a handle on first use
+    if (current_task == NULL)
+        current_task = new_task("main", NULL, NULL);
+    return current_task;
+}
+
+void vTaskDelete(TaskHandle_t task){
+    if (task == NULL || task == current_task)
+        pthread_exit(NULL);
+}
+
+void vTaskSuspend(TaskHandle_t task){
+    if (task != NULL && task != current_task)
+        return;
+    while (true)
+        pause();
+}
+
+void vTaskResume(TaskHandle_t task){}
+
+void vTaskDelay(TickType_t ticks){
+    struct timespec delay = {
+        .tv_sec = ticks / configTICK_RATE_HZ,
+        .tv_nsec = (ticks % configTICK_RATE_HZ) * (1000000000L / configTICK_RATE_HZ)
+    };
+    nanosleep(&delay, NULL);
+}
+
+TickType_t xTaskGetTickCount(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (TickType_t)(now.tv_sec * configTICK_RATE_HZ + now.tv_nsec / (1000000000L / configTICK_RATE_HZ));
+}
+
+TickType_t xTaskGetTickCountFromISR(void){
+    return xTaskGetTickCount();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks){
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline = deadline_after(ticks);
+    pthread_mutex_lock(&task->lock);
+    while (task->notify_value == 0 && wait_until(&task->notified, &task->lock, ticks, &deadline))
+        ;
+    uint32_t value = task->notify_value;
+    if (value)
+        task->notify_value = clear ? 0 : value - 1;
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task){
+    pthread_mutex_lock(&task->lock);
+    task->notify_value++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* woken){
+    xTaskNotifyGive(task);
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, int action){
+    pthread_mutex_lock(&task->lock);
+    task->notify_value |= value;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t* value, TickType_t ticks){
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline = deadline_after(ticks);
+    pthread_mutex_lock(&task->lock);
+    task->notify_value &= ~clear_on_entry;
+    while (task->notify_value == 0 && wait_until(&task->notified, &task->lock, ticks, &deadline))
+        ;
+    BaseType_t received = task->notify_value != 0;
+    if (value)
+        *value = task->notify_value;
+    if (received)
+        task->notify_value &= ~clear_on_exit;
+    pthread_mutex_unlock(&task->lock);
+    return received ? pdTRUE : pdFALSE;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task){
+    return 0;
+}
+
+const char* pcTaskGetName(TaskHandle_t task){
+    return task ? task->name : xTaskGetCurrentTaskHandle()->name;
+}
+
+TaskHandle_t xTaskGetHandle(const char* name){
+    return NULL;
+}
+
+BaseType_t xPortGetCoreID(void){
+    return 0;
+}
+
+static QueueHandle_t new_queue(UBaseType_t length, UBaseType_t item_size){
+    QueueHandle_t queue = calloc(1, sizeof(*queue));
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->items = calloc(length, item_size ? item_size : 1);
+    return queue;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size){
+    return new_queue(length, item_size);
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t* storage, StaticQueue_t* buffer){
+    return new_queue(length, item_size);
+}
+
+static BaseType_t queue_send(QueueHandle_t queue, const void* item, TickType_t ticks, bool to_front, bool overwrite){
+    struct timespec deadline = deadline_after(ticks);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length && !overwrite){
+        if (!wait_until(&queue->changed, &queue->lock, ticks, &deadline)){
+            pthread_mutex_unlock(&queue->lock);
+            return pdFAIL;
+        }
+    }
+    UBaseType_t index;
+    if (overwrite && queue->count == queue->length)
+        index = (queue->head + queue->count - 1) % queue->length;
+    else if (to_front){
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        index = queue->head;
+        queue->count++;
+    }
+    else {
+        index = (queue->head + queue->count) % queue->length;
+        queue->count++;
+    }
+    if (queue->item_size)
+        memcpy(queue->items + index * queue->item_size, item, queue->item_size);
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+static BaseType_t queue_receive(QueueHandle_t queue, void* item, TickType_t ticks, bool remove){
+    struct timespec deadline = deadline_after(ticks);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0){
+        if (!wait_until(&queue->changed, &queue->lock, ticks, &deadline)){
+            pthread_mutex_unlock(&queue->lock);
+            return pdFAIL;
+        }
+    }
+    if (queue->item_size)
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    if (remove){
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks){
+    return queue_send(queue, item, ticks, false, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void* item, TickType_t ticks){
+    return queue_send(queue, item, ticks, true, false);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken){
+    return queue_send(queue, item, 0, false, false);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void* item){
+    return queue_send(queue, item, 0, false, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks){
+    return queue_receive(queue, item, ticks, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t ticks){
+    return queue_receive(queue, item, ticks, false);
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue){
+    pthread_mutex_lock(&queue->lock);
+    queue->count = 0;
+    queue->head = 0;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue){
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue){
+    return queue->length - uxQueueMessagesWaiting(queue);
+}
+
+// Semaphores are queues of empty items: a mutex starts full, a binary semaphore empty
+SemaphoreHandle_t xSemaphoreCreateBinary(void){
+    return new_queue(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void){
+    SemaphoreHandle_t mutex = new_queue(1, 0);
+    mutex->count = 1;
+    return mutex;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* buffer){
+    return xSemaphoreCreateMutex();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks){
+    return queue_receive(semaphore, NULL, ticks, true);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore){
+    return queue_send(semaphore, NULL, 0, false, false);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_attr.h"
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint8_t StackType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xffffffff
+#define configTICK_RATE_HZ 100
+#define portTICK_PERIOD_MS (1000/configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(x) ((TickType_t)((x)*configTICK_RATE_HZ/1000))
+#define pdTICKS_TO_MS(x) ((x)*1000/configTICK_RATE_HZ)
+typedef struct { int x; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+void vPortEnterCritical(portMUX_TYPE*); void vPortExitCritical(portMUX_TYPE*);
+#define portENTER_CRITICAL(m) vPortEnterCritical(m)
+#define portEXIT_CRITICAL(m) vPortExitCritical(m)
+#define portENTER_CRITICAL_ISR(m) vPortEnterCritical(m)
+#define portEXIT_CRITICAL_ISR(m) vPortExitCritical(m)
+#define portYIELD_FROM_ISR(x) (void)(x)
+typedef struct { int x[32]; } StaticTask_t;
+typedef struct { int x[32]; } StaticQueue_t;
+typedef StaticQueue_t StaticSemaphore_t;
+#define configSTACK_DEPTH_TYPE uint32_t
+#define tskNO_AFFINITY 0x7fffffff
@@ -0,0 +1,191 @@
+#include "mbedtls/ccm.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/md.h"
+#include "mbedtls/sha256.h"
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <stdbool.h>
+#include <string.h>
+
+// The few mbedTLS calls the shared code makes, on OpenSSL's libcrypto
+
+struct mbedtls_md_info_t {
+    mbedtls_md_type_t type;
+};
+
+static const mbedtls_md_info_t sha256_info = { MBEDTLS_MD_SHA256 };
+
+const mbedtls_md_info_t* mbedtls_md_info_from_type(mbedtls_md_type_t type){
+    return type == MBEDTLS_MD_SHA256 ? &sha256_info : NULL;
+}
+
+int mbedtls_md_hmac(const mbedtls_md_info_t* info, const unsigned char* key, size_t keylen,
+                    const unsigned char* input, size_t ilen, unsigned char* output){
+    unsigned int len;
+    if (info == NULL)
+        return -1;
+    return HMAC(EVP_sha256(), key, (int)keylen, input, ilen, output, &len) ? 0 : -1;
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx){
+    ctx->evp = EVP_MD_CTX_new();
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx){
+    EVP_MD_CTX_free(ctx->evp);
+    ctx->evp = NULL;
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224){
+    return EVP_DigestInit_ex(ctx->evp, is224 ? EVP_sha224() : EVP_sha256(), NULL) ? 0 : -1;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t ilen){
+    return EVP_DigestUpdate(ctx->evp, input, ilen) ? 0 : -1;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char output[32]){
+    return EVP_DigestFinal_ex(ctx->evp, output, NULL) ? 0 : -1;
+}
+
+void mbedtls_ccm_init(mbedtls_ccm_context* ctx){
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_ccm_free(mbedtls_ccm_context* ctx){
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_ccm_setkey(mbedtls_ccm_context* ctx, mbedtls_cipher_id_t cipher, const unsigned char* key, unsigned int keybits){
+    if (cipher != MBEDTLS_CIPHER_ID_AES || (keybits != 128 && keybits != 256))
+        return MBEDTLS_ERR_CCM_BAD_INPUT;
+    memcpy(ctx->key, key, keybits / 8);
+    ctx->keybits = keybits;
+    return 0;
+}
+
+// One CCM operation; OpenSSL wants the lengths, then the AAD, then the data in one go
+static int ccm(mbedtls_ccm_context* ctx, bool encrypt, size_t length, const unsigned char* iv, size_t iv_len,
+               const unsigned char* ad, size_t ad_len, const unsigned char* input, unsigned char* output,
+               unsigned char* tag, size_t tag_len){
+    if (ctx->keybits == 0)
+        return MBEDTLS_ERR_CCM_BAD_INPUT;
+    EVP_CIPHER_CTX* evp = EVP_CIPHER_CTX_new();
+    const EVP_CIPHER* cipher = ctx->keybits == 128 ? EVP_aes_128_ccm() : EVP_aes_256_ccm();
+    int out_len;
+    int ok = EVP_CipherInit_ex(evp, cipher, NULL, NULL, NULL, encrypt) &&
+             EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_CCM_SET_IVLEN, (int)iv_len, NULL) &&
+             EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_CCM_SET_TAG, (int)tag_len, encrypt ? NULL : tag) &&
+             EVP_CipherInit_ex(evp, NULL, NULL, ctx->key, iv, encrypt) &&
+             EVP_CipherUpdate(evp, NULL, &out_len, NULL, (int)length) &&
+             (ad_len == 0 || EVP_CipherUpdate(evp, NULL, &out_len, ad, (int)ad_len));
+    int ret = ok ? 0 : MBEDTLS_ERR_CCM_BAD_INPUT;
+    if (ok && !EVP_CipherUpdate(evp, output, &out_len, input, (int)length))
+        ret = encrypt ? MBEDTLS_ERR_CCM_BAD_INPUT : MBEDTLS_ERR_CCM_AUTH_FAILED;
+    if (ret == 0 && encrypt && !EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_CCM_GET_TAG, (int)tag_len, tag))
+        ret = MBEDTLS_ERR_CCM_BAD_INPUT;
+    EVP_CIPHER_CTX_free(evp);
+    // Like mbedTLS, leave no unauthenticated plaintext behind
+    if (ret != 0 && !encrypt)
+        memset(output, 0, length);
+    return ret;
+}
+
+int mbedtls_ccm_encrypt_and_tag(mbedtls_ccm_context* ctx, size_t length, const unsigned char* iv, size_t iv_len,
+                                const unsigned char* ad, size_t ad_len, const unsigned char* input,
+                                unsigned char* output, unsigned char* tag, size_t tag_len){
+    return ccm(ctx, true, length, iv, iv_len, ad, ad_len, input, output, tag, tag_len);
+}
+
+int mbedtls_ccm_auth_decrypt(mbedtls_ccm_context* ctx, size_t length, const unsigned char* iv, size_t iv_len,
+                             const unsigned char* ad, size_t ad_len, const unsigned char* input,
+                             unsigned char* output, const unsigned char* tag, size_t tag_len){
+    return ccm(ctx, false, length, iv, iv_len, ad, ad_len, input, output, (unsigned char*)tag, tag_len);
+}
+
+void mbedtls_ecp_group_init(mbedtls_ecp_group* grp){
+    grp->id = MBEDTLS_ECP_DP_NONE;
+}
+
+void mbedtls_ecp_group_free(mbedtls_ecp_group* grp){}
+
+int mbedtls_ecp_group_load(mbedtls_ecp_group* grp, mbedtls_ecp_group_id id){
+    if (id != MBEDTLS_ECP_DP_CURVE25519)
+        return MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+    grp->id = id;
+    return 0;
+}
+
+void mbedtls_mpi_init(mbedtls_mpi* x){
+    memset(x, 0, sizeof(*x));
+}
+
+void mbedtls_mpi_free(mbedtls_mpi* x){
+    memset(x, 0, sizeof(*x));
+}
+
+int mbedtls_mpi_read_binary_le(mbedtls_mpi* x, const unsigned char* buf, size_t len){
+    if (len != sizeof(x->le))
+        return MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+    memcpy(x->le, buf, len);
+    return 0;
+}
+
+int mbedtls_mpi_write_binary_le(const mbedtls_mpi* x, unsigned char* buf, size_t len){
+    if (len != sizeof(x->le))
+        return MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+    memcpy(buf, x->le, len);
+    return 0;
+}
+
+void mbedtls_ecp_point_init(mbedtls_ecp_point* pt){
+    memset(pt, 0, sizeof(*pt));
+}
+
+void mbedtls_ecp_point_free(mbedtls_ecp_point* pt){}
+
+int mbedtls_ecp_point_read_binary(const mbedtls_ecp_group* grp, mbedtls_ecp_point* pt, const unsigned char* buf, size_t len){
+    if (grp->id != MBEDTLS_ECP_DP_CURVE25519 || len != sizeof(pt->x))
+        return MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+    memcpy(pt->x, buf, len);
+    return 0;
+}
+
+int mbedtls_ecp_point_write_binary(const mbedtls_ecp_group* grp, const mbedtls_ecp_point* pt, int format,
+                                   size_t* olen, unsigned char* buf, size_t len){
+    if (grp->id != MBEDTLS_ECP_DP_CURVE25519 || len < sizeof(pt->x))
+        return MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+    memcpy(buf, pt->x, sizeof(pt->x));
+    *olen = sizeof(pt->x);
+    return 0;
+}
+
+int mbedtls_ecdh_gen_public(mbedtls_ecp_group* grp, mbedtls_mpi* d, mbedtls_ecp_point* Q,
+                            int (*f_rng)(void*, unsigned char*, size_t), void* p_rng){
+    if (grp->id != MBEDTLS_ECP_DP_CURVE25519 || f_rng(p_rng, d->le, sizeof(d->le)) != 0)
+        return MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+    EVP_PKEY* key = EVP_PKEY_new_raw_private_key(EVP_PKEY_X25519, NULL, d->le, sizeof(d->le));
+    size_t len = sizeof(Q->x);
+    int ok = key && EVP_PKEY_get_raw_public_key(key, Q->x, &len);
+    EVP_PKEY_free(key);
+    return ok ? 0 : MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+}
+
+int mbedtls_ecdh_compute_shared(mbedtls_ecp_group* grp, mbedtls_mpi* z, const mbedtls_ecp_point* Q, const mbedtls_mpi* d,
+                                int (*f_rng)(void*, unsigned char*, size_t), void* p_rng){
+    if (grp->id != MBEDTLS_ECP_DP_CURVE25519)
+        return MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+    EVP_PKEY* own = EVP_PKEY_new_raw_private_key(EVP_PKEY_X25519, NULL, d->le, sizeof(d->le));
+    EVP_PKEY* peer = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, NULL, Q->x, sizeof(Q->x));
+    EVP_PKEY_CTX* ctx = own ? EVP_PKEY_CTX_new(own, NULL) : NULL;
+    size_t len = sizeof(z->le);
+    // OpenSSL refuses an all-zero result; mbedTLS hands it back for the caller to check
+    memset(z->le, 0, sizeof(z->le));
+    int ok = ctx && peer && EVP_PKEY_derive_init(ctx) > 0 && EVP_PKEY_derive_set_peer(ctx, peer) > 0;
+    if (ok)
+        EVP_PKEY_derive(ctx, z->le, &len);
+    EVP_PKEY_CTX_free(ctx);
+    EVP_PKEY_free(peer);
+    EVP_PKEY_free(own);
+    return ok ? 0 : MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+// X25519 only: an MPI or a point is its 32-byte little-endian encoding
+#define MBEDTLS_ERR_ECP_BAD_INPUT_DATA -0x4F80
+#define MBEDTLS_ECP_PF_UNCOMPRESSED 0
+typedef enum { MBEDTLS_ECP_DP_NONE = 0, MBEDTLS_ECP_DP_CURVE25519 = 9 } mbedtls_ecp_group_id;
+typedef struct { mbedtls_ecp_group_id id; } mbedtls_ecp_group;
+typedef struct { unsigned char le[32]; } mbedtls_mpi;
+typedef struct { unsigned char x[32]; } mbedtls_ecp_point;
+void mbedtls_ecp_group_init(mbedtls_ecp_group* grp);
+void mbedtls_ecp_group_free(mbedtls_ecp_group* grp);
+int mbedtls_ecp_group_load(mbedtls_ecp_group* grp, mbedtls_ecp_group_id id);
+void mbedtls_mpi_init(mbedtls_mpi* x);
+void mbedtls_mpi_free(mbedtls_mpi* x);
+int mbedtls_mpi_read_binary_le(mbedtls_mpi* x, const unsigned char* buf, size_t len);
+int mbedtls_mpi_write_binary_le(const mbedtls_mpi* x, unsigned char* buf, size_t len);
+void mbedtls_ecp_point_init(mbedtls_ecp_point* pt);
+void mbedtls_ecp_point_free(mbedtls_ecp_point* pt);
+int mbedtls_ecp_point_read_binary(const mbedtls_ecp_group* grp, mbedtls_ecp_point* pt, const unsigned char* buf, size_t len);
+int mbedtls_ecp_point_write_binary(const mbedtls_ecp_group* grp, const mbedtls_ecp_point* pt, int format,
+                                   size_t* olen, unsigned char* buf, size_t len);
+int mbedtls_ecdh_gen_public(mbedtls_ecp_group* grp, mbedtls_mpi* d, mbedtls_ecp_point* Q,
+                            int (*f_rng)(void*, unsigned char*, size_t), void* p_rng);
+int mbedtls_ecdh_compute_shared(mbedtls_ecp_group* grp, mbedtls_mpi* z, const mbedtls_ecp_point* Q, const mbedtls_mpi* d,
+                                int (*f_rng)(void*, unsigned char*, size_t), void* p_rng);
@@ -0,0 +1,137 @@
+#include "nvs_flash.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// NVS in memory: it survives everything but nvs_flash_erase(), so a test can "reboot"
+// a module by initialising it again. Namespaces are ignored; there is only "storage".
+
+#define NVS_MAX_ENTRIES 64
+#define NVS_KEY_LEN 16          // NVS_KEY_NAME_MAX_SIZE, terminator included
+
+typedef struct {
+    char key[NVS_KEY_LEN];
+    uint8_t* data;
+    size_t len;
+} nvs_entry_t;
+
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static nvs_entry_t entries[NVS_MAX_ENTRIES];
+
+static nvs_entry_t* find(const char* key){
+    for (int i = 0; i < NVS_MAX_ENTRIES; i++){
+        if (entries[i].data && strcmp(entries[i].key, key) == 0)
+            return &entries[i];
+    }
+    return NULL;
+}
+
+static esp_err_t set(const char* key, const void* data, size_t len){
+    if (strlen(key) >= NVS_KEY_LEN)
+        return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&nvs_lock);
+    nvs_entry_t* entry = find(key);
+    for (int i = 0; entry == NULL && i < NVS_MAX_ENTRIES; i++){
+        if (entries[i].data == NULL)
+            entry = &entries[i];
+    }
+    esp_err_t err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    if (entry){
+        free(entry->data);
+        strcpy(entry->key, key);
+        entry->data = malloc(len ? len : 1);
+        memcpy(entry->data, data, len);
+        entry->len = len;
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+// Exactly len bytes, or with exact false up to *len bytes and the stored length back in *len
+static esp_err_t get(const char* key, void* data, size_t* len, bool exact){
+    pthread_mutex_lock(&nvs_lock);
+    nvs_entry_t* entry = find(key);
+    esp_err_t err = ESP_OK;
+    if (entry == NULL)
+        err = ESP_ERR_NVS_NOT_FOUND;
+    else if (exact ? entry->len != *len : entry->len > *len)
+        err = exact ? ESP_ERR_NVS_TYPE_MISMATCH : ESP_ERR_NVS_INVALID_LENGTH;
+    else {
+        if (data)
+            memcpy(data, entry->data, entry->len);
+        *len = entry->len;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_flash_init(void){
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void){
+    pthread_mutex_lock(&nvs_lock);
+    for (int i = 0; i < NVS_MAX_ENTRIES; i++){
+        free(entries[i].data);
+        entries[i].data = NULL;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t mode, nvs_handle_t* handle){
+    *handle = 1;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle){}
+
+esp_err_t nvs_commit(nvs_handle_t handle){
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key){
+    pthread_mutex_lock(&nvs_lock);
+    nvs_entry_t* entry = find(key);
+    if (entry){
+        free(entry->data);
+        entry->data = NULL;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return entry ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t len){
+    return set(key, value, len);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* value, size_t* len){
+    return get(key, value, len, false);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value){
+    return set(key, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* value, size_t* len){
+    return get(key, value, len, false);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char* key, uint8_t value){
+    return set(key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char* key, uint8_t* value){
+    size_t len = sizeof(*value);
+    return get(key, value, &len, true);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char* key, uint32_t value){
+    return set(key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char* key, uint32_t* value){
+    size_t len = sizeof(*value);
+    return get(key, value, &len, true);
+}
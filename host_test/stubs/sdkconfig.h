@@ -0,0 +1,13 @@
+#pragma once
+// The configuration host tests build the shared code with: the linux target with
+// the UDP transport and the Kconfig defaults that apply to it
+#define CONFIG_IDF_TARGET_LINUX 1
+#define CONFIG_WIRELESS_TRANSPORT_UDP 1
+#define CONFIG_WIRELESS_UDP_LOCAL_PORT 47100
+#define CONFIG_WIRELESS_UDP_REMOTE_HOST "127.0.0.1"
+#define CONFIG_WIRELESS_UDP_REMOTE_PORT 47101
+#define CONFIG_WIRELESS_LINK_ENCRYPTION 1
+#define CONFIG_WIRELESS_LINK_PMK "WirelessAdapter!"
+#define CONFIG_WIRELESS_CHANNEL 1
+#define CONFIG_WIRELESS_PAIRING_BUTTON_GPIO -1
+#define CONFIG_ESP_TIMER_TASK_STACK_SIZE 3584
@@ -0,0 +1,5 @@
+#pragma once
+#include "esp_err.h"
+
+// Only the handle: the parsers never talk to the USB host driver
+typedef struct hid_interface* hid_host_device_handle_t;
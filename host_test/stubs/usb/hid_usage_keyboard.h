@@ -0,0 +1,10 @@
+#pragma once
+#include <stdint.h>
+typedef union { struct { uint8_t left_ctr:1, left_shift:1, left_alt:1, left_gui:1, rigth_ctr:1, right_shift:1, right_alt:1, right_gui:1; }; uint8_t val; } hid_keyboard_modifier_bm_t;
+typedef struct __attribute__((packed)) { hid_keyboard_modifier_bm_t modifier; uint8_t reserved; uint8_t key[6]; } hid_keyboard_input_report_boot_t;
+#define HID_KEY_F1 0x3A
+#define HID_KEY_F2 0x3B
+#define HID_KEY_F3 0x3C
+#define HID_KEY_F12 0x45
+#define HID_KEY_O 0x12
+#define HID_KEY_P 0x13
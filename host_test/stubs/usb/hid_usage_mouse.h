@@ -0,0 +1,4 @@
+#pragma once
+#include <stdint.h>
+typedef union { struct { uint8_t button1:1, button2:1, button3:1, reserved:5; }; uint8_t val; } hid_mouse_button_bm_t;
+typedef struct __attribute__((packed)) { hid_mouse_button_bm_t buttons; int8_t x_displacement; int8_t y_displacement; } hid_mouse_input_report_boot_t;
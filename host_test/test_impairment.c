@@ -0,0 +1,144 @@
+#include "host_test.h"
+#include "wifi/impairment.h"
+#include <math.h>
+#include <string.h>
+
+// Statistics of the link impairment model against what its parameters promise: the
+// Kconfig defaults give ~4.7% loss in bursts of ~5 frames, each delay distribution has
+// the p99 its parameters give, and a seed repeats its run exactly.
+
+#define FRAMES 1000000
+#define DELAY_SAMPLES 200000
+
+static const impairment_config_t default_config = {
+    .seed = 1,
+    .good_to_bad = 100,
+    .bad_to_good = 2000,
+    .loss_good = 0,
+    .loss_bad = 10000,
+};
+
+static bool near(double value, double expected, double tolerance){
+    return fabs(value - expected) <= expected * tolerance;
+}
+
+static void test_burst_loss(void){
+    impairment_t link;
+    uint32_t delay_us[IMPAIRMENT_MAX_COPIES];
+    impairment_init(&link, &default_config);
+
+    uint32_t bursts = 0, lost = 0;
+    bool in_burst = false;
+    for (int i = 0; i < FRAMES; i++){
+        bool dropped = impairment_apply(&link, delay_us) == 0;
+        if (dropped){
+            lost++;
+            if (!in_burst)
+                bursts++;
+        }
+        in_burst = dropped;
+    }
+    CHECK(link.stats.frames == FRAMES);
+    CHECK(link.stats.lost == lost);
+
+    // 100 / (100 + 2000) of frames, in bursts of 10000 / 2000
+    double loss = (double)lost / FRAMES;
+    double mean_burst = (double)lost / bursts;
+    printf("loss %.2f%%, mean burst %.2f frames\n", loss * 100, mean_burst);
+    CHECK(near(loss, 100.0 / 2100, 0.05));
+    CHECK(near(mean_burst, 5.0, 0.05));
+}
+
+static int compare_delay(const void* a, const void* b){
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// p99 of the delays of the delivered frames
+static uint32_t p99_delay(impairment_delay_dist_t dist, uint32_t delay_us, uint32_t jitter_us){
+    impairment_config_t config = default_config;
+    config.delay_dist = dist;
+    config.delay_us = delay_us;
+    config.jitter_us = jitter_us;
+    impairment_t link;
+    impairment_init(&link, &config);
+
+    static uint32_t samples[DELAY_SAMPLES];
+    uint32_t delays[IMPAIRMENT_MAX_COPIES];
+    int count = 0;
+    while (count < DELAY_SAMPLES){
+        if (impairment_apply(&link, delays)){
+            CHECK(delays[0] >= delay_us);
+            samples[count++] = delays[0];
+        }
+    }
+    qsort(samples, DELAY_SAMPLES, sizeof(samples[0]), compare_delay);
+    return samples[(DELAY_SAMPLES * 99) / 100];
+}
+
+static void test_delay_p99(void){
+    uint32_t uniform = p99_delay(IMPAIRMENT_DELAY_UNIFORM, 1000, 2000);
+    uint32_t exponential = p99_delay(IMPAIRMENT_DELAY_EXPONENTIAL, 1000, 500);
+    uint32_t normal = p99_delay(IMPAIRMENT_DELAY_NORMAL, 1000, 500);
+    printf("p99: uniform %lu, exponential %lu, normal %lu US\n",
+           (unsigned long)uniform, (unsigned long)exponential, (unsigned long)normal);
+    // 0.99 of the spread; ln(100) means; 2.576 std devs of the half-normal
+    CHECK(near(uniform, 1000 + 0.99 * 2000, 0.02));
+    CHECK(near(exponential, 1000 + log(100) * 500, 0.03));
+    CHECK(near(normal, 1000 + 2.576 * 500, 0.03));
+    // No spread, no jitter
+    CHECK(p99_delay(IMPAIRMENT_DELAY_EXPONENTIAL, 1000, 0) == 1000);
+}
+
+static void test_reorder_duplicate(void){
+    impairment_config_t config = default_config;
+    config.good_to_bad = 0;
+    config.reorder = 200;
+    config.reorder_us = 5000;
+    config.duplicate = 100;
+    impairment_t link;
+    impairment_init(&link, &config);
+
+    uint32_t delays[IMPAIRMENT_MAX_COPIES];
+    uint32_t held = 0;
+    for (int i = 0; i < FRAMES; i++){
+        int copies = impairment_apply(&link, delays);
+        CHECK(copies >= 1 && copies <= IMPAIRMENT_MAX_COPIES);
+        for (int c = 0; c < copies; c++)
+            held += delays[c] == config.reorder_us;
+    }
+    CHECK(link.stats.lost == 0);
+    CHECK(link.stats.reordered == held);
+    CHECK(near(link.stats.duplicated, FRAMES * 0.01, 0.05));
+    CHECK(near(link.stats.reordered, (FRAMES + link.stats.duplicated) * 0.02, 0.05));
+}
+
+static void test_seed_repeats(void){
+    impairment_config_t config = default_config;
+    config.jitter_us = 1000;
+    impairment_t a, b, other;
+    impairment_init(&a, &config);
+    impairment_init(&b, &config);
+    config.seed = 2;
+    impairment_init(&other, &config);
+
+    uint32_t delay_a[IMPAIRMENT_MAX_COPIES], delay_b[IMPAIRMENT_MAX_COPIES], delay_other[IMPAIRMENT_MAX_COPIES];
+    int differ = 0;
+    for (int i = 0; i < 10000; i++){
+        int copies = impairment_apply(&a, delay_a);
+        CHECK(impairment_apply(&b, delay_b) == copies);
+        CHECK(memcmp(delay_a, delay_b, copies * sizeof(delay_a[0])) == 0);
+        int other_copies = impairment_apply(&other, delay_other);
+        differ += other_copies != copies || (copies && delay_other[0] != delay_a[0]);
+    }
+    CHECK(memcmp(&a.stats, &b.stats, sizeof(a.stats)) == 0);
+    CHECK(differ > 5000);
+}
+
+int main(void){
+    test_burst_loss();
+    test_delay_p99();
+    test_reorder_duplicate();
+    test_seed_repeats();
+    return 0;
+}
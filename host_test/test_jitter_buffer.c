@@ -0,0 +1,45 @@
+#include "host_test.h"
+#include "jitter_buffer.h"
+#include <stdint.h>
+
+// The receiver's mouse playout buffer: a report the host refused and gave back goes out
+// again with the next pull, its motion and button change included.
+
+static jitter_buffer_t jb;
+
+static void push(int32_t x, uint8_t buttons, int64_t rx_us){
+    mouse_motion_t motion = { .x = x, .buttons = buttons, .timestamp_us = (uint32_t)rx_us };
+    jb_push(&jb, &motion, rx_us);
+}
+
+static void test_refused_motion_kept(void){
+    espnow_msg_mouse_t report;
+    jb_reset(&jb);
+    push(200, 0, 1000);
+    CHECK(jb_pull(&jb, INT64_MAX, &report) && report.x == 127);
+    // Refused: all 200 are still owed
+    jb_unpull(&jb, &report);
+    CHECK(jb_has_pending(&jb) && jb_next_due_us(&jb, 5000) == 5000);
+    int32_t sent = 0;
+    while (jb_pull(&jb, INT64_MAX, &report))
+        sent += report.x;
+    CHECK(sent == 200);
+    CHECK(!jb_has_pending(&jb));
+}
+
+static void test_refused_buttons_kept(void){
+    espnow_msg_mouse_t report;
+    jb_reset(&jb);
+    push(0, 1, 1000);
+    CHECK(jb_pull(&jb, INT64_MAX, &report) && report.buttons == 1);
+    // The press alone was refused: it goes again though nothing changed since
+    jb_unpull(&jb, &report);
+    CHECK(jb_pull(&jb, INT64_MAX, &report) && report.buttons == 1 && report.x == 0);
+    CHECK(!jb_pull(&jb, INT64_MAX, &report));
+}
+
+int main(void){
+    test_refused_motion_kept();
+    test_refused_buttons_kept();
+    return 0;
+}
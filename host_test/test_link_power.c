@@ -0,0 +1,88 @@
+#include "host_test.h"
+#include "wifi/link_power.h"
+#include "wifi/transport.h"
+#include "wifi/wifi.h"
+#include "esp_timer.h"
+
+// Send timing of the power management: each completion is timed from its own send,
+// found by token, whatever order completions come in; sends the transport never
+// completes age out of the table; and a send goes in the mode the radio was in.
+
+static const transport_t test_transport = { .name = "test" };
+
+const transport_t* get_transport(void){
+    return &test_transport;
+}
+
+static link_power_stats_t power_stats(void){
+    link_power_stats_t stats;
+    get_link_power_stats(&stats);
+    return stats;
+}
+
+static void test_out_of_order(void){
+    link_power_stats_t before = power_stats();
+    link_power_frame_queued(10);
+    vTaskDelay(pdMS_TO_TICKS(30));
+    link_power_frame_queued(11);
+    // The newer send completes first, and is timed from its own start
+    link_power_frame_sent(11, true);
+    link_power_frame_sent(10, true);
+    link_power_stats_t after = power_stats();
+    uint32_t sends = after.sends[LINK_POWER_ACTIVE] - before.sends[LINK_POWER_ACTIVE];
+    uint64_t sum_us = after.send_sum_us[LINK_POWER_ACTIVE] - before.send_sum_us[LINK_POWER_ACTIVE];
+    CHECK(sends == 2);
+    CHECK(after.send_max_us[LINK_POWER_ACTIVE] >= 25000);
+    CHECK(sum_us - after.send_max_us[LINK_POWER_ACTIVE] < 10000);
+}
+
+static void test_unknown_tokens(void){
+    link_power_stats_t before = power_stats();
+    // Failed sends, completions for sends never timed, and a repeat are not counted
+    link_power_frame_queued(20);
+    link_power_frame_sent(20, false);
+    link_power_frame_sent(20, true);
+    link_power_frame_sent(21, true);
+    link_power_frame_sent(SEND_TOKEN_NONE, true);
+    CHECK(power_stats().sends[LINK_POWER_ACTIVE] == before.sends[LINK_POWER_ACTIVE]);
+}
+
+static void test_lost_completions_age_out(void){
+    link_power_stats_t before = power_stats();
+    // Far more sends than the table holds, each a little later; the newest are still there
+    for (uint32_t token = 100; token < 200; token++){
+        int64_t start_us = esp_timer_get_time();
+        while (esp_timer_get_time() == start_us);
+        link_power_frame_queued(token);
+    }
+    link_power_frame_sent(100, true);
+    link_power_frame_sent(199, true);
+    link_power_frame_sent(198, true);
+    CHECK(power_stats().sends[LINK_POWER_ACTIVE] == before.sends[LINK_POWER_ACTIVE] + 2);
+}
+
+static void test_mode_per_send(void){
+    set_link_power_idle(1000);
+    CHECK_SOON(get_link_power_mode() == LINK_POWER_IDLE, 500);
+    link_power_stats_t before = power_stats();
+    link_power_frame_queued(300);
+    link_power_frame_sent(300, true);
+    CHECK(power_stats().sends[LINK_POWER_IDLE] == before.sends[LINK_POWER_IDLE] + 1);
+
+    // Input takes it back; sends count as awake once the radio is
+    set_link_power_idle(0);
+    CHECK(get_link_power_mode() == LINK_POWER_ACTIVE);
+    CHECK_SOON(power_stats().wakes > before.wakes, 500);
+    link_power_frame_queued(301);
+    link_power_frame_sent(301, true);
+    CHECK(power_stats().sends[LINK_POWER_ACTIVE] == before.sends[LINK_POWER_ACTIVE] + 1);
+}
+
+int main(void){
+    CHECK(init_link_power(0) == ESP_OK);
+    test_out_of_order();
+    test_unknown_tokens();
+    test_lost_completions_age_out();
+    test_mode_per_send();
+    return 0;
+}
@@ -0,0 +1,224 @@
+#include "host_test.h"
+#include "wifi/link_security.h"
+#include "wifi/msg_types.h"
+#include "wifi/relay.h"
+#include "nvs_flash.h"
+#include <string.h>
+
+// Frame counter and relay sealing rules of link_security.c: counters never repeat, not
+// across reboots either; a frame is accepted once, and never after a reboot; the replay
+// floor clears a peer that skipped ahead; sealed frames open only unaltered, relayed
+// ones only sealed, and only those restart a relay window; a peer without a stored
+// link key gets none; and both ends of the X25519 pairing exchange derive the same
+// key, one that depends on the whole exchange.
+
+static const uint8_t own_mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+static const uint8_t peer_mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+static const uint8_t lmk[LINK_KEY_LEN] = "0123456789abcdef";
+static const uint8_t* addr = own_mac;      // which end the module plays
+
+static esp_err_t test_get_addr(uint8_t out[TRANSPORT_ADDR_LEN]){
+    memcpy(out, addr, TRANSPORT_ADDR_LEN);
+    return ESP_OK;
+}
+
+static const transport_t test_transport = { .name = "test", .get_addr = test_get_addr };
+
+const transport_t* get_transport(void){
+    return &test_transport;
+}
+
+// Waits out a block reservation, which the link task makes in the background
+static uint32_t next_counter(void){
+    uint32_t counter = 0;
+    for (int tries = 0; !link_next_tx_counter(&counter); tries++){
+        CHECK(tries < 100);
+        vTaskDelay(1);
+    }
+    return counter;
+}
+
+static void test_tx_counters(void){
+    uint32_t first = next_counter();
+    CHECK(next_counter() == first + 1);
+    uint32_t last = next_counter();
+
+    // Whatever the last boot reserved is skipped, used or not
+    CHECK(init_link_security() == ESP_OK);
+    uint32_t rebooted = next_counter();
+    CHECK(rebooted > last);
+
+    // A dropped connection moves a block on, past a rebooted peer's raised floor
+    link_skip_tx_counters();
+    CHECK(next_counter() >= rebooted + LINK_COUNTER_BLOCK);
+}
+
+static void test_replay_window(void){
+    CHECK(store_link_key(peer_mac, lmk) == ESP_OK);
+    CHECK(link_accept_rx_counter(100));
+    CHECK(!link_accept_rx_counter(100));
+    CHECK(link_accept_rx_counter(99));
+    CHECK(!link_accept_rx_counter(99));
+    CHECK(link_accept_rx_counter(100 - LINK_REPLAY_WINDOW + 1));
+    CHECK(!link_accept_rx_counter(100 - LINK_REPLAY_WINDOW));
+    CHECK(link_accept_rx_counter(100 + LINK_REPLAY_WINDOW));
+    CHECK(!link_accept_rx_counter(100));
+}
+
+static void test_replay_floor(void){
+    // Accepted, but not yet far enough along to be saved
+    CHECK(store_link_key(peer_mac, lmk) == ESP_OK);
+    CHECK(link_accept_rx_counter(1000));
+    CHECK(init_link_security() == ESP_OK);
+    CHECK(!link_accept_rx_counter(1000));
+    CHECK(!link_accept_rx_counter(1001));
+    CHECK(link_accept_rx_counter(2 * LINK_COUNTER_BLOCK));
+
+    // Far enough to be saved, which the link task does in the background
+    uint32_t newest = 5 * LINK_COUNTER_BLOCK;
+    CHECK(link_accept_rx_counter(newest));
+    vTaskDelay(pdMS_TO_TICKS(100));
+    CHECK(init_link_security() == ESP_OK);
+    CHECK(!link_accept_rx_counter(newest));
+    CHECK(!link_accept_rx_counter(newest + 1));
+    CHECK(link_accept_rx_counter(newest + LINK_COUNTER_BLOCK + 1));
+
+    // A peer that skipped a block past its last frame clears the floor
+    uint32_t peer_counter = newest + LINK_COUNTER_BLOCK + 2;
+    CHECK(link_accept_rx_counter(peer_counter));
+    vTaskDelay(pdMS_TO_TICKS(100));
+    CHECK(init_link_security() == ESP_OK);
+    CHECK(link_accept_rx_counter(peer_counter + LINK_COUNTER_BLOCK + 1));
+}
+
+static void test_relay_sealing(void){
+    uint8_t header[16] = "relay header....";
+    uint8_t plain[32], sealed[32], opened[32], tag[ESPNOW_RELAY_TAG_LEN];
+    for (size_t i = 0; i < sizeof(plain); i++)
+        plain[i] = (uint8_t)(i * 7);
+
+    CHECK(link_seal(peer_mac, 7, header, sizeof(header), plain, sealed, sizeof(plain), tag) == ESP_ERR_INVALID_STATE);
+    CHECK(link_set_relay_key(lmk) == ESP_OK);
+    CHECK(link_seal(peer_mac, 7, header, sizeof(header), plain, sealed, sizeof(plain), tag) == ESP_OK);
+    CHECK(memcmp(sealed, plain, sizeof(plain)) != 0);
+    CHECK(link_open(peer_mac, 7, header, sizeof(header), sealed, opened, sizeof(sealed), tag) == ESP_OK);
+    CHECK(memcmp(opened, plain, sizeof(plain)) == 0);
+
+    // Another counter, sender or header, or any flipped bit, and it does not open
+    CHECK(link_open(peer_mac, 8, header, sizeof(header), sealed, opened, sizeof(sealed), tag) != ESP_OK);
+    CHECK(link_open(own_mac, 7, header, sizeof(header), sealed, opened, sizeof(sealed), tag) != ESP_OK);
+    header[3] ^= 1;
+    CHECK(link_open(peer_mac, 7, header, sizeof(header), sealed, opened, sizeof(sealed), tag) != ESP_OK);
+    header[3] ^= 1;
+    sealed[5] ^= 0x80;
+    CHECK(link_open(peer_mac, 7, header, sizeof(header), sealed, opened, sizeof(sealed), tag) != ESP_OK);
+    sealed[5] ^= 0x80;
+    tag[0] ^= 1;
+    CHECK(link_open(peer_mac, 7, header, sizeof(header), sealed, opened, sizeof(sealed), tag) != ESP_OK);
+}
+
+// A relayed frame as the peer sends it: frame ends with its counter, which is the seq
+static int relay_frame(uint8_t envelope[ESPNOW_FRAME_MAX_LEN], const uint8_t* frame, int len){
+    espnow_msg_relay_t* header = (espnow_msg_relay_t*)envelope;
+    int sealed_len = len - ESPNOW_COUNTER_LEN;
+    memset(header, 0, sizeof(*header));
+    header->msg_type = ESPNOW_MSG_RELAY;
+    memcpy(header->origin, peer_mac, 6);
+    memcpy(header->dest, own_mac, 6);
+    memcpy(&header->seq, frame + sealed_len, ESPNOW_COUNTER_LEN);
+    CHECK(link_seal(peer_mac, header->seq, envelope, RELAY_AAD_LEN, frame, envelope + sizeof(*header), sealed_len, header->tag) == ESP_OK);
+    memcpy(envelope + sizeof(*header) + sealed_len, &header->seq, ESPNOW_COUNTER_LEN);
+    return sizeof(*header) + len;
+}
+
+static void test_relay_open(void){
+    const uint8_t frame[] = {ESPNOW_MSG_MOUSE, 1, 2, 3, 0x2A, 0, 0, 0};     // counter 42
+    uint8_t envelope[ESPNOW_FRAME_MAX_LEN], opened[ESPNOW_FRAME_MAX_LEN];
+    espnow_msg_relay_t header;
+    int len = relay_frame(envelope, frame, sizeof(frame));
+    CHECK(relay_open(peer_mac, envelope, len, opened, &header) == (int)sizeof(frame));
+    CHECK(memcmp(opened, frame, sizeof(frame)) == 0 && header.seq == 42);
+
+    // Hops and relay_us are the relay's to change
+    ((espnow_msg_relay_t*)envelope)->hops = 1;
+    ((espnow_msg_relay_t*)envelope)->relay_us = 300;
+    CHECK(relay_open(peer_mac, envelope, len, opened, &header) == (int)sizeof(frame));
+    // Not from the peer, another seq, or a frame in clear with any tag: nothing opens
+    CHECK(relay_open(own_mac, envelope, len, opened, &header) < 0);
+    ((espnow_msg_relay_t*)envelope)->seq = 43;
+    CHECK(relay_open(peer_mac, envelope, len, opened, &header) < 0);
+    memcpy(envelope + sizeof(header), frame, sizeof(frame));
+    ((espnow_msg_relay_t*)envelope)->seq = 42;
+    CHECK(relay_open(peer_mac, envelope, len, opened, &header) < 0);
+    memset(((espnow_msg_relay_t*)envelope)->tag, 0, ESPNOW_RELAY_TAG_LEN);
+    CHECK(relay_open(peer_mac, envelope, len, opened, &header) < 0);
+    CHECK(relay_open(peer_mac, envelope, sizeof(header) + ESPNOW_COUNTER_LEN, opened, &header) < 0);
+}
+
+static void test_relay_window(void){
+    replay_window_t window = {0};
+    CHECK(relay_seq_accept(&window, 5000, false));
+    CHECK(!relay_seq_accept(&window, 5000, false));
+    CHECK(relay_seq_accept(&window, 4999, false));
+    // Far behind: a restart only if the frame authenticated, and then once
+    CHECK(!relay_seq_accept(&window, 10, false));
+    CHECK(window.highest == 5000);
+    CHECK(relay_seq_accept(&window, 10, true));
+    CHECK(!relay_seq_accept(&window, 10, true));
+    CHECK(relay_seq_accept(&window, 11, false));
+    CHECK(!relay_seq_accept(&window, 11, false));
+}
+
+static void test_link_keys(void){
+    uint8_t key[LINK_KEY_LEN];
+    CHECK(store_link_key(peer_mac, lmk) == ESP_OK);
+    CHECK(get_link_key(peer_mac, key) == ESP_OK);
+    CHECK(memcmp(key, lmk, LINK_KEY_LEN) == 0);
+    // No key for anyone else, and none once forgotten: those have to pair again
+    CHECK(get_link_key(own_mac, key) == ESP_ERR_NOT_FOUND);
+    forget_link_key();
+    CHECK(get_link_key(peer_mac, key) == ESP_ERR_NOT_FOUND);
+}
+
+static void test_pairing_keys(void){
+    uint8_t own_private[LINK_ECDH_KEY_LEN], own_public[LINK_ECDH_KEY_LEN];
+    uint8_t peer_private[LINK_ECDH_KEY_LEN], peer_public[LINK_ECDH_KEY_LEN];
+    uint8_t transcript[64] = "nonces and public keys";
+    uint8_t own_lmk[LINK_KEY_LEN], peer_lmk[LINK_KEY_LEN], other_lmk[LINK_KEY_LEN];
+    CHECK(link_generate_keypair(own_private, own_public) == ESP_OK);
+    CHECK(link_generate_keypair(peer_private, peer_public) == ESP_OK);
+    CHECK(memcmp(own_public, peer_public, LINK_ECDH_KEY_LEN) != 0);
+
+    CHECK(derive_link_key(own_private, peer_public, peer_mac, transcript, sizeof(transcript), own_lmk) == ESP_OK);
+    addr = peer_mac;
+    CHECK(derive_link_key(peer_private, own_public, own_mac, transcript, sizeof(transcript), peer_lmk) == ESP_OK);
+    CHECK(memcmp(own_lmk, peer_lmk, LINK_KEY_LEN) == 0);
+
+    // Any other transcript or key pair gives another key
+    transcript[0] ^= 1;
+    CHECK(derive_link_key(peer_private, own_public, own_mac, transcript, sizeof(transcript), other_lmk) == ESP_OK);
+    CHECK(memcmp(other_lmk, peer_lmk, LINK_KEY_LEN) != 0);
+    transcript[0] ^= 1;
+    CHECK(link_generate_keypair(peer_private, peer_public) == ESP_OK);
+    CHECK(derive_link_key(peer_private, own_public, own_mac, transcript, sizeof(transcript), other_lmk) == ESP_OK);
+    CHECK(memcmp(other_lmk, peer_lmk, LINK_KEY_LEN) != 0);
+
+    // A low-order public key would make the secret known to anyone
+    const uint8_t zero_key[LINK_ECDH_KEY_LEN] = {0};
+    CHECK(derive_link_key(peer_private, zero_key, own_mac, transcript, sizeof(transcript), other_lmk) != ESP_OK);
+    addr = own_mac;
+}
+
+int main(void){
+    CHECK(nvs_flash_init() == ESP_OK);
+    CHECK(init_link_security() == ESP_OK);
+    test_tx_counters();
+    test_replay_window();
+    test_replay_floor();
+    test_relay_sealing();
+    test_relay_open();
+    test_relay_window();
+    test_link_keys();
+    test_pairing_keys();
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include "host_test.h"
+#include "ota_target.h"
+#include "tx_scheduler.h"
+#include "wifi/wifi.h"
+#include "esp_ota_ops.h"
+#include "esp_random.h"
+#include "mbedtls/sha256.h"
+#include <string.h>
+
+// The transmitter's side of a firmware update against fake flash: a link in clear
+// never starts one, an image whose hash does not match never reaches esp_ota_end(),
+// and only an image esp_ota_end() takes (its signature checks out) is set to boot.
+
+#define IMAGE_LEN 1000      // five chunks, the last one short
+
+static uint8_t image[IMAGE_LEN];
+static bool link_encrypted = false;
+
+// Fake flash; esp_ota_end() answers what the signature check would
+static const esp_partition_t ota_partition = { .label = "ota_1", .size = 64 * 1024 };
+static uint8_t flash[IMAGE_LEN];
+static size_t flash_len;
+static esp_err_t signature_check = ESP_OK;
+static int begins, ends, aborts, boots;
+static volatile uint8_t acked_state = OTA_STATE_IDLE;
+
+bool is_link_encrypted(void){
+    return link_encrypted;
+}
+
+esp_err_t tx_scheduler_submit(const espnow_message_t* msg, size_t length){
+    CHECK(msg->msg_type == ESPNOW_MSG_OTA_ACK);
+    acked_state = ((const espnow_msg_ota_ack_t*)msg)->state;
+    return ESP_OK;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from){
+    return &ota_partition;
+}
+
+const esp_partition_t* esp_ota_get_running_partition(void){
+    return NULL;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size, esp_ota_handle_t* out_handle){
+    begins++;
+    flash_len = 0;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size){
+    CHECK(flash_len + size <= sizeof(flash));
+    memcpy(flash + flash_len, data, size);
+    flash_len += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle){
+    ends++;
+    return signature_check;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle){
+    aborts++;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition){
+    boots++;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* ota_state){
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void){
+    return ESP_OK;
+}
+
+static void begin_update(bool good_hash){
+    espnow_msg_ota_begin_t begin = { .msg_type = ESPNOW_MSG_OTA_BEGIN, .size = IMAGE_LEN };
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    mbedtls_sha256_update(&sha, image, sizeof(image));
+    mbedtls_sha256_finish(&sha, begin.sha256);
+    mbedtls_sha256_free(&sha);
+    if (!good_hash)
+        begin.sha256[0] ^= 1;
+    ota_target_begin(&begin);
+}
+
+static void send_image(void){
+    for (uint32_t i = 0; i * ESPNOW_OTA_CHUNK_LEN < IMAGE_LEN; i++){
+        espnow_msg_ota_chunk_t chunk = { .msg_type = ESPNOW_MSG_OTA_CHUNK, .index = i };
+        uint32_t offset = i * ESPNOW_OTA_CHUNK_LEN;
+        chunk.len = (IMAGE_LEN - offset < ESPNOW_OTA_CHUNK_LEN) ? IMAGE_LEN - offset : ESPNOW_OTA_CHUNK_LEN;
+        memcpy(chunk.data, image + offset, chunk.len);
+        ota_target_chunk(&chunk);
+    }
+}
+
+static void test_clear_link_refused(void){
+    link_encrypted = false;
+    begin_update(true);
+    CHECK_SOON(acked_state == OTA_STATE_FAILED, 1000);
+    send_image();
+    vTaskDelay(pdMS_TO_TICKS(20));
+    CHECK(begins == 0 && flash_len == 0 && boots == 0);
+}
+
+static void test_hash_mismatch(void){
+    link_encrypted = true;
+    begin_update(false);
+    CHECK_SOON(acked_state == OTA_STATE_RECEIVING, 1000);
+    send_image();
+    CHECK_SOON(acked_state == OTA_STATE_FAILED, 1000);
+    CHECK(begins == 1 && flash_len == IMAGE_LEN);
+    // Never offered to the signature check
+    CHECK(ends == 0 && aborts == 1 && boots == 0);
+}
+
+static void test_signature_rejected(void){
+    signature_check = ESP_ERR_OTA_VALIDATE_FAILED;
+    begin_update(true);
+    CHECK_SOON(acked_state == OTA_STATE_RECEIVING, 1000);
+    send_image();
+    CHECK_SOON(acked_state == OTA_STATE_FAILED, 1000);
+    CHECK(ends == 1 && boots == 0);
+}
+
+static void test_signed_image_boots(void){
+    signature_check = ESP_OK;
+    begin_update(true);
+    CHECK_SOON(acked_state == OTA_STATE_RECEIVING, 1000);
+    send_image();
+    // Checked before the restart OTA_RESTART_DELAY_US after
+    CHECK_SOON(acked_state == OTA_STATE_DONE, 500);
+    CHECK(ends == 2 && boots == 1);
+    CHECK(flash_len == IMAGE_LEN && memcmp(flash, image, IMAGE_LEN) == 0);
+}
+
+int main(void){
+    esp_fill_random(image, sizeof(image));
+    CHECK(begin_ota_target() == ESP_OK);
+    test_clear_link_refused();
+    test_hash_mismatch();
+    test_signature_rejected();
+    test_signed_image_boots();
+    return 0;
+}
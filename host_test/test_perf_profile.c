@@ -0,0 +1,70 @@
+#include "host_test.h"
+#include "wifi/perf_profile.h"
+#include "wifi/wifi.h"
+#include "nvs.h"
+
+// Performance profiles: the saved one is applied at start, a switch applies the link
+// settings and the application's part from the profile task and is then saved, and
+// the hotkey's next profile wraps around.
+
+static volatile int applied;
+static volatile perf_profile_id_t applied_id = NUM_PERF_PROFILES;
+static link_rate_t rate;
+static int8_t tx_power;
+static uint64_t keepalive_us;
+
+void set_link_rate(link_rate_t new_rate){ rate = new_rate; }
+void set_link_tx_power(int8_t quarter_dbm){ tx_power = quarter_dbm; }
+void set_keepalive_interval(uint64_t interval_us){ keepalive_us = interval_us; }
+
+void perf_profile_applied_cb(const perf_profile_t* profile){
+    applied_id = get_perf_profile_id();
+    applied++;
+}
+
+static uint8_t saved_profile(void){
+    nvs_handle_t handle;
+    uint8_t id = 0xFF;
+    CHECK(nvs_open("storage", NVS_READONLY, &handle) == ESP_OK);
+    nvs_get_u8(handle, "perf_profile", &id);
+    nvs_close(handle);
+    return id;
+}
+
+static void test_saved_profile_at_start(void){
+    nvs_handle_t handle;
+    CHECK(nvs_open("storage", NVS_READWRITE, &handle) == ESP_OK);
+    CHECK(nvs_set_u8(handle, "perf_profile", PERF_PROFILE_BATTERY) == ESP_OK);
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    CHECK(init_perf_profile() == ESP_OK);
+    CHECK_SOON(applied == 1, 1000);
+    CHECK(applied_id == PERF_PROFILE_BATTERY);
+    CHECK(tx_power == 44 && keepalive_us == 10000000 && rate == LINK_RATE_FAST);
+}
+
+static void test_hotkey_wraps(void){
+    // Battery is the last: the next one is the first, applied and then saved
+    next_perf_profile();
+    CHECK_SOON(applied == 2 && saved_profile() == PERF_PROFILE_COMPETITIVE, 1000);
+    CHECK(applied_id == PERF_PROFILE_COMPETITIVE && !get_perf_profile()->jitter_buffer);
+}
+
+static void test_switch(void){
+    set_perf_profile(NUM_PERF_PROFILES);
+    set_perf_profile(PERF_PROFILE_OFFICE);
+    CHECK_SOON(applied == 3 && saved_profile() == PERF_PROFILE_OFFICE, 1000);
+    CHECK(rate == LINK_RATE_DEFAULT && keepalive_us == 4999000);
+    // The same profile again changes nothing
+    set_perf_profile(PERF_PROFILE_OFFICE);
+    vTaskDelay(pdMS_TO_TICKS(20));
+    CHECK(applied == 3);
+}
+
+int main(void){
+    test_saved_profile_at_start();
+    test_hotkey_wraps();
+    test_switch();
+    return 0;
+}
@@ -0,0 +1,223 @@
+#include "host_test.h"
+#include "device_config.h"
+#include "forward.h"
+#include "wifi/msg_types.h"
+#include "wifi/relay.h"
+#include "wifi/transport.h"
+#include <pthread.h>
+#include <string.h>
+
+// The relay's forwarding against a fake radio: frames between nodes it has not seen
+// are dropped until its peer task registers them, never from the receive callback;
+// forwarded frames leave with hops counted; a repeated seq, or one far behind, is
+// dropped while the node is active, since the relay cannot tell a restart from a
+// forged header; each send callback is matched to its frame by token; a quiet node
+// starts over; and a new node evicts the quietest.
+
+#define MAX_SENT 64
+
+static const uint8_t relay_addr[6] = {0x02, 0x52, 0x00, 0x00, 0x00, 0x01};
+static const uint8_t transmitter_addr[6] = {0x02, 0x54, 0x00, 0x00, 0x00, 0x01};
+static const uint8_t receiver_addr[6] = {0x02, 0x55, 0x00, 0x00, 0x00, 0x01};
+
+static transport_recv_cb_t recv_cb = NULL;
+static transport_send_cb_t send_cb = NULL;
+static pthread_t callback_thread;       // the one delivering frames, as the WiFi task would
+static portMUX_TYPE fake_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t sent[MAX_SENT][ESPNOW_FRAME_MAX_LEN];
+static uint32_t sent_tokens[MAX_SENT];
+static int sent_count = 0;
+static int peers_added = 0;
+static uint8_t last_deleted[6];
+
+static esp_err_t fake_start(transport_recv_cb_t recv, transport_send_cb_t send, transport_link_cb_t link){
+    recv_cb = recv;
+    send_cb = send;
+    return ESP_OK;
+}
+
+static esp_err_t fake_send(const uint8_t addr[6], const uint8_t* data, size_t len, uint32_t token){
+    // Beacons are broadcast, and nobody waits on them; only forwarded frames are kept
+    if (addr[0] & 0x01){
+        CHECK(token == TRANSPORT_TOKEN_NONE);
+        return ESP_OK;
+    }
+    portENTER_CRITICAL(&fake_lock);
+    CHECK(sent_count < MAX_SENT && memcmp(addr, data + offsetof(espnow_msg_relay_t, dest), 6) == 0);
+    CHECK(token != TRANSPORT_TOKEN_NONE);
+    sent_tokens[sent_count] = token;
+    memcpy(sent[sent_count++], data, len);
+    portEXIT_CRITICAL(&fake_lock);
+    return ESP_OK;
+}
+
+static esp_err_t fake_add_peer(const uint8_t addr[6], const uint8_t* lmk, bool* encrypted){
+    CHECK(!pthread_equal(pthread_self(), callback_thread));
+    *encrypted = false;
+    portENTER_CRITICAL(&fake_lock);
+    peers_added++;
+    portEXIT_CRITICAL(&fake_lock);
+    return ESP_OK;
+}
+
+static void fake_del_peer(const uint8_t addr[6]){
+    CHECK(!pthread_equal(pthread_self(), callback_thread));
+    portENTER_CRITICAL(&fake_lock);
+    memcpy(last_deleted, addr, 6);
+    portEXIT_CRITICAL(&fake_lock);
+}
+
+static esp_err_t fake_get_addr(uint8_t addr[6]){
+    memcpy(addr, relay_addr, 6);
+    return ESP_OK;
+}
+
+static esp_err_t fake_set_channel(uint8_t channel){
+    return ESP_OK;
+}
+
+static esp_err_t fake_set_rate(const uint8_t addr[6], link_rate_t rate){
+    return ESP_OK;
+}
+
+static const transport_t fake_transport = {
+    .name = "fake",
+    .start = fake_start,
+    .send = fake_send,
+    .add_peer = fake_add_peer,
+    .del_peer = fake_del_peer,
+    .get_addr = fake_get_addr,
+    .set_channel = fake_set_channel,
+    .set_rate = fake_set_rate
+};
+
+const transport_t* get_transport(void){
+    return &fake_transport;
+}
+
+static int frames_sent(void){
+    portENTER_CRITICAL(&fake_lock);
+    int count = sent_count;
+    portEXIT_CRITICAL(&fake_lock);
+    return count;
+}
+
+static int peer_adds(void){
+    portENTER_CRITICAL(&fake_lock);
+    int count = peers_added;
+    portEXIT_CRITICAL(&fake_lock);
+    return count;
+}
+
+static forward_stats_t forward_stats(void){
+    forward_stats_t stats;
+    get_forward_stats(&stats);
+    return stats;
+}
+
+// A relayed frame as src sends it; whether it is sealed is none of the relay's business
+static void deliver(const uint8_t src[6], const uint8_t origin[6], const uint8_t dest[6], uint32_t seq, uint8_t hops){
+    uint8_t frame[sizeof(espnow_msg_relay_t) + 8] = {0};
+    espnow_msg_relay_t* header = (espnow_msg_relay_t*)frame;
+    header->msg_type = ESPNOW_MSG_RELAY;
+    memcpy(header->origin, origin, 6);
+    memcpy(header->dest, dest, 6);
+    header->seq = seq;
+    header->hops = hops;
+    const transport_rx_info_t info = { .src_addr = src };
+    recv_cb(&info, frame, sizeof(frame));
+}
+
+// Forwarded at once, or not at all; acked by the destination
+static bool forwarded(const uint8_t origin[6], const uint8_t dest[6], uint32_t seq){
+    int before = frames_sent();
+    deliver(origin, origin, dest, seq, 0);
+    if (frames_sent() == before)
+        return false;
+    const espnow_msg_relay_t* header = (const espnow_msg_relay_t*)sent[before];
+    CHECK(header->seq == seq && header->hops == 1);
+    send_cb(dest, sent_tokens[before], true);
+    return true;
+}
+
+static void test_new_nodes_registered(void){
+    CHECK(!forwarded(transmitter_addr, receiver_addr, 100));
+    CHECK(forward_stats().dropped == 1);
+    CHECK_SOON(peer_adds() == 2, 500);
+    CHECK(forwarded(transmitter_addr, receiver_addr, 100));
+    CHECK(forwarded(receiver_addr, transmitter_addr, 7));
+    CHECK(forward_stats().forwarded == 2);
+}
+
+static void test_repeats_dropped(void){
+    CHECK(!forwarded(transmitter_addr, receiver_addr, 100));
+    CHECK(forwarded(transmitter_addr, receiver_addr, 99));
+    // Far behind: an unauthenticated header cannot restart the window
+    CHECK(!forwarded(transmitter_addr, receiver_addr, 10));
+    CHECK(forward_stats().duplicates == 2);
+    CHECK(forwarded(transmitter_addr, receiver_addr, 101));
+}
+
+static void test_bad_headers_dropped(void){
+    int before = frames_sent();
+    // Relayed once already, not sent by its origin, or meant for the relay itself
+    deliver(transmitter_addr, transmitter_addr, receiver_addr, 200, 1);
+    deliver(receiver_addr, transmitter_addr, receiver_addr, 201, 0);
+    deliver(transmitter_addr, transmitter_addr, relay_addr, 202, 0);
+    CHECK(frames_sent() == before);
+}
+
+static void test_completions_by_token(void){
+    forward_stats_t before = forward_stats();
+    int first = frames_sent();
+    deliver(transmitter_addr, transmitter_addr, receiver_addr, 300, 0);
+    deliver(receiver_addr, receiver_addr, transmitter_addr, 300, 0);
+    CHECK(frames_sent() == first + 2);
+    // The second completes first, and fails; a completion for no frame of ours is ignored
+    send_cb(transmitter_addr, sent_tokens[first + 1], false);
+    send_cb(receiver_addr, sent_tokens[first + 1] + 100, true);
+    send_cb(receiver_addr, sent_tokens[first], true);
+    send_cb(receiver_addr, sent_tokens[first], true);
+    forward_stats_t after = forward_stats();
+    CHECK(after.forwarded == before.forwarded + 1 && after.failed == before.failed + 1);
+}
+
+static void test_quiet_node_restarts(void){
+    CHECK(!forwarded(transmitter_addr, receiver_addr, 10));
+    vTaskDelay(pdMS_TO_TICKS(RELAY_TIMEOUT_US / 1000 + 100));
+    CHECK(forwarded(transmitter_addr, receiver_addr, 10));
+    CHECK(forwarded(transmitter_addr, receiver_addr, 11));
+}
+
+static void test_quietest_evicted(void){
+    // The receiver is refreshed by every frame to it; the transmitter goes quiet
+    for (int i = 0; i < RELAY_MAX_NODES - 1; i++){
+        uint8_t node[6] = {0x02, 0x56, 0x00, 0x00, 0x00, (uint8_t)i};
+        int adds = peer_adds();
+        vTaskDelay(2);
+        CHECK(!forwarded(node, receiver_addr, 1));
+        CHECK_SOON(peer_adds() == adds + 1, 500);
+        CHECK(forwarded(node, receiver_addr, 1));
+    }
+    portENTER_CRITICAL(&fake_lock);
+    bool evicted = memcmp(last_deleted, transmitter_addr, 6) == 0;
+    portEXIT_CRITICAL(&fake_lock);
+    CHECK(evicted);
+    // Back again: registered anew, with a fresh window
+    int adds = peer_adds();
+    CHECK(!forwarded(transmitter_addr, receiver_addr, 50));
+    CHECK_SOON(peer_adds() == adds + 1, 500);
+    CHECK(forwarded(transmitter_addr, receiver_addr, 50));
+}
+
+int main(void){
+    callback_thread = pthread_self();
+    CHECK(begin_forwarding() == ESP_OK);
+    test_new_nodes_registered();
+    test_repeats_dropped();
+    test_bad_headers_dropped();
+    test_completions_by_token();
+    test_quiet_node_restarts();
+    test_quietest_evicted();
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "host_test.h"
+#include "report_timing.h"
+#include <string.h>
+
+// Device characterization: the poll rate a device's report timing implies, with idle
+// gaps left out of the estimate, and the coalescing window fitted to it.
+
+// One report every interval_us with jitter_us of spread, an idle gap every 50 reports
+static void record(report_timing_t* timing, int reports, uint32_t interval_us, uint32_t jitter_us){
+    int64_t now_us = 1000000;
+    for (int i = 0; i < reports; i++){
+        int32_t spread = jitter_us ? (int32_t)(i % 3) * (int32_t)jitter_us - (int32_t)jitter_us : 0;
+        now_us += interval_us + spread;
+        if (i % 50 == 49)
+            now_us += 200000;
+        timing_record(timing, now_us, 4 + i % 2);
+    }
+}
+
+static void test_bin_edges(void){
+    uint32_t last = 0;
+    for (int bin = 0; bin < TIMING_BINS - 1; bin++){
+        CHECK(timing_bin_edge_us(bin) > last);
+        last = timing_bin_edge_us(bin);
+    }
+    CHECK(timing_bin_edge_us(TIMING_BINS - 1) == UINT32_MAX);
+}
+
+static void test_too_few_samples(void){
+    report_timing_t timing = {0};
+    poll_estimate_t estimate;
+    record(&timing, TIMING_MIN_SAMPLES, 1000, 0);
+    // One interval fewer than reports, and one of those was idle
+    CHECK(!timing_estimate(&timing, &estimate));
+}
+
+static void test_1000hz(void){
+    report_timing_t timing = {0};
+    poll_estimate_t estimate;
+    record(&timing, 500, 1000, 60);
+    CHECK(timing_estimate(&timing, &estimate));
+    CHECK(estimate.poll_hz == 1000 && estimate.interval_us == 1000);
+    // Idle gaps are in the histogram, not in the jitter
+    CHECK(estimate.jitter_us >= 40 && estimate.jitter_us <= 60);
+    CHECK(timing.bins[TIMING_BINS - 1] == 10);
+    CHECK(timing.min_len == 4 && timing.max_len == 5);
+}
+
+static void test_125hz(void){
+    report_timing_t timing = {0};
+    poll_estimate_t estimate;
+    record(&timing, 500, 8000, 200);
+    CHECK(timing_estimate(&timing, &estimate));
+    CHECK(estimate.poll_hz == 125 && estimate.interval_us == 8000);
+    CHECK(estimate.p99_us >= 8000 && estimate.p99_us <= 8500);
+}
+
+static void test_coalesce_window(void){
+    poll_estimate_t estimate = { .poll_hz = 1000, .interval_us = 1000, .jitter_us = 50 };
+    // Three polls fit, plus twice the jitter
+    CHECK(timing_coalesce_window(&estimate, 3500) == 3100);
+    // Not even one poll: no waiting
+    CHECK(timing_coalesce_window(&estimate, 900) == 0);
+    // The margin stops at a quarter of a poll
+    estimate.jitter_us = 400;
+    CHECK(timing_coalesce_window(&estimate, 2000) == 2250);
+}
+
+int main(void){
+    test_bin_edges();
+    test_too_few_samples();
+    test_1000hz();
+    test_125hz();
+    test_coalesce_window();
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include "host_test.h"
+#include "device_config.h"
+#include "devices.h"
+#include "tx_scheduler.h"
+#include "wifi/wifi.h"
+#include <stdio.h>
+#include <string.h>
+
+// trace.c with replay on, which the firmware leaves off; device_config.h is already in,
+// so the override stands
+#undef TRACE_REPLAY
+#define TRACE_REPLAY ENABLED
+#include "trace/trace.c"
+
+// A checked-in trace (traces/basic.trc, from traces/gen_basic_trace.py) replayed through
+// the real parsers and TX scheduler against a fake link that acks every frame at once.
+// What leaves the link is the same whatever the pace: every key edge in order, the
+// mouse counters at the sum of the motion with each button change kept, and the raw
+// reports of the device without a profile as they were.
+
+#define MAX_KEYS 16
+#define MAX_RAW 8
+
+// What the link carried, decoded from every frame
+typedef struct {
+    uint8_t keys[MAX_KEYS][2];      // modifiers, first key
+    int num_keys;
+    uint8_t buttons[MAX_KEYS];      // mouse buttons, each change once
+    int num_buttons;
+    uint32_t x, y;                  // last position counters
+    uint8_t raw[MAX_RAW][4];
+    int num_raw;
+    int frames;
+} carried_t;
+
+static carried_t carried;
+static uint32_t last_token = SEND_TOKEN_NONE;
+static portMUX_TYPE carried_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Completions reach the scheduler through the callback wifi.c declares for itself
+extern void send_status_cb(uint32_t token, bool success);
+
+// Not under test: the keyboard's hotkeys
+void begin_pairing(void){}
+void next_perf_profile(void){}
+
+uint32_t new_send_token(void){
+    return ++last_token;
+}
+
+static void take_message(const uint8_t* msg, size_t len){
+    switch (msg[0]){
+        case ESPNOW_MSG_KEYBOARD: {
+            const espnow_msg_keyboard_t* keyboard = (const espnow_msg_keyboard_t*)msg;
+            CHECK(carried.num_keys < MAX_KEYS);
+            carried.keys[carried.num_keys][0] = keyboard->modifiers;
+            carried.keys[carried.num_keys++][1] = keyboard->keys[0];
+            break;
+        }
+        case ESPNOW_MSG_MOUSE_POSITION: {
+            const espnow_msg_mouse_position_t* position = (const espnow_msg_mouse_position_t*)msg;
+            if (carried.num_buttons == 0 || carried.buttons[carried.num_buttons - 1] != position->buttons){
+                CHECK(carried.num_buttons < MAX_KEYS);
+                carried.buttons[carried.num_buttons++] = position->buttons;
+            }
+            carried.x = position->x;
+            carried.y = position->y;
+            break;
+        }
+        case ESPNOW_MSG_RAW_REPORT: {
+            const espnow_msg_raw_report_t* raw = (const espnow_msg_raw_report_t*)msg;
+            CHECK(carried.num_raw < MAX_RAW && raw->len == 4);
+            memcpy(carried.raw[carried.num_raw++], raw->data, 4);
+            break;
+        }
+        default:
+            CHECK(false);
+    }
+}
+
+esp_err_t send_message_tagged(const uint8_t* data, size_t size, uint32_t token){
+    portENTER_CRITICAL(&carried_lock);
+    carried.frames++;
+    if (data[0] != ESPNOW_MSG_BUNDLE)
+        take_message(data, size);
+    else {
+        size_t offset = sizeof(espnow_msg_bundle_t);
+        for (int i = 0; i < data[1] && offset < size; i++){
+            uint8_t len = data[offset++];
+            take_message(data + offset, len);
+            offset += len;
+        }
+    }
+    portEXIT_CRITICAL(&carried_lock);
+    send_status_cb(token, true);
+    return ESP_OK;
+}
+
+static carried_t snapshot(void){
+    portENTER_CRITICAL(&carried_lock);
+    carried_t copy = carried;
+    portEXIT_CRITICAL(&carried_lock);
+    return copy;
+}
+
+static uint8_t* read_trace(size_t* len){
+    FILE* file = fopen(TRACE_FILE, "rb");
+    CHECK(file != NULL);
+    static uint8_t trace[4096];
+    *len = fread(trace, 1, sizeof(trace), file);
+    fclose(file);
+    CHECK(*len > sizeof(trace_header_t) && *len < sizeof(trace));
+    return trace;
+}
+
+// Replay at speed, and check what the link carried since start
+static void replay_and_check(const uint8_t* trace, size_t len, uint32_t speed, carried_t start){
+    trace_replay_stats_t stats;
+    CHECK(trace_replay(trace, len, speed, &stats) == ESP_OK);
+    CHECK(stats.reports == 26 && stats.failed == 0);
+    if (speed == 1)
+        CHECK(stats.elapsed_us >= 25000);
+
+    // Motion left alone in the accumulator goes once the link is free again
+    CHECK_SOON(snapshot().x == start.x + 60 && snapshot().y == start.y - 40, 1000);
+    carried_t now = snapshot();
+    static const uint8_t keys[][2] = { {0, 0x04}, {0, 0}, {0x02, 0x05}, {0, 0} };
+    CHECK(now.num_keys == start.num_keys + 4);
+    CHECK(memcmp(now.keys[start.num_keys], keys, sizeof(keys)) == 0);
+    // Released, pressed, released: no change merged away
+    int button_changes = now.num_buttons - start.num_buttons;
+    CHECK(button_changes >= 2);
+    CHECK(now.buttons[now.num_buttons - 2] == 1 && now.buttons[now.num_buttons - 1] == 0);
+    CHECK(now.num_raw == start.num_raw + 2);
+    CHECK(now.raw[start.num_raw][0] == 1 && now.raw[start.num_raw + 1][3] == 8);
+}
+
+static void test_not_a_trace(void){
+    static const uint8_t junk[16] = {0};
+    trace_replay_stats_t stats;
+    CHECK(trace_replay(junk, sizeof(junk), 0, &stats) == ESP_ERR_INVALID_ARG);
+    CHECK(stats.reports == 0);
+}
+
+static void test_truncated_trace(const uint8_t* trace, size_t len){
+    // Cut inside the last report: the ones before it still go
+    carried_t start = snapshot();
+    trace_replay_stats_t stats;
+    CHECK(trace_replay(trace, len - 2, 0, &stats) == ESP_OK);
+    CHECK(stats.reports == 25);
+    CHECK_SOON(snapshot().x == start.x + 57, 1000);
+}
+
+int main(void){
+    begin_keyboard_watchdog();
+    CHECK(begin_tx_scheduler() == ESP_OK);
+    size_t len;
+    const uint8_t* trace = read_trace(&len);
+    test_not_a_trace();
+    // At the captured pace, then as fast as it goes: the same on the link
+    replay_and_check(trace, len, 1, snapshot());
+    replay_and_check(trace, len, 0, snapshot());
+    test_truncated_trace(trace, len);
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include "host_test.h"
+#include "wifi/transport.h"
+#include "sdkconfig.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// The UDP transport against a socket in the peer's place: every datagram carries the
+// sender's made-up address, each accepted send with a token completes once with it and
+// a send without one or a refused send not at all, and datagrams in reach the receive
+// callback with their sender.
+
+static const uint8_t peer_addr[TRANSPORT_ADDR_LEN] = { 0x02, 0x57, 0x41, 0x00, 0xB8, 0x2D };
+static int peer = -1;
+
+static portMUX_TYPE cb_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t completed[8];
+static int num_completed;
+static uint8_t received[32];
+static int received_len;
+static uint8_t received_from[TRANSPORT_ADDR_LEN];
+
+static void on_recv(const transport_rx_info_t* info, const uint8_t* data, int len){
+    portENTER_CRITICAL(&cb_lock);
+    memcpy(received_from, info->src_addr, TRANSPORT_ADDR_LEN);
+    received_len = len < (int)sizeof(received) ? len : (int)sizeof(received);
+    memcpy(received, data, received_len);
+    portEXIT_CRITICAL(&cb_lock);
+}
+
+static void on_sent(const uint8_t addr[TRANSPORT_ADDR_LEN], uint32_t token, bool success){
+    CHECK(memcmp(addr, peer_addr, TRANSPORT_ADDR_LEN) == 0 && success);
+    portENTER_CRITICAL(&cb_lock);
+    CHECK(num_completed < 8);
+    completed[num_completed++] = token;
+    portEXIT_CRITICAL(&cb_lock);
+}
+
+static int received_bytes(void){
+    portENTER_CRITICAL(&cb_lock);
+    int len = received_len;
+    portEXIT_CRITICAL(&cb_lock);
+    return len;
+}
+
+static void start_peer(void){
+    peer = socket(AF_INET, SOCK_DGRAM, 0);
+    CHECK(peer >= 0);
+    struct sockaddr_in local = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_WIRELESS_UDP_REMOTE_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    CHECK(bind(peer, (struct sockaddr*)&local, sizeof(local)) == 0);
+    struct timeval timeout = { .tv_sec = 1 };
+    setsockopt(peer, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+static void test_send(void){
+    const uint8_t frame[] = { 1, 2, 3 };
+    CHECK(udp_transport.send(peer_addr, frame, sizeof(frame), 7) == ESP_OK);
+    CHECK(udp_transport.send(peer_addr, frame, 2, TRANSPORT_TOKEN_NONE) == ESP_OK);
+    // Too long for a frame: refused, and no completion for it
+    static const uint8_t oversized[251];
+    CHECK(udp_transport.send(peer_addr, oversized, sizeof(oversized), 8) == ESP_ERR_INVALID_SIZE);
+
+    uint8_t own[TRANSPORT_ADDR_LEN];
+    CHECK(udp_transport.get_addr(own) == ESP_OK);
+    CHECK(own[4] == (CONFIG_WIRELESS_UDP_LOCAL_PORT >> 8) && own[5] == (CONFIG_WIRELESS_UDP_LOCAL_PORT & 0xFF));
+    uint8_t datagram[64];
+    CHECK(recv(peer, datagram, sizeof(datagram), 0) == TRANSPORT_ADDR_LEN + 3);
+    CHECK(memcmp(datagram, own, TRANSPORT_ADDR_LEN) == 0 && memcmp(datagram + TRANSPORT_ADDR_LEN, frame, 3) == 0);
+    CHECK(recv(peer, datagram, sizeof(datagram), 0) == TRANSPORT_ADDR_LEN + 2);
+    CHECK(num_completed == 1 && completed[0] == 7);
+}
+
+static void test_receive(void){
+    struct sockaddr_in transport_end = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_WIRELESS_UDP_LOCAL_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    // An address alone carries no frame and is dropped
+    CHECK(sendto(peer, peer_addr, TRANSPORT_ADDR_LEN, 0, (struct sockaddr*)&transport_end, sizeof(transport_end)) > 0);
+    uint8_t datagram[TRANSPORT_ADDR_LEN + 4];
+    memcpy(datagram, peer_addr, TRANSPORT_ADDR_LEN);
+    memcpy(datagram + TRANSPORT_ADDR_LEN, "\x09\x08\x07\x06", 4);
+    CHECK(sendto(peer, datagram, sizeof(datagram), 0, (struct sockaddr*)&transport_end, sizeof(transport_end)) > 0);
+    CHECK_SOON(received_bytes() != 0, 1000);
+    CHECK(received_bytes() == 4 && received[0] == 9 && received[3] == 6);
+    CHECK(memcmp(received_from, peer_addr, TRANSPORT_ADDR_LEN) == 0);
+}
+
+int main(void){
+    start_peer();
+    CHECK(udp_transport.start(on_recv, on_sent, NULL) == ESP_OK);
+    test_send();
+    test_receive();
+    close(peer);
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include "host_test.h"
+#include "wifi/tx_power_control.h"
+
+// Closed-loop TX power: it creeps down by at most step_down_db per report and jumps up
+// by the whole shortfall, a burst of failed sends raises it by fade_step_db, frames
+// without a report send it back to the ceiling, and the ceiling stays within what the
+// radio takes whatever a profile asks for.
+
+static const tx_power_config_t config = {
+    .target_rssi = -67,
+    .hysteresis_db = 6,
+    .step_down_db = 2,
+    .fade_step_db = 6,
+    .fail_burst = 2,
+    .floor = TX_POWER_MIN,
+    .ceiling = TX_POWER_MAX,
+    .report_timeout_us = 1000000
+};
+
+static void test_step_down_and_up(void){
+    tx_power_ctl_t ctl;
+    tx_power_init(&ctl, &config);
+    CHECK(ctl.power == TX_POWER_MAX);
+
+    // Within the hysteresis, nothing changes
+    CHECK(tx_power_on_report(&ctl, -67) == TX_POWER_MAX);
+    CHECK(tx_power_on_report(&ctl, -61) == TX_POWER_MAX);
+    // 20 dB too strong: down by step_down_db only, each report
+    CHECK(tx_power_on_report(&ctl, -47) == TX_POWER_MAX - 2 * 4);
+    CHECK(tx_power_on_report(&ctl, -47) == TX_POWER_MAX - 4 * 4);
+    // Just past the hysteresis: down by the excess
+    CHECK(tx_power_on_report(&ctl, -60) == TX_POWER_MAX - 5 * 4);
+    // 3 dB short: up by all of it at once
+    CHECK(tx_power_on_report(&ctl, -70) == TX_POWER_MAX - 2 * 4);
+    // Never below the floor
+    for (int i = 0; i < 50; i++)
+        tx_power_on_report(&ctl, -40);
+    CHECK(ctl.power == TX_POWER_MIN);
+    CHECK(ctl.stats.reports == 56);
+}
+
+static void test_fade(void){
+    tx_power_ctl_t ctl;
+    tx_power_init(&ctl, &config);
+    for (int i = 0; i < 5; i++)
+        tx_power_on_report(&ctl, -40);
+    int8_t low = ctl.power;
+    CHECK(low == TX_POWER_MAX - 10 * 4);
+
+    // One failure is noise, fail_burst in a row a fade
+    CHECK(tx_power_on_send(&ctl, false, 1) == low);
+    CHECK(tx_power_on_send(&ctl, true, 2) == low);
+    CHECK(tx_power_on_send(&ctl, false, 3) == low);
+    CHECK(tx_power_on_send(&ctl, false, 4) == low + 6 * 4);
+    CHECK(ctl.stats.fades == 1);
+    CHECK(tx_power_on_send(&ctl, false, 5) == low + 6 * 4);
+    // No higher than the ceiling, where a fade has nowhere to go
+    CHECK(tx_power_on_send(&ctl, false, 6) == TX_POWER_MAX);
+    for (int i = 0; i < 20; i++)
+        tx_power_on_send(&ctl, false, 7 + i);
+    CHECK(ctl.power == TX_POWER_MAX);
+    CHECK(ctl.stats.fades == 2);
+    CHECK(ctl.stats.frames == 26 && ctl.stats.failures == 25);
+    CHECK(ctl.stats.frames_at[low] == 4);
+}
+
+static void test_report_timeout(void){
+    tx_power_ctl_t ctl;
+    tx_power_init(&ctl, &config);
+    for (int i = 0; i < 5; i++)
+        tx_power_on_report(&ctl, -40);
+    int8_t low = ctl.power;
+
+    // An idle link keeps its power
+    CHECK(tx_power_on_tick(&ctl, 5000000) == low);
+    // Frames answered in time keep it too
+    tx_power_on_send(&ctl, true, 6000000);
+    CHECK(tx_power_on_tick(&ctl, 6900000) == low);
+    tx_power_on_report(&ctl, -67);
+    tx_power_on_send(&ctl, true, 7000000);
+    CHECK(tx_power_on_tick(&ctl, 7900000) == low);
+    // Frames sent for report_timeout_us with no report: back to the ceiling
+    tx_power_on_send(&ctl, true, 7500000);
+    CHECK(tx_power_on_tick(&ctl, 8000001) == TX_POWER_MAX);
+}
+
+static void test_ceiling(void){
+    tx_power_ctl_t ctl;
+    tx_power_init(&ctl, &config);
+    // Lowering it pulls the power down at once, raising it leaves the power where it is
+    CHECK(tx_power_set_ceiling(&ctl, 60) == 60);
+    CHECK(tx_power_set_ceiling(&ctl, 70) == 60);
+    CHECK(tx_power_on_send(&ctl, false, 1) == 60);
+    CHECK(tx_power_on_send(&ctl, false, 2) == 70);
+
+    // Past what the radio takes, or below the floor, it is clamped
+    CHECK(tx_power_set_ceiling(&ctl, 120) == 70);
+    CHECK(ctl.config.ceiling == TX_POWER_MAX);
+    CHECK(tx_power_on_tick(&ctl, 1) == 70);
+    tx_power_on_send(&ctl, true, 10);
+    CHECK(tx_power_on_tick(&ctl, 2000000) == TX_POWER_MAX);
+    tx_power_on_send(&ctl, true, 2000001);
+    CHECK(ctl.stats.frames_at[TX_POWER_MAX] == 1);
+    CHECK(tx_power_set_ceiling(&ctl, -5) == TX_POWER_MIN);
+    CHECK(ctl.config.ceiling == TX_POWER_MIN);
+
+    // A config out of range is clamped as well
+    tx_power_config_t wide = config;
+    wide.ceiling = 127;
+    wide.floor = 0;
+    tx_power_init(&ctl, &wide);
+    CHECK(ctl.power == TX_POWER_MAX && ctl.config.floor == TX_POWER_MIN);
+    tx_power_on_send(&ctl, true, 1);
+    CHECK(ctl.stats.frames_at[TX_POWER_MAX] == 1);
+}
+
+static void test_stats(void){
+    tx_power_ctl_t ctl;
+    tx_power_init(&ctl, &config);
+    tx_power_on_send(&ctl, true, 1);
+    tx_power_set_ceiling(&ctl, TX_POWER_MAX - 40);
+    tx_power_on_send(&ctl, true, 2);
+    CHECK(tx_power_mean(&ctl.stats) == TX_POWER_MAX - 20);
+    // One frame at full power, one at 10 dB less: (1 + 0.1) / 2 of the energy
+    int32_t saved = tx_power_energy_saved(&ctl.stats, TX_POWER_MAX);
+    CHECK(saved >= 4499 && saved <= 4500);
+}
+
+int main(void){
+    test_step_down_and_up();
+    test_fade();
+    test_report_timeout();
+    test_ceiling();
+    test_stats();
+    return 0;
+}
@@ -0,0 +1,271 @@
+#include "host_test.h"
+#include "device_config.h"
+#include "tx_scheduler.h"
+#include "wifi/wifi.h"
+#include "esp_timer.h"
+#include <string.h>
+
+// sleep.c with both tiers on, which the firmware leaves off; device_config.h is already
+// in, so the overrides stand
+#undef SLEEP
+#define SLEEP ENABLED
+#undef DEEP_SLEEP
+#define DEEP_SLEEP ENABLED
+#include "sleep/sleep.c"
+
+// The transmitter's TX scheduler against a fake link: one frame in flight, released only
+// by its own send token; motion merged meanwhile and resent after a failure; lone motion
+// held for the coalescing window; an edge whose send failed, even while the scheduler was
+// still filling frames, or whose completion never came, sent again; and the sleep tiers
+// a performance profile sets.
+
+#define MAX_SENT 64
+
+typedef struct {
+    uint8_t data[ESPNOW_BUNDLE_MAX_LEN];
+    size_t len;
+    uint32_t token;
+} sent_frame_t;
+
+static sent_frame_t sent[MAX_SENT];
+static volatile int sent_count = 0;
+static uint32_t last_token = SEND_TOKEN_NONE;
+static portMUX_TYPE sent_lock = portMUX_INITIALIZER_UNLOCKED;
+// Run on the scheduler task inside the send, as a link completing at once would
+static void (*on_send)(uint32_t token) = NULL;
+
+// Completions reach the scheduler through the callback wifi.c declares for itself
+extern void send_status_cb(uint32_t token, bool success);
+
+uint32_t new_send_token(void){
+    return ++last_token;
+}
+
+esp_err_t send_message_tagged(const uint8_t* data, size_t size, uint32_t token){
+    portENTER_CRITICAL(&sent_lock);
+    CHECK(sent_count < MAX_SENT && size <= sizeof(sent[0].data));
+    memcpy(sent[sent_count].data, data, size);
+    sent[sent_count].len = size;
+    sent[sent_count].token = token;
+    sent_count++;
+    portEXIT_CRITICAL(&sent_lock);
+    if (on_send)
+        on_send(token);
+    return ESP_OK;
+}
+
+static int frames_sent(void){
+    portENTER_CRITICAL(&sent_lock);
+    int count = sent_count;
+    portEXIT_CRITICAL(&sent_lock);
+    return count;
+}
+
+// Complete the newest frame, as the link would
+static void complete(bool success){
+    send_status_cb(sent[frames_sent() - 1].token, success);
+}
+
+// Mouse position message n of frame index, bundled or alone
+static const espnow_msg_mouse_position_t* position_in(int index, int n){
+    const sent_frame_t* frame = &sent[index];
+    if (frame->data[0] == ESPNOW_MSG_MOUSE_POSITION)
+        return n == 0 ? (const espnow_msg_mouse_position_t*)frame->data : NULL;
+    if (frame->data[0] != ESPNOW_MSG_BUNDLE)
+        return NULL;
+    static espnow_msg_mouse_position_t entry;
+    size_t offset = sizeof(espnow_msg_bundle_t);
+    for (int i = 0; i < frame->data[1] && offset < frame->len; i++){
+        uint8_t len = frame->data[offset++];
+        if (frame->data[offset] == ESPNOW_MSG_MOUSE_POSITION && n-- == 0){
+            memcpy(&entry, frame->data + offset, sizeof(entry));
+            return &entry;
+        }
+        offset += len;
+    }
+    return NULL;
+}
+
+// First key of each keyboard message of frame index, bundled or alone; returns how many
+static int keys_in(int index, uint8_t keys[], int max){
+    const sent_frame_t* frame = &sent[index];
+    if (frame->data[0] == ESPNOW_MSG_KEYBOARD){
+        keys[0] = ((const espnow_msg_keyboard_t*)frame->data)->keys[0];
+        return 1;
+    }
+    int found = 0;
+    size_t offset = sizeof(espnow_msg_bundle_t);
+    for (int i = 0; frame->data[0] == ESPNOW_MSG_BUNDLE && i < frame->data[1] && offset < frame->len; i++){
+        uint8_t len = frame->data[offset++];
+        if (frame->data[offset] == ESPNOW_MSG_KEYBOARD && found < max)
+            keys[found++] = ((const espnow_msg_keyboard_t*)(frame->data + offset))->keys[0];
+        offset += len;
+    }
+    return found;
+}
+
+static void press(uint8_t key){
+    const espnow_msg_keyboard_t keyboard = { .msg_type = ESPNOW_MSG_KEYBOARD, .keys = {key} };
+    CHECK(tx_scheduler_submit((const espnow_message_t*)&keyboard, sizeof(keyboard)) == ESP_OK);
+}
+
+static void move(uint8_t buttons, int8_t x){
+    const espnow_msg_mouse_t mouse = { .msg_type = ESPNOW_MSG_MOUSE, .buttons = buttons, .x = x };
+    CHECK(tx_scheduler_submit((const espnow_message_t*)&mouse, sizeof(mouse)) == ESP_OK);
+}
+
+// Well inside TX_IN_FLIGHT_TIMEOUT_US, after which a lost completion frees the lanes anyway
+static void settle(void){
+    vTaskDelay(pdMS_TO_TICKS(5));
+}
+
+static void test_motion_merges_in_flight(void){
+    move(0, 5);
+    CHECK_SOON(frames_sent() == 1, 100);
+    CHECK(position_in(0, 0) && position_in(0, 0)->x == 5);
+    move(0, 1);
+    move(0, 2);
+    move(0, 3);
+    settle();
+    CHECK(frames_sent() == 1);
+    complete(true);
+    CHECK_SOON(frames_sent() == 2, 100);
+    CHECK(position_in(1, 0) && position_in(1, 0)->x == 11);
+    // Numbered per message within one boot's epoch
+    const espnow_msg_mouse_position_t first = *position_in(0, 0);
+    CHECK(position_in(1, 0)->epoch == first.epoch);
+    CHECK(position_in(1, 0)->seq == (uint16_t)(first.seq + 1));
+    complete(true);
+}
+
+static void test_only_own_token_releases(void){
+    move(0, 1);
+    CHECK_SOON(frames_sent() == 3, 100);
+    move(0, 1);
+    // Another frame to the peer completing, a handshake say, frees nothing
+    send_status_cb(sent[2].token + 100, true);
+    settle();
+    CHECK(frames_sent() == 3);
+    complete(true);
+    CHECK_SOON(frames_sent() == 4, 100);
+    CHECK(position_in(3, 0)->x == 13);
+    complete(true);
+}
+
+static void test_failed_frame_resent(void){
+    move(0, 2);
+    CHECK_SOON(frames_sent() == 5, 100);
+    complete(false);
+    CHECK_SOON(frames_sent() == 6, 100);
+    // The counters carry the lost motion along
+    CHECK(position_in(5, 0) && position_in(5, 0)->x == 15);
+    complete(true);
+}
+
+static void test_button_edges_kept(void){
+    int first = frames_sent();
+    move(1, 0);
+    move(0, 0);
+    CHECK_SOON(frames_sent() > first, 100);
+    // Bundled together, or the release follows once the press is through
+    if (position_in(first, 1) == NULL){
+        complete(true);
+        CHECK_SOON(frames_sent() > first + 1, 100);
+    }
+    complete(true);
+    // Press then release, never merged away
+    uint8_t buttons[4];
+    int seen = 0;
+    for (int i = first; i < frames_sent(); i++){
+        for (int n = 0; position_in(i, n) && seen < 4; n++)
+            buttons[seen++] = position_in(i, n)->buttons;
+    }
+    CHECK(seen == 2 && buttons[0] == 1 && buttons[1] == 0);
+}
+
+static void test_coalescing_window(void){
+    int first = frames_sent();
+    tx_scheduler_set_coalesce_window(30000);
+    int64_t start_us = esp_timer_get_time();
+    move(0, 1);
+    settle();
+    CHECK(frames_sent() == first);
+    CHECK_SOON(frames_sent() == first + 1, 200);
+    CHECK(esp_timer_get_time() - start_us >= 25000);
+    complete(true);
+
+    tx_scheduler_set_coalesce_window(0);
+    move(0, 1);
+    CHECK_SOON(frames_sent() == first + 2, 100);
+    complete(true);
+}
+
+// The first send fails at once, and another key is pressed while it is being sent
+static void fail_first_send(uint32_t token){
+    on_send = NULL;
+    press(0x05);
+    send_status_cb(token, false);
+}
+
+static void test_failure_before_next_frame(void){
+    int first = frames_sent();
+    on_send = fail_first_send;
+    press(0x04);
+    CHECK_SOON(frames_sent() == first + 2, 100);
+    // The failed key goes again, ahead of the one pressed meanwhile, and nothing twice
+    uint8_t keys[4];
+    CHECK(keys_in(first, keys, 4) == 1 && keys[0] == 0x04);
+    int n = keys_in(first + 1, keys, 4);
+    if (n == 1){
+        complete(true);
+        CHECK_SOON(frames_sent() == first + 3, 100);
+        n += keys_in(first + 2, keys + 1, 3);
+    }
+    CHECK(n == 2 && keys[0] == 0x04 && keys[1] == 0x05);
+    int last = frames_sent();
+    complete(true);
+    settle();
+    CHECK(frames_sent() == last);
+}
+
+static void test_lost_completion_resent(void){
+    int first = frames_sent();
+    press(0x06);
+    CHECK_SOON(frames_sent() == first + 1, 100);
+    // No completion ever comes: once overdue the key is sent again, not dropped
+    CHECK_SOON(frames_sent() == first + 2, 200);
+    uint8_t key;
+    CHECK(keys_in(first + 1, &key, 1) == 1 && key == 0x06);
+    complete(true);
+    settle();
+    CHECK(frames_sent() == first + 2);
+}
+
+static void test_sleep_tiers(void){
+    start_sleep_timers();
+    CHECK(esp_timer_is_active(lsm_timer) && esp_timer_is_active(dsm_timer));
+    // A tier of 0 stays off; a profile switch restarts the countdowns
+    set_sleep_tiers(0, DEEP_SLEEP_DUR_S);
+    CHECK(!esp_timer_is_active(lsm_timer) && esp_timer_is_active(dsm_timer));
+    set_sleep_tiers(0, 0);
+    CHECK(!esp_timer_is_active(lsm_timer) && !esp_timer_is_active(dsm_timer));
+    reset_timers();
+    CHECK(!esp_timer_is_active(lsm_timer) && !esp_timer_is_active(dsm_timer));
+    // A tier that ran out starts over
+    set_sleep_tiers(1, 0);
+    vTaskDelay(pdMS_TO_TICKS(1100));
+    CHECK(esp_timer_is_active(lsm_timer) && !esp_timer_is_active(dsm_timer));
+}
+
+int main(void){
+    CHECK(begin_tx_scheduler() == ESP_OK);
+    test_motion_merges_in_flight();
+    test_only_own_token_releases();
+    test_failed_frame_resent();
+    test_button_edges_kept();
+    test_coalescing_window();
+    test_failure_before_next_frame();
+    test_lost_completion_resent();
+    test_sleep_tiers();
+    return 0;
+}
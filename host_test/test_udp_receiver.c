@@ -0,0 +1,173 @@
+#include "host_test.h"
+#include "wifi/link_security.h"
+#include "wifi/msg_types.h"
+#include "output_sink.h"
+#include "tusb_device_common.h"
+#include "nvs_flash.h"
+#include "sdkconfig.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// The receiver app over the UDP transport into the recording sink: the test plays the
+// transmitter on the peer port, answers nothing but what it checks, and reads back
+// what the sink took. The receiver is already paired with it, as after a pairing run.
+
+extern void app_main(void);
+
+// Made up from the ports by transport_udp.c
+static const uint8_t receiver_addr[6] = {0x02, 0x57, 0x41, 0x00, CONFIG_WIRELESS_UDP_LOCAL_PORT >> 8, CONFIG_WIRELESS_UDP_LOCAL_PORT & 0xFF};
+static const uint8_t transmitter_addr[6] = {0x02, 0x57, 0x41, 0x00, CONFIG_WIRELESS_UDP_REMOTE_PORT >> 8, CONFIG_WIRELESS_UDP_REMOTE_PORT & 0xFF};
+static const uint8_t stranger_addr[6] = {0x02, 0x57, 0x41, 0x00, 0x00, 0x01};
+static const uint8_t lmk[LINK_KEY_LEN] = "0123456789abcdef";
+
+static int sock = -1;
+static struct sockaddr_in receiver;
+
+static void send_frame(const uint8_t src[6], const void* frame, size_t len){
+    uint8_t datagram[6 + ESPNOW_FRAME_MAX_LEN];
+    memcpy(datagram, src, 6);
+    memcpy(datagram + 6, frame, len);
+    CHECK(sendto(sock, datagram, 6 + len, 0, (struct sockaddr*)&receiver, sizeof(receiver)) == (ssize_t)(6 + len));
+}
+
+// The next frame the receiver sends of msg_type, skipping its own heartbeats
+static bool wait_for_frame(uint8_t msg_type, int timeout_ms){
+    uint8_t datagram[6 + ESPNOW_FRAME_MAX_LEN];
+    for (int waited_ms = 0; waited_ms < timeout_ms; waited_ms += 10){
+        ssize_t len = recv(sock, datagram, sizeof(datagram), MSG_DONTWAIT);
+        if (len > 6 && memcmp(datagram, receiver_addr, 6) == 0 && datagram[6] == msg_type)
+            return true;
+        if (len < 0)
+            vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return false;
+}
+
+static record_sink_totals_t totals(void){
+    record_sink_totals_t taken;
+    get_record_sink_totals(&taken);
+    return taken;
+}
+
+static void start_receiver(void){
+    // Paired with the test, as pairing would have left it
+    nvs_handle_t nvs_handle;
+    CHECK(nvs_flash_init() == ESP_OK);
+    CHECK(store_link_key(transmitter_addr, lmk) == ESP_OK);
+    CHECK(nvs_open("storage", NVS_READWRITE, &nvs_handle) == ESP_OK);
+    CHECK(nvs_set_blob(nvs_handle, "peer_mac", transmitter_addr, 6) == ESP_OK);
+    nvs_close(nvs_handle);
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    CHECK(sock >= 0);
+    struct sockaddr_in local = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_WIRELESS_UDP_REMOTE_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    CHECK(bind(sock, (struct sockaddr*)&local, sizeof(local)) == 0);
+    receiver = (struct sockaddr_in){
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_WIRELESS_UDP_LOCAL_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    // Returns once the sink is up; the recording sink has no host to wait for
+    app_main();
+}
+
+static void test_handshake(void){
+    const espnow_msg_blank_t syn = { .msg_type = ESPNOW_MSG_SYN };
+    send_frame(transmitter_addr, &syn, sizeof(syn));
+    CHECK(wait_for_frame(ESPNOW_MSG_SYNACK, 1000));
+}
+
+static void test_mouse_motion(void){
+    record_sink_totals_t before = totals();
+    // Spaced out past the simulated host poll, so no report saturates
+    for (int i = 0; i < 40; i++){
+        const espnow_msg_mouse_t mouse = { .msg_type = ESPNOW_MSG_MOUSE, .buttons = 1, .x = 3, .y = -2, .wheel = i % 2 };
+        send_frame(transmitter_addr, &mouse, sizeof(mouse));
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    CHECK_SOON(totals().x == before.x + 120 && totals().y == before.y - 80, 2000);
+    record_sink_totals_t after = totals();
+    CHECK(after.wheel == before.wheel + 20);
+    CHECK(after.buttons == 1);
+    CHECK(after.reports[HID_MOUSE_INSTANCE] > before.reports[HID_MOUSE_INSTANCE]);
+}
+
+static void test_bundle(void){
+    record_sink_totals_t before = totals();
+    const espnow_msg_keyboard_t keyboard = { .msg_type = ESPNOW_MSG_KEYBOARD, .modifiers = 0x02, .keys = {0x04} };
+    const espnow_msg_mouse_t mouse = { .msg_type = ESPNOW_MSG_MOUSE, .buttons = 0, .x = -5, .y = 7 };
+    uint8_t frame[ESPNOW_FRAME_MAX_LEN];
+    size_t len = 0;
+    frame[len++] = ESPNOW_MSG_BUNDLE;
+    frame[len++] = 2;
+    frame[len++] = sizeof(keyboard);
+    memcpy(frame + len, &keyboard, sizeof(keyboard));
+    len += sizeof(keyboard);
+    frame[len++] = sizeof(mouse);
+    memcpy(frame + len, &mouse, sizeof(mouse));
+    len += sizeof(mouse);
+    send_frame(transmitter_addr, frame, len);
+
+    CHECK_SOON(totals().reports[HID_KEYBOARD_INSTANCE] > before.reports[HID_KEYBOARD_INSTANCE], 1000);
+    CHECK_SOON(totals().x == before.x - 5 && totals().y == before.y + 7, 1000);
+    CHECK(totals().buttons == 0);
+}
+
+static void send_position(uint32_t epoch, uint16_t seq, uint32_t x){
+    const espnow_msg_mouse_position_t position = {
+        .msg_type = ESPNOW_MSG_MOUSE_POSITION, .seq = seq, .epoch = epoch, .x = x
+    };
+    send_frame(transmitter_addr, &position, sizeof(position));
+    vTaskDelay(pdMS_TO_TICKS(10));
+}
+
+static void test_mouse_position(void){
+    record_sink_totals_t before = totals();
+    // The first message is the baseline; later ones move by how far the counters went
+    send_position(0x1234, 1, 1000);
+    send_position(0x1234, 2, 1010);
+    // More than 128 messages on, still newer
+    send_position(0x1234, 200, 1030);
+    CHECK_SOON(totals().x == before.x + 30, 1000);
+    // A late one is dropped rather than moving back
+    send_position(0x1234, 150, 1020);
+    // The transmitter restarted: its counters are a new baseline, not motion
+    send_position(0x5678, 0, 5);
+    send_position(0x5678, 1, 12);
+    CHECK_SOON(totals().x == before.x + 37, 1000);
+    // seq wraps past 65535 and is still newer
+    send_position(0x5678, 30000, 15);
+    send_position(0x5678, 60000, 18);
+    send_position(0x5678, 65535, 20);
+    send_position(0x5678, 2, 25);
+    CHECK_SOON(totals().x == before.x + 50, 1000);
+    vTaskDelay(pdMS_TO_TICKS(100));
+    CHECK(totals().x == before.x + 50 && totals().y == before.y);
+}
+
+static void test_stranger_ignored(void){
+    record_sink_totals_t before = totals();
+    const espnow_msg_mouse_t mouse = { .msg_type = ESPNOW_MSG_MOUSE, .x = 50, .y = 50 };
+    send_frame(stranger_addr, &mouse, sizeof(mouse));
+    vTaskDelay(pdMS_TO_TICKS(200));
+    record_sink_totals_t after = totals();
+    CHECK(after.x == before.x && after.y == before.y);
+    CHECK(after.reports[HID_MOUSE_INSTANCE] == before.reports[HID_MOUSE_INSTANCE]);
+}
+
+int main(void){
+    start_receiver();
+    test_handshake();
+    test_mouse_motion();
+    test_bundle();
+    test_mouse_position();
+    test_stranger_ignored();
+    return 0;
+}
@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+"""Write basic.trc, the trace test_trace_replay.c replays (layout in trace/trace.h).
+
+usage: gen_basic_trace.py basic.trc
+
+A keyboard, a boot mouse and a device without a profile, interleaved 1 ms apart:
+  keyboard  A down, A up, Shift+B down, all up
+  mouse     20 reports of (+3, -2), the button pressed from the 10th to the 14th
+  raw       two 4-byte reports
+"""
+import struct
+import sys
+
+MAGIC, VERSION = 0x45435254, 1
+DEVICE, REPORT = 0, 1
+KEYBOARD, MOUSE, OTHER = 1, 2, 0
+
+
+def device(dev_id, vid, pid, proto):
+    return struct.pack("<BBHHBH", DEVICE, dev_id, vid, pid, proto, 0)
+
+
+def report(dev_id, data, delta_us=1000):
+    return struct.pack("<BBBI", REPORT, dev_id, len(data), delta_us) + bytes(data)
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    out = struct.pack("<IB3x", MAGIC, VERSION)
+    out += device(0, 0x046D, 0xC31C, KEYBOARD)
+    out += device(1, 0x046D, 0xC077, MOUSE)
+    out += device(2, 0x1209, 0x0001, OTHER)
+    keys = [(0, 0x04), (0, 0), (0x02, 0x05), (0, 0)]
+    raw = [[1, 2, 3, 4], [5, 6, 7, 8]]
+    for i in range(20):
+        buttons = 1 if 10 <= i < 15 else 0
+        out += report(1, [buttons, 3, 0xFE])
+        if i % 5 == 0:
+            modifiers, key = keys[i // 5]
+            out += report(0, [modifiers, 0, key, 0, 0, 0, 0, 0])
+        if i in (7, 17):
+            out += report(2, raw[i // 10])
+    with open(sys.argv[1], "wb") as trace:
+        trace.write(out)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,4 +1,54 @@
 #include "constants.h"
 
 #define UPDATE_CONN_INTERVAL (10000ULL)
-#define DEBUG_WIFI DISABLED
\ No newline at end of file
+#define DEBUG_WIFI DISABLED
+#define BENCHMARK DISABLED
+
+// State of the mouse playout buffer until the performance profile (wifi/perf_profile.h)
+// is applied; switch at runtime with mouse_set_jitter_buffer()
+#define JITTER_BUFFER DISABLED
+
+// Log stack high-water marks, queue peaks and heap usage (see rtos/ram_budget.h)
+#define RAM_BUDGET_REPORT DISABLED
+#define RAM_BUDGET_REPORT_INTERVAL_US (10000000ULL)
+
+// Stream transmitter firmware from the host (ota/ota_upload.py) over the link (see ota/ota_source.h)
+#define OTA_UPDATE ENABLED
+
+// Input-free time before the power locks are released (CONFIG_WIRELESS_POWER_MANAGEMENT,
+// wifi/link_power.h); 0 = never: on USB power, a dozing radio would only delay the
+// transmitter's next frame
+#define POWER_IDLE_RELEASE_US (0ULL)
+
+// Where reports go (see sink/output_sink.h): OUTPUT_SINK_TUSB, OUTPUT_SINK_UINPUT (linux
+// target) or OUTPUT_SINK_RECORD to benchmark coalescing without a host; the host tests
+// pick the recording sink on the command line
+#if defined(OUTPUT_SINK)
+#elif defined(__linux__)
+#define OUTPUT_SINK OUTPUT_SINK_UINPUT
+#else
+#define OUTPUT_SINK OUTPUT_SINK_TUSB
+#endif
+// Host poll interval the uinput and recording sinks simulate, as the USB POLLING_RATE
+#define OUTPUT_SINK_POLL_US (1000LL)
+#define RECORD_SINK_REPORT_INTERVAL_US (5000000ULL)
+
+// Pipeline RAM budget -- stacks in bytes, all statically allocated
+#define TUD_TASK_STACK 4096
+#define TUD_TASK_PRIORITY 4
+#define KEYBOARD_TASK_STACK 1024
+#define KEYBOARD_TASK_PRIORITY 4
+#define KEYBOARD_QUEUE_LEN 100
+#define MOUSE_TASK_STACK 3072
+#define MOUSE_TASK_PRIORITY 4
+#define MOUSE_QUEUE_LEN 20
+#define GAMEPAD_TASK_STACK 2048
+#define GAMEPAD_TASK_PRIORITY 4
+#define GAMEPAD_QUEUE_LEN 16
+#define PASSTHROUGH_TASK_STACK 4096        // NVS writes for the descriptor cache
+#define PASSTHROUGH_TASK_PRIORITY 4
+#define PASSTHROUGH_QUEUE_LEN 16
+#define OTA_TASK_STACK 3072
+#define OTA_TASK_PRIORITY 2
+#define UINPUT_TASK_STACK 4096
+#define UINPUT_TASK_PRIORITY 2
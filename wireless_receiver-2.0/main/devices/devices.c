@@ -1,30 +1,43 @@
 #include "keyboard.h"
 #include "mouse.h"
+#include "passthrough.h"
+#include "gamepad.h"
 #include "tusb_device_common.h"
 #include "devices.h"
+#include "rtos/hot_path.h"
 
 void init_device_queues(){
     init_keyboard_queue();
     init_mouse_queue();
-    // init_gamepad_queue();
+    init_gamepad_queue();
 }
 
 void begin_device_tasks(){
     begin_keyboard_task();
     begin_mouse_task();
-    // begin_gamepad_task();
+    begin_passthrough_task();
+    begin_gamepad_task();
 }
 
-void notify_nst_task(uint8_t instance){
+// Flush stale motion and replay the keyboard state the host missed
+void devices_host_resumed(void){
+    keyboard_host_resumed();
+    mouse_host_resumed();
+}
+
+void HOT_PATH_ATTR notify_nst_task(uint8_t instance){
     switch(instance){
         case HID_KEYBOARD_INSTANCE:
-            notify_mouse_task();
+            notify_keyboard_task();
             break;
         case HID_MOUSE_INSTANCE:
-            notify_keyboard_task();
+            notify_mouse_task();
             break;
         case HID_GAMEPAD_INSTANCE:
-            // notify_gamepad_task();
+            notify_gamepad_task();
+            break;
+        case HID_PASSTHROUGH_INSTANCE:
+            notify_passthrough_task();
             break;
     }
 }
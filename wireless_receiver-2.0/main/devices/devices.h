@@ -1,5 +1,6 @@
 #pragma once
 #include <stdint.h>
+#include <stdbool.h>
 #include "wifi/msg_types.h"
 #include "esp_err.h"
 
@@ -9,5 +10,22 @@ void begin_device_tasks(void);
 // Notify the appropriate task that USB is ready for next report
 void notify_nst_task(uint8_t instance);
 
+// Host came out of suspend
+void devices_host_resumed(void);
+
 esp_err_t enqueue_mouse_event(espnow_msg_mouse_t mouse_msg);
-esp_err_t enqueue_keyboard_event(espnow_msg_keyboard_t keyboard_msg);
\ No newline at end of file
+esp_err_t enqueue_mouse_position_event(espnow_msg_mouse_position_t mouse_msg);
+esp_err_t enqueue_keyboard_event(espnow_msg_keyboard_t keyboard_msg);
+esp_err_t enqueue_gamepad_event(espnow_msg_gamepad_t gamepad_msg);
+
+// The transmitter may have restarted: the next mouse position message is the new baseline
+void mouse_resync_position(void);
+
+// Smooth bursty mouse motion at the cost of a small adaptive delay
+void mouse_set_jitter_buffer(bool enabled);
+
+// measure the mouse accumulate-and-clamp loop (BENCHMARK)
+void benchmark_mouse_coalescing(void);
+
+// compare hot-path tail latency with and without flash activity (BENCHMARK)
+void benchmark_hot_path_latency(void);
\ No newline at end of file
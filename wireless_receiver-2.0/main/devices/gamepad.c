@@ -0,0 +1,75 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "wifi/msg_types.h"
+#include "tusb_device_common.h"
+#include "output_sink.h"
+#include "rtos/ram_budget.h"
+#include "device_config.h"
+#include "rtos/hot_path.h"
+#include "suspend.h"
+#include "gamepad.h"
+
+STATIC_TASK(gamepad_task_mem, "gamepad", GAMEPAD_TASK_STACK, GAMEPAD_TASK_PRIORITY);
+STATIC_QUEUE(gamepad_queue_mem, "gamepad", GAMEPAD_QUEUE_LEN, espnow_msg_gamepad_t);
+
+static QueueHandle_t gamepad_queue = NULL;
+
+static TaskHandle_t gamepad_task_handle = NULL;
+
+// Each report carries the whole controller state, so reports queued behind a busy
+// interface are merged into the newest -- unless the buttons or hat changed, which the
+// host must see in order
+static void HOT_PATH_ATTR take_newer_state(espnow_msg_gamepad_t* msg){
+    espnow_msg_gamepad_t next;
+    while (xQueuePeek(gamepad_queue, &next, 0) == pdTRUE &&
+           next.buttons == msg->buttons && next.hat == msg->hat){
+        xQueueReceive(gamepad_queue, msg, 0);
+    }
+}
+
+static void HOT_PATH_ATTR gamepad_task(void* arg){
+    espnow_msg_gamepad_t msg;
+    const output_sink_t* sink = get_output_sink();
+    while (true){
+        if (xQueueReceive(gamepad_queue, &msg, portMAX_DELAY) != pdTRUE)
+            continue;
+        // Sinks without a gamepad drop these; a suspended host gets the state again with
+        // the first report after it resumes
+        if (sink->gamepad_report == NULL || is_host_suspended())
+            continue;
+
+        // wait for the interface to become ready
+        int num_tries = 0;
+        while (!sink->ready(HID_GAMEPAD_INSTANCE) && (num_tries++ < 5)) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+            if (!sink->mounted() || is_host_suspended())
+                break;
+        }
+
+        take_newer_state(&msg);
+        if (!is_host_suspended() && sink->ready(HID_GAMEPAD_INSTANCE))
+            sink->gamepad_report(&msg);
+    }
+}
+
+esp_err_t HOT_PATH_ATTR enqueue_gamepad_event(espnow_msg_gamepad_t gamepad_msg){
+    bool sent = xQueueSend(gamepad_queue, &gamepad_msg, 0) == pdTRUE;
+    ram_budget_note_send(&gamepad_queue_mem, sent);
+    return sent ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t begin_gamepad_task(void){
+    gamepad_task_handle = create_static_task(&gamepad_task_mem, gamepad_task, NULL);
+    return gamepad_task_handle ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t init_gamepad_queue(void){
+    gamepad_queue = create_static_queue(&gamepad_queue_mem);
+    return gamepad_queue ? ESP_OK : ESP_FAIL;
+}
+
+void HOT_PATH_ATTR notify_gamepad_task(void){
+    if (gamepad_task_handle)
+        xTaskNotifyGive(gamepad_task_handle);
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include "wifi/msg_types.h"
+#include "esp_err.h"
+
+esp_err_t enqueue_gamepad_event(espnow_msg_gamepad_t gamepad_msg);
+
+esp_err_t begin_gamepad_task(void);
+
+esp_err_t init_gamepad_queue(void);
+
+void notify_gamepad_task(void);
@@ -0,0 +1,165 @@
+#include "jitter_buffer.h"
+#include "rtos/hot_path.h"
+#include <string.h>
+
+static inline int8_t clamp32to8(int32_t val) { return (val < -128) ? -128 : ((val > 127) ? 127 : val); }
+static inline int64_t max64(int64_t a, int64_t b) { return (a > b) ? a : b; }
+
+void jb_reset(jitter_buffer_t* jb){
+    memset(jb, 0, sizeof(*jb));
+}
+
+// Track the best-case transit and how late messages arrive relative to it.
+// Returns this message's lateness.
+static uint32_t HOT_PATH_ATTR update_jitter(jitter_buffer_t* jb, uint32_t tx_us, int64_t rx_us){
+    // Clocks are unrelated; only differences between transits are meaningful
+    int32_t transit = (int32_t)((uint32_t)rx_us - tx_us);
+    if (jb->have_base){
+        // Let the base creep upward with time, not with the message rate, so clock drift
+        // does not read as jitter; the remainder of a microsecond carries to the next message
+        int64_t creep = (rx_us - jb->base_aged_us) * JB_BASE_CREEP_PPM / 1000000;
+        jb->base_transit_us += (int32_t)creep;
+        jb->base_aged_us += creep * 1000000 / JB_BASE_CREEP_PPM;
+    }
+    if (!jb->have_base || (transit - jb->base_transit_us) < 0){
+        jb->base_transit_us = transit;
+        jb->base_aged_us = rx_us;
+        jb->have_base = true;
+    }
+    uint32_t lateness = (uint32_t)(transit - jb->base_transit_us);
+
+    // Fast attack, slow decay so bursts raise the delay immediately
+    if (lateness > jb->jitter_us)
+        jb->jitter_us += (lateness - jb->jitter_us) / 2;
+    else
+        jb->jitter_us -= (jb->jitter_us - lateness) / 32;
+
+    uint32_t target = (jb->jitter_us < JB_CLEAN_JITTER_US) ? 0 : jb->jitter_us * 2;
+    jb->target_delay_us = (target > JB_MAX_DELAY_US) ? JB_MAX_DELAY_US : target;
+    return lateness;
+}
+
+// Release an entry's remaining motion into the carry
+static void HOT_PATH_ATTR finish_entry(jitter_buffer_t* jb, jb_entry_t* entry){
+    jb->carry_x += entry->x - entry->done_x;
+    jb->carry_y += entry->y - entry->done_y;
+    jb->carry_wheel += entry->wheel - entry->done_wheel;
+    jb->carry_pan += entry->pan - entry->done_pan;
+    jb->buttons = entry->buttons;
+    jb->head = (jb->head + 1) % JB_CAPACITY;
+    jb->count--;
+}
+
+void HOT_PATH_ATTR jb_push(jitter_buffer_t* jb, const mouse_motion_t* motion, int64_t rx_us){
+    uint32_t lateness = update_jitter(jb, motion->timestamp_us, rx_us);
+
+    bool moving = motion->x || motion->y || motion->wheel || motion->pan;
+    if (moving && jb->last_rx_us && (rx_us - jb->last_rx_us) > JB_STUTTER_GAP_US && (rx_us - jb->last_rx_us) < JB_MAX_SPREAD_US)
+        jb->stats.input_stutters++;
+    jb->last_rx_us = rx_us;
+
+    // A full buffer plays its oldest message out right away
+    if (jb->count == JB_CAPACITY)
+        finish_entry(jb, &jb->entries[jb->head]);
+
+    // Ideal arrival time plus the playout delay, never earlier than what is already queued
+    int64_t end_us = max64(rx_us - lateness + jb->target_delay_us, rx_us);
+    end_us = max64(end_us, jb->last_end_us);
+    jb_entry_t* entry = &jb->entries[(jb->head + jb->count) % JB_CAPACITY];
+    *entry = (jb_entry_t){
+        .start_us = max64(jb->last_end_us, end_us - JB_MAX_SPREAD_US),
+        .end_us = end_us,
+        .x = motion->x, .y = motion->y, .wheel = motion->wheel, .pan = motion->pan,
+        .buttons = motion->buttons
+    };
+    jb->count++;
+    jb->last_end_us = end_us;
+
+    uint32_t added_delay = (uint32_t)(end_us - rx_us);
+    jb->stats.messages++;
+    jb->stats.total_delay_us += added_delay;
+    if (added_delay > jb->stats.max_delay_us)
+        jb->stats.max_delay_us = added_delay;
+}
+
+// Portion of value due after elapsed out of window
+static inline int32_t due(int32_t value, int64_t elapsed, int64_t window){
+    return (int32_t)((int64_t)value * elapsed / window);
+}
+
+bool HOT_PATH_ATTR jb_pull(jitter_buffer_t* jb, int64_t now_us, espnow_msg_mouse_t* out){
+    uint8_t prev_buttons = jb->buttons;
+    bool resend = jb->resend;
+    jb->resend = false;
+    while (jb->count > 0){
+        jb_entry_t* entry = &jb->entries[jb->head];
+        if (now_us < entry->start_us)
+            break;
+        if (now_us >= entry->end_us || entry->end_us == entry->start_us){
+            finish_entry(jb, entry);
+            continue;
+        }
+        // Spread linearly across the window; buttons apply once the window opens
+        int64_t elapsed = now_us - entry->start_us, window = entry->end_us - entry->start_us;
+        int32_t x = due(entry->x, elapsed, window), y = due(entry->y, elapsed, window);
+        int32_t wheel = due(entry->wheel, elapsed, window), pan = due(entry->pan, elapsed, window);
+        jb->carry_x += x - entry->done_x;
+        jb->carry_y += y - entry->done_y;
+        jb->carry_wheel += wheel - entry->done_wheel;
+        jb->carry_pan += pan - entry->done_pan;
+        entry->done_x = x;
+        entry->done_y = y;
+        entry->done_wheel = wheel;
+        entry->done_pan = pan;
+        jb->buttons = entry->buttons;
+        break;
+    }
+
+    out->msg_type = ESPNOW_MSG_MOUSE;
+    out->buttons = jb->buttons;
+    out->x = clamp32to8(jb->carry_x);
+    out->y = clamp32to8(jb->carry_y);
+    out->wheel = clamp32to8(jb->carry_wheel);
+    out->pan = clamp32to8(jb->carry_pan);
+    jb->carry_x -= out->x;
+    jb->carry_y -= out->y;
+    jb->carry_wheel -= out->wheel;
+    jb->carry_pan -= out->pan;
+
+    bool moving = out->x || out->y || out->wheel || out->pan;
+    if (!moving && jb->buttons == prev_buttons && !resend)
+        return false;
+    if (moving && jb->last_output_us && (now_us - jb->last_output_us) > JB_STUTTER_GAP_US && (now_us - jb->last_output_us) < JB_MAX_SPREAD_US)
+        jb->stats.output_stutters++;
+    jb->last_output_us = now_us;
+    return true;
+}
+
+void HOT_PATH_ATTR jb_unpull(jitter_buffer_t* jb, const espnow_msg_mouse_t* report){
+    jb->carry_x += report->x;
+    jb->carry_y += report->y;
+    jb->carry_wheel += report->wheel;
+    jb->carry_pan += report->pan;
+    jb->resend = true;
+}
+
+bool HOT_PATH_ATTR jb_has_pending(const jitter_buffer_t* jb){
+    return jb->count || jb->resend || jb->carry_x || jb->carry_y || jb->carry_wheel || jb->carry_pan;
+}
+
+int64_t HOT_PATH_ATTR jb_next_due_us(const jitter_buffer_t* jb, int64_t now_us){
+    if (jb->resend || jb->carry_x || jb->carry_y || jb->carry_wheel || jb->carry_pan)
+        return now_us;
+    if (jb->count == 0)
+        return -1;
+    const jb_entry_t* entry = &jb->entries[jb->head];
+    if (now_us < entry->start_us)
+        return entry->start_us;
+    // Mid-window: release the next slice on the following host poll
+    return now_us + JB_POLL_INTERVAL_US;
+}
+
+void jb_take_stats(jitter_buffer_t* jb, jb_stats_t* stats){
+    *stats = jb->stats;
+    memset(&jb->stats, 0, sizeof(jb->stats));
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "wifi/msg_types.h"
+
+#define JB_CAPACITY 32                 // Messages held at most; older ones are played out early
+#define JB_MAX_DELAY_US (8000)         // Upper bound on the adaptive playout delay
+#define JB_CLEAN_JITTER_US (250)       // Below this much jitter no delay is added
+#define JB_MAX_SPREAD_US (8000)        // Longest window one message's motion is spread over
+#define JB_POLL_INTERVAL_US (1000)     // Host polling interval of the mouse endpoint
+#define JB_STUTTER_GAP_US (3000)       // Gaps this long during motion count as a stutter
+#define JB_BASE_CREEP_PPM (100)        // Upward creep of the best-case transit, above crystal drift
+
+// One message's motion, widened: a position message (ESPNOW_MSG_MOUSE_POSITION) recovers the
+// motion of lost ones and may carry more than an 8-bit report holds
+typedef struct {
+    int32_t x, y, wheel, pan;
+    uint32_t timestamp_us;
+    uint8_t buttons;
+} mouse_motion_t;
+
+typedef struct {
+    int64_t start_us;       // Playout window in receiver time
+    int64_t end_us;
+    int32_t x, y, wheel, pan;           // Total motion of the message
+    int32_t done_x, done_y, done_wheel, done_pan; // Motion already played out
+    uint8_t buttons;
+} jb_entry_t;
+
+typedef struct {
+    uint32_t messages;
+    uint64_t total_delay_us;    // Sum of delay added on top of the best-case transit
+    uint32_t max_delay_us;
+    uint32_t input_stutters;    // Arrival gaps > JB_STUTTER_GAP_US while moving
+    uint32_t output_stutters;   // Playout gaps > JB_STUTTER_GAP_US while moving
+} jb_stats_t;
+
+// Playout buffer for mouse motion: estimates delivery jitter from sender timestamps and
+// spreads each message's motion over the host polls between its playout deadlines.
+typedef struct {
+    jb_entry_t entries[JB_CAPACITY];
+    uint8_t head;
+    uint8_t count;
+    bool have_base;
+    int32_t base_transit_us;    // Best-case (rx - tx) clock offset seen recently
+    int64_t base_aged_us;       // Receiver time the base's creep is accounted up to
+    uint32_t jitter_us;         // Smoothed lateness relative to base_transit_us
+    uint32_t target_delay_us;   // Playout delay currently applied
+    int64_t last_end_us;
+    int64_t last_rx_us;
+    int64_t last_output_us;
+    int32_t carry_x, carry_y, carry_wheel, carry_pan; // Motion beyond the 8-bit report range
+    uint8_t buttons;
+    bool resend;                // A refused report was given back; report again even without a change
+    jb_stats_t stats;
+} jitter_buffer_t;
+
+void jb_reset(jitter_buffer_t* jb);
+
+// Add a received message's motion; rx_us is the receiver time it arrived
+void jb_push(jitter_buffer_t* jb, const mouse_motion_t* motion, int64_t rx_us);
+
+// Fill out with the motion due by now_us; returns true if there is anything to report
+bool jb_pull(jitter_buffer_t* jb, int64_t now_us, espnow_msg_mouse_t* out);
+
+// Give back a report the host refused: its motion and buttons go out with the next pull
+void jb_unpull(jitter_buffer_t* jb, const espnow_msg_mouse_t* report);
+
+// Motion still to be played out, buffered or carried past the 8-bit report range
+bool jb_has_pending(const jitter_buffer_t* jb);
+
+// Receiver time at which jb_pull() next has motion to release, -1 if the buffer is empty
+int64_t jb_next_due_us(const jitter_buffer_t* jb, int64_t now_us);
+
+// Read and clear the statistics gathered since the last call
+void jb_take_stats(jitter_buffer_t* jb, jb_stats_t* stats);
@@ -4,69 +4,113 @@
 #include "freertos/task.h"
 #include "wifi/msg_types.h"
 #include "tusb_device_common.h"
-#include "tusb.h"
-#include "freertos/task.h"
-
-#define KEYBOARD_QUEUE_SIZE 100
+#include "output_sink.h"
+#include "rtos/ram_budget.h"
+#include "device_config.h"
+#include "rtos/hot_path.h"
+#include "suspend.h"
 
 // static const char* TAG = "USB_TRANSMITTER // keyboard.c";
 
+STATIC_TASK(keyboard_task_mem, "keyboard", KEYBOARD_TASK_STACK, KEYBOARD_TASK_PRIORITY);
+STATIC_QUEUE(keyboard_queue_mem, "keyboard", KEYBOARD_QUEUE_LEN, espnow_msg_keyboard_t);
+
 static QueueHandle_t keyboard_queue = NULL;
 
 static TaskHandle_t keyboard_task_handle = NULL;
 
-static bool __send_report(espnow_msg_keyboard_t* msg){
-    return tud_hid_n_keyboard_report(
-        HID_KEYBOARD_INSTANCE,
-        HID_KEYBOARD_REPORT_ID,
-        msg->modifiers,
-        msg->keys
-    );
+// Latest state the host missed while suspended, replayed when it resumes
+static espnow_msg_keyboard_t held_state = { .msg_type = ESPNOW_MSG_KEYBOARD };
+static bool replay_pending = false;
+static portMUX_TYPE held_state_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static inline bool is_key_press(const espnow_msg_keyboard_t* msg){
+    if (msg->modifiers)
+        return true;
+    for (size_t i = 0; i < sizeof(msg->keys); i++){
+        if (msg->keys[i])
+            return true;
+    }
+    return false;
+}
+
+static void HOT_PATH_ATTR hold_for_resume(const espnow_msg_keyboard_t* msg){
+    portENTER_CRITICAL(&held_state_lock);
+    held_state = *msg;
+    replay_pending = true;
+    portEXIT_CRITICAL(&held_state_lock);
+    if (is_key_press(msg))
+        request_remote_wakeup();
 }
 
-static void keyboard_task(void* arg){
+static bool HOT_PATH_ATTR __send_report(espnow_msg_keyboard_t* msg){
+    return get_output_sink()->keyboard_report(msg);
+}
+
+static void HOT_PATH_ATTR keyboard_task(void* arg){
     espnow_msg_keyboard_t kbd_msg_buf;
+    const output_sink_t* sink = get_output_sink();
     while (true){
         // attempt to retrieve msg from queue
         // restart on failure
         if (xQueueReceive(keyboard_queue, &kbd_msg_buf, portMAX_DELAY) != pdTRUE)
             continue;
+        if (is_host_suspended()){
+            hold_for_resume(&kbd_msg_buf);
+            continue;
+        }
 
         // wait for the interface to become ready
         int num_tries = 0;
-        while (!tud_hid_n_ready(HID_KEYBOARD_INSTANCE) && (num_tries++ < 5)) {
-            // Sleep until USB callback wakes us (or give up after 10MS)
+        while (!sink->ready(HID_KEYBOARD_INSTANCE) && (num_tries++ < 5)) {
+            // Sleep until the sink wakes us (or give up after 10MS)
             ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
             // Check if still mounted after waiting
-            if (!tud_mounted()) {
+            if (!sink->mounted() || is_host_suspended()) {
                 break;
             }
         }
 
-        if (num_tries < 5) { __send_report(&kbd_msg_buf); }
+        if (is_host_suspended())
+            hold_for_resume(&kbd_msg_buf);
+        else if (num_tries < 5 && __send_report(&kbd_msg_buf))
+            wake_report_sent();
     }
 }
 
-esp_err_t enqueue_keyboard_event(espnow_msg_keyboard_t keyboard_msg){
-    if (xQueueSend(keyboard_queue, &keyboard_msg, 0) != pdTRUE)
-        return ESP_FAIL;
-    return ESP_OK; 
+esp_err_t HOT_PATH_ATTR enqueue_keyboard_event(espnow_msg_keyboard_t keyboard_msg){
+    bool sent = xQueueSend(keyboard_queue, &keyboard_msg, 0) == pdTRUE;
+    ram_budget_note_send(&keyboard_queue_mem, sent);
+    return sent ? ESP_OK : ESP_FAIL;
 }
 
 esp_err_t begin_keyboard_task(void){
-    if (xTaskCreate(keyboard_task, "keyboard", 1024, NULL, 4, &keyboard_task_handle) != pdPASS)
+    keyboard_task_handle = create_static_task(&keyboard_task_mem, keyboard_task, NULL);
+    if (keyboard_task_handle == NULL)
         return ESP_FAIL;
     return ESP_OK;
 }
 
 esp_err_t init_keyboard_queue(void){
-    keyboard_queue = xQueueCreate(KEYBOARD_QUEUE_SIZE, sizeof(espnow_msg_keyboard_t));
+    keyboard_queue = create_static_queue(&keyboard_queue_mem);
     if (keyboard_queue == 0)
         return ESP_FAIL;
     return ESP_OK;
 
 }
 
-void notify_keyboard_task(void){
+void HOT_PATH_ATTR notify_keyboard_task(void){
     xTaskNotifyGive(keyboard_task_handle);
+}
+
+// Replay the state the host missed ahead of anything queued since it resumed
+void keyboard_host_resumed(void){
+    espnow_msg_keyboard_t state;
+    portENTER_CRITICAL(&held_state_lock);
+    bool replay = replay_pending;
+    state = held_state;
+    replay_pending = false;
+    portEXIT_CRITICAL(&held_state_lock);
+    if (replay)
+        xQueueSendToFront(keyboard_queue, &state, 0);
 }
\ No newline at end of file
@@ -11,4 +11,6 @@ esp_err_t begin_keyboard_task(void);
 
 esp_err_t init_keyboard_queue(void);
 
-void notify_keyboard_task(void);
\ No newline at end of file
+void notify_keyboard_task(void);
+
+void keyboard_host_resumed(void);
\ No newline at end of file
@@ -4,88 +4,456 @@
 #include "freertos/task.h"
 #include "wifi/msg_types.h"
 #include "tusb_device_common.h"
-#include "tusb.h"
+#include "output_sink.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "device_config.h"
+#include "jitter_buffer.h"
+#include "rtos/ram_budget.h"
+#include "rtos/hot_path.h"
+#include "suspend.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#if BENCHMARK
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#endif
 
-#define MOUSE_QUEUE_SIZE 20
+#define BENCH_ITERATIONS 1000
+#define LATENCY_SAMPLES 4000
+#define FLASH_STRESS_BLOB_LEN 1024
+#define FLASH_STRESS_TASK_STACK 3072
+#define FLASH_STRESS_TASK_PRIORITY 1
+#define JB_STATS_INTERVAL_US (5000000LL)
+#define POSITION_MAX_GAP (32768)    // Counters jumping further are not trusted as motion
 
-// static const char* TAG = "USB_TRANSMITTER // mouse.c";
+static const char* TAG = "USB_RECEIVER // mouse.c";
+
+typedef struct {
+    union {
+        espnow_msg_mouse_t msg;
+        espnow_msg_mouse_position_t position_msg; // msg.msg_type tells which; buttons are shared
+    };
+    int64_t rx_us; // Receiver time the message arrived
+} mouse_event_t;
+
+STATIC_TASK(mouse_task_mem, "mouse", MOUSE_TASK_STACK, MOUSE_TASK_PRIORITY);
+STATIC_QUEUE(mouse_queue_mem, "mouse", MOUSE_QUEUE_LEN, mouse_event_t);
 
 static QueueHandle_t mouse_queue = NULL;
 
 static TaskHandle_t mouse_task_handle = NULL;
 
-static inline int8_t clamp16to8(int16_t val) { return (val < -128) ? -128 : ((val > 127) ? 127 : val); }
+// Jitter buffer state is owned by mouse_task
+static volatile bool jitter_buffer_enabled = (JITTER_BUFFER == ENABLED);
+static jitter_buffer_t jitter_buffer;
+static esp_timer_handle_t jb_timer = NULL;
+
+// Motion received before the host last resumed is stale
+static volatile int64_t host_resumed_us = 0;
 
-static bool __send_report(espnow_msg_mouse_t* msg){
-    return tud_hid_n_mouse_report(
-        HID_MOUSE_INSTANCE,
-        HID_MOUSE_REPORT_ID,
-        msg->buttons,
-        msg->x,
-        msg->y,
-        msg->wheel,
-        msg->pan
-    );
+// Counters of the last position message applied; owned by mouse_task
+static struct {
+    uint32_t x, y, wheel, pan;
+    uint32_t epoch;
+    uint16_t seq;
+    bool synced;
+} position = {0};
+static volatile bool position_resync = false;
+
+static inline int8_t clamp32to8(int32_t val) { return (val < -128) ? -128 : ((val > 127) ? 127 : val); }
+static inline bool within_gap(int32_t val) { return val >= -POSITION_MAX_GAP && val <= POSITION_MAX_GAP; }
+
+static bool HOT_PATH_ATTR __send_report(espnow_msg_mouse_t* msg){
+    return get_output_sink()->mouse_report(msg);
 }
 
-static void mouse_task(void* arg){
-    espnow_msg_mouse_t mouse_msg_buf, mouse_msg_acc;
-    
-    while (true){
-        int16_t x = 0, y = 0, wheel = 0, pan = 0;
-        // attempt to retrieve msg from queue
-        // restart on failure
-        if (xQueueReceive(mouse_queue, &mouse_msg_buf, portMAX_DELAY) != pdTRUE)
+// Motion of a queued message. A position message's is how far its counters moved since
+// the last one applied, which includes the motion of any lost in between.
+// Returns false for a resent position message that was already applied.
+static bool HOT_PATH_ATTR event_motion(const mouse_event_t* event, mouse_motion_t* motion){
+    motion->buttons = event->msg.buttons;
+    if (event->msg.msg_type != ESPNOW_MSG_MOUSE_POSITION){
+        motion->x = event->msg.x;
+        motion->y = event->msg.y;
+        motion->wheel = event->msg.wheel;
+        motion->pan = event->msg.pan;
+        motion->timestamp_us = event->msg.timestamp_us;
+        return true;
+    }
+
+    const espnow_msg_mouse_position_t* msg = &event->position_msg;
+    if (position_resync){
+        position_resync = false;
+        position.synced = false;
+    }
+    // A transmitter that restarted counts from zero again, whatever seq it is at
+    if (position.synced && msg->epoch != position.epoch){
+        ESP_LOGW(TAG, "Transmitter restarted, resyncing mouse position");
+        position.synced = false;
+    }
+    if (position.synced && (int16_t)(msg->seq - position.seq) <= 0)
+        return false;
+    motion->x = (int32_t)(msg->x - position.x);
+    motion->y = (int32_t)(msg->y - position.y);
+    motion->wheel = (int32_t)(msg->wheel - position.wheel);
+    motion->pan = (int32_t)(msg->pan - position.pan);
+    motion->timestamp_us = msg->timestamp_us;
+    // Without a baseline the counters only become the new one
+    if (!position.synced || !within_gap(motion->x) || !within_gap(motion->y) ||
+        !within_gap(motion->wheel) || !within_gap(motion->pan)){
+        if (position.synced)
+            ESP_LOGW(TAG, "Mouse position jumped, resyncing");
+        motion->x = motion->y = motion->wheel = motion->pan = 0;
+    }
+    position.x = msg->x;
+    position.y = msg->y;
+    position.wheel = msg->wheel;
+    position.pan = msg->pan;
+    position.seq = msg->seq;
+    position.epoch = msg->epoch;
+    position.synced = true;
+    return true;
+}
+
+static inline bool has_motion(const mouse_motion_t* motion){
+    return motion->x || motion->y || motion->wheel || motion->pan;
+}
+
+// Accumulate dx, dy, wheel, and pan of every queued message into motion
+static void HOT_PATH_ATTR coalesce_mouse_queue(mouse_motion_t* motion){
+    mouse_event_t event;
+    mouse_motion_t queued;
+    while (xQueueReceive(mouse_queue, &event, 0) == pdTRUE){
+        if (!event_motion(&event, &queued))
             continue;
+        motion->x += queued.x;
+        motion->y += queued.y;
+        motion->wheel += queued.wheel;
+        motion->pan += queued.pan;
+        motion->timestamp_us = queued.timestamp_us;
+    }
+}
+
+// Move as much motion as one report holds into mouse_msg_buf; the rest waits for the next report
+static void HOT_PATH_ATTR take_report(mouse_motion_t* motion, espnow_msg_mouse_t* mouse_msg_buf){
+    mouse_msg_buf->msg_type = ESPNOW_MSG_MOUSE;
+    mouse_msg_buf->buttons = motion->buttons;
+    mouse_msg_buf->x = clamp32to8(motion->x);
+    mouse_msg_buf->y = clamp32to8(motion->y);
+    mouse_msg_buf->wheel = clamp32to8(motion->wheel);
+    mouse_msg_buf->pan = clamp32to8(motion->pan);
+    mouse_msg_buf->timestamp_us = motion->timestamp_us;
+    motion->x -= mouse_msg_buf->x;
+    motion->y -= mouse_msg_buf->y;
+    motion->wheel -= mouse_msg_buf->wheel;
+    motion->pan -= mouse_msg_buf->pan;
+}
+
+// Drop motion the host slept through; a button press while it sleeps wakes it
+static bool HOT_PATH_ATTR drop_if_stale(const mouse_event_t* event){
+    if (is_host_suspended()){
+        if (event->msg.buttons)
+            request_remote_wakeup();
+        return true;
+    }
+    return event->rx_us < host_resumed_us;
+}
+
+static void HOT_PATH_ATTR send_when_ready(espnow_msg_mouse_t* mouse_msg_buf){
+    const output_sink_t* sink = get_output_sink();
+    // wait for the interface to become ready
+    int num_tries = 0;
+    while (!sink->ready(HID_MOUSE_INSTANCE) && (num_tries++ < 5)) {
+        // Sleep until the sink wakes us (or give up after 10MS)
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
         
-        // accumulate dx, dy, wheel, and pan
-        while (xQueueReceive(mouse_queue, &mouse_msg_acc, 0) == pdTRUE){
-            x += mouse_msg_acc.x;
-            y += mouse_msg_acc.y;
-            wheel += mouse_msg_acc.wheel;
-            pan += mouse_msg_acc.pan;
+        // Check if still mounted after waiting
+        if (!sink->mounted() || is_host_suspended()) {
+            break;
         }
-        mouse_msg_buf.x = clamp16to8(mouse_msg_buf.x + x);
-        mouse_msg_buf.y = clamp16to8(mouse_msg_buf.y + y);
-        mouse_msg_buf.wheel = clamp16to8(mouse_msg_buf.wheel + wheel);
-        mouse_msg_buf.pan = clamp16to8(mouse_msg_buf.pan + pan);
-        
-        // wait for the interface to become ready
-        int num_tries = 0;
-        while (!tud_hid_n_ready(HID_MOUSE_INSTANCE) && (num_tries++ < 5)) {
-            // Sleep until USB callback wakes us (or give up after 10MS)
-            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
-            
-            // Check if still mounted after waiting
-            if (!tud_mounted()) {
-                break;
+    }
+
+    if (sink->mounted() && sink->ready(HID_MOUSE_INSTANCE))
+        __send_report(mouse_msg_buf);
+}
+
+static void HOT_PATH_ATTR jb_timer_cb(void* arg){
+    xTaskNotifyGive(mouse_task_handle);
+}
+
+static void HOT_PATH_ATTR arm_jb_timer(int64_t due_us, int64_t now_us){
+    esp_timer_stop(jb_timer);
+    esp_timer_start_once(jb_timer, due_us - now_us);
+}
+
+static void log_jitter_stats(void){
+    jb_stats_t stats;
+    jb_take_stats(&jitter_buffer, &stats);
+    ESP_LOGI(TAG, "jitter buffer: %" PRIu32 " msgs, delay avg %" PRIu32 " US max %" PRIu32 " US, "
+             "jitter %" PRIu32 " US, stutters in %" PRIu32 " -> out %" PRIu32,
+             stats.messages, stats.messages ? (uint32_t)(stats.total_delay_us / stats.messages) : 0,
+             stats.max_delay_us, jitter_buffer.jitter_us, stats.input_stutters, stats.output_stutters);
+}
+
+// Play buffered motion out one host poll at a time.
+// Sleeps until woken by new messages, report completion or the playout timer.
+static void HOT_PATH_ATTR jitter_buffer_step(void){
+    static int64_t last_stats_us = 0;
+    mouse_event_t event;
+    mouse_motion_t motion;
+    espnow_msg_mouse_t mouse_msg_buf;
+
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    while (xQueueReceive(mouse_queue, &event, 0) == pdTRUE){
+        // Decoded even when stale, so the counters move past the dropped motion
+        if (event_motion(&event, &motion) && !drop_if_stale(&event))
+            jb_push(&jitter_buffer, &motion, event.rx_us);
+    }
+    if (is_host_suspended()){
+        jb_reset(&jitter_buffer);
+        return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    // Report completion wakes us again once the host has taken this report
+    const output_sink_t* sink = get_output_sink();
+    if (sink->mounted() && sink->ready(HID_MOUSE_INSTANCE)){
+        if (jb_pull(&jitter_buffer, now_us, &mouse_msg_buf)){
+            // No completion will come for a report the sink refused: give it back so its
+            // motion and buttons go out with the next poll
+            if (!__send_report(&mouse_msg_buf)){
+                jb_unpull(&jitter_buffer, &mouse_msg_buf);
+                arm_jb_timer(now_us + JB_POLL_INTERVAL_US, now_us);
             }
         }
+        else {
+            int64_t due_us = jb_next_due_us(&jitter_buffer, now_us);
+            if (due_us > now_us)
+                arm_jb_timer(due_us, now_us);
+        }
+    }
 
-        if (tud_mounted() && tud_hid_n_ready(HID_MOUSE_INSTANCE))
-            __send_report(&mouse_msg_buf);
+    if (now_us - last_stats_us > JB_STATS_INTERVAL_US){
+        if (last_stats_us)
+            log_jitter_stats();
+        last_stats_us = now_us;
     }
 }
 
-esp_err_t enqueue_mouse_event(espnow_msg_mouse_t mouse_msg){
-    if (xQueueSend(mouse_queue, &mouse_msg, 0) != pdTRUE)
+static void HOT_PATH_ATTR mouse_task(void* arg){
+    espnow_msg_mouse_t mouse_msg_buf;
+    mouse_event_t event;
+    mouse_motion_t motion = {0}; // Decoded but not yet reported
+    
+    while (true){
+        if (is_host_suspended())
+            motion.x = motion.y = motion.wheel = motion.pan = 0;
+        if (jitter_buffer_enabled){
+            // Motion still owed to the host goes out with the buffer's own carry
+            jitter_buffer.carry_x += motion.x;
+            jitter_buffer.carry_y += motion.y;
+            jitter_buffer.carry_wheel += motion.wheel;
+            jitter_buffer.carry_pan += motion.pan;
+            motion.x = motion.y = motion.wheel = motion.pan = 0;
+            jitter_buffer_step();
+            continue;
+        }
+        // Play out anything left over from the jitter buffer before bypassing it
+        if (is_host_suspended())
+            jb_reset(&jitter_buffer);
+        if (jb_has_pending(&jitter_buffer)){
+            if (jb_pull(&jitter_buffer, INT64_MAX, &mouse_msg_buf))
+                send_when_ready(&mouse_msg_buf);
+            continue;
+        }
+
+        // Motion beyond one report's range goes out with the next ones, before waiting for more
+        if (!has_motion(&motion)){
+            // attempt to retrieve msg from queue
+            // restart on failure; decoded before the stale check so the counters move past it
+            if (xQueueReceive(mouse_queue, &event, portMAX_DELAY) != pdTRUE ||
+                !event_motion(&event, &motion) || drop_if_stale(&event)){
+                motion.x = motion.y = motion.wheel = motion.pan = 0;
+                continue;
+            }
+            if (jitter_buffer_enabled){
+                jb_push(&jitter_buffer, &motion, event.rx_us);
+                motion.x = motion.y = motion.wheel = motion.pan = 0;
+                continue;
+            }
+        }
+        coalesce_mouse_queue(&motion);
+        take_report(&motion, &mouse_msg_buf);
+        send_when_ready(&mouse_msg_buf);
+    }
+}
+
+// Switch the playout buffer on or off; takes effect on the next message
+void mouse_set_jitter_buffer(bool enabled){
+    if (enabled == jitter_buffer_enabled)
+        return;
+    jitter_buffer_enabled = enabled;
+    ESP_LOGI(TAG, "Mouse jitter buffer %s", enabled ? "enabled" : "disabled");
+    if (mouse_task_handle)
+        xTaskNotifyGive(mouse_task_handle);
+}
+
+static esp_err_t HOT_PATH_ATTR push_mouse_event(const mouse_event_t* event){
+    bool sent = xQueueSend(mouse_queue, event, 0) == pdTRUE;
+    ram_budget_note_send(&mouse_queue_mem, sent);
+    if (!sent)
         return ESP_FAIL;
+    if (jitter_buffer_enabled)
+        xTaskNotifyGive(mouse_task_handle);
     return ESP_OK;
 }
 
+esp_err_t HOT_PATH_ATTR enqueue_mouse_event(espnow_msg_mouse_t mouse_msg){
+    const mouse_event_t event = { .msg = mouse_msg, .rx_us = esp_timer_get_time() };
+    return push_mouse_event(&event);
+}
+
+// A lost message -- on the link or in a full queue -- costs nothing: the next one has its motion
+esp_err_t HOT_PATH_ATTR enqueue_mouse_position_event(espnow_msg_mouse_position_t mouse_msg){
+    const mouse_event_t event = { .position_msg = mouse_msg, .rx_us = esp_timer_get_time() };
+    return push_mouse_event(&event);
+}
+
+void mouse_resync_position(void){
+    position_resync = true;
+}
+
 esp_err_t begin_mouse_task(void){
-    if (xTaskCreate(mouse_task, "mouse", 1024, NULL, 4, &mouse_task_handle) != pdPASS)
+    jb_reset(&jitter_buffer);
+    const esp_timer_create_args_t timer_args = { .callback = jb_timer_cb, .name = "mouse_jb" };
+    if (esp_timer_create(&timer_args, &jb_timer) != ESP_OK)
+        return ESP_FAIL;
+    mouse_task_handle = create_static_task(&mouse_task_mem, mouse_task, NULL);
+    if (mouse_task_handle == NULL)
         return ESP_FAIL;
     return ESP_OK;
 }
 
 esp_err_t init_mouse_queue(void){
-    mouse_queue = xQueueCreate(MOUSE_QUEUE_SIZE, sizeof(espnow_msg_mouse_t));
+    mouse_queue = create_static_queue(&mouse_queue_mem);
     if (mouse_queue == 0)
         return ESP_FAIL;
     return ESP_OK;
 }
 
-void notify_mouse_task(void){
+void HOT_PATH_ATTR notify_mouse_task(void){
     xTaskNotifyGive(mouse_task_handle);
-}
\ No newline at end of file
+}
+
+void mouse_host_resumed(void){
+    host_resumed_us = esp_timer_get_time();
+    notify_mouse_task();
+}
+
+// Cycles and nanoseconds spent receiving and coalescing a backlog of queued messages,
+// as mouse_task does each time it wakes. Must run before the mouse task is started.
+void benchmark_mouse_coalescing(void){
+#if BENCHMARK
+    static const int depths[] = { 1, 4, 10, MOUSE_QUEUE_LEN };
+    const uint32_t cycles_per_us = esp_rom_get_cpu_ticks_per_us();
+    const mouse_event_t sample = { .msg = { .msg_type = ESPNOW_MSG_MOUSE, .x = 100, .y = -100, .wheel = 1 } };
+    mouse_event_t mouse_event_buf;
+    mouse_motion_t motion;
+
+    for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++){
+        uint64_t total_cycles = 0;
+        for (int n = 0; n < BENCH_ITERATIONS; n++){
+            for (int i = 0; i < depths[d]; i++)
+                xQueueSend(mouse_queue, &sample, 0);
+            uint32_t start = esp_cpu_get_cycle_count();
+            xQueueReceive(mouse_queue, &mouse_event_buf, 0);
+            event_motion(&mouse_event_buf, &motion);
+            coalesce_mouse_queue(&motion);
+            total_cycles += esp_cpu_get_cycle_count() - start;
+        }
+        uint32_t cycles = total_cycles / BENCH_ITERATIONS;
+        ESP_LOGI(TAG, "coalesce %2d msgs: %5" PRIu32 " cycles, %6" PRIu32 " ns, %4" PRIu32 " ns/msg",
+                 depths[d], cycles, cycles * 1000 / cycles_per_us, cycles * 1000 / cycles_per_us / depths[d]);
+    }
+#endif
+}
+
+#if BENCHMARK
+STATIC_TASK(flash_stress_task_mem, "flash_stress", FLASH_STRESS_TASK_STACK, FLASH_STRESS_TASK_PRIORITY);
+static volatile bool flash_stress_running = false;
+
+// Keep the flash busy from the other core: NVS writes run from flash and evict the cache
+static void flash_stress_task(void* arg){
+    static uint8_t blob[FLASH_STRESS_BLOB_LEN];
+    nvs_handle_t nvs_handle;
+    if (nvs_open("storage", NVS_READWRITE, &nvs_handle) == ESP_OK){
+        for (uint32_t n = 0; flash_stress_running; n++){
+            memset(blob, n, sizeof(blob));
+            nvs_set_blob(nvs_handle, "bench_stress", blob, sizeof(blob));
+            nvs_commit(nvs_handle);
+        }
+        nvs_erase_key(nvs_handle, "bench_stress");
+        nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
+    }
+    xTaskNotifyGive((TaskHandle_t)arg);
+    // Parked, not deleted: the RAM budget report keeps reading its stack
+    vTaskSuspend(NULL);
+}
+
+static int compare_cycles(const void* a, const void* b){
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Enqueue one message as the ESP-NOW callback does, then receive and coalesce it as mouse_task does
+static void measure_hot_path(const char* label, uint32_t* samples){
+    const uint32_t cycles_per_us = esp_rom_get_cpu_ticks_per_us();
+    const espnow_msg_mouse_t msg = { .msg_type = ESPNOW_MSG_MOUSE, .x = 3, .y = -3 };
+    mouse_event_t event;
+    mouse_motion_t motion;
+
+    for (int n = 0; n < LATENCY_SAMPLES; n++){
+        uint32_t start = esp_cpu_get_cycle_count();
+        enqueue_mouse_event(msg);
+        xQueueReceive(mouse_queue, &event, 0);
+        event_motion(&event, &motion);
+        coalesce_mouse_queue(&motion);
+        samples[n] = esp_cpu_get_cycle_count() - start;
+        // Idle gap between reports, giving other code the chance to evict the hot path
+        esp_rom_delay_us(100);
+        if (n % 100 == 99)
+            vTaskDelay(1);
+    }
+    qsort(samples, LATENCY_SAMPLES, sizeof(samples[0]), compare_cycles);
+    ESP_LOGI(TAG, "hot path %-12s p50 %5" PRIu32 " ns, p99 %6" PRIu32 " ns, p99.9 %6" PRIu32 " ns, max %7" PRIu32 " ns", label,
+             samples[LATENCY_SAMPLES / 2] * 1000 / cycles_per_us,
+             samples[LATENCY_SAMPLES * 99 / 100] * 1000 / cycles_per_us,
+             samples[LATENCY_SAMPLES * 999 / 1000] * 1000 / cycles_per_us,
+             samples[LATENCY_SAMPLES - 1] * 1000 / cycles_per_us);
+}
+#endif
+
+// Tail latency of the receive hot path, idle and while the other core writes to NVS.
+// Build once with and once without CONFIG_WIRELESS_HOT_PATH_IRAM to compare placements.
+// Must run after NVS is initialised and before the mouse task is started.
+void benchmark_hot_path_latency(void){
+#if BENCHMARK
+    uint32_t* samples = malloc(LATENCY_SAMPLES * sizeof(uint32_t));
+    if (samples == NULL)
+        return;
+    ESP_LOGI(TAG, "hot path placement: %s", HOT_PATH_PLACEMENT);
+    measure_hot_path("idle", samples);
+
+    flash_stress_running = true;
+    if (create_static_task_pinned(&flash_stress_task_mem, flash_stress_task, xTaskGetCurrentTaskHandle(),
+                                  !xPortGetCoreID()) != NULL){
+        measure_hot_path("flash stress", samples);
+        flash_stress_running = false;
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    free(samples);
+#endif
+}
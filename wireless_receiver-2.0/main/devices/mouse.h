@@ -6,9 +6,19 @@
 extern TaskHandle_t mouse_task_handle;
 
 esp_err_t enqueue_mouse_event(espnow_msg_mouse_t mouse_msg);
+esp_err_t enqueue_mouse_position_event(espnow_msg_mouse_position_t mouse_msg);
 
 esp_err_t begin_mouse_task(void);
 
 esp_err_t init_mouse_queue(void);
 
-void notify_mouse_task(void);
\ No newline at end of file
+void notify_mouse_task(void);
+
+// Discard motion queued while the host was suspended
+void mouse_host_resumed(void);
+
+void benchmark_mouse_coalescing(void);
+
+void benchmark_hot_path_latency(void);
+
+void mouse_set_jitter_buffer(bool enabled);
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "wifi/wifi.h"
+#include "timer/timer_service.h"
+#include "tusb_device_common.h"
+#include "output.h"
+#include "log/deferred_log.h"
+#include <inttypes.h>
+#include <string.h>
+
+#define OUTPUT_RETRY_US (30000ULL)   // Resend an unacknowledged report after 30ms
+#define OUTPUT_MAX_RETRIES 3         // Afterwards the connection heartbeat carries it
+
+static const char* TAG = "USB_RECEIVER // output.c";
+
+typedef struct {
+    espnow_msg_output_t msg;
+    bool valid;             // msg holds the host's latest report for this target
+    bool pending;           // msg not yet acknowledged by the transmitter
+    uint8_t retries;
+    int64_t set_us;         // time the host set msg
+} output_slot_t;
+
+static output_slot_t slots[NUM_OUTPUT_TARGETS];
+static uint8_t next_seq = 0;
+static uint8_t next_piggyback = 0;
+static portMUX_TYPE output_lock = portMUX_INITIALIZER_UNLOCKED;
+static service_timer_t retry_timer = NULL;
+
+static struct {
+    uint32_t count;
+    int64_t total_us;
+    int64_t max_us;
+} latency = {0};
+
+static const char* target_name(uint8_t target){
+    return (target == OUTPUT_TARGET_KEYBOARD) ? "keyboard" : "gamepad";
+}
+
+static void send_output(const espnow_msg_output_t* msg){
+    if (send_message((const uint8_t*)msg, sizeof(*msg)) != ESP_OK)
+        ESP_LOGW(TAG, "Output report %u deferred to the next handshake", msg->seq);
+}
+
+static void retry_timer_cb(void* arg){
+    espnow_msg_output_t resend[NUM_OUTPUT_TARGETS];
+    size_t num_resend = 0;
+    bool still_pending = false;
+
+    portENTER_CRITICAL(&output_lock);
+    for (int i = 0; i < NUM_OUTPUT_TARGETS; i++){
+        if (!slots[i].pending || slots[i].retries >= OUTPUT_MAX_RETRIES)
+            continue;
+        slots[i].retries++;
+        resend[num_resend++] = slots[i].msg;
+        still_pending = true;
+    }
+    portEXIT_CRITICAL(&output_lock);
+
+    for (size_t i = 0; i < num_resend; i++)
+        send_output(&resend[i]);
+    if (still_pending)
+        service_timer_start_once(retry_timer, OUTPUT_RETRY_US);
+}
+
+void forward_output_report(uint8_t instance, const uint8_t* buffer, uint16_t bufsize){
+    uint8_t target;
+    switch (instance){
+        case HID_KEYBOARD_INSTANCE:
+            target = OUTPUT_TARGET_KEYBOARD;
+            break;
+        case HID_GAMEPAD_INSTANCE:
+            target = OUTPUT_TARGET_GAMEPAD;
+            break;
+        default:
+            return;
+    }
+    if (bufsize > ESPNOW_OUTPUT_MAX_LEN){
+        ESP_LOGW(TAG, "Truncating %u byte %s output report", bufsize, target_name(target));
+        bufsize = ESPNOW_OUTPUT_MAX_LEN;
+    }
+
+    espnow_msg_output_t msg = { .msg_type = ESPNOW_MSG_OUTPUT, .target = target, .len = bufsize };
+    memcpy(msg.data, buffer, bufsize);
+
+    output_slot_t* slot = &slots[target];
+    portENTER_CRITICAL(&output_lock);
+    // Hosts repeat LED state on every lock-key press; only changes go over the air
+    bool unchanged = slot->valid && slot->msg.len == msg.len && memcmp(slot->msg.data, msg.data, msg.len) == 0;
+    if (!unchanged){
+        msg.seq = next_seq++;
+        slot->msg = msg;
+        slot->valid = true;
+        slot->pending = true;
+        slot->retries = 0;
+        slot->set_us = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL(&output_lock);
+    if (unchanged)
+        return;
+
+    // Sent straight away for latency; the handshake frames carry it if this is lost
+    send_output(&msg);
+    service_timer_start_once(retry_timer, OUTPUT_RETRY_US);
+}
+
+bool take_pending_output(espnow_msg_output_t* output){
+    bool found = false;
+    portENTER_CRITICAL(&output_lock);
+    // Alternate targets so one unacknowledged report cannot starve the other
+    for (int i = 0; i < NUM_OUTPUT_TARGETS && !found; i++){
+        output_slot_t* slot = &slots[(next_piggyback + i) % NUM_OUTPUT_TARGETS];
+        if (slot->pending){
+            *output = slot->msg;
+            found = true;
+        }
+    }
+    next_piggyback = (next_piggyback + 1) % NUM_OUTPUT_TARGETS;
+    portEXIT_CRITICAL(&output_lock);
+    return found;
+}
+
+void output_report_acked(const espnow_msg_output_ack_t* ack){
+    if (ack->target >= NUM_OUTPUT_TARGETS)
+        return;
+    int64_t latency_us = -1;
+    output_slot_t* slot = &slots[ack->target];
+    portENTER_CRITICAL(&output_lock);
+    if (slot->pending && slot->msg.seq == ack->seq){
+        slot->pending = false;
+        latency_us = esp_timer_get_time() - slot->set_us;
+    }
+    portEXIT_CRITICAL(&output_lock);
+    if (latency_us < 0)
+        return;
+
+    // Host SET_REPORT to report applied on the device, plus the ACK's flight back
+    latency.count++;
+    latency.total_us += latency_us;
+    if (latency_us > latency.max_us)
+        latency.max_us = latency_us;
+    // Acks arrive on the WiFi task, so the line is formatted later by the deferred log,
+    // which takes 32-bit numbers only: the target goes as its number, not its name
+    DLOGI(TAG, "Output report (target %" PRIu32 ") applied in %" PRIu32 " US (avg %" PRIu32 " US, max %" PRIu32 " US)",
+          (uint32_t)ack->target, (uint32_t)latency_us, (uint32_t)(latency.total_us / latency.count),
+          (uint32_t)latency.max_us);
+}
+
+esp_err_t init_output_reports(void){
+    return service_timer_create_deferred(&retry_timer, "output_retry", retry_timer_cb, NULL);
+}
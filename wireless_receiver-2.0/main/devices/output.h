@@ -0,0 +1,16 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "wifi/msg_types.h"
+
+// Forward an output report the host set (LEDs, rumble) to the transmitter
+void forward_output_report(uint8_t instance, const uint8_t* buffer, uint16_t bufsize);
+
+// Copy an unacknowledged output report into a handshake frame, false if none is pending
+bool take_pending_output(espnow_msg_output_t* output);
+
+// Transmitter applied an output report -- logs the end-to-end latency
+void output_report_acked(const espnow_msg_output_ack_t* ack);
+
+esp_err_t init_output_reports(void);
@@ -0,0 +1,277 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+#include "tusb_device_common.h"
+#include "output_sink.h"
+#include "wifi/wifi.h"
+#include "rtos/ram_budget.h"
+#include "device_config.h"
+#include "passthrough.h"
+#include <stdio.h>
+#include <string.h>
+
+#define PASSTHROUGH_LAST_KEY "pt_last"
+#define QUERY_INTERVAL_US (1000000LL)      // Limit on asking for an unknown device's descriptor
+
+static const char* TAG = "USB_RECEIVER // passthrough.c";
+
+STATIC_TASK(passthrough_task_mem, "passthrough", PASSTHROUGH_TASK_STACK, PASSTHROUGH_TASK_PRIORITY);
+
+// Raw reports and descriptor messages, handled by the passthrough task in arrival order
+typedef union {
+    uint8_t msg_type;
+    espnow_msg_raw_report_t report;
+    espnow_msg_desc_info_t info;
+    espnow_msg_desc_chunk_t chunk;
+} passthrough_item_t;
+
+STATIC_QUEUE(passthrough_queue_mem, "passthrough", PASSTHROUGH_QUEUE_LEN, passthrough_item_t);
+
+typedef struct {
+    espnow_msg_desc_info_t info;
+    uint16_t received;      // bytes assembled so far
+    uint8_t data[ESPNOW_DESC_MAX_LEN];
+} report_descriptor_t;
+
+// Descriptor being downloaded, and the one the passthrough interface enumerates with.
+// The sink serves active's data, so a download never writes into it: activating swaps
+// the two. Only the passthrough task touches them once it runs.
+static report_descriptor_t descriptors[2] = {0};
+static report_descriptor_t* incoming = &descriptors[0];
+static report_descriptor_t* active = &descriptors[1];
+static volatile bool passthrough_active = false;
+// The transmitter has announced the active device; a descriptor restored at boot is not yet trusted
+static volatile bool passthrough_confirmed = false;
+
+static QueueHandle_t passthrough_queue = NULL;
+static TaskHandle_t passthrough_task_handle = NULL;
+static int64_t last_query_us = 0;
+
+static inline bool same_device(const espnow_msg_desc_info_t* a, const espnow_msg_desc_info_t* b){
+    return a->vid == b->vid && a->pid == b->pid && a->desc_len == b->desc_len && a->crc == b->crc;
+}
+
+static void cache_key(char key[16], uint16_t vid, uint16_t pid){
+    snprintf(key, 16, "pt%04x%04x", vid, pid);
+}
+
+// Load the descriptor cached for info's VID/PID into incoming, true if it matches info's CRC
+static bool load_cached_descriptor(const espnow_msg_desc_info_t* info){
+    nvs_handle_t nvs_handle;
+    if (info->desc_len == 0 || info->desc_len > ESPNOW_DESC_MAX_LEN)
+        return false;
+    if (nvs_open("storage", NVS_READONLY, &nvs_handle) != ESP_OK)
+        return false;
+    char key[16];
+    cache_key(key, info->vid, info->pid);
+    size_t len = sizeof(incoming->data);
+    bool found = nvs_get_blob(nvs_handle, key, incoming->data, &len) == ESP_OK;
+    nvs_close(nvs_handle);
+    if (!found || len != info->desc_len || esp_rom_crc32_le(0, incoming->data, len) != info->crc)
+        return false;
+    incoming->info = *info;
+    incoming->received = len;
+    return true;
+}
+
+static void store_descriptor(const report_descriptor_t* desc){
+    nvs_handle_t nvs_handle;
+    if (nvs_open("storage", NVS_READWRITE, &nvs_handle) != ESP_OK)
+        return;
+    char key[16];
+    cache_key(key, desc->info.vid, desc->info.pid);
+    if (nvs_set_blob(nvs_handle, key, desc->data, desc->info.desc_len) != ESP_OK ||
+        nvs_set_blob(nvs_handle, PASSTHROUGH_LAST_KEY, &desc->info, sizeof(desc->info)) != ESP_OK)
+        ESP_LOGW(TAG, "Could not cache descriptor for %04X:%04X", desc->info.vid, desc->info.pid);
+    nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+}
+
+// Swap the passthrough interface over to the descriptor in incoming
+static void activate_incoming(bool confirmed){
+    const output_sink_t* sink = get_output_sink();
+    passthrough_active = false;
+    report_descriptor_t* previous = active;
+    active = incoming;
+    incoming = previous;
+    if (sink->set_raw_descriptor)
+        sink->set_raw_descriptor(active->data, active->info.desc_len);
+    passthrough_active = true;
+    passthrough_confirmed = confirmed;
+    ESP_LOGI(TAG, "Passthrough %04X:%04X enumerating with %u byte descriptor",
+             active->info.vid, active->info.pid, active->info.desc_len);
+}
+
+static void send_ready(void){
+    espnow_msg_desc_info_t ready = active->info;
+    ready.msg_type = ESPNOW_MSG_DESC_READY;
+    send_message((const uint8_t*)&ready, sizeof(ready));
+}
+
+static void request_descriptor(uint16_t vid, uint16_t pid, uint16_t offset){
+    const espnow_msg_desc_request_t request = {
+        .msg_type = ESPNOW_MSG_DESC_REQUEST,
+        .vid = vid,
+        .pid = pid,
+        .offset = offset
+    };
+    send_message((const uint8_t*)&request, sizeof(request));
+}
+
+static void process_desc_info(const espnow_msg_desc_info_t* info){
+    if (info->desc_len == 0 || info->desc_len > ESPNOW_DESC_MAX_LEN){
+        ESP_LOGW(TAG, "%04X:%04X descriptor too large for passthrough", info->vid, info->pid);
+        return;
+    }
+    if (passthrough_active && same_device(&active->info, info)){
+        passthrough_confirmed = true;
+        send_ready();
+        return;
+    }
+    // Resume a download already under way, or start a new one
+    if (!same_device(&incoming->info, info)){
+        if (!load_cached_descriptor(info)){
+            incoming->info = *info;
+            incoming->received = 0;
+        }
+    }
+    if (incoming->received >= incoming->info.desc_len){
+        activate_incoming(true);
+        send_ready();
+        return;
+    }
+    request_descriptor(info->vid, info->pid, incoming->received);
+}
+
+static void process_desc_chunk(const espnow_msg_desc_chunk_t* chunk){
+    if (chunk->vid != incoming->info.vid || chunk->pid != incoming->info.pid || incoming->received >= incoming->info.desc_len)
+        return;
+    // A lost chunk: ask again from the first missing byte
+    if (chunk->offset != incoming->received){
+        if (chunk->offset > incoming->received)
+            request_descriptor(chunk->vid, chunk->pid, incoming->received);
+        return;
+    }
+    if (chunk->len > ESPNOW_DESC_CHUNK_LEN || incoming->received + chunk->len > incoming->info.desc_len)
+        return;
+    memcpy(incoming->data + incoming->received, chunk->data, chunk->len);
+    incoming->received += chunk->len;
+    if (incoming->received < incoming->info.desc_len)
+        return;
+
+    if (esp_rom_crc32_le(0, incoming->data, incoming->received) != incoming->info.crc){
+        ESP_LOGW(TAG, "Descriptor CRC mismatch, downloading again");
+        incoming->received = 0;
+        request_descriptor(chunk->vid, chunk->pid, 0);
+        return;
+    }
+    store_descriptor(incoming);
+    activate_incoming(true);
+    send_ready();
+}
+
+// NVS and the descriptor swap are too slow for the WiFi task; a dropped message is
+// asked for again by the download or repeated by the transmitter's announcements
+void process_passthrough_message(const espnow_message_t* msg){
+    passthrough_item_t item;
+    switch (msg->msg_type){
+        case ESPNOW_MSG_DESC_INFO:
+            item.info = msg->desc_info_msg;
+            break;
+        case ESPNOW_MSG_DESC_CHUNK:
+            item.chunk = msg->desc_chunk_msg;
+            break;
+        default:
+            return;
+    }
+    bool sent = xQueueSend(passthrough_queue, &item, 0) == pdTRUE;
+    ram_budget_note_send(&passthrough_queue_mem, sent);
+}
+
+esp_err_t enqueue_passthrough_report(const espnow_msg_raw_report_t* report){
+    if (!passthrough_confirmed){
+        // Reports from a device we have no descriptor for -- e.g. after a receiver reboot
+        int64_t now_us = esp_timer_get_time();
+        if (now_us - last_query_us > QUERY_INTERVAL_US){
+            last_query_us = now_us;
+            request_descriptor(0, 0, 0);
+        }
+        return ESP_FAIL;
+    }
+    if (report->len == 0 || report->len > ESPNOW_RAW_REPORT_MAX_LEN)
+        return ESP_FAIL;
+    const passthrough_item_t item = { .report = *report };
+    bool sent = xQueueSend(passthrough_queue, &item, 0) == pdTRUE;
+    ram_budget_note_send(&passthrough_queue_mem, sent);
+    return sent ? ESP_OK : ESP_FAIL;
+}
+
+static void send_raw_report(const output_sink_t* sink, const espnow_msg_raw_report_t* report){
+    // Sinks without arbitrary HID devices drop these
+    if (sink->raw_report == NULL)
+        return;
+
+    // wait for the interface to become ready
+    int num_tries = 0;
+    while (!sink->ready(HID_PASSTHROUGH_INSTANCE) && (num_tries++ < 5)) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+        if (!sink->mounted())
+            break;
+    }
+
+    // Report ID, if the device uses them, is already the first byte
+    if (passthrough_confirmed && sink->ready(HID_PASSTHROUGH_INSTANCE))
+        sink->raw_report(report->data, report->len);
+}
+
+static void passthrough_task(void* arg){
+    passthrough_item_t item;
+    const output_sink_t* sink = get_output_sink();
+    while (true){
+        if (xQueueReceive(passthrough_queue, &item, portMAX_DELAY) != pdTRUE)
+            continue;
+        switch (item.msg_type){
+            case ESPNOW_MSG_DESC_INFO:
+                process_desc_info(&item.info);
+                break;
+            case ESPNOW_MSG_DESC_CHUNK:
+                process_desc_chunk(&item.chunk);
+                break;
+            default:
+                send_raw_report(sink, &item.report);
+                break;
+        }
+    }
+}
+
+esp_err_t init_passthrough(void){
+    passthrough_queue = create_static_queue(&passthrough_queue_mem);
+    if (passthrough_queue == NULL)
+        return ESP_FAIL;
+
+    // Enumerate with the last passthrough device straight away; DESC_INFO corrects it if it changed
+    nvs_handle_t nvs_handle;
+    if (nvs_open("storage", NVS_READONLY, &nvs_handle) != ESP_OK)
+        return ESP_OK;
+    espnow_msg_desc_info_t last;
+    size_t len = sizeof(last);
+    bool found = nvs_get_blob(nvs_handle, PASSTHROUGH_LAST_KEY, &last, &len) == ESP_OK && len == sizeof(last);
+    nvs_close(nvs_handle);
+    if (found && load_cached_descriptor(&last))
+        activate_incoming(false);
+    return ESP_OK;
+}
+
+esp_err_t begin_passthrough_task(void){
+    passthrough_task_handle = create_static_task(&passthrough_task_mem, passthrough_task, NULL);
+    return passthrough_task_handle ? ESP_OK : ESP_FAIL;
+}
+
+void notify_passthrough_task(void){
+    if (passthrough_task_handle)
+        xTaskNotifyGive(passthrough_task_handle);
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "wifi/msg_types.h"
+#include "esp_err.h"
+
+// DESC_INFO / DESC_CHUNK from the transmitter, queued for the passthrough task
+void process_passthrough_message(const espnow_message_t* msg);
+
+esp_err_t enqueue_passthrough_report(const espnow_msg_raw_report_t* report);
+
+// Load the last passthrough descriptor from NVS; call before USB starts so it enumerates at boot
+esp_err_t init_passthrough(void);
+
+esp_err_t begin_passthrough_task(void);
+
+void notify_passthrough_task(void);
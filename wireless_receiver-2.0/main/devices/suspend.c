@@ -0,0 +1,78 @@
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "output_sink.h"
+#include "timer/timer_service.h"
+#include "devices.h"
+#include "suspend.h"
+#include "rtos/hot_path.h"
+#include <inttypes.h>
+
+#define MIN_SUSPEND_BEFORE_WAKE_US (5000LL) // USB 2.0 7.1.7.7: bus idle for 5ms before remote wakeup
+
+static const char* TAG = "USB_RECEIVER // suspend.c";
+
+static volatile bool host_suspended = false;
+static volatile bool wakeup_allowed = false;
+static volatile bool wakeup_requested = false;
+static int64_t suspend_us = 0;
+static int64_t wake_request_us = 0;
+static int64_t resume_us = 0;
+static service_timer_t wake_timer = NULL;
+
+static void signal_remote_wakeup(void){
+    const output_sink_t* sink = get_output_sink();
+    if (host_suspended && (sink->remote_wakeup == NULL || !sink->remote_wakeup()))
+        ESP_LOGW(TAG, "Remote wakeup refused");
+}
+
+static void wake_timer_cb(void* arg){
+    signal_remote_wakeup();
+}
+
+void usb_host_suspended(bool remote_wakeup_allowed){
+    suspend_us = esp_timer_get_time();
+    wakeup_allowed = remote_wakeup_allowed;
+    wakeup_requested = false;
+    host_suspended = true;
+    ESP_LOGI(TAG, "Host suspended (remote wakeup %s)", remote_wakeup_allowed ? "allowed" : "disabled");
+}
+
+void usb_host_resumed(void){
+    resume_us = esp_timer_get_time();
+    host_suspended = false;
+    service_timer_cancel(wake_timer);
+    if (wakeup_requested)
+        ESP_LOGI(TAG, "Host resumed %" PRId64 " US after remote wakeup", resume_us - wake_request_us);
+    else
+        ESP_LOGI(TAG, "Host resumed");
+    devices_host_resumed();
+}
+
+bool HOT_PATH_ATTR is_host_suspended(void){
+    return host_suspended;
+}
+
+void request_remote_wakeup(void){
+    if (!host_suspended || !wakeup_allowed || wakeup_requested)
+        return;
+    wakeup_requested = true;
+    wake_request_us = esp_timer_get_time();
+    int64_t wait_us = suspend_us + MIN_SUSPEND_BEFORE_WAKE_US - wake_request_us;
+    if (wait_us > 0)
+        service_timer_start_once(wake_timer, wait_us);
+    else
+        signal_remote_wakeup();
+}
+
+void wake_report_sent(void){
+    if (!wakeup_requested || host_suspended)
+        return;
+    wakeup_requested = false;
+    ESP_LOGI(TAG, "Wake to first keystroke: %" PRId64 " US (resume %" PRId64 " US)",
+             esp_timer_get_time() - wake_request_us, resume_us - wake_request_us);
+}
+
+esp_err_t init_suspend(void){
+    return service_timer_create(&wake_timer, "remote_wakeup", wake_timer_cb, NULL);
+}
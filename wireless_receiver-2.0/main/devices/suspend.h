@@ -0,0 +1,17 @@
+#pragma once
+#include <stdbool.h>
+#include "esp_err.h"
+
+// TinyUSB suspend / resume callbacks
+void usb_host_suspended(bool remote_wakeup_allowed);
+void usb_host_resumed(void);
+
+bool is_host_suspended(void);
+
+// A key or button was pressed while the host sleeps -- wake it if it allows
+void request_remote_wakeup(void);
+
+// First report delivered after a remote wakeup; logs the wake-to-input latency
+void wake_report_sent(void);
+
+esp_err_t init_suspend(void);
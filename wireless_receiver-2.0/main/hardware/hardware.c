@@ -3,9 +3,13 @@
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "tusb.h"
+#include "rtos/ram_budget.h"
+#include "device_config.h"
 
 static const char* TAG = "USB_RECEIVER // hardware.c";
 
+STATIC_TASK(tud_task_mem, "tud_task", TUD_TASK_STACK, TUD_TASK_PRIORITY);
+
 usb_phy_handle_t phy_hdl;
 
 void init_phy(void){
@@ -21,14 +25,6 @@ void init_phy(void){
     ESP_ERROR_CHECK(usb_new_phy(&phy_config, &phy_hdl));
 }
 
-void wait_for_mount(void){
-    ESP_LOGI(TAG, "Waiting for USB to mount...");
-    while (!tud_mounted()) {
-        vTaskDelay(pdMS_TO_TICKS(100));
-    }
-    ESP_LOGI(TAG, "USB mounted! Device is ready.");
-}
-
 // Task to process and deliver USB events to host
 // tud_task() wrapper to control polling rate
 static void usb_tud_task(void* arg){
@@ -41,7 +37,7 @@ static void usb_tud_task(void* arg){
 
 esp_err_t begin_usb_tud(void){
     if (tusb_init()) {
-        if(xTaskCreate(usb_tud_task, "tud_task", 4096, NULL, 4, NULL) == pdPASS)
+        if (create_static_task(&tud_task_mem, usb_tud_task, NULL) != NULL)
             return ESP_OK;
     }
     return ESP_FAIL;
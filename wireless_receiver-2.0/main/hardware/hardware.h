@@ -1,5 +1,4 @@
 #include "esp_err.h"
 
 void init_phy(void);
-esp_err_t begin_usb_tud(void);
-void wait_for_mount(void);
\ No newline at end of file
+esp_err_t begin_usb_tud(void);
\ No newline at end of file
@@ -2,48 +2,133 @@
 #include "freertos/task.h"
 #include "wifi/msg_types.h"
 #include "wifi/wifi.h"
+#include "wifi/link_security.h"
+#include "wifi/pairing.h"
+#include "wifi/perf_profile.h"
+#include "wifi/link_power.h"
 #include "devices.h"
+#include "output.h"
+#include "passthrough.h"
+#include "suspend.h"
+#include "ota_source.h"
 #include "esp_log.h"
-#include "hardware.h"
+#include "output_sink.h"
+#include "device_config.h"
+#include "rtos/ram_budget.h"
+#include "rtos/hot_path.h"
+#include "log/deferred_log.h"
 
 static const char* TAG = "USB_RECEIVER // main.c";
 
+static inline bool is_input_message(uint8_t msg_type){
+    return msg_type <= ESPNOW_MSG_GAMEPAD || msg_type == ESPNOW_MSG_RAW_REPORT || msg_type == ESPNOW_MSG_MOUSE_POSITION;
+}
+
 // message callback to be invoked when data is received -- referenced in wifi.c
 // Routes messages to their repective queues
-void process_message_cb(const espnow_message_t* esp_msg){
+void HOT_PATH_ATTR process_message_cb(const espnow_message_t* esp_msg){
+#if CONFIG_WIRELESS_POWER_MANAGEMENT
+    if (is_input_message(esp_msg->msg_type))
+        link_power_note_input();
+#endif
+#if OTA_UPDATE
+    if (is_input_message(esp_msg->msg_type))
+        ota_source_note_input();
+#endif
     switch (esp_msg->msg_type) {
         case ESPNOW_MSG_MOUSE:
             enqueue_mouse_event(esp_msg->mouse_msg);
             break;
+        case ESPNOW_MSG_MOUSE_POSITION:
+            enqueue_mouse_position_event(esp_msg->mouse_position_msg);
+            break;
         case ESPNOW_MSG_KEYBOARD:
             enqueue_keyboard_event(esp_msg->keyboard_msg);
             break;
         case ESPNOW_MSG_GAMEPAD:
-            // enqueue_gamepad_event(esp_msg->gamepad_msg);
+            enqueue_gamepad_event(esp_msg->gamepad_msg);
+            break;
+        case ESPNOW_MSG_RAW_REPORT:
+            enqueue_passthrough_report(&esp_msg->raw_report_msg);
+            break;
+        case ESPNOW_MSG_DESC_INFO:
+        case ESPNOW_MSG_DESC_CHUNK:
+            process_passthrough_message(esp_msg);
+            break;
+        case ESPNOW_MSG_OUTPUT_ACK:
+            output_report_acked(&esp_msg->output_ack_msg);
+            break;
+        case ESPNOW_MSG_PROFILE:
+            set_perf_profile(esp_msg->profile_msg.profile);
             break;
+#if OTA_UPDATE
+        case ESPNOW_MSG_OTA_ACK:
+            ota_source_ack(&esp_msg->ota_ack_msg);
+            break;
+#endif
         case ESPNOW_MSG_START_RTT:
-            static const espnow_msg_blank_t packet = { .msg_type = ESPNOW_MSG_END_RTT };
+            static const HOT_PATH_DATA espnow_msg_blank_t packet = { .msg_type = ESPNOW_MSG_END_RTT };
             send_message((uint8_t*)&packet, sizeof(packet));
             break;
         default:
-            ESP_LOGI(TAG, "Unknown Format: %d", esp_msg->msg_type);
+            DLOGI(TAG, "Unknown Format: %d", esp_msg->msg_type);
     }
 }
 
+// Called from the profile task once the link settings are switched
+void perf_profile_applied_cb(const perf_profile_t* profile){
+    mouse_set_jitter_buffer(profile->jitter_buffer);
+}
+
 void connection_status_cb(bool connection_status){
     ESP_LOGI(TAG, "Connection: %s", connection_status ? "CONNECTED" : "DISCONNECTED");
+    if (!connection_status)
+        mouse_resync_position();
 }
+// Listen for a transmitter whenever there is no peer
 void paired_status_updated_cb(bool paired_status){
     ESP_LOGI(TAG, "Paired: %s", paired_status ? "YES" : "NO");
+    if (!paired_status)
+        begin_pairing();
+}
+void send_status_cb(uint32_t token, bool success){
+    (void)token;
+    (void)success;
+}
+// Lets SYN / SYNACK / ACK frames carry unacknowledged LED and rumble reports
+bool handshake_piggyback_cb(espnow_msg_output_t* output){
+    return take_pending_output(output);
+}
+
+// How the transmitter's frames arrive, for its TX power control
+void send_link_report_cb(const espnow_msg_link_report_t* report){
+    send_message((const uint8_t*)report, sizeof(*report));
 }
 
 void app_main(void){
-    start_espnow();
-    unpair(); // strictly for testing
-    begin_pairing_task();
+    ESP_ERROR_CHECK(init_pairing(PAIRING_RESPONDER));
+    start_link();
+#if CONFIG_WIRELESS_POWER_MANAGEMENT
+    ESP_ERROR_CHECK(init_link_power(POWER_IDLE_RELEASE_US));
+#endif
+    ESP_ERROR_CHECK(begin_deferred_log());
     init_device_queues();
+    ESP_ERROR_CHECK(init_output_reports());
+    ESP_ERROR_CHECK(init_passthrough());
+    ESP_ERROR_CHECK(init_suspend());
+#if OTA_UPDATE
+    ESP_ERROR_CHECK(begin_ota_source());
+#endif
+#if BENCHMARK
+    benchmark_mouse_coalescing();
+    benchmark_hot_path_latency();
+    benchmark_link_security();
+#endif
     begin_device_tasks();
-    init_phy();
-    ESP_ERROR_CHECK(begin_usb_tud());
+    ESP_ERROR_CHECK(init_perf_profile());
+    ESP_ERROR_CHECK(get_output_sink()->start());
+#if RAM_BUDGET_REPORT
+    ESP_ERROR_CHECK(begin_ram_budget_report(RAM_BUDGET_REPORT_INTERVAL_US));
+#endif
     wait_for_mount();
 }
\ No newline at end of file
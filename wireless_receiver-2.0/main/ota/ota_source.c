@@ -0,0 +1,312 @@
+#include "ota_source.h"
+#include "device_config.h"
+#include "wifi/wifi.h"
+#include "rtos/ram_budget.h"
+#include "rtos/hot_path.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+#define OTA_RING_CHUNKS 80                  // 16000 bytes of image between host and radio
+#define OTA_RING_LEN (OTA_RING_CHUNKS * ESPNOW_OTA_CHUNK_LEN)
+#define OTA_BURST 8                         // chunks per wake while no input arrives
+#define OTA_BUSY_BURST 1                    // ... and while it does
+#define OTA_INPUT_HOLDOFF_US (20000LL)
+#define OTA_POLL_MS 10
+#define OTA_RTO_US (200000LL)               // resend a chunk nothing was heard of
+#define OTA_GAP_RESEND_US (20000LL)         // resend a chunk acks skip over, at most this often
+#define OTA_BEGIN_RETRY_US (500000LL)
+#define OTA_STALL_US (10000000LL)           // give up on a transmitter this long silent
+#define OTA_LOG_INTERVAL_US (2000000LL)
+
+static const char* TAG = "USB_RECEIVER // ota_source.c";
+
+// Shared between the TinyUSB task (host), the WiFi task (acks) and the update task
+static struct {
+    ota_source_state_t state;
+    bool fresh;                 // a new image was announced, the task resets its side
+    uint32_t size;
+    uint8_t sha256[ESPNOW_OTA_HASH_LEN];
+    uint32_t accepted;          // bytes from the host
+    uint32_t written;           // chunks in the transmitter's flash
+    uint32_t held;              // ack bitmap after written
+    int64_t last_ack_us;
+} update = { .state = OTA_SOURCE_IDLE };
+static portMUX_TYPE ota_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Image bytes [written * ESPNOW_OTA_CHUNK_LEN, accepted), at their offset modulo OTA_RING_LEN
+static uint8_t ring[OTA_RING_LEN];
+
+// Only touched by the update task
+static uint32_t next_chunk = 0;             // first chunk never sent
+static int64_t sent_us[ESPNOW_OTA_WINDOW];  // last send of each chunk in the window
+static uint32_t retransmits = 0;
+static int64_t start_us = 0;
+static volatile uint16_t kb_per_s = 0;
+
+static volatile int64_t HOT_PATH_DATA last_input_us = 0;
+
+STATIC_TASK(ota_task_mem, "ota_source", OTA_TASK_STACK, OTA_TASK_PRIORITY);
+static TaskHandle_t ota_task_handle = NULL;
+
+static inline uint32_t total_chunks(uint32_t size){
+    return (size + ESPNOW_OTA_CHUNK_LEN - 1) / ESPNOW_OTA_CHUNK_LEN;
+}
+
+static inline uint32_t chunk_len(uint32_t size, uint32_t index){
+    uint32_t offset = index * ESPNOW_OTA_CHUNK_LEN;
+    return (size - offset < ESPNOW_OTA_CHUNK_LEN) ? size - offset : ESPNOW_OTA_CHUNK_LEN;
+}
+
+static uint16_t throughput(uint32_t written, uint32_t size, int64_t now_us){
+    uint64_t bytes = (uint64_t)written * ESPNOW_OTA_CHUNK_LEN;
+    if (bytes > size)
+        bytes = size;
+    int64_t elapsed_us = now_us - start_us;
+    return elapsed_us > 0 ? (uint16_t)((bytes * 1000000ULL) / (1024ULL * elapsed_us)) : 0;
+}
+
+static void fail_update(const char* reason){
+    portENTER_CRITICAL(&ota_lock);
+    update.state = OTA_SOURCE_FAILED;
+    portEXIT_CRITICAL(&ota_lock);
+    ESP_LOGE(TAG, "Update failed: %s", reason);
+}
+
+static esp_err_t send_chunk(uint32_t index, uint32_t size, int64_t now_us){
+    espnow_msg_ota_chunk_t chunk = { .msg_type = ESPNOW_MSG_OTA_CHUNK, .index = index };
+    chunk.len = chunk_len(size, index);
+    // Chunks never wrap: the ring holds a whole number of them
+    memcpy(chunk.data, ring + (index * ESPNOW_OTA_CHUNK_LEN) % OTA_RING_LEN, chunk.len);
+    esp_err_t err = send_message((const uint8_t*)&chunk, offsetof(espnow_msg_ota_chunk_t, data) + chunk.len);
+    if (err == ESP_OK)
+        sent_us[index % ESPNOW_OTA_WINDOW] = now_us;
+    return err;
+}
+
+// Resends what the acks show lost, then fills the window with new chunks
+static void send_chunks(int64_t now_us, int budget){
+    portENTER_CRITICAL(&ota_lock);
+    uint32_t size = update.size;
+    uint32_t accepted = update.accepted;
+    uint32_t written = update.written;
+    uint32_t held = update.held;
+    portEXIT_CRITICAL(&ota_lock);
+
+    if (next_chunk < written)
+        next_chunk = written;
+    // Chunks after the newest one held are not known lost yet
+    uint32_t newest = written + (held ? 32 - __builtin_clz(held) : 0);
+    for (uint32_t index = written; index < next_chunk && budget > 0; index++){
+        if (held & (1u << (index - written)))
+            continue;
+        int64_t since_us = now_us - sent_us[index % ESPNOW_OTA_WINDOW];
+        if (since_us < (index < newest ? OTA_GAP_RESEND_US : OTA_RTO_US))
+            continue;
+        if (send_chunk(index, size, now_us) != ESP_OK)
+            return;
+        retransmits++;
+        budget--;
+    }
+    uint32_t total = total_chunks(size);
+    while (budget > 0 && next_chunk < written + ESPNOW_OTA_WINDOW && next_chunk < total &&
+           next_chunk * ESPNOW_OTA_CHUNK_LEN + chunk_len(size, next_chunk) <= accepted){
+        if (send_chunk(next_chunk, size, now_us) != ESP_OK)
+            return;
+        next_chunk++;
+        budget--;
+    }
+}
+
+static void send_begin(void){
+    espnow_msg_ota_begin_t begin = { .msg_type = ESPNOW_MSG_OTA_BEGIN };
+    portENTER_CRITICAL(&ota_lock);
+    begin.size = update.size;
+    memcpy(begin.sha256, update.sha256, sizeof(begin.sha256));
+    portEXIT_CRITICAL(&ota_lock);
+    send_message((const uint8_t*)&begin, sizeof(begin));
+}
+
+static void ota_task(void* arg){
+    ota_source_state_t reported = OTA_SOURCE_IDLE;
+    int64_t begin_sent_us = 0;
+    int64_t last_log_us = 0;
+    while (true){
+        bool busy = esp_timer_get_time() - last_input_us < OTA_INPUT_HOLDOFF_US;
+        ulTaskNotifyTake(pdTRUE, busy ? 1 : pdMS_TO_TICKS(OTA_POLL_MS));
+        int64_t now_us = esp_timer_get_time();
+
+        portENTER_CRITICAL(&ota_lock);
+        bool fresh = update.fresh;
+        update.fresh = false;
+        ota_source_state_t state = update.state;
+        uint32_t size = update.size;
+        uint32_t written = update.written;
+        int64_t last_ack_us = update.last_ack_us;
+        portEXIT_CRITICAL(&ota_lock);
+
+        if (fresh){
+            next_chunk = 0;
+            retransmits = 0;
+            kb_per_s = 0;
+            begin_sent_us = 0;
+            start_us = now_us;
+            memset(sent_us, 0, sizeof(sent_us));
+        }
+        switch (state){
+            case OTA_SOURCE_STARTING:
+                if (now_us - begin_sent_us >= OTA_BEGIN_RETRY_US){
+                    send_begin();
+                    begin_sent_us = now_us;
+                }
+                if (now_us - start_us > OTA_STALL_US)
+                    fail_update("transmitter did not answer");
+                break;
+            case OTA_SOURCE_SENDING:
+                send_chunks(now_us, busy ? OTA_BUSY_BURST : OTA_BURST);
+                kb_per_s = throughput(written, size, now_us);
+                if (now_us - last_ack_us > OTA_STALL_US)
+                    fail_update("transmitter stopped answering");
+                else if (now_us - last_log_us >= OTA_LOG_INTERVAL_US){
+                    ESP_LOGI(TAG, "%" PRIu32 " / %" PRIu32 " bytes, %u KB/s, %" PRIu32 " resent",
+                             written * ESPNOW_OTA_CHUNK_LEN, size, kb_per_s, retransmits);
+                    last_log_us = now_us;
+                }
+                break;
+            case OTA_SOURCE_DONE:
+                if (reported != OTA_SOURCE_DONE){
+                    kb_per_s = throughput(written, size, now_us);
+                    ESP_LOGI(TAG, "Transmitter verified %" PRIu32 " bytes in %" PRId64 " ms: %u KB/s, %" PRIu32 " chunks resent",
+                             size, (now_us - start_us) / 1000, kb_per_s, retransmits);
+                }
+                break;
+            default:
+                break;
+        }
+        reported = state;
+    }
+}
+
+void ota_source_host_write(const uint8_t* report, uint16_t len){
+    if (len < 1)
+        return;
+    switch (report[0]){
+        case OTA_HOST_BEGIN: {
+            const ota_host_begin_t* begin = (const ota_host_begin_t*)report;
+            if (len < sizeof(*begin) || begin->size == 0)
+                return;
+            portENTER_CRITICAL(&ota_lock);
+            update.state = OTA_SOURCE_STARTING;
+            update.fresh = true;
+            update.size = begin->size;
+            memcpy(update.sha256, begin->sha256, sizeof(update.sha256));
+            update.accepted = 0;
+            update.written = 0;
+            update.held = 0;
+            portEXIT_CRITICAL(&ota_lock);
+            ESP_LOGI(TAG, "Updating the transmitter with a %" PRIu32 " byte image", begin->size);
+            break;
+        }
+        case OTA_HOST_DATA: {
+            const ota_host_data_t* data = (const ota_host_data_t*)report;
+            if (len < offsetof(ota_host_data_t, data) || data->len > len - offsetof(ota_host_data_t, data))
+                return;
+            portENTER_CRITICAL(&ota_lock);
+            uint32_t space = OTA_RING_LEN - (update.accepted - update.written * ESPNOW_OTA_CHUNK_LEN);
+            bool wanted = (update.state == OTA_SOURCE_STARTING || update.state == OTA_SOURCE_SENDING) &&
+                          data->offset == update.accepted && data->len <= space &&
+                          data->len <= update.size - update.accepted;
+            portEXIT_CRITICAL(&ota_lock);
+            if (!wanted)
+                return;
+            // Bytes past accepted are not read by the update task, so the copy needs no lock
+            uint32_t at = data->offset % OTA_RING_LEN;
+            uint32_t first = (data->len < OTA_RING_LEN - at) ? data->len : OTA_RING_LEN - at;
+            memcpy(ring + at, data->data, first);
+            memcpy(ring, data->data + first, data->len - first);
+            portENTER_CRITICAL(&ota_lock);
+            update.accepted += data->len;
+            portEXIT_CRITICAL(&ota_lock);
+            break;
+        }
+        case OTA_HOST_ABORT:
+            portENTER_CRITICAL(&ota_lock);
+            update.state = OTA_SOURCE_IDLE;
+            portEXIT_CRITICAL(&ota_lock);
+            ESP_LOGW(TAG, "Update aborted by the host");
+            break;
+        default:
+            return;
+    }
+    xTaskNotifyGive(ota_task_handle);
+}
+
+uint16_t ota_source_host_status(uint8_t* report, uint16_t len){
+    ota_host_status_t status;
+    portENTER_CRITICAL(&ota_lock);
+    status.state = update.state;
+    status.accepted = update.accepted;
+    status.space = OTA_RING_LEN - (update.accepted - update.written * ESPNOW_OTA_CHUNK_LEN);
+    status.written = update.written * ESPNOW_OTA_CHUNK_LEN;
+    if (status.written > update.size)
+        status.written = update.size;
+    portEXIT_CRITICAL(&ota_lock);
+    status.retransmits = retransmits;
+    status.kb_per_s = kb_per_s;
+
+    if (len > OTA_HOST_REPORT_LEN)
+        len = OTA_HOST_REPORT_LEN;
+    memset(report, 0, len);
+    memcpy(report, &status, (len < sizeof(status)) ? len : sizeof(status));
+    return len;
+}
+
+void ota_source_ack(const espnow_msg_ota_ack_t* ack){
+    int64_t now_us = esp_timer_get_time();
+    bool rejected = false;
+    portENTER_CRITICAL(&ota_lock);
+    uint32_t total = total_chunks(update.size);
+    switch (update.state){
+        case OTA_SOURCE_STARTING:
+            if (ack->state == OTA_STATE_RECEIVING && ack->written == 0)
+                update.state = OTA_SOURCE_SENDING;
+            // The same image was verified before, its DONE ack lost
+            else if (ack->state == OTA_STATE_DONE && ack->written == total)
+                update.state = OTA_SOURCE_DONE;
+            update.last_ack_us = now_us;
+            break;
+        case OTA_SOURCE_SENDING:
+            if (ack->state == OTA_STATE_FAILED){
+                update.state = OTA_SOURCE_FAILED;
+                rejected = true;
+            }
+            // Acks overtaken by a newer one are dropped
+            else if (ack->written >= update.written && ack->written <= total){
+                update.written = ack->written;
+                update.held = ack->received;
+                update.last_ack_us = now_us;
+                if (ack->state == OTA_STATE_DONE)
+                    update.state = OTA_SOURCE_DONE;
+            }
+            break;
+        default:
+            break;
+    }
+    portEXIT_CRITICAL(&ota_lock);
+    if (rejected)
+        ESP_LOGE(TAG, "Transmitter rejected the image");
+    xTaskNotifyGive(ota_task_handle);
+}
+
+void HOT_PATH_ATTR ota_source_note_input(void){
+    last_input_us = esp_timer_get_time();
+}
+
+esp_err_t begin_ota_source(void){
+    ota_task_handle = create_static_task(&ota_task_mem, ota_task, NULL);
+    return ota_task_handle ? ESP_OK : ESP_FAIL;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "wifi/msg_types.h"
+
+// Firmware update of the paired transmitter (OTA_UPDATE). The host writes the image
+// through a vendor feature report on the gamepad interface (ota/ota_upload.py), into a
+// ring the update is streamed from:
+//  - ESPNOW_MSG_OTA_BEGIN announces size and SHA-256 until the transmitter acks it
+//  - chunks go out pipelined, up to ESPNOW_OTA_WINDOW past the last one in its flash
+//  - each ESPNOW_MSG_OTA_ACK shows which chunks after that arrived; the gaps below the
+//    newest one are resent at once, anything unanswered after OTA_RTO_US again
+// Input keeps priority: the task runs below the input tasks, and while input arrives it
+// sends one chunk per tick instead of a burst.
+
+#pragma pack(push, 1)
+
+#define OTA_HOST_REPORT_LEN 63      // CFG_TUD_HID_EP_BUFSIZE less the report ID
+#define OTA_HOST_DATA_MAX (OTA_HOST_REPORT_LEN - 6)
+
+typedef enum {
+    OTA_HOST_BEGIN,
+    OTA_HOST_DATA,
+    OTA_HOST_ABORT
+} ota_host_cmd_t;
+
+typedef enum {
+    OTA_SOURCE_IDLE,
+    OTA_SOURCE_STARTING,    // waiting for the transmitter to open its partition
+    OTA_SOURCE_SENDING,
+    OTA_SOURCE_DONE,        // verified by the transmitter, which reboots into it
+    OTA_SOURCE_FAILED
+} ota_source_state_t;
+
+// SET_REPORT from the host
+typedef struct {
+    uint8_t cmd;            // OTA_HOST_BEGIN
+    uint32_t size;
+    uint8_t sha256[ESPNOW_OTA_HASH_LEN];
+} ota_host_begin_t;
+
+typedef struct {
+    uint8_t cmd;            // OTA_HOST_DATA
+    uint32_t offset;        // must be status.accepted, anything else is ignored
+    uint8_t len;
+    uint8_t data[OTA_HOST_DATA_MAX];
+} ota_host_data_t;
+
+// GET_REPORT to the host
+typedef struct {
+    uint8_t state;          // ota_source_state_t
+    uint32_t accepted;      // image bytes taken from the host
+    uint32_t space;         // bytes the ring can take now
+    uint32_t written;       // image bytes in the transmitter's flash
+    uint32_t retransmits;
+    uint16_t kb_per_s;      // throughput to the transmitter's flash
+} ota_host_status_t;
+
+#pragma pack(pop)
+
+// Host requests, from the TinyUSB task
+void ota_source_host_write(const uint8_t* report, uint16_t len);
+uint16_t ota_source_host_status(uint8_t* report, uint16_t len);
+
+// ESPNOW_MSG_OTA_ACK from the transmitter
+void ota_source_ack(const espnow_msg_ota_ack_t* ack);
+
+// An input report arrived; the update backs off while they keep coming
+void ota_source_note_input(void);
+
+esp_err_t begin_ota_source(void);
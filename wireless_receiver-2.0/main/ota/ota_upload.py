@@ -0,0 +1,86 @@
+"""Update the paired transmitter's firmware through the receiver's USB port.
+
+Usage: python ota_upload.py wireless_transmitter-2.0.bin
+
+Needs the hidapi package (pip install hidapi). The image is the transmitter's
+build/wireless_transmitter-2.0.bin; the receiver streams it over the link and
+the transmitter checks its SHA-256 before booting it (see ota_source.h).
+"""
+import hashlib
+import struct
+import sys
+import time
+
+import hid
+
+VID, PID = 0x303A, 0x4010
+REPORT_ID = 4                   # HID_OTA_REPORT_ID
+REPORT_LEN = 63                 # OTA_HOST_REPORT_LEN
+DATA_MAX = REPORT_LEN - 6       # OTA_HOST_DATA_MAX
+GAMEPAD_INTERFACE = 2
+VENDOR_USAGE_PAGE = 0xFF00
+
+HOST_BEGIN, HOST_DATA, HOST_ABORT = range(3)
+IDLE, STARTING, SENDING, DONE, FAILED = range(5)
+STATUS = struct.Struct("<BIIIIH")   # ota_host_status_t
+
+
+def open_receiver():
+    for info in hid.enumerate(VID, PID):
+        # Windows lists the vendor collection on its own, hidraw the whole interface
+        if info["usage_page"] == VENDOR_USAGE_PAGE or (
+                info["usage_page"] == 0 and info["interface_number"] == GAMEPAD_INTERFACE):
+            device = hid.device()
+            device.open_path(info["path"])
+            return device
+    sys.exit("Receiver not found (built with OTA_UPDATE?)")
+
+
+def send(device, payload):
+    device.send_feature_report(bytes([REPORT_ID]) + payload.ljust(REPORT_LEN, b"\0"))
+
+
+def status(device):
+    report = bytes(device.get_feature_report(REPORT_ID, REPORT_LEN + 1))
+    return STATUS.unpack_from(report, 1)
+
+
+def upload(device, image):
+    send(device, struct.pack("<BI", HOST_BEGIN, len(image)) + hashlib.sha256(image).digest())
+    accepted = 0
+    while True:
+        state, accepted, space, written, resent, kb_per_s = status(device)
+        if state == DONE:
+            print(f"\nDone: {len(image)} bytes, {kb_per_s} KB/s, {resent} chunks resent")
+            return
+        if state in (IDLE, FAILED):
+            sys.exit("\nUpdate failed, see the receiver's log")
+        print(f"\r{written}/{len(image)} bytes, {kb_per_s} KB/s, {resent} resent", end="", flush=True)
+        if accepted == len(image) or space < DATA_MAX:
+            time.sleep(0.01)
+            continue
+        # Fill the ring; the receiver ignores anything not at the offset it expects
+        while space >= DATA_MAX and accepted < len(image):
+            data = image[accepted:accepted + DATA_MAX]
+            send(device, struct.pack("<BIB", HOST_DATA, accepted, len(data)) + data)
+            accepted += len(data)
+            space -= len(data)
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    with open(sys.argv[1], "rb") as image_file:
+        image = image_file.read()
+    device = open_receiver()
+    try:
+        upload(device, image)
+    except KeyboardInterrupt:
+        send(device, bytes([HOST_ABORT]))
+        sys.exit("\nAborted")
+    finally:
+        device.close()
+
+
+if __name__ == "__main__":
+    main()
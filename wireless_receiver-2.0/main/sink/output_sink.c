@@ -0,0 +1,57 @@
+#include "output_sink.h"
+#include "devices.h"
+#include "device_config.h"
+#include "timer/timer_service.h"
+#include "rtos/hot_path.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char* TAG = "USB_RECEIVER // output_sink.c";
+
+static int64_t HOT_PATH_DATA last_poll_us[SINK_NUM_DEVICES] = {0};
+static service_timer_t HOT_PATH_DATA poll_timers[SINK_NUM_DEVICES] = {0};
+
+const output_sink_t* HOT_PATH_ATTR get_output_sink(void){
+#if OUTPUT_SINK == OUTPUT_SINK_UINPUT
+    return &uinput_sink;
+#elif OUTPUT_SINK == OUTPUT_SINK_RECORD
+    return &record_sink;
+#else
+    return &tusb_sink;
+#endif
+}
+
+void wait_for_mount(void){
+    const output_sink_t* sink = get_output_sink();
+    ESP_LOGI(TAG, "Waiting for %s to mount...", sink->name);
+    while (!sink->mounted()) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    ESP_LOGI(TAG, "%s mounted! Device is ready.", sink->name);
+}
+
+// The simulated host polled again: the device's task may send
+static void HOT_PATH_ATTR poll_timer_cb(void* arg){
+    notify_nst_task((uint8_t)(uintptr_t)arg);
+}
+
+esp_err_t sink_poll_init(void){
+    for (uint8_t i = 0; i < SINK_NUM_DEVICES; i++){
+        if (service_timer_create(&poll_timers[i], "sink_poll", poll_timer_cb, (void*)(uintptr_t)i) != ESP_OK)
+            return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+bool HOT_PATH_ATTR sink_poll_ready(uint8_t instance){
+    return instance < SINK_NUM_DEVICES && esp_timer_get_time() - last_poll_us[instance] >= OUTPUT_SINK_POLL_US;
+}
+
+void HOT_PATH_ATTR sink_poll_sent(uint8_t instance){
+    if (instance >= SINK_NUM_DEVICES)
+        return;
+    last_poll_us[instance] = esp_timer_get_time();
+    service_timer_start_once(poll_timers[instance], OUTPUT_SINK_POLL_US);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "esp_err.h"
+#include "wifi/msg_types.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Where the receiver's reports go (OUTPUT_SINK in device_config.h). The device tasks --
+// queues, coalescing, jitter buffer, suspend handling -- only talk to a sink:
+//  - TinyUSB: the USB HID device the receiver normally is
+//  - uinput: a virtual mouse and keyboard on a linux workstation (linux target); with
+//    the UDP transport the receiver runs as a program and evdev timestamps every event
+//  - record: no host at all; takes reports at a simulated host poll rate and logs their
+//    timing and motion, for comparing coalescing and scheduling policies
+// Devices are the HID instances in tusb_device_common.h. A sink calls notify_nst_task()
+// when a device can take its next report, as USB report completion does.
+
+#define OUTPUT_SINK_TUSB 0
+#define OUTPUT_SINK_UINPUT 1
+#define OUTPUT_SINK_RECORD 2
+
+#define SINK_NUM_DEVICES 4      // HID_PASSTHROUGH_INSTANCE + 1
+
+typedef struct {
+    const char* name;
+    esp_err_t (*start)(void);
+    // A host is there to take reports
+    bool (*mounted)(void);
+    // The device's last report was taken, a new one would be sent now
+    bool (*ready)(uint8_t instance);
+    bool (*mouse_report)(const espnow_msg_mouse_t* msg);
+    bool (*keyboard_report)(const espnow_msg_keyboard_t* msg);
+    // Optional (NULL): sinks without a gamepad drop its reports
+    bool (*gamepad_report)(const espnow_msg_gamepad_t* msg);
+    // Optional (NULL): the passthrough device, described by its report descriptor (NULL
+    // removes it); may be called before start
+    void (*set_raw_descriptor)(const uint8_t* desc, uint16_t len);
+    // Report ID, if the device uses them, is the first byte
+    bool (*raw_report)(const uint8_t* data, uint8_t len);
+    // Optional (NULL): ask a suspended host to resume
+    bool (*remote_wakeup)(void);
+} output_sink_t;
+
+extern const output_sink_t tusb_sink;
+extern const output_sink_t uinput_sink;
+extern const output_sink_t record_sink;
+
+// Everything the recording sink took since it started, for comparing whole runs
+typedef struct {
+    uint32_t reports[SINK_NUM_DEVICES];
+    int64_t x, y, wheel, pan;
+    uint8_t buttons;
+} record_sink_totals_t;
+
+void get_record_sink_totals(record_sink_totals_t* totals);
+
+// The sink selected by OUTPUT_SINK
+const output_sink_t* get_output_sink(void);
+
+// Block until the sink's host has taken the device (USB enumeration)
+void wait_for_mount(void);
+
+// Host polling for sinks that have none: each device takes one report per
+// OUTPUT_SINK_POLL_US, and its task is notified when the next poll is due
+esp_err_t sink_poll_init(void);
+bool sink_poll_ready(uint8_t instance);
+void sink_poll_sent(uint8_t instance);
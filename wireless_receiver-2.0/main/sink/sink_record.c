@@ -0,0 +1,155 @@
+#include "output_sink.h"
+#include "device_config.h"
+#include "tusb_device_common.h"
+#include "timer/timer_service.h"
+#include "rtos/hot_path.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <inttypes.h>
+
+static const char* TAG = "USB_RECEIVER // sink_record.c";
+
+typedef struct {
+    uint32_t reports;
+    uint32_t min_interval_us;
+    uint32_t max_interval_us;
+    uint64_t total_interval_us;
+    uint32_t intervals;
+    int64_t last_us;
+} device_record_t;
+
+// Motion as the host would have seen it; a saturated axis is motion clamped away by coalescing
+typedef struct {
+    int64_t x, y, wheel, pan;
+    uint32_t saturated;
+    uint32_t button_changes;
+    uint8_t buttons;
+} motion_record_t;
+
+static device_record_t records[SINK_NUM_DEVICES];
+static motion_record_t motion;
+static record_sink_totals_t totals;
+static portMUX_TYPE record_lock = portMUX_INITIALIZER_UNLOCKED;
+static service_timer_t report_timer = NULL;
+
+static const char* device_names[SINK_NUM_DEVICES] = { "mouse", "keyboard", "gamepad", "passthrough" };
+
+static inline bool saturated(int8_t value){
+    return value == 127 || value == -128;
+}
+
+static void HOT_PATH_ATTR record_report(uint8_t instance){
+    int64_t now_us = esp_timer_get_time();
+    device_record_t* device = &records[instance];
+    portENTER_CRITICAL(&record_lock);
+    totals.reports[instance]++;
+    device->reports++;
+    if (device->last_us){
+        uint32_t interval_us = (uint32_t)(now_us - device->last_us);
+        if (device->intervals == 0 || interval_us < device->min_interval_us)
+            device->min_interval_us = interval_us;
+        if (interval_us > device->max_interval_us)
+            device->max_interval_us = interval_us;
+        device->total_interval_us += interval_us;
+        device->intervals++;
+    }
+    device->last_us = now_us;
+    portEXIT_CRITICAL(&record_lock);
+    sink_poll_sent(instance);
+}
+
+static void report_timer_cb(void* arg){
+    device_record_t taken[SINK_NUM_DEVICES];
+    motion_record_t taken_motion;
+    portENTER_CRITICAL(&record_lock);
+    for (int i = 0; i < SINK_NUM_DEVICES; i++){
+        taken[i] = records[i];
+        records[i] = (device_record_t){ .last_us = records[i].last_us };
+    }
+    taken_motion = motion;
+    motion = (motion_record_t){ .buttons = motion.buttons };
+    portEXIT_CRITICAL(&record_lock);
+
+    for (int i = 0; i < SINK_NUM_DEVICES; i++){
+        const device_record_t* device = &taken[i];
+        if (device->reports == 0)
+            continue;
+        ESP_LOGI(TAG, "%s: %" PRIu32 " reports, interval min %" PRIu32 " avg %" PRIu32 " max %" PRIu32 " US",
+                 device_names[i], device->reports, device->min_interval_us,
+                 device->intervals ? (uint32_t)(device->total_interval_us / device->intervals) : 0,
+                 device->max_interval_us);
+    }
+    if (taken[HID_MOUSE_INSTANCE].reports)
+        ESP_LOGI(TAG, "mouse motion x %" PRId64 " y %" PRId64 " wheel %" PRId64 " pan %" PRId64 ", %" PRIu32 " saturated reports, %" PRIu32 " button changes",
+                 taken_motion.x, taken_motion.y, taken_motion.wheel, taken_motion.pan,
+                 taken_motion.saturated, taken_motion.button_changes);
+}
+
+void get_record_sink_totals(record_sink_totals_t* taken){
+    portENTER_CRITICAL(&record_lock);
+    *taken = totals;
+    portEXIT_CRITICAL(&record_lock);
+}
+
+static esp_err_t record_start(void){
+    if (sink_poll_init() != ESP_OK)
+        return ESP_FAIL;
+    if (service_timer_create_deferred(&report_timer, "sink_record", report_timer_cb, NULL) != ESP_OK)
+        return ESP_FAIL;
+    ESP_LOGI(TAG, "Recording reports at a %" PRIu32 " US host poll", (uint32_t)OUTPUT_SINK_POLL_US);
+    return service_timer_start_periodic(report_timer, RECORD_SINK_REPORT_INTERVAL_US);
+}
+
+static bool HOT_PATH_ATTR record_mounted(void){
+    return true;
+}
+
+static bool HOT_PATH_ATTR record_mouse_report(const espnow_msg_mouse_t* msg){
+    portENTER_CRITICAL(&record_lock);
+    motion.x += msg->x;
+    motion.y += msg->y;
+    motion.wheel += msg->wheel;
+    motion.pan += msg->pan;
+    if (saturated(msg->x) || saturated(msg->y) || saturated(msg->wheel) || saturated(msg->pan))
+        motion.saturated++;
+    if (msg->buttons != motion.buttons)
+        motion.button_changes++;
+    motion.buttons = msg->buttons;
+    totals.x += msg->x;
+    totals.y += msg->y;
+    totals.wheel += msg->wheel;
+    totals.pan += msg->pan;
+    totals.buttons = msg->buttons;
+    portEXIT_CRITICAL(&record_lock);
+    record_report(HID_MOUSE_INSTANCE);
+    return true;
+}
+
+static bool HOT_PATH_ATTR record_keyboard_report(const espnow_msg_keyboard_t* msg){
+    record_report(HID_KEYBOARD_INSTANCE);
+    return true;
+}
+
+static bool HOT_PATH_ATTR record_gamepad_report(const espnow_msg_gamepad_t* msg){
+    record_report(HID_GAMEPAD_INSTANCE);
+    return true;
+}
+
+static bool record_raw_report(const uint8_t* data, uint8_t len){
+    record_report(HID_PASSTHROUGH_INSTANCE);
+    return true;
+}
+
+const output_sink_t HOT_PATH_DATA record_sink = {
+    .name = "recording",
+    .start = record_start,
+    .mounted = record_mounted,
+    .ready = sink_poll_ready,
+    .mouse_report = record_mouse_report,
+    .keyboard_report = record_keyboard_report,
+    .gamepad_report = record_gamepad_report,
+    .set_raw_descriptor = NULL,
+    .raw_report = record_raw_report,
+    .remote_wakeup = NULL
+};
@@ -0,0 +1,198 @@
+#include "output_sink.h"
+
+#if defined(__linux__)
+#include "device_config.h"
+#include "output.h"
+#include "tusb_device_common.h"
+#include "rtos/ram_budget.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// One virtual device with the mouse's buttons and axes and the keyboard's keys; the
+// kernel stamps every event, so evtest / libevdev readers see when each report landed.
+// Needs write access to /dev/uinput (root, or a udev rule for the input group).
+#define UINPUT_PATH "/dev/uinput"
+#define UINPUT_VENDOR 0x303A        // as the USB device
+#define UINPUT_PRODUCT 0x4010
+#define UINPUT_LED_POLL_TICKS 10    // LED changes from the host, see uinput_task
+
+static const char* TAG = "USB_RECEIVER // sink_uinput.c";
+
+STATIC_TASK(uinput_task_mem, "uinput", UINPUT_TASK_STACK, UINPUT_TASK_PRIORITY);
+
+static int fd = -1;
+static uint8_t mouse_buttons = 0;
+static espnow_msg_keyboard_t keyboard_state = {0};
+static uint8_t leds = 0;
+
+// HID keyboard usage (0x00 - 0x65) to evdev key code, as drivers/hid/hid-input.c
+static const uint8_t hid_to_evdev[] = {
+      0,   0,   0,   0,  30,  48,  46,  32,  18,  33,  34,  35,  23,  36,  37,  38,
+     50,  49,  24,  25,  16,  19,  31,  20,  22,  47,  17,  45,  21,  44,   2,   3,
+      4,   5,   6,   7,   8,   9,  10,  11,  28,   1,  14,  15,  57,  12,  13,  26,
+     27,  43,  43,  39,  40,  41,  51,  52,  53,  58,  59,  60,  61,  62,  63,  64,
+     65,  66,  67,  68,  87,  88,  99,  70, 119, 110, 102, 104, 111, 107, 109, 106,
+    105, 108, 103,  69,  98,  55,  74,  78,  96,  79,  80,  81,  75,  76,  77,  71,
+     72,  73,  82,  83,  86, 127
+};
+
+// Modifier bits, Left Ctrl first
+static const uint16_t modifier_keys[8] = {
+    KEY_LEFTCTRL, KEY_LEFTSHIFT, KEY_LEFTALT, KEY_LEFTMETA,
+    KEY_RIGHTCTRL, KEY_RIGHTSHIFT, KEY_RIGHTALT, KEY_RIGHTMETA
+};
+
+// Mouse button bits, as the boot protocol
+static const uint16_t mouse_button_keys[5] = { BTN_LEFT, BTN_RIGHT, BTN_MIDDLE, BTN_SIDE, BTN_EXTRA };
+
+// evdev LED codes in the bit order of the keyboard's HID output report
+static const uint16_t led_codes[5] = { LED_NUML, LED_CAPSL, LED_SCROLLL, LED_COMPOSE, LED_KANA };
+
+static void emit(uint16_t type, uint16_t code, int32_t value){
+    struct input_event event = { .type = type, .code = code, .value = value };
+    if (write(fd, &event, sizeof(event)) != sizeof(event))
+        ESP_LOGW(TAG, "uinput write failed: %s", strerror(errno));
+}
+
+static inline uint16_t evdev_key(uint8_t usage){
+    return usage < sizeof(hid_to_evdev) ? hid_to_evdev[usage] : 0;
+}
+
+static bool has_key(const espnow_msg_keyboard_t* msg, uint8_t usage){
+    for (size_t i = 0; i < sizeof(msg->keys); i++){
+        if (msg->keys[i] == usage)
+            return true;
+    }
+    return false;
+}
+
+// The host's LED state arrives as EV_LED events on the same descriptor; forwarded like
+// a USB SET_REPORT so the physical keyboard's LEDs follow the workstation's
+static void uinput_task(void* arg){
+    struct input_event event;
+    while (true){
+        ssize_t len = read(fd, &event, sizeof(event));
+        if (len != sizeof(event)){
+            vTaskDelay(UINPUT_LED_POLL_TICKS);
+            continue;
+        }
+        if (event.type != EV_LED)
+            continue;
+        for (size_t i = 0; i < sizeof(led_codes) / sizeof(led_codes[0]); i++){
+            if (event.code == led_codes[i])
+                leds = event.value ? (leds | (1 << i)) : (leds & ~(1 << i));
+        }
+        forward_output_report(HID_KEYBOARD_INSTANCE, &leds, sizeof(leds));
+    }
+}
+
+static esp_err_t uinput_start(void){
+    fd = open(UINPUT_PATH, O_RDWR | O_NONBLOCK);
+    if (fd < 0){
+        ESP_LOGE(TAG, "Cannot open %s: %s", UINPUT_PATH, strerror(errno));
+        return ESP_FAIL;
+    }
+    ioctl(fd, UI_SET_EVBIT, EV_KEY);
+    ioctl(fd, UI_SET_EVBIT, EV_REL);
+    ioctl(fd, UI_SET_EVBIT, EV_LED);
+    for (size_t i = 0; i < sizeof(mouse_button_keys) / sizeof(mouse_button_keys[0]); i++)
+        ioctl(fd, UI_SET_KEYBIT, mouse_button_keys[i]);
+    for (size_t i = 0; i < sizeof(modifier_keys) / sizeof(modifier_keys[0]); i++)
+        ioctl(fd, UI_SET_KEYBIT, modifier_keys[i]);
+    for (size_t i = 0; i < sizeof(hid_to_evdev); i++){
+        if (hid_to_evdev[i])
+            ioctl(fd, UI_SET_KEYBIT, hid_to_evdev[i]);
+    }
+    for (size_t i = 0; i < sizeof(led_codes) / sizeof(led_codes[0]); i++)
+        ioctl(fd, UI_SET_LEDBIT, led_codes[i]);
+    ioctl(fd, UI_SET_RELBIT, REL_X);
+    ioctl(fd, UI_SET_RELBIT, REL_Y);
+    ioctl(fd, UI_SET_RELBIT, REL_WHEEL);
+    ioctl(fd, UI_SET_RELBIT, REL_HWHEEL);
+
+    struct uinput_setup setup = {
+        .id = { .bustype = BUS_VIRTUAL, .vendor = UINPUT_VENDOR, .product = UINPUT_PRODUCT, .version = 1 }
+    };
+    strncpy(setup.name, "Wireless Adapter", UINPUT_MAX_NAME_SIZE - 1);
+    if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0){
+        ESP_LOGE(TAG, "Cannot create the uinput device: %s", strerror(errno));
+        close(fd);
+        fd = -1;
+        return ESP_FAIL;
+    }
+    if (sink_poll_init() != ESP_OK || create_static_task(&uinput_task_mem, uinput_task, NULL) == NULL)
+        return ESP_FAIL;
+    ESP_LOGI(TAG, "uinput device created, host poll %u US", (unsigned)OUTPUT_SINK_POLL_US);
+    return ESP_OK;
+}
+
+static bool uinput_mounted(void){
+    return fd >= 0;
+}
+
+static bool uinput_mouse_report(const espnow_msg_mouse_t* msg){
+    uint8_t changed = msg->buttons ^ mouse_buttons;
+    for (size_t i = 0; i < sizeof(mouse_button_keys) / sizeof(mouse_button_keys[0]); i++){
+        if (changed & (1 << i))
+            emit(EV_KEY, mouse_button_keys[i], (msg->buttons >> i) & 1);
+    }
+    mouse_buttons = msg->buttons;
+    if (msg->x)
+        emit(EV_REL, REL_X, msg->x);
+    if (msg->y)
+        emit(EV_REL, REL_Y, msg->y);
+    if (msg->wheel)
+        emit(EV_REL, REL_WHEEL, msg->wheel);
+    if (msg->pan)
+        emit(EV_REL, REL_HWHEEL, msg->pan);
+    emit(EV_SYN, SYN_REPORT, 0);
+    sink_poll_sent(HID_MOUSE_INSTANCE);
+    return true;
+}
+
+// Key reports carry the whole state; evdev wants the presses and releases
+static bool uinput_keyboard_report(const espnow_msg_keyboard_t* msg){
+    uint8_t changed = msg->modifiers ^ keyboard_state.modifiers;
+    for (int i = 0; i < 8; i++){
+        if (changed & (1 << i))
+            emit(EV_KEY, modifier_keys[i], (msg->modifiers >> i) & 1);
+    }
+    for (size_t i = 0; i < sizeof(keyboard_state.keys); i++){
+        uint8_t usage = keyboard_state.keys[i];
+        if (evdev_key(usage) && !has_key(msg, usage))
+            emit(EV_KEY, evdev_key(usage), 0);
+    }
+    for (size_t i = 0; i < sizeof(msg->keys); i++){
+        uint8_t usage = msg->keys[i];
+        if (evdev_key(usage) && !has_key(&keyboard_state, usage))
+            emit(EV_KEY, evdev_key(usage), 1);
+    }
+    keyboard_state = *msg;
+    emit(EV_SYN, SYN_REPORT, 0);
+    sink_poll_sent(HID_KEYBOARD_INSTANCE);
+    return true;
+}
+
+// Passthrough devices have no evdev mapping without their descriptor parsed, and gamepads
+// none at all yet; uhid could carry them, but the tests this sink is for only need the
+// mouse and keyboard
+const output_sink_t uinput_sink = {
+    .name = "uinput",
+    .start = uinput_start,
+    .mounted = uinput_mounted,
+    .ready = sink_poll_ready,
+    .mouse_report = uinput_mouse_report,
+    .keyboard_report = uinput_keyboard_report,
+    .gamepad_report = NULL,
+    .set_raw_descriptor = NULL,
+    .raw_report = NULL,
+    .remote_wakeup = NULL
+};
+#endif
@@ -1,7 +1,12 @@
 #include "devices.h"
+#include "output.h"
+#include "suspend.h"
+#include "ota_source.h"
+#include "device_config.h"
 #include "esp_log.h"
 #include "tusb.h"
 #include "tusb_device_common.h"
+#include "rtos/hot_path.h"
 #include <string.h>
 
 // Configuration Descriptors
@@ -11,7 +16,9 @@
 #define EPNUM_HID_MOUSE     0x81
 #define EPNUM_HID_KEYBOARD  0x82
 #define EPNUM_HID_GAMEPAD   0x83
+#define EPNUM_HID_PASSTHROUGH 0x84
 #define CONFIG_TOTAL_LEN  (TUD_CONFIG_DESC_LEN + (NUM_INFS * TUD_HID_DESC_LEN))
+#define PASSTHROUGH_CONFIG_TOTAL_LEN (CONFIG_TOTAL_LEN + TUD_HID_DESC_LEN)
 
 // Device Descriptor
 tusb_desc_device_t const desc_device = {
@@ -35,7 +42,25 @@ tusb_desc_device_t const desc_device = {
 // HID Report Descriptors
 uint8_t const desc_hid_report_mouse[]       = { TUD_HID_REPORT_DESC_MOUSE(HID_REPORT_ID(HID_MOUSE_REPORT_ID)) };
 uint8_t const desc_hid_report_keyboard[]    = { TUD_HID_REPORT_DESC_KEYBOARD(HID_REPORT_ID(HID_KEYBOARD_REPORT_ID)) };
+#if OTA_UPDATE
+// A vendor collection beside the gamepad's, so firmware updates need no extra endpoint
+uint8_t const desc_hid_report_gamepad[]     = {
+    TUD_HID_REPORT_DESC_GAMEPAD(HID_REPORT_ID(HID_GAMEPAD_REPORT_ID)),
+    HID_USAGE_PAGE_N(HID_USAGE_PAGE_VENDOR, 2),
+    HID_USAGE(0x01),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+        HID_REPORT_ID(HID_OTA_REPORT_ID)
+        HID_USAGE(0x02),
+        HID_LOGICAL_MIN(0x00),
+        HID_LOGICAL_MAX_N(0xFF, 2),
+        HID_REPORT_SIZE(8),
+        HID_REPORT_COUNT(OTA_HOST_REPORT_LEN),
+        HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+    HID_COLLECTION_END
+};
+#else
 uint8_t const desc_hid_report_gamepad[]     = { TUD_HID_REPORT_DESC_GAMEPAD(HID_REPORT_ID(HID_GAMEPAD_REPORT_ID)) };
+#endif
 
 uint8_t const desc_configuration[] = {
     // Config: 1 config, 3 interfaces, no string, total length, remote wakeup, 100mA
@@ -82,6 +107,34 @@ uint8_t const desc_configuration[] = {
     )
 };
 
+// Configuration with the passthrough interface appended, built once its report descriptor is known
+static uint8_t desc_configuration_passthrough[PASSTHROUGH_CONFIG_TOTAL_LEN];
+static const uint8_t* desc_hid_report_passthrough = NULL;
+
+void set_passthrough_report_descriptor(const uint8_t* desc, uint16_t len){
+    desc_hid_report_passthrough = NULL;
+    if (desc == NULL)
+        return;
+    const uint8_t desc_passthrough_itf[] = {
+        TUD_HID_DESCRIPTOR(
+            HID_PASSTHROUGH_ITF_NUM,
+            0,
+            HID_ITF_PROTOCOL_NONE,
+            len,
+            EPNUM_HID_PASSTHROUGH,
+            CFG_TUD_HID_EP_BUFSIZE,
+            POLLING_RATE
+        )
+    };
+    memcpy(desc_configuration_passthrough, desc_configuration, CONFIG_TOTAL_LEN);
+    memcpy(desc_configuration_passthrough + CONFIG_TOTAL_LEN, desc_passthrough_itf, sizeof(desc_passthrough_itf));
+    // Patch wTotalLength and bNumInterfaces of the copied configuration header
+    desc_configuration_passthrough[2] = PASSTHROUGH_CONFIG_TOTAL_LEN & 0xFF;
+    desc_configuration_passthrough[3] = PASSTHROUGH_CONFIG_TOTAL_LEN >> 8;
+    desc_configuration_passthrough[4] = NUM_INFS + 1;
+    desc_hid_report_passthrough = desc;
+}
+
 // String Descriptors
 static char const* string_desc_arr[] = {
     (const char[]) { 0x09, 0x04 },  // 0: Language (English)
@@ -96,8 +149,12 @@ static char const* string_desc_arr[] = {
 // Invoked when received GET_REPORT control request
 // Application must fill buffer report's content and return its length.
 // Return zero will cause the stack to STALL request
-// Leave empty, devices will send reports according to their polling rate
+// Only the firmware update status; devices send reports according to their polling rate
 uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t* buffer, uint16_t reqlen){
+#if OTA_UPDATE
+    if (instance == HID_GAMEPAD_INSTANCE && report_id == HID_OTA_REPORT_ID && report_type == HID_REPORT_TYPE_FEATURE)
+        return ota_source_host_status(buffer, reqlen);
+#endif
     (void) instance;
     (void) report_id;
     (void) report_type;
@@ -108,25 +165,40 @@ uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_t
 
 // Invoked when received SET_REPORT control request or
 // received data on OUT endpoint ( Report ID = 0, Type = 0 )
-// ! ! ! TO IMPLEMENT ! ! !
-// Requires: Host -> Device Communication
+// Forwards LED / rumble reports to the physical device behind the transmitter
 void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t const* buffer, uint16_t bufsize)
 {
-    (void) instance;
-    (void) report_id;
-    (void) report_type;
-    (void) buffer;
-    (void) bufsize;
+    // report_id is already stripped from buffer by TinyUSB
+#if OTA_UPDATE
+    if (instance == HID_GAMEPAD_INSTANCE && report_id == HID_OTA_REPORT_ID && report_type == HID_REPORT_TYPE_FEATURE){
+        ota_source_host_write(buffer, bufsize);
+        return;
+    }
+#endif
+    // Report type 0 is data received on the OUT endpoint
+    if (report_type == HID_REPORT_TYPE_OUTPUT || report_type == HID_REPORT_TYPE_INVALID)
+        forward_output_report(instance, buffer, bufsize);
 }
 
 // Invoked when a HID report is completed
 // Notifies appropriate queue that their particular HID instance will be ready soon
-void tud_hid_report_complete_cb(uint8_t instance, uint8_t const* report, uint16_t len){
+void HOT_PATH_ATTR tud_hid_report_complete_cb(uint8_t instance, uint8_t const* report, uint16_t len){
     (void)report;
     (void)len;
     notify_nst_task(instance);
 }
 
+// Invoked when the bus has been idle for 3ms -- the host is asleep
+// Reports sent now are lost; keyboard and mouse hold or drop input until it resumes
+void tud_suspend_cb(bool remote_wakeup_en){
+    usb_host_suspended(remote_wakeup_en);
+}
+
+// Invoked when the host resumes the bus, on its own or after tud_remote_wakeup()
+void tud_resume_cb(void){
+    usb_host_resumed();
+}
+
 // OS callback requests for Device Descriptor ^^^
 uint8_t const* tud_descriptor_device_cb(void){
     return (uint8_t const *) &desc_device;
@@ -141,6 +213,8 @@ uint8_t const* tud_hid_descriptor_report_cb(uint8_t instance){
             return desc_hid_report_keyboard;
         case HID_GAMEPAD_INSTANCE:
             return desc_hid_report_gamepad;
+        case HID_PASSTHROUGH_INSTANCE:
+            return desc_hid_report_passthrough;
         default:
             return 0;
     }
@@ -150,6 +224,8 @@ uint8_t const* tud_hid_descriptor_report_cb(uint8_t instance){
 uint8_t const* tud_descriptor_configuration_cb(uint8_t index)
 {
     (void) index; // We have only defined 1 Config Desc!
+    if (desc_hid_report_passthrough)
+        return desc_configuration_passthrough;
     return desc_configuration;
 }
 
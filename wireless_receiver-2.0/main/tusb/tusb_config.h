@@ -42,8 +42,8 @@
 #endif
 
 //------------- CLASS -------------//
-// We use three HID interfaces: mouse + keyboard + gamepad
-#define CFG_TUD_HID               3
+// Up to four HID interfaces: mouse + keyboard + gamepad (+ passthrough once a descriptor is cached)
+#define CFG_TUD_HID               4
 #define CFG_TUD_CDC               0
 #define CFG_TUD_MSC               0
 #define CFG_TUD_MIDI              0
@@ -51,4 +51,4 @@
 #define CFG_TUD_CUSTOM_CLASS      0
 
 // HID buffer sizes (tune as needed)
-#define CFG_TUD_HID_EP_BUFSIZE    16
+#define CFG_TUD_HID_EP_BUFSIZE    64 // Fits passthrough reports and the firmware update feature report
@@ -1,4 +1,5 @@
 #pragma once
+#include <stdint.h>
 
 // INST_NUM happen to be the same as ITF_NUM in this case
 // Decided to be pedantic about seperating the two, as they may differ
@@ -6,11 +7,17 @@
 #define HID_MOUSE_ITF_NUM       0
 #define HID_KEYBOARD_ITF_NUM    1
 #define HID_GAMEPAD_ITF_NUM     2
+#define HID_PASSTHROUGH_ITF_NUM 3
 
 #define HID_MOUSE_INSTANCE      0
 #define HID_KEYBOARD_INSTANCE   1
 #define HID_GAMEPAD_INSTANCE    2
+#define HID_PASSTHROUGH_INSTANCE 3
 
 #define HID_MOUSE_REPORT_ID     1
 #define HID_KEYBOARD_REPORT_ID  2
-#define HID_GAMEPAD_REPORT_ID   3
\ No newline at end of file
+#define HID_GAMEPAD_REPORT_ID   3
+#define HID_OTA_REPORT_ID       4   // Vendor feature report on the gamepad interface
+
+// Add (or with NULL remove) the passthrough interface; takes effect on the next enumeration
+void set_passthrough_report_descriptor(const uint8_t* desc, uint16_t len);
\ No newline at end of file
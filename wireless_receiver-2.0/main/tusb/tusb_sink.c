@@ -0,0 +1,97 @@
+#include "output_sink.h"
+#include "hardware.h"
+#include "tusb.h"
+#include "tusb_device_common.h"
+#include "timer/timer_service.h"
+#include "rtos/hot_path.h"
+
+#define REENUMERATE_DELAY_US (100000ULL)   // Long enough for the host to notice the disconnect
+
+static service_timer_t reconnect_timer = NULL;
+
+static void reconnect_timer_cb(void* arg){
+    tud_connect();
+}
+
+static esp_err_t tusb_start(void){
+    if (service_timer_create(&reconnect_timer, "pt_reconnect", reconnect_timer_cb, NULL) != ESP_OK)
+        return ESP_FAIL;
+    init_phy();
+    return begin_usb_tud();
+}
+
+static bool HOT_PATH_ATTR tusb_mounted(void){
+    return tud_mounted();
+}
+
+static bool HOT_PATH_ATTR tusb_ready(uint8_t instance){
+    return tud_hid_n_ready(instance);
+}
+
+static bool HOT_PATH_ATTR tusb_mouse_report(const espnow_msg_mouse_t* msg){
+    return tud_hid_n_mouse_report(
+        HID_MOUSE_INSTANCE,
+        HID_MOUSE_REPORT_ID,
+        msg->buttons,
+        msg->x,
+        msg->y,
+        msg->wheel,
+        msg->pan
+    );
+}
+
+static bool HOT_PATH_ATTR tusb_keyboard_report(const espnow_msg_keyboard_t* msg){
+    return tud_hid_n_keyboard_report(
+        HID_KEYBOARD_INSTANCE,
+        HID_KEYBOARD_REPORT_ID,
+        msg->modifiers,
+        msg->keys
+    );
+}
+
+static bool HOT_PATH_ATTR tusb_gamepad_report(const espnow_msg_gamepad_t* msg){
+    return tud_hid_n_gamepad_report(
+        HID_GAMEPAD_INSTANCE,
+        HID_GAMEPAD_REPORT_ID,
+        msg->x,
+        msg->y,
+        msg->z,
+        msg->rz,
+        msg->rx,
+        msg->ry,
+        msg->hat,
+        msg->buttons
+    );
+}
+
+// Swap the passthrough interface's descriptor, re-enumerating if the host has the old one
+static void tusb_set_raw_descriptor(const uint8_t* desc, uint16_t len){
+    bool usb_started = tud_inited();
+    // The host must not read the descriptor while it is being replaced
+    if (usb_started)
+        tud_disconnect();
+    set_passthrough_report_descriptor(desc, len);
+    if (usb_started)
+        service_timer_start_once(reconnect_timer, REENUMERATE_DELAY_US);
+}
+
+static bool tusb_raw_report(const uint8_t* data, uint8_t len){
+    return tud_hid_n_report(HID_PASSTHROUGH_INSTANCE, 0, data, len);
+}
+
+static bool tusb_remote_wakeup(void){
+    return tud_remote_wakeup();
+}
+
+const output_sink_t HOT_PATH_DATA tusb_sink = {
+    .name = "USB",
+    .start = tusb_start,
+    .mounted = tusb_mounted,
+    .ready = tusb_ready,
+    .mouse_report = tusb_mouse_report,
+    .keyboard_report = tusb_keyboard_report,
+    .gamepad_report = tusb_gamepad_report,
+    .set_raw_descriptor = tusb_set_raw_descriptor,
+    .raw_report = tusb_raw_report,
+    .remote_wakeup = tusb_remote_wakeup
+};
@@ -0,0 +1,13 @@
+#include "constants.h"
+#include "wifi/transport.h"
+
+// Forwarding statistics (frames, repeats, per-hop latency) are logged this often
+#define RELAY_STATS_INTERVAL_MS 10000
+
+// Transmitters and receivers the relay keeps track of -- each is an ESP-NOW peer
+// with its own duplicate window
+#define RELAY_MAX_NODES 8
+
+// PHY rate of forwarded frames: at 1 Mbps a bundle's air time alone is close to the
+// 1 ms per-hop budget (RELAY_HOP_BUDGET_US)
+#define RELAY_LINK_RATE LINK_RATE_FAST
@@ -0,0 +1,238 @@
+#include "forward.h"
+#include "device_config.h"
+#include "wifi/msg_types.h"
+#include "wifi/relay.h"
+#include "wifi/transport.h"
+#include "timer/timer_service.h"
+#include "rtos/hot_path.h"
+#include "rtos/ram_budget.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+
+#if !CONFIG_WIRELESS_TRANSPORT_ESPNOW
+#error "A relay forwards ESP-NOW frames; select the ESP-NOW transport"
+#endif
+
+#define FORWARDS_IN_FLIGHT 16       // forwarded frames awaiting their send callback
+#define PEER_QUEUE_LEN RELAY_MAX_NODES  // nodes waiting to be registered
+#define PEER_TASK_STACK 3072
+#define PEER_TASK_PRIORITY 5
+
+static const char* TAG = "WIRELESS_RELAY // forward.c";
+
+typedef struct {
+    bool used;
+    uint8_t addr[TRANSPORT_ADDR_LEN];
+    replay_window_t window;         // sequence numbers of the frames it sent
+    int64_t seen_us;
+} relay_node_t;
+
+typedef struct {
+    uint8_t addr[TRANSPORT_ADDR_LEN];
+} node_addr_t;
+
+typedef struct {
+    uint32_t token;                 // TRANSPORT_TOKEN_NONE when free
+    int64_t received_us;
+} forward_t;
+
+static const transport_t* HOT_PATH_DATA transport = NULL;
+static const uint8_t broadcast_addr[TRANSPORT_ADDR_LEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static uint8_t own_addr[TRANSPORT_ADDR_LEN];
+// The receive callback looks nodes up and moves their windows; only the peer task
+// adds and evicts them, since adding and deleting ESP-NOW peers may block
+static relay_node_t nodes[RELAY_MAX_NODES];
+static portMUX_TYPE node_lock = portMUX_INITIALIZER_UNLOCKED;
+STATIC_TASK(peer_task_mem, "relay_peers", PEER_TASK_STACK, PEER_TASK_PRIORITY);
+STATIC_QUEUE(peer_queue_mem, "relay_peers", PEER_QUEUE_LEN, node_addr_t);
+static QueueHandle_t peer_queue = NULL;
+// The frames in flight are only touched from the WiFi task, which runs both callbacks
+static forward_t in_flight[FORWARDS_IN_FLIGHT];
+static uint32_t last_token = TRANSPORT_TOKEN_NONE;
+static forward_stats_t stats = {0};
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static service_timer_t beacon_timer = NULL;
+
+// The node for addr, under node_lock. A node quiet for RELAY_TIMEOUT_US may have lost
+// its counters (a new pairing), and the relay cannot authenticate a restart, so its
+// window starts again.
+static relay_node_t* HOT_PATH_ATTR find_node(const uint8_t addr[TRANSPORT_ADDR_LEN], int64_t now_us){
+    for (int i = 0; i < RELAY_MAX_NODES; i++){
+        relay_node_t* node = &nodes[i];
+        if (node->used && memcmp(node->addr, addr, TRANSPORT_ADDR_LEN) == 0){
+            if (now_us - node->seen_us > RELAY_TIMEOUT_US)
+                node->window = (replay_window_t){0};
+            node->seen_us = now_us;
+            return node;
+        }
+    }
+    return NULL;
+}
+
+// Hand a node seen for the first time to the peer task; its frames are dropped until then
+static void HOT_PATH_ATTR request_node(const uint8_t addr[TRANSPORT_ADDR_LEN]){
+    node_addr_t wanted;
+    memcpy(wanted.addr, addr, TRANSPORT_ADDR_LEN);
+    ram_budget_note_send(&peer_queue_mem, xQueueSend(peer_queue, &wanted, 0) == pdTRUE);
+}
+
+// Registers requested nodes as peers, in a free slot or the longest quiet one
+static void peer_task(void* arg){
+    node_addr_t wanted;
+    while (true){
+        if (xQueueReceive(peer_queue, &wanted, portMAX_DELAY) != pdTRUE)
+            continue;
+        relay_node_t* slot = NULL;
+        bool known = false;
+        uint8_t evicted[TRANSPORT_ADDR_LEN];
+        bool evict = false;
+        portENTER_CRITICAL(&node_lock);
+        for (int i = 0; i < RELAY_MAX_NODES && !known; i++){
+            relay_node_t* node = &nodes[i];
+            known = node->used && memcmp(node->addr, wanted.addr, TRANSPORT_ADDR_LEN) == 0;
+            if (slot == NULL || (slot->used && (!node->used || node->seen_us < slot->seen_us)))
+                slot = node;
+        }
+        if (!known && slot->used){
+            memcpy(evicted, slot->addr, TRANSPORT_ADDR_LEN);
+            evict = true;
+            slot->used = false;
+        }
+        portEXIT_CRITICAL(&node_lock);
+        // Requested again before the first request got here
+        if (known)
+            continue;
+
+        bool encrypted;
+        if (evict)
+            transport->del_peer(evicted);
+        if (transport->add_peer(wanted.addr, NULL, &encrypted) != ESP_OK){
+            ESP_LOGW(TAG, "Could not add " MACSTR, MAC2STR(wanted.addr));
+            continue;
+        }
+        transport->set_rate(wanted.addr, RELAY_LINK_RATE);
+        portENTER_CRITICAL(&node_lock);
+        memcpy(slot->addr, wanted.addr, TRANSPORT_ADDR_LEN);
+        slot->window = (replay_window_t){0};
+        slot->seen_us = esp_timer_get_time();
+        slot->used = true;
+        portEXIT_CRITICAL(&node_lock);
+    }
+}
+
+static inline void HOT_PATH_ATTR count_dropped(void){
+    portENTER_CRITICAL(&stats_lock);
+    stats.dropped++;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+// Forwarded straight from the receive callback: no queue and no task switch, and the
+// one copy is the one needed to update hops and relay_us
+static void HOT_PATH_ATTR relay_frame(const transport_rx_info_t* info, const uint8_t* data, int len){
+    int64_t rx_us = esp_timer_get_time();
+    uint8_t frame[ESPNOW_FRAME_MAX_LEN];
+    espnow_msg_relay_t* header = (espnow_msg_relay_t*)frame;
+    if (len <= (int)sizeof(*header) || len > ESPNOW_FRAME_MAX_LEN || data[0] != ESPNOW_MSG_RELAY)
+        return;
+    memcpy(frame, data, len);
+    // One hop: frames come from their origin, and never go back to a relay
+    if (memcmp(header->origin, info->src_addr, TRANSPORT_ADDR_LEN) != 0 ||
+        memcmp(header->dest, own_addr, TRANSPORT_ADDR_LEN) == 0 || header->hops != 0)
+        return;
+
+    // The relay cannot authenticate the frame, so a seq far behind is never a restart
+    portENTER_CRITICAL(&node_lock);
+    relay_node_t* origin = find_node(header->origin, rx_us);
+    bool dest_known = find_node(header->dest, rx_us) != NULL;
+    bool fresh = origin && dest_known && relay_seq_accept(&origin->window, header->seq, false);
+    portEXIT_CRITICAL(&node_lock);
+    forward_t* forward = NULL;
+    for (int i = 0; i < FORWARDS_IN_FLIGHT && forward == NULL; i++){
+        if (in_flight[i].token == TRANSPORT_TOKEN_NONE)
+            forward = &in_flight[i];
+    }
+    if (origin == NULL || !dest_known || forward == NULL){
+        if (origin == NULL)
+            request_node(header->origin);
+        if (!dest_known)
+            request_node(header->dest);
+        count_dropped();
+        return;
+    }
+    if (!fresh){
+        portENTER_CRITICAL(&stats_lock);
+        stats.duplicates++;
+        portEXIT_CRITICAL(&stats_lock);
+        return;
+    }
+
+    header->hops++;
+    uint32_t relay_us = header->relay_us + (uint32_t)(esp_timer_get_time() - rx_us);
+    header->relay_us = relay_us > UINT16_MAX ? UINT16_MAX : relay_us;
+    if (++last_token == TRANSPORT_TOKEN_NONE)
+        ++last_token;
+    // Listed first, as the send callback may come before send() returns
+    forward->token = last_token;
+    forward->received_us = rx_us;
+    if (transport->send(header->dest, frame, len, forward->token) != ESP_OK){
+        forward->token = TRANSPORT_TOKEN_NONE;
+        count_dropped();
+    }
+}
+
+// The send callback of the forwarded frame sent under token
+static void HOT_PATH_ATTR frame_forwarded(const uint8_t addr[TRANSPORT_ADDR_LEN], uint32_t token, bool success){
+    forward_t* forward = NULL;
+    for (int i = 0; i < FORWARDS_IN_FLIGHT && forward == NULL; i++){
+        if (token != TRANSPORT_TOKEN_NONE && in_flight[i].token == token)
+            forward = &in_flight[i];
+    }
+    if (forward == NULL)
+        return;
+    uint32_t hop_us = (uint32_t)(esp_timer_get_time() - forward->received_us);
+    forward->token = TRANSPORT_TOKEN_NONE;
+    portENTER_CRITICAL(&stats_lock);
+    if (success){
+        stats.forwarded++;
+        stats.hop_us_sum += hop_us;
+        if (hop_us > stats.hop_us_max)
+            stats.hop_us_max = hop_us;
+        if (hop_us > RELAY_HOP_BUDGET_US)
+            stats.over_budget++;
+    }
+    else
+        stats.failed++;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+static void beacon_timer_cb(void* arg){
+    static const espnow_msg_blank_t beacon = { .msg_type = ESPNOW_MSG_RELAY_BEACON };
+    transport->send(broadcast_addr, (const uint8_t*)&beacon, sizeof(beacon), TRANSPORT_TOKEN_NONE);
+}
+
+void get_forward_stats(forward_stats_t* out){
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+esp_err_t begin_forwarding(void){
+    transport = get_transport();
+    esp_err_t err = transport->start(relay_frame, frame_forwarded, NULL);
+    if (err != ESP_OK)
+        return err;
+    ESP_ERROR_CHECK(transport->get_addr(own_addr));
+    peer_queue = create_static_queue(&peer_queue_mem);
+    if (peer_queue == NULL || create_static_task(&peer_task_mem, peer_task, NULL) == NULL)
+        return ESP_ERR_NO_MEM;
+    // The pair talks on the channel the receiver listens for pairing on
+    ESP_ERROR_CHECK(transport->set_channel(CONFIG_WIRELESS_CHANNEL));
+    if (service_timer_create_deferred(&beacon_timer, "relay_beacon", beacon_timer_cb, NULL) != ESP_OK)
+        return ESP_FAIL;
+    service_timer_start_periodic(beacon_timer, RELAY_BEACON_INTERVAL_US);
+    ESP_LOGI(TAG, "Relay " MACSTR " on channel %d", MAC2STR(own_addr), CONFIG_WIRELESS_CHANNEL);
+    return ESP_OK;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "esp_err.h"
+#include <stdint.h>
+
+typedef struct {
+    uint32_t forwarded;
+    uint32_t failed;        // not acked by the destination
+    uint32_t duplicates;
+    uint32_t dropped;       // no peer slot, too many in flight, or refused by the radio
+    uint32_t hop_us_max;    // from receiving a frame to the destination's ack
+    uint64_t hop_us_sum;
+    uint32_t over_budget;   // hops above RELAY_HOP_BUDGET_US
+} forward_stats_t;
+
+// Start the radio on CONFIG_WIRELESS_CHANNEL, announce the relay and forward
+// ESPNOW_MSG_RELAY frames (wifi/relay.h); after NVS is up
+esp_err_t begin_forwarding(void);
+
+void get_forward_stats(forward_stats_t* stats);
@@ -0,0 +1,43 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "wifi/relay.h"
+#include "forward.h"
+#include "esp_log.h"
+#include "nvs_flash.h"
+#include "device_config.h"
+#include "log/deferred_log.h"
+#include <inttypes.h>
+
+static const char* TAG = "WIRELESS_RELAY // main.c";
+
+// WiFi keeps its calibration data in NVS
+static esp_err_t start_nvs(void){
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    return ret;
+}
+
+static void report_forwarding(void){
+    forward_stats_t stats;
+    get_forward_stats(&stats);
+    if (stats.forwarded == 0 && stats.failed == 0)
+        return;
+    uint32_t mean_us = stats.forwarded ? (uint32_t)(stats.hop_us_sum / stats.forwarded) : 0;
+    ESP_LOGI(TAG, "Forwarded %" PRIu32 ", failed %" PRIu32 ", repeats %" PRIu32 ", dropped %" PRIu32,
+             stats.forwarded, stats.failed, stats.duplicates, stats.dropped);
+    ESP_LOGI(TAG, "Hop latency mean %" PRIu32 " US, max %" PRIu32 " US, %" PRIu32 " over %d US",
+             mean_us, stats.hop_us_max, stats.over_budget, RELAY_HOP_BUDGET_US);
+}
+
+void app_main(void){
+    ESP_ERROR_CHECK(start_nvs());
+    ESP_ERROR_CHECK(begin_deferred_log());
+    ESP_ERROR_CHECK(begin_forwarding());
+    while (true){
+        vTaskDelay(pdMS_TO_TICKS(RELAY_STATS_INTERVAL_MS));
+        report_forwarding();
+    }
+}
@@ -1,3 +1,4 @@
+#pragma once
 #include "constants.h"
 
 
@@ -5,6 +6,9 @@
 #define DEEP_SLEEP DISABLED
 #define LIGHT_SLEEP_DUR_S 120
 #define DEEP_SLEEP_DUR_S 600
+// Input-free time before the power locks are released (CONFIG_WIRELESS_POWER_MANAGEMENT,
+// wifi/link_power.h) until a performance profile sets its own
+#define POWER_IDLE_RELEASE_US (2000000ULL)
 
 #define BENCHMARK DISABLED
 #define ONE_PER_SEC (1000UL)
@@ -12,4 +16,65 @@
 #define ONE_HUNDRED_PER_SEC (10UL)
 #define LOW_LOAD_DEL_MS ONE_PER_SEC
 #define MED_LOAD_DEL_MS TEN_PER_SEC
-#define HIGH_LOAD_DEL_MS ONE_HUNDRED_PER_SEC
\ No newline at end of file
+#define HIGH_LOAD_DEL_MS ONE_HUNDRED_PER_SEC
+// Each round of RTT pings is checked against these objectives, e.g. with
+// CONFIG_WIRELESS_IMPAIRMENT emulating burst loss; a ping without a reply
+// before the next one counts as lost
+#define BENCHMARK_RTT_SAMPLES 1000
+#define SLO_EDGE_P99_US (10000)
+#define SLO_EDGE_LOSS_PER_10000 (10)
+
+// Left Ctrl + Left Shift + Left Alt + this key opens a pairing window (see wifi/pairing.h)
+#define PAIRING_HOTKEY ENABLED
+#define PAIRING_HOTKEY_KEY HID_KEY_P
+// Left Ctrl + Left Shift + Left Alt + this key steps through the performance profiles
+// (Competitive, Office, Battery -- see wifi/perf_profile.h)
+#define PROFILE_HOTKEY ENABLED
+#define PROFILE_HOTKEY_KEY HID_KEY_O
+
+// Record raw HID input-reports into a binary trace (see trace/trace.h)
+#define TRACE_CAPTURE DISABLED
+#define TRACE_BUFFER_SIZE (32 * 1024)
+// Replay main/trace/replay.trc (embedded at build time) through the input path
+#define TRACE_REPLAY DISABLED
+#define TRACE_REPLAY_SPEED 1 // 1 = original timing, N = N times faster, 0 = as fast as possible
+#define TRACE_REPLAY_LOOPS 1
+
+// Log stack high-water marks, queue peaks and heap usage (see rtos/ram_budget.h)
+#define RAM_BUDGET_REPORT DISABLED
+#define RAM_BUDGET_REPORT_INTERVAL_US (10000000ULL)
+
+// Per-device report rate caps behind a hub, 0 = uncapped; mouse motion is never capped
+#define KEYBOARD_RATE_CAP_HZ 0
+#define GAMEPAD_RATE_CAP_HZ 250
+#define PASSTHROUGH_RATE_CAP_HZ 500
+// Log each connected device's report rate and how many reports its cap coalesced
+#define DEVICE_STATS_REPORT DISABLED
+#define DEVICE_STATS_INTERVAL_US (10000000ULL)
+// Histogram each device's report intervals and detect its poll rate (see hardware/report_timing.h);
+// a diagnostic, off by default as it costs a lock per input report
+#define DEVICE_CHARACTERIZATION DISABLED
+#define DEVICE_CHARACTERIZATION_INTERVAL_US (10000000ULL)
+// Fit the profile's mouse coalescing window to the detected poll rate (needs DEVICE_CHARACTERIZATION)
+#define AUTO_COALESCE DISABLED
+// Send mouse motion as wrapping position counters (ESPNOW_MSG_MOUSE_POSITION) rather than
+// deltas, so the receiver recovers the motion of lost frames; needs a receiver that knows it
+#define MOUSE_POSITION ENABLED
+
+// Accept firmware updates streamed by the receiver (see ota/ota_target.h); needs the
+// OTA partition table and signed images from sdkconfig.defaults
+#define OTA_UPDATE ENABLED
+
+// Pipeline RAM budget -- stacks in bytes; the HID driver task is created by usb_host_hid
+#define USB_HOST_TASK_STACK 8192
+#define USB_HOST_TASK_PRIORITY 5
+#define HID_HOST_TASK_STACK 8192
+#define HID_HOST_TASK_PRIORITY 5
+#define TX_SCHEDULER_TASK_STACK 3072
+#define TX_SCHEDULER_TASK_PRIORITY 5
+#define TX_EDGE_QUEUE_LEN 32
+#define HID_OUTPUT_TASK_STACK 3072
+#define HID_OUTPUT_TASK_PRIORITY 3
+#define HID_OUTPUT_QUEUE_LEN 4
+#define OTA_TASK_STACK 4096
+#define OTA_TASK_PRIORITY 1
@@ -0,0 +1,88 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define TU_BIT(n) (1UL << (n))
+
+#define CONTROLLER_AXIS_NONE 0xFF
+#define CONTROLLER_MAX_BUTTON_BYTES 4
+// Profiles keyed with this PID match any product of their vendor
+#define CONTROLLER_ANY_PID 0xFFFF
+
+#define MAKE_KEY(vid, pid) (((uint32_t)(vid) << 16) | (pid))
+
+typedef enum {
+    GAMEPAD_HAT_CENTERED   = 0,  ///< DPAD_CENTERED
+    GAMEPAD_HAT_UP         = 1,  ///< DPAD_UP
+    GAMEPAD_HAT_UP_RIGHT   = 2,  ///< DPAD_UP_RIGHT
+    GAMEPAD_HAT_RIGHT      = 3,  ///< DPAD_RIGHT
+    GAMEPAD_HAT_DOWN_RIGHT = 4,  ///< DPAD_DOWN_RIGHT
+    GAMEPAD_HAT_DOWN       = 5,  ///< DPAD_DOWN
+    GAMEPAD_HAT_DOWN_LEFT  = 6,  ///< DPAD_DOWN_LEFT
+    GAMEPAD_HAT_LEFT       = 7,  ///< DPAD_LEFT
+    GAMEPAD_HAT_UP_LEFT    = 8,  ///< DPAD_UP_LEFT
+} hid_gamepad_hat_t;
+
+// Standard button layout -- gen_controller_profiles.py mirrors these bit positions
+typedef enum {
+    GAMEPAD_BUTTON_SOUTH   = TU_BIT(0),
+    GAMEPAD_BUTTON_EAST    = TU_BIT(1),
+    GAMEPAD_BUTTON_C       = TU_BIT(2),
+    GAMEPAD_BUTTON_NORTH   = TU_BIT(3),
+    GAMEPAD_BUTTON_WEST    = TU_BIT(4),
+    GAMEPAD_BUTTON_Z       = TU_BIT(5),
+    GAMEPAD_BUTTON_TL      = TU_BIT(6),
+    GAMEPAD_BUTTON_TR      = TU_BIT(7),
+    GAMEPAD_BUTTON_TL2     = TU_BIT(8),
+    GAMEPAD_BUTTON_TR2     = TU_BIT(9),
+    GAMEPAD_BUTTON_SELECT  = TU_BIT(10),
+    GAMEPAD_BUTTON_START   = TU_BIT(11),
+    GAMEPAD_BUTTON_MODE    = TU_BIT(12),
+    GAMEPAD_BUTTON_THUMBL  = TU_BIT(13),
+    GAMEPAD_BUTTON_THUMBR  = TU_BIT(14)
+} std_gamepad_button_bm_t;
+
+// Order of axis_offset entries
+typedef enum {
+    CONTROLLER_AXIS_X,
+    CONTROLLER_AXIS_Y,
+    CONTROLLER_AXIS_Z,
+    CONTROLLER_AXIS_RZ,
+    CONTROLLER_AXIS_RX,
+    CONTROLLER_AXIS_RY,
+    CONTROLLER_AXIS_COUNT
+} controller_axis_t;
+
+// Describes where a controller's report keeps each field and how to convert it.
+// Generated from controller_profiles.json by gen_controller_profiles.py
+typedef struct {
+    const char* name;
+    uint8_t min_report_len;                             // Shorter reports are rejected
+    uint8_t axis_offset[CONTROLLER_AXIS_COUNT];         // Byte per axis, or CONTROLLER_AXIS_NONE
+    uint8_t axis_center;                                // Raw value of a centered axis
+    uint8_t hat_offset;                                 // Byte holding the hat, or CONTROLLER_AXIS_NONE
+    uint8_t hat_shift;                                  // Hat value is (byte >> shift) & 0x0F
+    const uint8_t* hat_lut;                             // 16 entries: raw hat -> hid_gamepad_hat_t
+    uint8_t num_button_bytes;
+    uint8_t button_offset[CONTROLLER_MAX_BUTTON_BYTES]; // Bytes holding buttons
+    const uint32_t* button_lut[CONTROLLER_MAX_BUTTON_BYTES]; // 256 entries: raw byte -> std_gamepad_button_bm_t
+} controller_profile_t;
+
+// Perfect hash slot: key is MAKE_KEY(vid, pid), profile indexes the profile table
+typedef struct {
+    uint32_t key;
+    uint8_t profile;
+} controller_profile_slot_t;
+
+#define CONTROLLER_PROFILE_NONE 0xFF
+
+// Shared with gen_controller_profiles.py -- both must hash identically
+static inline uint32_t controller_profile_hash(uint32_t key, uint32_t seed){
+    uint32_t h = key ^ seed;
+    h ^= h >> 16;
+    h *= 0x7FEB352DUL;
+    h ^= h >> 15;
+    h *= 0x846CA68BUL;
+    h ^= h >> 16;
+    return h;
+}
@@ -1,12 +1,37 @@
+#pragma once
 #include "usb/hid_host.h"
+#include "wifi/msg_types.h"
+#include "controller_profile.h"
 
-// starts keyboard-watchdog task
+// creates the keyboard-watchdog timer
 void begin_keyboard_watchdog(void);
 
-// parse a keyboard input-report and return a formatted espnow_message
-esp_err_t process_keyboard_report(const uint8_t* data, size_t length,
-                                    uint8_t** formatted_data, size_t* formatted_length);
+// parse a keyboard input-report into a formatted espnow_message
+esp_err_t process_keyboard_report(const uint8_t* data, size_t length, espnow_msg_keyboard_t* msg);
 
-// parse a mouse input-report and return a formatted espnow_message
-esp_err_t process_mouse_report(const uint8_t* data, size_t length,
-                                uint8_t** formatted_data, size_t* formatted_length);
\ No newline at end of file
+// parse a mouse input-report into a formatted espnow_message
+esp_err_t process_mouse_report(const uint8_t* data, size_t length, espnow_msg_mouse_t* msg);
+
+// find the profile describing a controller's reports, NULL if the controller is unknown
+const controller_profile_t* identify_controller(uint16_t vid, uint16_t pid);
+
+const char* get_controller_name(const controller_profile_t* profile);
+
+// parse a gamepad input-report into a formatted espnow_message
+esp_err_t process_gamepad_report(const controller_profile_t* profile, const uint8_t* data, size_t length,
+                                  espnow_msg_gamepad_t* msg);
+
+// Claim the receiver's passthrough interface for a device with no known report layout
+esp_err_t passthrough_device_connected(hid_host_device_handle_t handle, uint16_t vid, uint16_t pid);
+
+void passthrough_device_removed(hid_host_device_handle_t handle);
+
+bool is_passthrough_device(hid_host_device_handle_t handle);
+
+// handle descriptor requests and confirmations from the receiver
+void process_passthrough_message(const espnow_message_t* msg);
+
+esp_err_t init_passthrough(void);
+
+// measure per-report parsing cost and check parsers against malformed reports (BENCHMARK)
+void benchmark_report_parsers(void);
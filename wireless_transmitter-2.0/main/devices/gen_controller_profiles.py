@@ -0,0 +1,192 @@
+"""Generate the controller profile lookup tables from controller_profiles.json.
+
+Usage: python gen_controller_profiles.py controller_profiles.json controller_profile_table.h
+
+Profiles are found with a hash-and-displace perfect hash keyed on MAKE_KEY(vid, pid),
+and each button byte is remapped through a 256-entry lookup table, so identifying a
+controller and converting its buttons are single table lookups at runtime.
+A device entry with "pid": "any" matches every product of that vendor.
+"""
+import json
+import sys
+
+ANY_PID = 0xFFFF
+AXES = ["x", "y", "z", "rz", "rx", "ry"]
+AXIS_NONE = 0xFF
+MAX_BUTTON_BYTES = 4
+
+# Mirrors std_gamepad_button_bm_t in controller_profile.h
+STD_BUTTONS = {
+    "SOUTH": 0, "EAST": 1, "C": 2, "NORTH": 3, "WEST": 4, "Z": 5, "TL": 6, "TR": 7,
+    "TL2": 8, "TR2": 9, "SELECT": 10, "START": 11, "MODE": 12, "THUMBL": 13, "THUMBR": 14,
+}
+
+# Raw 4-bit hat value -> hid_gamepad_hat_t (0 = centered, 1..8 = up clockwise to up-left)
+HAT_ENCODINGS = {
+    "zero_based": [i + 1 if i < 8 else 0 for i in range(16)],
+    "one_based": [i if 1 <= i <= 8 else 0 for i in range(16)],
+}
+
+
+def controller_profile_hash(key, seed):
+    """Python twin of controller_profile_hash() in controller_profile.h."""
+    h = (key ^ seed) & 0xFFFFFFFF
+    h ^= h >> 16
+    h = (h * 0x7FEB352D) & 0xFFFFFFFF
+    h ^= h >> 15
+    h = (h * 0x846CA68B) & 0xFFFFFFFF
+    h ^= h >> 16
+    return h
+
+
+def next_pow2(n):
+    size = 1
+    while size < n:
+        size <<= 1
+    return size
+
+
+def build_perfect_hash(keys):
+    """Hash-and-displace: bucket by seed 0, then find a per-bucket seed placing
+    every key of the bucket into a free slot. Returns (seeds, slots)."""
+    num_slots = next_pow2(max(len(keys), 1))
+    num_buckets = next_pow2(max(len(keys) // 2, 1))
+    buckets = [[] for _ in range(num_buckets)]
+    for key, value in keys.items():
+        buckets[controller_profile_hash(key, 0) & (num_buckets - 1)].append((key, value))
+
+    seeds = [0] * num_buckets
+    slots = [None] * num_slots
+    for index in sorted(range(num_buckets), key=lambda b: -len(buckets[b])):
+        bucket = buckets[index]
+        if not bucket:
+            continue
+        for seed in range(1, 1 << 20):
+            positions = [controller_profile_hash(key, seed) & (num_slots - 1) for key, _ in bucket]
+            if len(set(positions)) == len(positions) and all(slots[p] is None for p in positions):
+                break
+        else:
+            sys.exit("Could not build a perfect hash for the controller profiles")
+        seeds[index] = seed
+        for (key, value), position in zip(bucket, positions):
+            slots[position] = (key, value)
+    return seeds, slots
+
+
+def button_lut(bits):
+    """256-entry table turning a raw button byte into the standard button mask."""
+    masks = []
+    for bit in bits:
+        if bit is None:
+            masks.append(0)
+        elif bit in STD_BUTTONS:
+            masks.append(1 << STD_BUTTONS[bit])
+        elif bit.startswith("BUTTON_"):
+            masks.append(1 << int(bit[len("BUTTON_"):]))
+        else:
+            sys.exit(f"Unknown button name: {bit}")
+    masks += [0] * (8 - len(masks))
+    return [sum(mask for i, mask in enumerate(masks) if raw & (1 << i)) for raw in range(256)]
+
+
+def parse_id(value):
+    return ANY_PID if value == "any" else int(value, 0)
+
+
+def generate(spec):
+    profiles, keys = [], {}
+    luts, lut_names = [], {}
+    hat_names = {}
+
+    for index, profile in enumerate(spec["profiles"]):
+        for device in profile["devices"]:
+            key = (parse_id(device["vid"]) << 16) | parse_id(device["pid"])
+            if key in keys:
+                sys.exit(f"Duplicate controller {device['vid']}:{device['pid']}")
+            keys[key] = index
+
+        offsets = list(profile.get("axes", {}).values()) + [b["offset"] for b in profile.get("buttons", [])]
+        if "hat" in profile:
+            offsets.append(profile["hat"]["offset"])
+        if any(offset >= profile["min_report_len"] for offset in offsets):
+            sys.exit(f"{profile['name']}: every field must lie within min_report_len")
+
+        buttons = profile.get("buttons", [])
+        if len(buttons) > MAX_BUTTON_BYTES:
+            sys.exit(f"{profile['name']}: at most {MAX_BUTTON_BYTES} button bytes are supported")
+        button_luts = []
+        for field in buttons:
+            lut = tuple(button_lut(field["bits"]))
+            if lut not in lut_names:
+                lut_names[lut] = f"button_lut_{len(luts)}"
+                luts.append(lut)
+            button_luts.append(lut_names[lut])
+
+        hat = profile.get("hat")
+        if hat:
+            hat_names[hat["encoding"]] = f"hat_lut_{hat['encoding']}"
+        profiles.append((profile, button_luts))
+
+    seeds, slots = build_perfect_hash(keys)
+
+    out = ["// Generated by gen_controller_profiles.py from controller_profiles.json -- do not edit",
+           "#pragma once",
+           '#include "controller_profile.h"',
+           "",
+           f"#define CONTROLLER_PROFILE_BUCKETS {len(seeds)}",
+           f"#define CONTROLLER_PROFILE_SLOTS {len(slots)}",
+           ""]
+    for encoding, name in sorted(hat_names.items()):
+        values = ", ".join(str(v) for v in HAT_ENCODINGS[encoding])
+        out.append(f"static const uint8_t {name}[16] = {{ {values} }};")
+    for lut in luts:
+        out.append(f"static const uint32_t {lut_names[lut]}[256] = {{")
+        for row in range(0, 256, 8):
+            out.append("    " + ", ".join(f"0x{v:04X}" for v in lut[row:row + 8]) + ",")
+        out.append("};")
+    out.append("")
+
+    out.append("static const controller_profile_t controller_profiles[] = {")
+    for profile, button_luts in profiles:
+        axes = profile.get("axes", {})
+        offsets = ", ".join(str(axes[a]) if a in axes else "CONTROLLER_AXIS_NONE" for a in AXES)
+        hat = profile.get("hat")
+        button_offsets = ", ".join(str(b["offset"]) for b in profile.get("buttons", [])) or "0"
+        out += ["    {",
+                f"        .name = \"{profile['name']}\",",
+                f"        .min_report_len = {profile['min_report_len']},",
+                f"        .axis_offset = {{ {offsets} }},",
+                f"        .axis_center = {profile.get('axis_center', 0)},",
+                f"        .hat_offset = {hat['offset'] if hat else 'CONTROLLER_AXIS_NONE'},",
+                f"        .hat_shift = {hat.get('shift', 0) if hat else 0},",
+                f"        .hat_lut = {hat_names[hat['encoding']] if hat else 'NULL'},",
+                f"        .num_button_bytes = {len(button_luts)},",
+                f"        .button_offset = {{ {button_offsets} }},",
+                f"        .button_lut = {{ {', '.join(button_luts) or 'NULL'} }}",
+                "    },"]
+    out += ["};", ""]
+
+    out.append("static const uint32_t controller_profile_seeds[CONTROLLER_PROFILE_BUCKETS] = {")
+    out.append("    " + ", ".join(str(s) for s in seeds))
+    out += ["};", ""]
+    out.append("static const controller_profile_slot_t controller_profile_slots[CONTROLLER_PROFILE_SLOTS] = {")
+    for slot in slots:
+        if slot is None:
+            out.append("    { 0, CONTROLLER_PROFILE_NONE },")
+        else:
+            out.append(f"    {{ 0x{slot[0]:08X}, {slot[1]} }},")
+    out += ["};", ""]
+    return "\n".join(out)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    with open(sys.argv[1]) as spec_file:
+        spec = json.load(spec_file)
+    with open(sys.argv[2], "w") as out:
+        out.write(generate(spec))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,45 @@
+#include "esp_timer.h"
+#include "wifi/msg_types.h"
+#include "devices.h"
+#include "hardware.h"
+#include "tx_scheduler.h"
+#include "rtos/hot_path.h"
+#include <stddef.h>
+#include <string.h>
+
+// parse a raw input-report from the given device and queue it for the receiver
+// Shared by live HID input and trace replay
+esp_err_t HOT_PATH_ATTR forward_input_report(const input_device_t* device, const uint8_t* data, size_t length){
+    espnow_message_t msg;
+    size_t msg_length = 0;
+    switch (device->type){
+        case KEYBOARD:
+            if (process_keyboard_report(data, length, &msg.keyboard_msg) == ESP_OK)
+                msg_length = sizeof(msg.keyboard_msg);
+            break;
+        case MOUSE:
+            if (process_mouse_report(data, length, &msg.mouse_msg) == ESP_OK){
+                msg.mouse_msg.timestamp_us = (uint32_t)esp_timer_get_time();
+                msg_length = sizeof(msg.mouse_msg);
+            }
+            break;
+        case OTHER:
+        default:
+            // Devices without a profile are forwarded as-is for the receiver's passthrough interface
+            if (device->profile == NULL){
+                if (length == 0 || length > ESPNOW_RAW_REPORT_MAX_LEN)
+                    break;
+                msg.raw_report_msg.msg_type = ESPNOW_MSG_RAW_REPORT;
+                msg.raw_report_msg.len = length;
+                memcpy(msg.raw_report_msg.data, data, length);
+                msg_length = offsetof(espnow_msg_raw_report_t, data) + length;
+            }
+            else if (process_gamepad_report(device->profile, data, length, &msg.gamepad_msg) == ESP_OK)
+                msg_length = sizeof(msg.gamepad_msg);
+            break;
+    }
+
+    if (msg_length == 0)
+        return ESP_FAIL;
+    return tx_scheduler_submit_input(device->index, &msg, msg_length);
+}
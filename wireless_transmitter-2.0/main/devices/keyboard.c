@@ -4,72 +4,110 @@
 #include "esp_log.h"
 #include "constants.h"
 #include "wifi/wifi.h"
+#include "wifi/pairing.h"
+#include "wifi/perf_profile.h"
+#include "device_config.h"
+#include "devices.h"
+#include "tx_scheduler.h"
+#include "timer/timer_service.h"
+#include "rtos/hot_path.h"
+#include "log/deferred_log.h"
+#include <inttypes.h>
 #include <string.h>
 
+// release a modifier combo if no report follows it within this window
+#define KBD_WD_TIMEOUT_US (200000ULL)
+
 static const char* TAG = "USB_TRANSMITTER // keyboard.c";
 
 typedef struct kwt {
     bool active;
-    uint32_t last_report_time;
+    int64_t last_report_time;
 } keyboard_watchdog_t;
 
 static keyboard_watchdog_t kbd_wd = {0};
 
-static TaskHandle_t kbd_wd_task_handle = NULL;
+static service_timer_t kbd_wd_timer = NULL;
 
 static inline bool is_modifier(uint8_t mask){ return mask != 0; }
 
 // update keyboard watchdog timer given modifier mask
-static void update_kbd_wd(uint8_t mask){
-    uint32_t curr_time_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
-    // enable watchdog if modifier is sent
+static void HOT_PATH_ATTR update_kbd_wd(uint8_t mask){
+    kbd_wd.last_report_time = esp_timer_get_time();
+    // (re)arm watchdog on every report carrying a modifier
     if (is_modifier(mask)){
         if (!kbd_wd.active) {
-            ESP_LOGI(TAG, "kbd_wd: Watchdog Activated -> mod=0x%02X", mask);
+            DLOGI(TAG, "kbd_wd: Watchdog Activated -> mod=0x%02X", mask);
             kbd_wd.active = true;
-            xTaskNotifyGive(kbd_wd_task_handle);
         }
+        service_timer_start_once(kbd_wd_timer, KBD_WD_TIMEOUT_US);
     }
     // disable watchdog if report has no modifier, if enabled
     else if (kbd_wd.active) {
-        ESP_LOGI(TAG, "kbd_wd: Watchdog Deactivated");
+        DLOGI(TAG, "kbd_wd: Watchdog Deactivated");
         kbd_wd.active = false;
+        service_timer_cancel(kbd_wd_timer);
     }
-    kbd_wd.last_report_time = curr_time_ms;
 }
 
-// Task to clear "stuck" macros commonly sent by composite devices.
-static void keyboard_watchdog_task(void* arg) {
-    espnow_msg_keyboard_t release = {
+// Fires KBD_WD_TIMEOUT_US after the last modifier report to clear "stuck" macros
+// commonly sent by composite devices. Deferred: it logs and submits a frame.
+static void kbd_wd_timer_cb(void* arg) {
+    static const espnow_msg_keyboard_t release = {
         .msg_type = ESPNOW_MSG_KEYBOARD,
         .modifiers = 0,
         .reserved = 0,
         .keys = {0}
     };
-    while (true) {
-        // Wait until watchdog is activated
-        if (!kbd_wd.active){
-            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-        }
-        vTaskDelay(pdMS_TO_TICKS(50));
-        
-        uint32_t curr_time_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
-        uint32_t idle_time = curr_time_ms - kbd_wd.last_report_time;
-        // fire watchdog if time between last report and macro longer than 200ms
-        if (idle_time >= 200) {
-            ESP_LOGW(TAG, "kbd_wd: Modifier combo timeout %dms - auto-releasing", idle_time);
-            kbd_wd.active = false;
-            send_message((uint8_t*)&release, sizeof(release));
-        }
+    int64_t idle_us = esp_timer_get_time() - kbd_wd.last_report_time;
+    // A modifier report that came in while this call waited on the service task rearmed the timer
+    if (!kbd_wd.active || idle_us < (int64_t)KBD_WD_TIMEOUT_US)
+        return;
+    ESP_LOGW(TAG, "kbd_wd: Modifier combo timeout %" PRId64 "ms - auto-releasing", idle_us / 1000);
+    kbd_wd.active = false;
+    tx_scheduler_submit((espnow_message_t*)&release, sizeof(release));
+}
+
+#if PAIRING_HOTKEY || PROFILE_HOTKEY
+// True while Left Ctrl + Left Shift + Left Alt + key are held
+static bool HOT_PATH_ATTR hotkey_held(const hid_keyboard_input_report_boot_t* report, uint8_t key){
+    bool pressed = false;
+    if (report->modifier.left_ctr && report->modifier.left_shift && report->modifier.left_alt){
+        for (int i = 0; i < (int)sizeof(report->key); i++)
+            pressed |= report->key[i] == key;
     }
+    return pressed;
 }
+#endif
+
+#if PAIRING_HOTKEY
+// Open a pairing window once per press of the hotkey
+static void HOT_PATH_ATTR check_pairing_hotkey(const hid_keyboard_input_report_boot_t* report){
+    static bool held = false;
+    bool pressed = hotkey_held(report, PAIRING_HOTKEY_KEY);
+    if (pressed && !held)
+        begin_pairing();
+    held = pressed;
+}
+#endif
+
+#if PROFILE_HOTKEY
+// Step to the next performance profile once per press of the hotkey
+static void HOT_PATH_ATTR check_profile_hotkey(const hid_keyboard_input_report_boot_t* report){
+    static bool held = false;
+    bool pressed = hotkey_held(report, PROFILE_HOTKEY_KEY);
+    if (pressed && !held)
+        next_perf_profile();
+    held = pressed;
+}
+#endif
 
 void begin_keyboard_watchdog(void){
-    xTaskCreate(keyboard_watchdog_task, "kbd_watchdog", 8192, NULL, 4, &kbd_wd_task_handle);
+    service_timer_create_deferred(&kbd_wd_timer, "kbd_watchdog", kbd_wd_timer_cb, NULL);
 }
 
-// parse a keyboard input-report and return a formatted espnow_message
-esp_err_t process_keyboard_report(const uint8_t* data, size_t length, uint8_t** formatted_data, size_t* formatted_length) {
+// parse a keyboard input-report into a formatted espnow_message
+esp_err_t HOT_PATH_ATTR process_keyboard_report(const uint8_t* data, size_t length, espnow_msg_keyboard_t* msg) {
     // handle malformed report 
     if (length < sizeof(hid_keyboard_input_report_boot_t))
         return ESP_FAIL;
@@ -77,15 +115,17 @@ esp_err_t process_keyboard_report(const uint8_t* data, size_t length, uint8_t**
     // Convert data to standard report format
     const hid_keyboard_input_report_boot_t* report = (hid_keyboard_input_report_boot_t*)data;
 
-    // Fill message and send
-    espnow_msg_keyboard_t* msg = (espnow_msg_keyboard_t*)malloc(sizeof(espnow_msg_keyboard_t));
+    // Fill message
     msg->msg_type = ESPNOW_MSG_KEYBOARD;
     memcpy(msg->keys, report->key, sizeof(report->key));
     msg->modifiers = report->modifier.val;
     msg->reserved = 0;
     update_kbd_wd(report->modifier.val);
-
-    *formatted_data = (uint8_t*)msg;
-    *formatted_length = sizeof(*msg);
+#if PAIRING_HOTKEY
+    check_pairing_hotkey(report);
+#endif
+#if PROFILE_HOTKEY
+    check_profile_hotkey(report);
+#endif
     return ESP_OK;
 }
\ No newline at end of file
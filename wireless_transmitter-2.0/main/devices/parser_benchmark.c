@@ -0,0 +1,97 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_rom_sys.h"
+#include "device_config.h"
+#include "devices.h"
+#include <string.h>
+#include <inttypes.h>
+
+#define BENCH_ITERATIONS 10000
+#define FUZZ_ITERATIONS 100000
+#define FUZZ_MAX_REPORT_LEN 32
+
+#if BENCHMARK
+static const char* TAG = "USB_TRANSMITTER // parser_benchmark.c";
+
+typedef esp_err_t (*report_parser_t)(const uint8_t* data, size_t length, espnow_message_t* msg);
+
+static esp_err_t parse_keyboard(const uint8_t* data, size_t length, espnow_message_t* msg){
+    return process_keyboard_report(data, length, &msg->keyboard_msg);
+}
+
+static esp_err_t parse_mouse(const uint8_t* data, size_t length, espnow_message_t* msg){
+    return process_mouse_report(data, length, &msg->mouse_msg);
+}
+
+typedef struct {
+    const char* name;
+    report_parser_t parser;
+    uint8_t report[8];
+    size_t length;
+} parser_case_t;
+
+// Modifier-free keyboard reports keep the keyboard watchdog idle during the benchmark
+static const parser_case_t bench_cases[] = {
+    { "mouse boot 3B",      parse_mouse,    { 0x01, 0x05, 0xFB },                         3 },
+    { "mouse wheel 4B",     parse_mouse,    { 0x00, 0x05, 0xFB, 0x01 },                   4 },
+    { "mouse 16-bit 7B",    parse_mouse,    { 0x00, 0x34, 0x01, 0xCC, 0xFE, 0x01, 0xFF }, 7 },
+    { "keyboard boot 8B",   parse_keyboard, { 0x00, 0x00, 0x04, 0x05, 0x00, 0x00, 0x00, 0x00 }, 8 },
+};
+
+// Cycles and nanoseconds per report for each representative report
+static void bench_parsers(void){
+    const uint32_t cycles_per_us = esp_rom_get_cpu_ticks_per_us();
+    espnow_message_t msg;
+    for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++){
+        const parser_case_t* bench = &bench_cases[i];
+        uint32_t start = esp_cpu_get_cycle_count();
+        for (int n = 0; n < BENCH_ITERATIONS; n++)
+            bench->parser(bench->report, bench->length, &msg);
+        uint32_t cycles = (esp_cpu_get_cycle_count() - start) / BENCH_ITERATIONS;
+        ESP_LOGI(TAG, "%-18s %4" PRIu32 " cycles/report, %5" PRIu32 " ns/report",
+                 bench->name, cycles, cycles * 1000 / cycles_per_us);
+    }
+}
+
+// Feed random reports of every length to each parser and check each one is either
+// rejected untouched or fully formatted. Nothing here notices a read past the report;
+// host_test/fuzz_parsers.c runs the parsers under AddressSanitizer for that.
+static void fuzz_parsers(void){
+    static const report_parser_t parsers[] = { parse_keyboard, parse_mouse };
+    static const size_t min_lengths[] = { 8, 3 };
+    static const uint8_t msg_types[] = { ESPNOW_MSG_KEYBOARD, ESPNOW_MSG_MOUSE };
+    uint8_t buf[FUZZ_MAX_REPORT_LEN];
+    uint32_t failures = 0;
+
+    for (int n = 0; n < FUZZ_ITERATIONS; n++){
+        size_t length = esp_random() % (FUZZ_MAX_REPORT_LEN + 1);
+        uint8_t* report = &buf[sizeof(buf) - length];
+        esp_fill_random(report, length);
+        // Keep modifiers clear so the keyboard watchdog stays idle
+        if (length > 0)
+            report[0] = 0;
+        for (size_t p = 0; p < sizeof(parsers) / sizeof(parsers[0]); p++){
+            espnow_message_t msg;
+            memset(&msg, 0xA5, sizeof(msg));
+            esp_err_t err = parsers[p](report, length, &msg);
+            bool expect_ok = length >= min_lengths[p];
+            if ((err == ESP_OK) != expect_ok || (expect_ok && msg.msg_type != msg_types[p]) ||
+                (!expect_ok && msg.msg_type != 0xA5)){
+                ESP_LOGW(TAG, "Parser %u misbehaved on a %u byte report", (unsigned)p, (unsigned)length);
+                failures++;
+            }
+        }
+    }
+    ESP_LOGI(TAG, "Fuzzed %d reports per parser: %" PRIu32 " failures", FUZZ_ITERATIONS, failures);
+}
+#endif
+
+void benchmark_report_parsers(void){
+#if BENCHMARK
+    bench_parsers();
+    fuzz_parsers();
+#endif
+}
@@ -0,0 +1,143 @@
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "timer/timer_service.h"
+#include "tx_scheduler.h"
+#include "devices.h"
+#include <string.h>
+
+#define ANNOUNCE_INTERVAL_US (1000000ULL) // Repeat DESC_INFO until the receiver has the descriptor
+
+static const char* TAG = "USB_TRANSMITTER // passthrough.c";
+
+// The single device whose reports are forwarded untouched
+static struct {
+    hid_host_device_handle_t handle;
+    const uint8_t* desc;
+    uint16_t desc_len;
+    uint16_t vid;
+    uint16_t pid;
+    uint32_t crc;
+    bool ready;         // receiver has confirmed the descriptor
+} passthrough = {0};
+
+static portMUX_TYPE passthrough_lock = portMUX_INITIALIZER_UNLOCKED;
+static service_timer_t announce_timer = NULL;
+
+static void announce(void){
+    espnow_msg_desc_info_t info = { .msg_type = ESPNOW_MSG_DESC_INFO };
+    portENTER_CRITICAL(&passthrough_lock);
+    bool active = passthrough.handle != NULL;
+    info.vid = passthrough.vid;
+    info.pid = passthrough.pid;
+    info.desc_len = passthrough.desc_len;
+    info.crc = passthrough.crc;
+    portEXIT_CRITICAL(&passthrough_lock);
+    if (active)
+        tx_scheduler_submit((const espnow_message_t*)&info, sizeof(info));
+}
+
+static void announce_timer_cb(void* arg){
+    if (passthrough.ready || passthrough.handle == NULL){
+        service_timer_cancel(announce_timer);
+        return;
+    }
+    announce();
+}
+
+// Queue every chunk from offset onwards; the receiver asks again from wherever a chunk went missing
+static void send_descriptor(uint16_t vid, uint16_t pid, uint16_t offset){
+    espnow_msg_desc_chunk_t chunk = { .msg_type = ESPNOW_MSG_DESC_CHUNK, .vid = vid, .pid = pid };
+    while (true){
+        bool done = false;
+        portENTER_CRITICAL(&passthrough_lock);
+        if (passthrough.handle == NULL || passthrough.vid != vid || passthrough.pid != pid || offset >= passthrough.desc_len)
+            done = true;
+        else {
+            uint16_t remaining = passthrough.desc_len - offset;
+            chunk.offset = offset;
+            chunk.len = (remaining < ESPNOW_DESC_CHUNK_LEN) ? remaining : ESPNOW_DESC_CHUNK_LEN;
+            memcpy(chunk.data, passthrough.desc + offset, chunk.len);
+        }
+        portEXIT_CRITICAL(&passthrough_lock);
+        if (done)
+            break;
+        if (tx_scheduler_submit((const espnow_message_t*)&chunk, sizeof(chunk)) != ESP_OK)
+            break;
+        offset += chunk.len;
+    }
+}
+
+bool is_passthrough_device(hid_host_device_handle_t handle){
+    return handle != NULL && handle == passthrough.handle;
+}
+
+esp_err_t passthrough_device_connected(hid_host_device_handle_t handle, uint16_t vid, uint16_t pid){
+    if (passthrough.handle != NULL){
+        ESP_LOGW(TAG, "%04X:%04X ignored, passthrough already in use by %04X:%04X", vid, pid, passthrough.vid, passthrough.pid);
+        return ESP_ERR_INVALID_STATE;
+    }
+    size_t desc_len = 0;
+    const uint8_t* desc = hid_host_get_report_descriptor(handle, &desc_len);
+    if (desc == NULL || desc_len == 0 || desc_len > ESPNOW_DESC_MAX_LEN){
+        ESP_LOGW(TAG, "%04X:%04X report descriptor unusable (%u bytes)", vid, pid, (unsigned)desc_len);
+        return ESP_FAIL;
+    }
+    uint32_t crc = esp_rom_crc32_le(0, desc, desc_len);
+
+    portENTER_CRITICAL(&passthrough_lock);
+    passthrough.handle = handle;
+    passthrough.desc = desc;
+    passthrough.desc_len = desc_len;
+    passthrough.vid = vid;
+    passthrough.pid = pid;
+    passthrough.crc = crc;
+    passthrough.ready = false;
+    portEXIT_CRITICAL(&passthrough_lock);
+
+    ESP_LOGI(TAG, "Passthrough %04X:%04X, %u byte report descriptor", vid, pid, (unsigned)desc_len);
+    announce();
+    return service_timer_start_periodic(announce_timer, ANNOUNCE_INTERVAL_US);
+}
+
+void passthrough_device_removed(hid_host_device_handle_t handle){
+    if (!is_passthrough_device(handle))
+        return;
+    portENTER_CRITICAL(&passthrough_lock);
+    passthrough.handle = NULL;
+    passthrough.desc = NULL;
+    passthrough.ready = false;
+    portEXIT_CRITICAL(&passthrough_lock);
+    service_timer_cancel(announce_timer);
+}
+
+// DESC_REQUEST / DESC_READY from the receiver
+void process_passthrough_message(const espnow_message_t* msg){
+    switch (msg->msg_type){
+        case ESPNOW_MSG_DESC_REQUEST: {
+            const espnow_msg_desc_request_t* request = &msg->desc_request_msg;
+            if (request->vid == 0 && request->pid == 0){
+                passthrough.ready = false;
+                announce();
+                service_timer_start_periodic(announce_timer, ANNOUNCE_INTERVAL_US);
+            }
+            else
+                send_descriptor(request->vid, request->pid, request->offset);
+            break;
+        }
+        case ESPNOW_MSG_DESC_READY:
+            if (msg->desc_info_msg.vid == passthrough.vid && msg->desc_info_msg.pid == passthrough.pid &&
+                msg->desc_info_msg.crc == passthrough.crc){
+                passthrough.ready = true;
+                service_timer_cancel(announce_timer);
+                ESP_LOGI(TAG, "Receiver enumerated passthrough %04X:%04X", passthrough.vid, passthrough.pid);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+esp_err_t init_passthrough(void){
+    return service_timer_create(&announce_timer, "pt_announce", announce_timer_cb, NULL);
+}
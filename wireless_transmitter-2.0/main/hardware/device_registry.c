@@ -0,0 +1,356 @@
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "timer/timer_service.h"
+#include "device_config.h"
+#include "devices.h"
+#include "device_registry.h"
+#include "tx_scheduler.h"
+#include "rtos/hot_path.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#define RATE_CAP_INTERVAL_US(hz) ((hz) ? (1000000UL / (hz)) : 0)
+
+static const char* TAG = "USB_TRANSMITTER // device_registry.c";
+
+// Newest report held back by a device's rate cap
+typedef struct {
+    uint8_t data[MAX_RAW_REPORT_LEN];
+    size_t length;
+    bool pending;
+    service_timer_t timer;
+} held_report_t;
+
+static input_device_t input_devices[MAX_INPUT_DEVICES] = {0};
+static held_report_t held_reports[MAX_INPUT_DEVICES] = {0};
+static portMUX_TYPE registry_lock = portMUX_INITIALIZER_UNLOCKED;
+static service_timer_t stats_timer = NULL;
+static service_timer_t characterize_timer = NULL;
+static service_timer_t coalesce_timer = NULL;
+// Set by the profile task under registry_lock; the window is only worked out and applied
+// on the timer service task
+static uint32_t coalesce_budget_us = 0;
+static bool budget_changed = false;
+static int64_t applied_window_us = -1;
+
+static const char* describe_device(const input_device_t* device){
+    switch (device->type){
+        case KEYBOARD:
+            return "keyboard";
+        case MOUSE:
+            return "mouse";
+        default:
+            return device->profile ? get_controller_name(device->profile) : "passthrough";
+    }
+}
+
+// Mouse motion is merged by the TX scheduler, so only state reports are worth capping
+static uint32_t rate_cap_interval(const input_device_t* device){
+    switch (device->type){
+        case KEYBOARD:
+            return RATE_CAP_INTERVAL_US(KEYBOARD_RATE_CAP_HZ);
+        case MOUSE:
+            return 0;
+        default:
+            return device->profile ? RATE_CAP_INTERVAL_US(GAMEPAD_RATE_CAP_HZ) : RATE_CAP_INTERVAL_US(PASSTHROUGH_RATE_CAP_HZ);
+    }
+}
+
+static device_type_t get_interface_type(hid_host_device_handle_t device_handle){
+    hid_host_dev_params_t dev_params;
+    hid_host_device_get_params(device_handle, &dev_params);
+    return (device_type_t)dev_params.proto;
+}
+
+input_device_t* registry_add_device(hid_host_device_handle_t handle){
+    for (int i = 0; i < MAX_INPUT_DEVICES; i++){
+        input_device_t* device = &input_devices[i];
+        if (device->handle != NULL)
+            continue;
+        memset(device, 0, sizeof(*device));
+        device->handle = handle;
+        device->index = i;
+        device->type = get_interface_type(handle);
+        hid_host_dev_info_t dev_info;
+        if (hid_host_get_device_info(handle, &dev_info) == ESP_OK){
+            device->vid = dev_info.VID;
+            device->pid = dev_info.PID;
+        }
+        if (device->type == OTHER)
+            device->profile = identify_controller(device->vid, device->pid);
+        device->min_interval_us = rate_cap_interval(device);
+        ESP_LOGI(TAG, "Device %d: %04X:%04X %s, rate cap %" PRIu32 " US", i, device->vid, device->pid,
+                 describe_device(device), device->min_interval_us);
+        return device;
+    }
+    return NULL;
+}
+
+void registry_remove_device(input_device_t* device){
+    held_report_t* held = &held_reports[device - input_devices];
+    service_timer_cancel(held->timer);
+    portENTER_CRITICAL(&registry_lock);
+    held->pending = false;
+    device->handle = NULL;
+    portEXIT_CRITICAL(&registry_lock);
+    tx_scheduler_forget_source(device->index);
+}
+
+input_device_t* registry_get_device(int index){
+    if (index < 0 || index >= MAX_INPUT_DEVICES || input_devices[index].handle == NULL)
+        return NULL;
+    return &input_devices[index];
+}
+
+// A report that changes key, button or hat state from the held one must not replace it,
+// or a press and release inside one capped interval would never reach the receiver.
+// Reports of unknown layout (passthrough) only ever replace.
+static bool HOT_PATH_ATTR changes_buttons(const input_device_t* device, const held_report_t* held,
+                                          const uint8_t* data, size_t length){
+    switch (device->type){
+        case KEYBOARD:
+            return held->length != length || memcmp(held->data, data, length) != 0;
+        case MOUSE:
+            return false;   // uncapped
+        default: {
+            espnow_msg_gamepad_t before, after;
+            if (device->profile == NULL ||
+                process_gamepad_report(device->profile, held->data, held->length, &before) != ESP_OK ||
+                process_gamepad_report(device->profile, data, length, &after) != ESP_OK)
+                return false;
+            return before.buttons != after.buttons || before.hat != after.hat;
+        }
+    }
+}
+
+bool HOT_PATH_ATTR registry_admit_report(input_device_t* device, const uint8_t* data, size_t length){
+    device_stats_t* stats = &device->stats;
+    int64_t now_us = esp_timer_get_time();
+    if (stats->last_report_us){
+        uint32_t delta_us = now_us - stats->last_report_us;
+        stats->interval_us = stats->interval_us ? stats->interval_us + ((int32_t)(delta_us - stats->interval_us) / 8) : delta_us;
+    }
+    stats->last_report_us = now_us;
+    stats->reports++;
+#if DEVICE_CHARACTERIZATION
+    portENTER_CRITICAL(&registry_lock);
+    timing_record(&device->timing, now_us, length);
+    portEXIT_CRITICAL(&registry_lock);
+#endif
+
+    held_report_t* held = &held_reports[device - input_devices];
+    int64_t next_allowed_us = stats->last_sent_us + device->min_interval_us;
+    if (device->min_interval_us == 0 || now_us >= next_allowed_us){
+        portENTER_CRITICAL(&registry_lock);
+        held->pending = false;
+        portEXIT_CRITICAL(&registry_lock);
+        stats->last_sent_us = now_us;
+        stats->sent++;
+        return true;
+    }
+    if (length > sizeof(held->data))
+        return true;
+
+    // Over the cap: keep only the newest report until the device's next slot, unless
+    // it changes button state -- then the held one goes out now and this one waits
+    uint8_t flushed[MAX_RAW_REPORT_LEN];
+    size_t flushed_length = 0;
+    portENTER_CRITICAL(&registry_lock);
+    if (held->pending){
+        if (changes_buttons(device, held, data, length)){
+            memcpy(flushed, held->data, held->length);
+            flushed_length = held->length;
+        }
+        else
+            stats->held++;
+    }
+    memcpy(held->data, data, length);
+    held->length = length;
+    held->pending = true;
+    portEXIT_CRITICAL(&registry_lock);
+    if (flushed_length){
+        stats->last_sent_us = now_us;
+        stats->sent++;
+        next_allowed_us = now_us + device->min_interval_us;
+        forward_input_report(device, flushed, flushed_length);
+        service_timer_start_once(held->timer, next_allowed_us - now_us);
+    }
+    else if (!service_timer_is_active(held->timer))
+        service_timer_start_once(held->timer, next_allowed_us - now_us);
+    return false;
+}
+
+static void held_report_timer_cb(void* arg){
+    input_device_t* device = (input_device_t*)arg;
+    held_report_t* held = &held_reports[device - input_devices];
+    uint8_t data[MAX_RAW_REPORT_LEN];
+    size_t length = 0;
+
+    portENTER_CRITICAL(&registry_lock);
+    if (held->pending && device->handle != NULL){
+        memcpy(data, held->data, held->length);
+        length = held->length;
+    }
+    held->pending = false;
+    portEXIT_CRITICAL(&registry_lock);
+    if (length == 0)
+        return;
+
+    device->stats.last_sent_us = esp_timer_get_time();
+    device->stats.sent++;
+    forward_input_report(device, data, length);
+}
+
+void registry_report_stats(void){
+    for (int i = 0; i < MAX_INPUT_DEVICES; i++){
+        const input_device_t* device = &input_devices[i];
+        if (device->handle == NULL)
+            continue;
+        uint32_t rate_hz = device->stats.interval_us ? 1000000UL / device->stats.interval_us : 0;
+        ESP_LOGI(TAG, "Device %d: %04X:%04X %-12s %5" PRIu32 " Hz, reports %" PRIu32 ", sent %" PRIu32 ", held %" PRIu32,
+                 i, device->vid, device->pid, describe_device(device), rate_hz,
+                 device->stats.reports, device->stats.sent, device->stats.held);
+    }
+}
+
+// The input task records into device->timing; readers work on a copy taken under the lock
+static void snapshot_timing(const input_device_t* device, report_timing_t* timing){
+    portENTER_CRITICAL(&registry_lock);
+    *timing = device->timing;
+    portEXIT_CRITICAL(&registry_lock);
+}
+
+static const char* describe_protocol(const input_device_t* device){
+    switch (device->type){
+        case KEYBOARD:
+            return "boot keyboard";
+        case MOUSE:
+            return "boot mouse";
+        default:
+            return "report protocol";
+    }
+}
+
+void registry_report_characterization(void){
+    for (int i = 0; i < MAX_INPUT_DEVICES; i++){
+        const input_device_t* device = &input_devices[i];
+        if (device->handle == NULL)
+            continue;
+        report_timing_t snapshot;
+        const report_timing_t* timing = &snapshot;
+        poll_estimate_t estimate;
+        snapshot_timing(device, &snapshot);
+        ESP_LOGI(TAG, "Device %d: %04X:%04X %s, %s, reports %u-%u bytes", i, device->vid, device->pid,
+                 describe_device(device), describe_protocol(device), timing->min_len, timing->max_len);
+        if (timing_estimate(timing, &estimate))
+            ESP_LOGI(TAG, "  poll %" PRIu32 " Hz: interval %" PRIu32 " US, jitter %" PRIu32 " US, p99 %" PRIu32 " US",
+                     estimate.poll_hz, estimate.interval_us, estimate.jitter_us, estimate.p99_us);
+        else
+            ESP_LOGI(TAG, "  poll rate unknown: %" PRIu32 " of %d busy intervals", timing->busy, TIMING_MIN_SAMPLES);
+        // Non-empty bins as upper edge:count
+        char line[160];
+        int used = 0;
+        for (int bin = 0; bin < TIMING_BINS && used < (int)sizeof(line) - 24; bin++){
+            if (timing->bins[bin] == 0)
+                continue;
+            uint32_t edge_us = timing_bin_edge_us(bin);
+            if (edge_us == UINT32_MAX)
+                used += snprintf(line + used, sizeof(line) - used, " >%" PRIu32 ":%" PRIu32,
+                                 timing_bin_edge_us(bin - 1), timing->bins[bin]);
+            else
+                used += snprintf(line + used, sizeof(line) - used, " <%" PRIu32 ":%" PRIu32, edge_us, timing->bins[bin]);
+        }
+        if (used)
+            ESP_LOGI(TAG, "  intervals (US)%s", line);
+    }
+}
+
+// The scheduler merges motion from every mouse, so the fastest one sizes the window.
+// Only from the timer service task, which runs the deferred timers one at a time.
+static void apply_coalesce_window(void){
+    portENTER_CRITICAL(&registry_lock);
+    uint32_t budget_us = coalesce_budget_us;
+    if (budget_changed)
+        applied_window_us = -1;
+    budget_changed = false;
+    portEXIT_CRITICAL(&registry_lock);
+
+    uint32_t window_us = budget_us;
+    uint32_t fastest_us = UINT32_MAX;
+    for (int i = 0; i < MAX_INPUT_DEVICES; i++){
+        const input_device_t* device = &input_devices[i];
+        report_timing_t timing;
+        poll_estimate_t estimate;
+        if (device->handle == NULL || device->type != MOUSE)
+            continue;
+        snapshot_timing(device, &timing);
+        if (!timing_estimate(&timing, &estimate))
+            continue;
+        if (estimate.interval_us < fastest_us){
+            fastest_us = estimate.interval_us;
+            window_us = timing_coalesce_window(&estimate, budget_us);
+        }
+    }
+    if (window_us == applied_window_us)
+        return;
+    applied_window_us = window_us;
+    tx_scheduler_set_coalesce_window(window_us);
+    ESP_LOGI(TAG, "Mouse coalescing window %" PRIu32 " US (budget %" PRIu32 " US)", window_us, budget_us);
+}
+
+// From the profile task; the window follows on the timer service task
+void registry_set_coalesce_budget(uint32_t budget_us){
+    portENTER_CRITICAL(&registry_lock);
+    coalesce_budget_us = budget_us;
+    budget_changed = true;
+    portEXIT_CRITICAL(&registry_lock);
+    if (coalesce_timer)
+        service_timer_start_once(coalesce_timer, 0);
+}
+
+static void coalesce_timer_cb(void* arg){
+    apply_coalesce_window();
+}
+
+static void characterize_timer_cb(void* arg){
+    registry_report_characterization();
+#if AUTO_COALESCE
+    apply_coalesce_window();
+#endif
+}
+
+static void stats_timer_cb(void* arg){
+    registry_report_stats();
+}
+
+esp_err_t init_device_registry(void){
+    for (int i = 0; i < MAX_INPUT_DEVICES; i++){
+        if (service_timer_create_deferred(&held_reports[i].timer, "rate_cap", held_report_timer_cb, &input_devices[i]) != ESP_OK)
+            return ESP_FAIL;
+    }
+    // A budget set before the registry was up is applied now
+    if (service_timer_create_deferred(&coalesce_timer, "coalesce", coalesce_timer_cb, NULL) != ESP_OK)
+        return ESP_FAIL;
+#if AUTO_COALESCE
+    service_timer_start_once(coalesce_timer, 0);
+#endif
+#if DEVICE_CHARACTERIZATION
+    if (service_timer_create_deferred(&characterize_timer, "characterize", characterize_timer_cb, NULL) != ESP_OK ||
+        service_timer_start_periodic(characterize_timer, DEVICE_CHARACTERIZATION_INTERVAL_US) != ESP_OK)
+        return ESP_FAIL;
+#else
+    (void)characterize_timer;
+    (void)characterize_timer_cb;
+#endif
+#if DEVICE_STATS_REPORT
+    if (service_timer_create_deferred(&stats_timer, "device_stats", stats_timer_cb, NULL) != ESP_OK)
+        return ESP_FAIL;
+    return service_timer_start_periodic(stats_timer, DEVICE_STATS_INTERVAL_US);
+#else
+    (void)stats_timer;
+    (void)stats_timer_cb;
+    return ESP_OK;
+#endif
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdbool.h>
+#include "esp_err.h"
+#include "hardware.h"
+
+// Claim a free slot for a newly connected device and work out how to parse its reports
+input_device_t* registry_add_device(hid_host_device_handle_t handle);
+
+void registry_remove_device(input_device_t* device);
+
+// Slot index of the registry, NULL if the slot is empty
+input_device_t* registry_get_device(int index);
+
+// Update the device's statistics and apply its rate cap.
+// Returns false if the report is held back; the newest held report is forwarded once the cap allows.
+bool registry_admit_report(input_device_t* device, const uint8_t* data, size_t length);
+
+// Log per-device report rates and counters
+void registry_report_stats(void);
+
+// Log each device's interval histogram, poll rate, jitter and report sizes (DEVICE_CHARACTERIZATION)
+void registry_report_characterization(void);
+
+// Latency the performance profile allows mouse motion to wait (AUTO_COALESCE); the
+// scheduler's window is sized from it and the fastest mouse's poll rate
+void registry_set_coalesce_budget(uint32_t budget_us);
+
+esp_err_t init_device_registry(void);
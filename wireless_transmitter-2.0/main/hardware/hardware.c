@@ -1,75 +1,111 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "wifi/wifi.h"
+#include "wifi/link_power.h"
 #include "devices.h"
+#include "hardware.h"
+#include "device_registry.h"
+#include "trace.h"
+#include "tx_scheduler.h"
+#include "rtos/ram_budget.h"
+#include "device_config.h"
+#include "rtos/hot_path.h"
+#include "log/deferred_log.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
 // #include "sleep.h"
 
-#define HID_INTERFACE_PROTOCOL_NONE     0
-#define HID_INTERFACE_PROTOCOL_KEYBOARD 1
-#define HID_INTERFACE_PROTOCOL_MOUSE    2
+static const char* TAG = "USB_TRANSMITTER // hardware.c";
 
-typedef enum {
-    KEYBOARD = HID_INTERFACE_PROTOCOL_KEYBOARD,
-    MOUSE = HID_INTERFACE_PROTOCOL_MOUSE,
-    OTHER = HID_INTERFACE_PROTOCOL_NONE
-} device_type_t;
+STATIC_TASK(usbh_task_mem, "usb_host", USB_HOST_TASK_STACK, USB_HOST_TASK_PRIORITY);
+STATIC_TASK(output_task_mem, "hid_output", HID_OUTPUT_TASK_STACK, HID_OUTPUT_TASK_PRIORITY);
+STATIC_QUEUE(output_queue_mem, "hid_output", HID_OUTPUT_QUEUE_LEN, espnow_msg_output_t);
 
-static const char* TAG = "USB_TRANSMITTER // hardware.c";
+static QueueHandle_t output_queue = NULL;
+// seq of the last report applied per target; retransmits of it are only acknowledged
+static int16_t applied_output_seq[NUM_OUTPUT_TARGETS] = { -1, -1 };
 
-static esp_err_t process_input_report(hid_host_device_handle_t hid_device_handle, device_type_t device_type){
-    uint8_t ret_val = ESP_FAIL;
-    uint8_t raw_data[32];
+static esp_err_t HOT_PATH_ATTR process_input_report(input_device_t* device){
+    uint8_t raw_data[MAX_RAW_REPORT_LEN];
     size_t data_length = 0;
-    if (hid_host_device_get_raw_input_report_data(hid_device_handle, raw_data, sizeof(raw_data), &data_length) == ESP_OK){
-        uint8_t* formatted_data = NULL;
-        size_t formatted_length = 0;
-        switch (device_type){
-            case KEYBOARD:
-                process_keyboard_report(raw_data, data_length,
-                                        &formatted_data, &formatted_length);
-                break;
-            case MOUSE:
-                process_mouse_report(raw_data, data_length,
-                                        &formatted_data, &formatted_length);
-                break;
-            case OTHER:
-            default:
-                // msg = process_gamepad_report(raw_data, data_length);
-                break;
-        }
-    
-        if (formatted_data != NULL){
-            ret_val = send_message(formatted_data, formatted_length);
-            free(formatted_data);
-        }
-    }
-    return ret_val;
+    if (hid_host_device_get_raw_input_report_data(device->handle, raw_data, sizeof(raw_data), &data_length) != ESP_OK)
+        return ESP_FAIL;
+    trace_record_report(device->handle, raw_data, data_length);
+#if CONFIG_WIRELESS_POWER_MANAGEMENT
+    link_power_note_input();
+#endif
+    // Only one unknown device at a time owns the receiver's passthrough interface
+    if (device->type == OTHER && device->profile == NULL && !is_passthrough_device(device->handle))
+        return ESP_OK;
+    if (!registry_admit_report(device, raw_data, data_length))
+        return ESP_OK;
+    return forward_input_report(device, raw_data, data_length);
 }
 
-static void hid_device_interface_callback(hid_host_device_handle_t hid_device_handle, const hid_host_interface_event_t event, void* arg){
+static void HOT_PATH_ATTR hid_device_interface_callback(hid_host_device_handle_t hid_device_handle, const hid_host_interface_event_t event, void* arg){
+    input_device_t* device = (input_device_t*)arg;
     switch (event) {
         case HID_HOST_INTERFACE_EVENT_INPUT_REPORT:
-            esp_err_t err = process_input_report(hid_device_handle, (device_type_t)arg);
-            if (err != ESP_OK) { ESP_LOGI(TAG, "Failed to process input-report: %s", esp_err_to_name(err)); }
+            esp_err_t err = process_input_report(device);
+            if (err != ESP_OK) { DLOGI(TAG, "Failed to process input-report: 0x%" PRIx32, (uint32_t)err); }
             break;
         case HID_HOST_INTERFACE_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "HID Device disconnected");
+            trace_forget_device(hid_device_handle);
+            passthrough_device_removed(hid_device_handle);
             hid_host_device_close(hid_device_handle);
+            registry_remove_device(device);
             break;
         case HID_HOST_INTERFACE_EVENT_TRANSFER_ERROR:
-            ESP_LOGW(TAG, "HID transfer error");
+            DLOGW(TAG, "HID transfer error");
             break;
         default:
-            ESP_LOGW(TAG, "Something went wrong with HID event. ");
+            DLOGW(TAG, "Something went wrong with HID event. ");
             break;
     }
 }
 
-static device_type_t get_interface_type(hid_host_device_handle_t device_handle){
-    hid_host_dev_params_t dev_params;
-    hid_host_device_get_params(device_handle, &dev_params);
-    return (device_type_t)dev_params.proto;
+static inline bool is_output_target(const input_device_t* device, uint8_t target){
+    if (target == OUTPUT_TARGET_KEYBOARD)
+        return device->type == KEYBOARD;
+    // A device without a profile is the passthrough device, not the receiver's gamepad
+    return device->type == OTHER && device->profile != NULL;
+}
+
+// SET_REPORT is a blocking control transfer, so it runs here rather than in the ESP-NOW callback
+static void output_task(void* arg){
+    espnow_msg_output_t msg;
+    while (true){
+        if (xQueueReceive(output_queue, &msg, portMAX_DELAY) != pdTRUE)
+            continue;
+        if (msg.target >= NUM_OUTPUT_TARGETS || msg.len > ESPNOW_OUTPUT_MAX_LEN)
+            continue;
+        if (applied_output_seq[msg.target] != msg.seq){
+            for (int i = 0; i < MAX_INPUT_DEVICES; i++){
+                const input_device_t* device = registry_get_device(i);
+                if (device == NULL || !is_output_target(device, msg.target))
+                    continue;
+                esp_err_t err = hid_class_request_set_report(device->handle, HID_REPORT_TYPE_OUTPUT, 0, msg.data, msg.len);
+                if (err != ESP_OK)
+                    ESP_LOGW(TAG, "Output report rejected: %s", esp_err_to_name(err));
+            }
+            applied_output_seq[msg.target] = msg.seq;
+        }
+        const espnow_msg_output_ack_t ack = { .msg_type = ESPNOW_MSG_OUTPUT_ACK, .target = msg.target, .seq = msg.seq };
+        tx_scheduler_submit((const espnow_message_t*)&ack, sizeof(ack));
+    }
+}
+
+esp_err_t enqueue_output_report(const espnow_msg_output_t* msg){
+    if (output_queue == NULL)
+        return ESP_FAIL;
+    bool sent = xQueueSend(output_queue, msg, 0) == pdTRUE;
+    ram_budget_note_send(&output_queue_mem, sent);
+    return sent ? ESP_OK : ESP_FAIL;
 }
 
 // Initliaze a connecting HID device
@@ -79,15 +115,26 @@ static void hid_host_device_callback(hid_host_device_handle_t hid_device_handle,
             // Allow time for stabilization
             ESP_LOGI(TAG, "HID Device connected");
 
+            input_device_t* device = registry_add_device(hid_device_handle);
+            if (device == NULL){
+                ESP_LOGW(TAG, "Too many HID devices, ignoring new device");
+                break;
+            }
+
             // Configure interface callback
             const hid_host_device_config_t dev_config = {
                 .callback = hid_device_interface_callback,
-                .callback_arg = (void*)get_interface_type(hid_device_handle)
+                .callback_arg = device
             };
             
             // Open and start device
             ESP_ERROR_CHECK(hid_host_device_open(hid_device_handle, &dev_config));
             ESP_ERROR_CHECK(hid_host_device_start(hid_device_handle));
+            trace_record_device(hid_device_handle, device->type);
+
+            // Unknown devices are mirrored by the receiver from their own report descriptor
+            if (device->type == OTHER && device->profile == NULL)
+                passthrough_device_connected(hid_device_handle, device->vid, device->pid);
             break;
         default: 
             break;
@@ -104,8 +151,13 @@ static void usbh_task(void *arg) {
 
 // Create USB host task and any other required setup
 void begin_usbh_task(void){
-    xTaskCreate(usbh_task, "usb_host", 8192, NULL, 5, NULL);
+    create_static_task(&usbh_task_mem, usbh_task, NULL);
+    output_queue = create_static_queue(&output_queue_mem);
+    create_static_task(&output_task_mem, output_task, NULL);
     begin_keyboard_watchdog();
+    init_device_registry();
+    init_passthrough();
+    begin_trace_tasks();
 }
 
 // Initialize MCU D-Pins & PHY for host_mode
@@ -121,8 +173,8 @@ void init_phy(void){
     // Install HID host driver
     const hid_host_driver_config_t hid_host_config = {
         .create_background_task = true,
-        .task_priority = 5,
-        .stack_size = 8192,
+        .task_priority = HID_HOST_TASK_PRIORITY,
+        .stack_size = HID_HOST_TASK_STACK,
         .callback = hid_host_device_callback,
         .callback_arg = NULL
     };
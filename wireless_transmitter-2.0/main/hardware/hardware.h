@@ -1,2 +1,51 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "usb/hid_host.h"
+#include "controller_profile.h"
+#include "report_timing.h"
+#include "wifi/msg_types.h"
+
+#define HID_INTERFACE_PROTOCOL_NONE     0
+#define HID_INTERFACE_PROTOCOL_KEYBOARD 1
+#define HID_INTERFACE_PROTOCOL_MOUSE    2
+
+typedef enum {
+    KEYBOARD = HID_INTERFACE_PROTOCOL_KEYBOARD,
+    MOUSE = HID_INTERFACE_PROTOCOL_MOUSE,
+    OTHER = HID_INTERFACE_PROTOCOL_NONE
+} device_type_t;
+
+#define MAX_INPUT_DEVICES 8
+#define MAX_RAW_REPORT_LEN 32
+
+typedef struct {
+    uint32_t reports;       // input reports received
+    uint32_t sent;          // reports handed to the TX scheduler
+    uint32_t held;          // reports superseded by a newer one while over the rate cap
+    uint32_t interval_us;   // smoothed time between reports
+    int64_t last_report_us;
+    int64_t last_sent_us;
+} device_stats_t;
+
+typedef struct {
+    hid_host_device_handle_t handle;
+    device_type_t type;
+    uint8_t index;                       // Registry slot, keys the device's state in the TX scheduler
+    const controller_profile_t* profile; // Report layout of OTHER devices, NULL if unknown (passthrough)
+    uint16_t vid;
+    uint16_t pid;
+    uint32_t min_interval_us;            // Rate cap, 0 = uncapped
+    device_stats_t stats;
+    report_timing_t timing;              // DEVICE_CHARACTERIZATION
+} input_device_t;
+
 void init_phy(void);
-void begin_usbh_task(void);
\ No newline at end of file
+void begin_usbh_task(void);
+
+// parse a raw input-report from the given device and send it to the receiver
+esp_err_t forward_input_report(const input_device_t* device, const uint8_t* data, size_t length);
+
+// Queue a host output report (LEDs, rumble) for the connected devices it targets
+esp_err_t enqueue_output_report(const espnow_msg_output_t* msg);
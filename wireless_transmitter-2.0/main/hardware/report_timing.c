@@ -0,0 +1,108 @@
+#include "report_timing.h"
+#include "rtos/hot_path.h"
+#include <math.h>
+
+// Bins 0-15 are 125 US wide up to 2 ms, 16-31 500 US wide up to 10 ms, then coarse
+#define FINE_BIN_US 125
+#define FINE_BINS 16
+#define MID_BIN_US 500
+#define MID_BINS 16
+#define FINE_END_US (FINE_BINS * FINE_BIN_US)
+#define MID_END_US (FINE_END_US + MID_BINS * MID_BIN_US)
+#define BUSY_BINS (FINE_BINS + MID_BINS + 1)    // through the one ending at TIMING_BUSY_US
+
+static const uint32_t coarse_edges_us[] = { TIMING_BUSY_US, 32000, 100000, UINT32_MAX };
+static const uint32_t standard_intervals_us[] = { 1000, 2000, 4000, 8000 };
+
+static inline int HOT_PATH_ATTR bin_of(uint32_t interval_us){
+    if (interval_us < FINE_END_US)
+        return interval_us / FINE_BIN_US;
+    if (interval_us < MID_END_US)
+        return FINE_BINS + (interval_us - FINE_END_US) / MID_BIN_US;
+    int bin = FINE_BINS + MID_BINS;
+    while (interval_us >= coarse_edges_us[bin - FINE_BINS - MID_BINS])
+        bin++;
+    return bin;
+}
+
+uint32_t timing_bin_edge_us(int bin){
+    if (bin < FINE_BINS)
+        return (bin + 1) * FINE_BIN_US;
+    if (bin < FINE_BINS + MID_BINS)
+        return FINE_END_US + (bin - FINE_BINS + 1) * MID_BIN_US;
+    return coarse_edges_us[bin - FINE_BINS - MID_BINS];
+}
+
+static inline uint32_t bin_start_us(int bin){
+    return bin ? timing_bin_edge_us(bin - 1) : 0;
+}
+
+void HOT_PATH_ATTR timing_record(report_timing_t* timing, int64_t now_us, size_t length){
+    if (timing->min_len == 0 || length < timing->min_len)
+        timing->min_len = length;
+    if (length > timing->max_len)
+        timing->max_len = length;
+    if (timing->last_us){
+        int64_t delta_us = now_us - timing->last_us;
+        uint32_t interval_us = delta_us > UINT32_MAX - 1 ? UINT32_MAX - 1 : (uint32_t)delta_us;
+        timing->bins[bin_of(interval_us)]++;
+        if (interval_us < TIMING_BUSY_US){
+            timing->busy++;
+            timing->busy_sum_us += interval_us;
+            timing->busy_sq_sum_us += (uint64_t)interval_us * interval_us;
+        }
+    }
+    timing->last_us = now_us;
+}
+
+// Where the busy intervals reach fraction of their count, interpolated inside the bin
+static uint32_t busy_percentile_us(const report_timing_t* timing, uint32_t per_mille, bool upper_edge){
+    uint64_t target = ((uint64_t)timing->busy * per_mille + 999) / 1000;
+    uint64_t seen = 0;
+    for (int bin = 0; bin < BUSY_BINS; bin++){
+        uint32_t count = timing->bins[bin];
+        if (count == 0 || seen + count < target){
+            seen += count;
+            continue;
+        }
+        if (upper_edge)
+            return timing_bin_edge_us(bin);
+        uint32_t start_us = bin_start_us(bin);
+        return start_us + (uint32_t)(((target - seen) * (timing_bin_edge_us(bin) - start_us)) / count);
+    }
+    return TIMING_BUSY_US;
+}
+
+bool timing_estimate(const report_timing_t* timing, poll_estimate_t* estimate){
+    if (timing->busy < TIMING_MIN_SAMPLES)
+        return false;
+    uint32_t median_us = busy_percentile_us(timing, 500, false);
+    estimate->interval_us = median_us ? median_us : 1;
+    estimate->p99_us = busy_percentile_us(timing, 990, true);
+
+    double mean = (double)timing->busy_sum_us / timing->busy;
+    double variance = (double)timing->busy_sq_sum_us / timing->busy - mean * mean;
+    estimate->jitter_us = variance > 0 ? (uint32_t)sqrt(variance) : 0;
+
+    estimate->poll_hz = 1000000UL / estimate->interval_us;
+    for (size_t i = 0; i < sizeof(standard_intervals_us) / sizeof(standard_intervals_us[0]); i++){
+        uint32_t standard_us = standard_intervals_us[i];
+        uint32_t off_us = median_us > standard_us ? median_us - standard_us : standard_us - median_us;
+        if (off_us <= standard_us / 8){
+            estimate->interval_us = standard_us;
+            estimate->poll_hz = 1000000UL / standard_us;
+            break;
+        }
+    }
+    return true;
+}
+
+uint32_t timing_coalesce_window(const poll_estimate_t* estimate, uint32_t budget_us){
+    uint32_t polls = budget_us / estimate->interval_us;
+    if (polls == 0)
+        return 0;
+    uint32_t margin_us = 2 * estimate->jitter_us;
+    if (margin_us > estimate->interval_us / 4)
+        margin_us = estimate->interval_us / 4;
+    return polls * estimate->interval_us + margin_us;
+}
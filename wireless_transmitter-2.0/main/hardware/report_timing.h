@@ -0,0 +1,46 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Device characterization (DEVICE_CHARACTERIZATION): a histogram of the time between
+// one device's input reports, and the poll rate it implies. Devices only report on
+// change, so idle gaps are part of the histogram but not of the estimate: the poll
+// interval is the median of the busy intervals (under TIMING_BUSY_US), snapped to the
+// standard 125 / 250 / 500 / 1000 Hz when close. Jitter is the spread of the busy
+// intervals around their mean.
+
+#define TIMING_BINS 36
+#define TIMING_BUSY_US 16000        // two missed polls at 125 Hz
+#define TIMING_MIN_SAMPLES 64       // busy intervals before a rate is reported
+
+typedef struct {
+    uint32_t bins[TIMING_BINS];     // intervals by TIMING_BIN_* edges, see timing_bin_edge_us()
+    uint32_t busy;
+    uint64_t busy_sum_us;
+    uint64_t busy_sq_sum_us;        // us^2, for the jitter
+    uint16_t min_len;               // report sizes seen
+    uint16_t max_len;
+    int64_t last_us;
+} report_timing_t;
+
+typedef struct {
+    uint32_t poll_hz;
+    uint32_t interval_us;           // median busy interval
+    uint32_t jitter_us;             // standard deviation of the busy intervals
+    uint32_t p99_us;                // 99th percentile busy interval (bin upper edge)
+} poll_estimate_t;
+
+// One input report at now_us
+void timing_record(report_timing_t* timing, int64_t now_us, size_t length);
+
+// Upper edge of a bin, UINT32_MAX for the last one
+uint32_t timing_bin_edge_us(int bin);
+
+// False until TIMING_MIN_SAMPLES busy intervals were seen
+bool timing_estimate(const report_timing_t* timing, poll_estimate_t* estimate);
+
+// Mouse coalescing window for a device: the whole poll intervals that fit in budget_us,
+// plus a jitter margin so the last report is not just missed; 0 if not even one fits
+// (waiting would only add latency)
+uint32_t timing_coalesce_window(const poll_estimate_t* estimate, uint32_t budget_us);
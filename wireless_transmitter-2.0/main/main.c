@@ -2,13 +2,27 @@
 #include "freertos/task.h"
 #include "wifi/wifi.h"
 #include "wifi/msg_types.h"
+#include "wifi/link_security.h"
+#include "wifi/pairing.h"
+#include "wifi/perf_profile.h"
+#include "wifi/link_power.h"
 #include "hardware.h"
+#include "device_registry.h"
+#include "devices.h"
+#include "tx_scheduler.h"
+#include "sleep.h"
+#include "ota_target.h"
 #include "esp_timer.h"
+#include "timer/timer_service.h"
 #include "esp_log.h"
 #include "device_config.h"
+#include "rtos/ram_budget.h"
+#include "log/deferred_log.h"
 #include "driver/gpio.h"
+#include <stdlib.h>
 
 #define LED_PIN GPIO_NUM_15
+#define BLINK_PERIOD_US (200000ULL)
 
 #define LOW_LOAD ENABLED
 #define MED_LOAD DISABLED
@@ -18,14 +32,50 @@
 static const char* TAG = "USB_TRANSMITTER // main.c";
 
 #if BENCHMARK
-int64_t time_start, time_end;
+static volatile int64_t time_start = 0;
+static volatile bool awaiting_reply = false;
+static int32_t rtt_samples[BENCHMARK_RTT_SAMPLES];
+static volatile uint32_t rtt_count = 0;
+
+static int compare_rtt(const void* a, const void* b){
+    return *(const int32_t*)a - *(const int32_t*)b;
+}
+
+// Check one round of pings against the edge latency and loss objectives
+static void report_rtt_round(uint32_t sent){
+    uint32_t count = rtt_count;
+    uint32_t lost = sent - count;
+    uint32_t loss_per_10000 = sent ? (lost * 10000) / sent : 0;
+    qsort(rtt_samples, count, sizeof(rtt_samples[0]), compare_rtt);
+    int32_t p50 = count ? rtt_samples[count / 2] : 0;
+    int32_t p99 = count ? rtt_samples[(count * 99) / 100] : 0;
+    int32_t max = count ? rtt_samples[count - 1] : 0;
+    ESP_LOGI(TAG, "RTT over %lu pings: p50 %ld, p99 %ld, max %ld US, lost %lu",
+             (unsigned long)sent, (long)p50, (long)p99, (long)max, (unsigned long)lost);
+#if CONFIG_WIRELESS_IMPAIRMENT
+    impairment_stats_t stats;
+    get_link_impairment_stats(&stats);
+    ESP_LOGI(TAG, "Impairment: %lu frames, %lu lost, %lu reordered, %lu duplicated", (unsigned long)stats.frames,
+             (unsigned long)stats.lost, (unsigned long)stats.reordered, (unsigned long)stats.duplicated);
+#endif
+    if (count && p99 < SLO_EDGE_P99_US && loss_per_10000 <= SLO_EDGE_LOSS_PER_10000)
+        ESP_LOGI(TAG, "SLO PASS");
+    else
+        ESP_LOGE(TAG, "SLO FAIL: p99 %ld US (limit %d), loss %lu/10000 (limit %d)", (long)p99, SLO_EDGE_P99_US,
+                 (unsigned long)loss_per_10000, SLO_EDGE_LOSS_PER_10000);
+}
 
 void benchmark_task(void* arg){
-    static espnow_msg_blank_t packet = { .msg_type = ESPNOW_MSG_START_RTT };
+    static const espnow_msg_blank_t packet = { .msg_type = ESPNOW_MSG_START_RTT };
     while(true){
-        if (send_message((uint8_t*)&packet, sizeof(packet)) == ESP_OK){
+        uint32_t sent = 0;
+        rtt_count = 0;
+        while (sent < BENCHMARK_RTT_SAMPLES){
+            // Pings ride the edge lane, so retries after a failed send count towards their latency
             time_start = esp_timer_get_time();
-        }
+            awaiting_reply = true;
+            if (tx_scheduler_submit((const espnow_message_t*)&packet, sizeof(packet)) == ESP_OK)
+                sent++;
 #if LOW_LOAD
             vTaskDelay(pdMS_TO_TICKS(LOW_LOAD_DEL_MS));
 #endif
@@ -35,19 +85,39 @@ void benchmark_task(void* arg){
 #if HIGH_LOAD
             vTaskDelay(pdMS_TO_TICKS(HIGH_LOAD_DEL_MS));
 #endif
+            awaiting_reply = false;
+        }
+        report_rtt_round(sent);
     }
 }
 #endif
 
 
 void process_message_cb(const espnow_message_t* msg){
-#if BENCHMARK
-    time_end = esp_timer_get_time();
-#endif
     switch(msg->msg_type){
+        case ESPNOW_MSG_OUTPUT:
+            enqueue_output_report(&msg->output_msg);
+            break;
+        case ESPNOW_MSG_DESC_REQUEST:
+        case ESPNOW_MSG_DESC_READY:
+            process_passthrough_message(msg);
+            break;
+#if OTA_UPDATE
+        case ESPNOW_MSG_OTA_BEGIN:
+            ota_target_begin(&msg->ota_begin_msg);
+            break;
+        case ESPNOW_MSG_OTA_CHUNK:
+            ota_target_chunk((const espnow_msg_ota_chunk_t*)msg);
+            break;
+#endif
 #if BENCHMARK
         case ESPNOW_MSG_END_RTT:
-            ESP_LOGI(TAG, "RRT: %lld US", (time_end - time_start));
+            // Only the first reply to the current ping; duplicates and late replies are ignored
+            if (awaiting_reply){
+                awaiting_reply = false;
+                if (rtt_count < BENCHMARK_RTT_SAMPLES)
+                    rtt_samples[rtt_count++] = esp_timer_get_time() - time_start;
+            }
             break;
 #endif
         default:
@@ -55,52 +125,103 @@ void process_message_cb(const espnow_message_t* msg){
     }
 }
 
-TaskHandle_t blink_task_handle = NULL;
+static service_timer_t blink_timer = NULL;
 
-void blink_task(void* arg){
-    (void)arg;
-    gpio_reset_pin(LED_PIN);
-    gpio_set_direction(LED_PIN, GPIO_MODE_OUTPUT);
-    while (true){
-        gpio_set_level(LED_PIN, 1);
-        vTaskDelay(pdMS_TO_TICKS(200));
-        gpio_set_level(LED_PIN, 0);
-        vTaskDelay(pdMS_TO_TICKS(200)); 
-    }
+static void blink_timer_cb(void* arg){
+    static uint32_t led_level = 0;
+    led_level ^= 1;
+    gpio_set_level(LED_PIN, led_level);
 }
 
-void begin_blink_task(void){
-    xTaskCreate(blink_task, "blink task", 2048, NULL, 3, &blink_task_handle);
+void begin_blink(void){
+    if (blink_timer == NULL){
+        gpio_reset_pin(LED_PIN);
+        gpio_set_direction(LED_PIN, GPIO_MODE_OUTPUT);
+        service_timer_create(&blink_timer, "blink", blink_timer_cb, NULL);
+    }
+    if (!service_timer_is_active(blink_timer))
+        service_timer_start_periodic(blink_timer, BLINK_PERIOD_US);
 }
 
-void end_blink_task(void){
-    if (blink_task_handle){
-        vTaskDelete(blink_task_handle);
-        blink_task_handle = NULL;
+void end_blink(void){
+    if (service_timer_is_active(blink_timer)){
+        service_timer_cancel(blink_timer);
         gpio_set_level(LED_PIN, 0);
     }
 }
 
+// The receiver follows the transmitter's profile
+static void send_perf_profile(void){
+    const espnow_msg_profile_t msg = { .msg_type = ESPNOW_MSG_PROFILE, .profile = get_perf_profile_id() };
+    tx_scheduler_submit((const espnow_message_t*)&msg, sizeof(msg));
+}
+
+// Called from the profile task once the link settings are switched
+void perf_profile_applied_cb(const perf_profile_t* profile){
+#if AUTO_COALESCE
+    registry_set_coalesce_budget(profile->coalesce_us);
+#else
+    tx_scheduler_set_coalesce_window(profile->coalesce_us);
+#endif
+    set_sleep_tiers(profile->light_sleep_s, profile->deep_sleep_s);
+#if CONFIG_WIRELESS_POWER_MANAGEMENT
+    set_link_power_idle(profile->power_idle_ms * 1000ULL);
+#endif
+    send_perf_profile();
+}
+
 void connection_status_cb(bool connection_status){
     ESP_LOGI(TAG, "Connection: %s", connection_status ? "CONNECTED" : "DISCONNECTED");
+    // Catch up a receiver that was off or out of range during a switch
+    if (connection_status)
+        send_perf_profile();
+#if OTA_UPDATE
+    if (connection_status)
+        ota_target_confirm_image();
+#endif
+}
+
+// Output reports only flow receiver -> transmitter
+bool handshake_piggyback_cb(espnow_msg_output_t* output){
+    (void)output;
+    return false;
+}
+
+// Queued behind input like any other message, so it never races a frame in flight
+void send_link_report_cb(const espnow_msg_link_report_t* report){
+    tx_scheduler_submit((const espnow_message_t*)report, sizeof(*report));
 }
 
 void paired_status_updated_cb(bool paired_status){
     ESP_LOGI(TAG, "Paired: %s", paired_status ? "YES" : "NO");
     if (!paired_status){
-        begin_pairing_task();
-        begin_blink_task();
+        begin_pairing();
+        begin_blink();
     }
     else
-        end_blink_task();
+        end_blink();
 }
 
 void app_main(void){
     init_phy();
-    start_espnow();
-    unpair(); // strictly for testing
+    ESP_ERROR_CHECK(init_pairing(PAIRING_INITIATOR));
+    start_link();
+#if CONFIG_WIRELESS_POWER_MANAGEMENT
+    ESP_ERROR_CHECK(init_link_power(POWER_IDLE_RELEASE_US));
+#endif
+    ESP_ERROR_CHECK(begin_deferred_log());
+    ESP_ERROR_CHECK(begin_tx_scheduler());
+    ESP_ERROR_CHECK(init_perf_profile());
+#if OTA_UPDATE
+    ESP_ERROR_CHECK(begin_ota_target());
+#endif
     begin_usbh_task();
+#if RAM_BUDGET_REPORT
+    ESP_ERROR_CHECK(begin_ram_budget_report(RAM_BUDGET_REPORT_INTERVAL_US));
+#endif
 #if BENCHMARK
+    benchmark_report_parsers();
+    benchmark_link_security();
     xTaskCreate(benchmark_task, "benchmark_task", 4096, NULL, 4, NULL);
 #endif
 }
@@ -0,0 +1,273 @@
+#include "ota_target.h"
+#include "device_config.h"
+#include "tx_scheduler.h"
+#include "wifi/wifi.h"
+#include "rtos/ram_budget.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "mbedtls/sha256.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <inttypes.h>
+#include <string.h>
+
+// The SHA-256 only shows the image arrived whole; esp_ota_end() checks who signed it,
+// against the public key built in, only with signed apps (or secure boot)
+#if OTA_UPDATE && !CONFIG_SECURE_SIGNED_ON_UPDATE
+#error "OTA_UPDATE takes signed images: set CONFIG_SECURE_SIGNED_APPS_NO_SECURE_BOOT (sdkconfig.defaults) or enable secure boot"
+#endif
+
+#define OTA_ACK_EVERY 8                     // chunks written per ack while they flow
+#define OTA_ACK_GAP_US (5000LL)             // acks on a gap or a repeat, at most this often
+#define OTA_ACK_INTERVAL_MS 50              // ... and while chunks wait for a missing one
+#define OTA_DONE_ACKS 3
+#define OTA_RESTART_DELAY_US (1000000LL)
+
+static const char* TAG = "USB_TRANSMITTER // ota_target.c";
+
+// Shared between the WiFi task and the update task
+static struct {
+    uint8_t state;              // __espnow_ota_state_t
+    uint32_t size;
+    uint8_t sha256[ESPNOW_OTA_HASH_LEN];
+    uint32_t written;           // chunks in flash
+    uint32_t held;              // bit i: chunk written + i waits in the window
+    bool ack_due;
+    bool begin_pending;
+    espnow_msg_ota_begin_t begin;
+} update = { .state = OTA_STATE_IDLE };
+static portMUX_TYPE ota_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Chunk i waits in slot i % ESPNOW_OTA_WINDOW; a slot is only filled while its bit is clear
+static uint8_t window[ESPNOW_OTA_WINDOW][ESPNOW_OTA_CHUNK_LEN];
+static uint8_t window_len[ESPNOW_OTA_WINDOW];
+
+// Only touched by the update task
+static const esp_partition_t* partition = NULL;
+static esp_ota_handle_t handle = 0;
+static mbedtls_sha256_context sha;
+static int64_t done_us = 0;
+
+STATIC_TASK(ota_task_mem, "ota_target", OTA_TASK_STACK, OTA_TASK_PRIORITY);
+static TaskHandle_t ota_task_handle = NULL;
+
+static inline uint32_t chunk_len(uint32_t size, uint32_t index){
+    uint32_t offset = index * ESPNOW_OTA_CHUNK_LEN;
+    return (size - offset < ESPNOW_OTA_CHUNK_LEN) ? size - offset : ESPNOW_OTA_CHUNK_LEN;
+}
+
+static void send_ack(void){
+    espnow_msg_ota_ack_t ack = { .msg_type = ESPNOW_MSG_OTA_ACK };
+    portENTER_CRITICAL(&ota_lock);
+    ack.state = update.state;
+    ack.written = update.written;
+    ack.received = update.held;
+    update.ack_due = false;
+    portEXIT_CRITICAL(&ota_lock);
+    tx_scheduler_submit((const espnow_message_t*)&ack, sizeof(ack));
+}
+
+static void set_state(uint8_t state){
+    portENTER_CRITICAL(&ota_lock);
+    update.state = state;
+    update.ack_due = true;
+    portEXIT_CRITICAL(&ota_lock);
+}
+
+static void fail_update(const char* what, esp_err_t err){
+    ESP_LOGE(TAG, "Update failed, %s: %s", what, esp_err_to_name(err));
+    if (handle){
+        esp_ota_abort(handle);
+        handle = 0;
+    }
+    mbedtls_sha256_free(&sha);
+    set_state(OTA_STATE_FAILED);
+}
+
+static void start_update(const espnow_msg_ota_begin_t* begin){
+    portENTER_CRITICAL(&ota_lock);
+    // The receiver repeats BEGIN until it hears back
+    bool same = update.size == begin->size && memcmp(update.sha256, begin->sha256, ESPNOW_OTA_HASH_LEN) == 0 &&
+                (update.state == OTA_STATE_RECEIVING || update.state == OTA_STATE_DONE);
+    update.ack_due = true;
+    portEXIT_CRITICAL(&ota_lock);
+    if (same || done_us)
+        return;
+
+    if (handle){
+        esp_ota_abort(handle);
+        handle = 0;
+        mbedtls_sha256_free(&sha);
+    }
+    partition = esp_ota_get_next_update_partition(NULL);
+    if (partition == NULL || begin->size > partition->size){
+        ESP_LOGE(TAG, "No OTA partition fits a %" PRIu32 " byte image", begin->size);
+        set_state(OTA_STATE_FAILED);
+        return;
+    }
+    // Erased sector by sector as it is written, not all up front
+    esp_err_t err = esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &handle);
+    if (err != ESP_OK){
+        handle = 0;
+        ESP_LOGE(TAG, "esp_ota_begin: %s", esp_err_to_name(err));
+        set_state(OTA_STATE_FAILED);
+        return;
+    }
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    portENTER_CRITICAL(&ota_lock);
+    update.state = OTA_STATE_RECEIVING;
+    update.size = begin->size;
+    memcpy(update.sha256, begin->sha256, ESPNOW_OTA_HASH_LEN);
+    update.written = 0;
+    update.held = 0;
+    portEXIT_CRITICAL(&ota_lock);
+    ESP_LOGI(TAG, "Receiving a %" PRIu32 " byte image into %s", begin->size, partition->label);
+}
+
+static void finish_update(void){
+    uint8_t digest[ESPNOW_OTA_HASH_LEN];
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
+    if (memcmp(digest, update.sha256, sizeof(digest)) != 0){
+        fail_update("image hash", ESP_ERR_INVALID_CRC);
+        return;
+    }
+    // Checks the image itself and its signature
+    esp_err_t err = esp_ota_end(handle);
+    handle = 0;
+    if (err == ESP_OK)
+        err = esp_ota_set_boot_partition(partition);
+    if (err != ESP_OK){
+        ESP_LOGE(TAG, "Update failed, image rejected: %s", esp_err_to_name(err));
+        set_state(OTA_STATE_FAILED);
+        return;
+    }
+    done_us = esp_timer_get_time();
+    set_state(OTA_STATE_DONE);
+    ESP_LOGI(TAG, "Image verified, restarting into %s", partition->label);
+}
+
+// Writes every chunk that follows the ones in flash; returns how many
+static uint32_t write_held_chunks(void){
+    uint32_t count = 0;
+    while (true){
+        portENTER_CRITICAL(&ota_lock);
+        bool ready = update.state == OTA_STATE_RECEIVING && (update.held & 1);
+        uint32_t index = update.written;
+        portEXIT_CRITICAL(&ota_lock);
+        if (!ready)
+            return count;
+
+        uint8_t slot = index % ESPNOW_OTA_WINDOW;
+        esp_err_t err = esp_ota_write(handle, window[slot], window_len[slot]);
+        if (err != ESP_OK){
+            fail_update("flash write", err);
+            return count;
+        }
+        mbedtls_sha256_update(&sha, window[slot], window_len[slot]);
+        portENTER_CRITICAL(&ota_lock);
+        update.held >>= 1;
+        update.written++;
+        bool complete = (uint64_t)update.written * ESPNOW_OTA_CHUNK_LEN >= update.size;
+        portEXIT_CRITICAL(&ota_lock);
+        count++;
+        if (complete){
+            finish_update();
+            return count;
+        }
+    }
+}
+
+static void ota_task(void* arg){
+    uint32_t unacked = 0;
+    uint8_t done_acks = 0;
+    int64_t last_ack_us = 0;
+    while (true){
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(OTA_ACK_INTERVAL_MS));
+        portENTER_CRITICAL(&ota_lock);
+        bool begin_pending = update.begin_pending;
+        update.begin_pending = false;
+        espnow_msg_ota_begin_t begin = update.begin;
+        portEXIT_CRITICAL(&ota_lock);
+        if (begin_pending)
+            start_update(&begin);
+
+        unacked += write_held_chunks();
+        int64_t now_us = esp_timer_get_time();
+        portENTER_CRITICAL(&ota_lock);
+        uint8_t state = update.state;
+        bool ack_due = update.ack_due;
+        bool waiting = update.held != 0;
+        portEXIT_CRITICAL(&ota_lock);
+
+        bool ack = unacked >= OTA_ACK_EVERY ||
+                   (ack_due && now_us - last_ack_us >= OTA_ACK_GAP_US) ||
+                   ((unacked || waiting) && now_us - last_ack_us >= OTA_ACK_INTERVAL_MS * 1000LL);
+        // The last ack may be lost; the receiver takes repeats
+        if (state == OTA_STATE_DONE && done_acks < OTA_DONE_ACKS && now_us - last_ack_us >= OTA_ACK_INTERVAL_MS * 1000LL){
+            ack = true;
+            done_acks++;
+        }
+        if (ack){
+            send_ack();
+            unacked = 0;
+            last_ack_us = now_us;
+        }
+        if (done_us && now_us - done_us >= OTA_RESTART_DELAY_US)
+            esp_restart();
+    }
+}
+
+void ota_target_begin(const espnow_msg_ota_begin_t* begin){
+    // Frames on a link in clear could come from anyone in range
+    if (!is_link_encrypted()){
+        ESP_LOGW(TAG, "Update refused, the link is not encrypted");
+        set_state(OTA_STATE_FAILED);
+        xTaskNotifyGive(ota_task_handle);
+        return;
+    }
+    portENTER_CRITICAL(&ota_lock);
+    update.begin = *begin;
+    update.begin_pending = true;
+    portEXIT_CRITICAL(&ota_lock);
+    xTaskNotifyGive(ota_task_handle);
+}
+
+void ota_target_chunk(const espnow_msg_ota_chunk_t* chunk){
+    portENTER_CRITICAL(&ota_lock);
+    uint32_t bit = chunk->index - update.written;
+    if (update.state != OTA_STATE_RECEIVING || chunk->index < update.written || bit >= ESPNOW_OTA_WINDOW ||
+        (uint64_t)chunk->index * ESPNOW_OTA_CHUNK_LEN >= update.size){
+        // A repeat, or ahead of the window: tell the receiver where the update stands
+        update.ack_due = true;
+    }
+    else if (!(update.held & (1u << bit)) && chunk->len == chunk_len(update.size, chunk->index)){
+        uint8_t slot = chunk->index % ESPNOW_OTA_WINDOW;
+        memcpy(window[slot], chunk->data, chunk->len);
+        window_len[slot] = chunk->len;
+        update.held |= 1u << bit;
+        // Arrived past a missing chunk: ask for it now rather than at the next interval
+        if (!(update.held & 1))
+            update.ack_due = true;
+    }
+    portEXIT_CRITICAL(&ota_lock);
+    xTaskNotifyGive(ota_task_handle);
+}
+
+void ota_target_confirm_image(void){
+    esp_ota_img_states_t state;
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    if (esp_ota_get_state_partition(running, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY){
+        esp_ota_mark_app_valid_cancel_rollback();
+        ESP_LOGI(TAG, "Updated image reached its receiver, keeping it");
+    }
+}
+
+esp_err_t begin_ota_target(void){
+    ota_task_handle = create_static_task(&ota_task_mem, ota_task, NULL);
+    return ota_task_handle ? ESP_OK : ESP_FAIL;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "esp_err.h"
+#include "wifi/msg_types.h"
+
+// Firmware update streamed by the receiver (OTA_UPDATE, see ota_source.h there).
+// Chunks are held in a window of ESPNOW_OTA_WINDOW until the ones before them arrive,
+// then written in order straight into the inactive OTA partition and hashed on the
+// way. Only an image whose SHA-256 matches ESPNOW_MSG_OTA_BEGIN and whose signature
+// checks out (signed apps, sdkconfig.defaults) is set to boot, and only an encrypted
+// link may start an update.
+// Acks go through the TX scheduler behind input, and the writing task runs below
+// every input task; flash erases still stall code outside IRAM, so input outside
+// the hot path may see a few ms of delay per 4 KB sector.
+
+// From the WiFi task
+void ota_target_begin(const espnow_msg_ota_begin_t* begin);
+void ota_target_chunk(const espnow_msg_ota_chunk_t* chunk);
+
+// The link came up: an updated image still on trial (rollback enabled) is kept
+void ota_target_confirm_image(void);
+
+esp_err_t begin_ota_target(void);
@@ -0,0 +1,511 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "wifi/wifi.h"
+#include "tx_scheduler.h"
+#include "rtos/ram_budget.h"
+#include "device_config.h"
+#include "rtos/hot_path.h"
+#include "log/deferred_log.h"
+#include "timer/timer_service.h"
+#include <string.h>
+
+#define TX_MAX_RETRIES 3
+#define TX_BUNDLE_MAX_FRAMES 8
+#define TX_IN_FLIGHT_TIMEOUT_US (20000LL) // Give up on a send callback after 20ms
+#if MOUSE_POSITION
+#define MOUSE_FRAME_LEN sizeof(espnow_msg_mouse_position_t)
+#else
+#define MOUSE_FRAME_LEN sizeof(espnow_msg_mouse_t)
+#endif
+
+static const char* TAG = "USB_TRANSMITTER // tx_scheduler.c";
+
+typedef enum {
+    TX_LANE_EDGE,    // Keyboard reports, mouse button and gamepad button/hat changes
+    TX_LANE_GAMEPAD, // Latest gamepad state
+    TX_LANE_MOTION   // Accumulated mouse motion
+} tx_lane_t;
+
+typedef enum {
+    TX_NONE,
+    TX_SENT,
+    TX_FAILED
+} tx_completion_t;
+
+typedef struct {
+    espnow_message_t msg;
+    uint8_t length;
+    uint8_t lane;
+    uint8_t retries;
+    uint8_t source;     // input device the frame's state belongs to
+} tx_frame_t;
+
+STATIC_TASK(tx_scheduler_task_mem, "tx_scheduler", TX_SCHEDULER_TASK_STACK, TX_SCHEDULER_TASK_PRIORITY);
+STATIC_QUEUE(edge_queue_mem, "tx_edge", TX_EDGE_QUEUE_LEN, tx_frame_t);
+
+static QueueHandle_t edge_queue = NULL;
+// Mouse and gamepad edges still queued -- state of that class may not overtake them
+static int16_t queued_mouse_edges = 0;
+static int16_t queued_gamepad_edges[TX_SCHEDULER_MAX_SOURCES] = {0};
+static TaskHandle_t tx_scheduler_task_handle = NULL;
+static portMUX_TYPE tx_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Gamepad lane -- only the newest state of each gamepad is worth sending
+static struct {
+    espnow_msg_gamepad_t pending;
+    bool dirty;
+    uint8_t hat;
+    uint32_t buttons;
+} gamepads[TX_SCHEDULER_MAX_SOURCES] = {0};
+static uint8_t next_gamepad = 0;    // first gamepad offered a place in the next frame
+
+// Buttons each mouse holds; the receiver has one pointer, so their motion shares
+// mouse_acc and its buttons are all of these combined
+static uint8_t mouse_buttons[TX_SCHEDULER_MAX_SOURCES] = {0};
+
+// Motion lane -- deltas summed while the radio is busy
+static struct {
+    uint8_t buttons;
+    int32_t x, y, wheel, pan;
+    uint32_t timestamp_us;
+    int64_t since_us;       // when motion started accumulating
+    bool dirty;
+} mouse_acc = {0};
+
+#if MOUSE_POSITION
+// Wrapping sums of all motion submitted, sent in place of the deltas (ESPNOW_MSG_MOUSE_POSITION)
+static struct {
+    uint32_t x, y, wheel, pan;
+    uint32_t epoch;     // drawn at begin_tx_scheduler()
+    uint16_t seq;
+} mouse_position = {0};
+#endif
+
+// Motion alone waits up to this long for more motion to share its frame; 0 sends at once
+static uint32_t coalesce_window_us = 0;
+static service_timer_t coalesce_timer = NULL;
+
+// Frames sharing the radio frame currently awaiting its send completion; completions
+// of every other frame to the peer carry other tokens
+static tx_frame_t in_flight_frames[TX_BUNDLE_MAX_FRAMES];
+static size_t in_flight_count = 0;
+static bool in_flight = false;
+static uint32_t in_flight_token = SEND_TOKEN_NONE;
+static int64_t in_flight_since_us = 0;
+static tx_completion_t completion = TX_NONE;
+static service_timer_t in_flight_timer = NULL;
+
+static inline int8_t clamp32to8(int32_t val) { return (val < -128) ? -128 : ((val > 127) ? 127 : val); }
+
+#if MOUSE_POSITION
+// Must be called with tx_lock held
+static void HOT_PATH_ATTR advance_position(const espnow_msg_mouse_t* msg){
+    mouse_position.x += msg->x;
+    mouse_position.y += msg->y;
+    mouse_position.wheel += msg->wheel;
+    mouse_position.pan += msg->pan;
+}
+
+// Fill frame with the counters as they stand; must be called with tx_lock held
+static void HOT_PATH_ATTR position_frame(tx_frame_t* frame, uint8_t buttons, uint32_t timestamp_us){
+    espnow_msg_mouse_position_t* msg = &frame->msg.mouse_position_msg;
+    msg->msg_type = ESPNOW_MSG_MOUSE_POSITION;
+    msg->buttons = buttons;
+    msg->seq = mouse_position.seq++;
+    msg->epoch = mouse_position.epoch;
+    msg->x = mouse_position.x;
+    msg->y = mouse_position.y;
+    msg->wheel = mouse_position.wheel;
+    msg->pan = mouse_position.pan;
+    msg->timestamp_us = timestamp_us;
+    frame->length = sizeof(*msg);
+}
+
+// The counters carry all accumulated motion at once, however much there is
+// Must be called with tx_lock held
+static void HOT_PATH_ATTR take_mouse_frame(tx_frame_t* frame){
+    position_frame(frame, mouse_acc.buttons, mouse_acc.timestamp_us);
+    mouse_acc.x = mouse_acc.y = mouse_acc.wheel = mouse_acc.pan = 0;
+    mouse_acc.dirty = false;
+    frame->lane = TX_LANE_MOTION;
+    frame->retries = 0;
+}
+#else
+// Move as much accumulated motion as fits in one report into frame; the remainder stays queued
+// Must be called with tx_lock held
+static void HOT_PATH_ATTR take_mouse_frame(tx_frame_t* frame){
+    espnow_msg_mouse_t* msg = &frame->msg.mouse_msg;
+    msg->msg_type = ESPNOW_MSG_MOUSE;
+    msg->buttons = mouse_acc.buttons;
+    msg->x = clamp32to8(mouse_acc.x);
+    msg->y = clamp32to8(mouse_acc.y);
+    msg->wheel = clamp32to8(mouse_acc.wheel);
+    msg->pan = clamp32to8(mouse_acc.pan);
+    msg->timestamp_us = mouse_acc.timestamp_us;
+    mouse_acc.x -= msg->x;
+    mouse_acc.y -= msg->y;
+    mouse_acc.wheel -= msg->wheel;
+    mouse_acc.pan -= msg->pan;
+    mouse_acc.dirty = mouse_acc.x || mouse_acc.y || mouse_acc.wheel || mouse_acc.pan;
+    frame->length = sizeof(*msg);
+    frame->lane = TX_LANE_MOTION;
+    frame->retries = 0;
+}
+#endif
+
+static void HOT_PATH_ATTR count_edge(const tx_frame_t* frame, int16_t delta){
+    portENTER_CRITICAL(&tx_lock);
+    if (frame->msg.msg_type == ESPNOW_MSG_MOUSE || frame->msg.msg_type == ESPNOW_MSG_MOUSE_POSITION)
+        queued_mouse_edges += delta;
+    else if (frame->msg.msg_type == ESPNOW_MSG_GAMEPAD)
+        queued_gamepad_edges[frame->source] += delta;
+    portEXIT_CRITICAL(&tx_lock);
+}
+
+static esp_err_t HOT_PATH_ATTR push_edge(const tx_frame_t* frame){
+    count_edge(frame, 1);
+    bool sent = xQueueSend(edge_queue, frame, 0) == pdTRUE;
+    ram_budget_note_send(&edge_queue_mem, sent);
+    if (!sent){
+        count_edge(frame, -1);
+        DLOGW(TAG, "Edge queue full, dropping message %d", frame->msg.msg_type);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// A button change closes the current motion frame so presses and releases are never merged
+static esp_err_t HOT_PATH_ATTR submit_mouse(uint8_t source, const espnow_msg_mouse_t* msg){
+    tx_frame_t pending, edge = { .length = sizeof(*msg), .lane = TX_LANE_EDGE, .source = source };
+    bool has_pending = false, is_edge = false;
+
+    portENTER_CRITICAL(&tx_lock);
+    mouse_buttons[source] = msg->buttons;
+    uint8_t buttons = 0;
+    for (int i = 0; i < TX_SCHEDULER_MAX_SOURCES; i++)
+        buttons |= mouse_buttons[i];
+    if (buttons != mouse_acc.buttons){
+        if (mouse_acc.dirty){
+            // Flush everything accumulated under the previous button state
+            take_mouse_frame(&pending);
+            pending.lane = TX_LANE_EDGE;
+            has_pending = true;
+        }
+        mouse_acc.buttons = buttons;
+        mouse_acc.x = mouse_acc.y = mouse_acc.wheel = mouse_acc.pan = 0;
+        mouse_acc.dirty = false;
+#if MOUSE_POSITION
+        advance_position(msg);
+        position_frame(&edge, buttons, msg->timestamp_us);
+#else
+        edge.msg.mouse_msg = *msg;
+        edge.msg.mouse_msg.buttons = buttons;
+#endif
+        is_edge = true;
+    }
+    else {
+#if MOUSE_POSITION
+        advance_position(msg);
+#endif
+        mouse_acc.x += msg->x;
+        mouse_acc.y += msg->y;
+        mouse_acc.wheel += msg->wheel;
+        mouse_acc.pan += msg->pan;
+        mouse_acc.timestamp_us = msg->timestamp_us;
+        if (!mouse_acc.dirty)
+            mouse_acc.since_us = esp_timer_get_time();
+        mouse_acc.dirty = true;
+    }
+    portEXIT_CRITICAL(&tx_lock);
+
+    esp_err_t err = ESP_OK;
+    if (has_pending)
+        err = push_edge(&pending);
+    if (is_edge && push_edge(&edge) != ESP_OK)
+        err = ESP_FAIL;
+    return err;
+}
+
+// Button and hat changes are edges; axis-only updates overwrite the gamepad's pending state
+static esp_err_t HOT_PATH_ATTR submit_gamepad(uint8_t source, const espnow_msg_gamepad_t* msg){
+    bool is_edge;
+    portENTER_CRITICAL(&tx_lock);
+    is_edge = (msg->buttons != gamepads[source].buttons) || (msg->hat != gamepads[source].hat);
+    gamepads[source].buttons = msg->buttons;
+    gamepads[source].hat = msg->hat;
+    gamepads[source].pending = *msg;
+    gamepads[source].dirty = !is_edge;
+    portEXIT_CRITICAL(&tx_lock);
+
+    if (!is_edge)
+        return ESP_OK;
+    tx_frame_t edge = { .length = sizeof(*msg), .lane = TX_LANE_EDGE, .source = source };
+    edge.msg.gamepad_msg = *msg;
+    return push_edge(&edge);
+}
+
+esp_err_t HOT_PATH_ATTR tx_scheduler_submit(const espnow_message_t* msg, size_t length){
+    return tx_scheduler_submit_input(0, msg, length);
+}
+
+esp_err_t HOT_PATH_ATTR tx_scheduler_submit_input(uint8_t source, const espnow_message_t* msg, size_t length){
+    esp_err_t err;
+    // Link callbacks may fire before begin_tx_scheduler()
+    if (edge_queue == NULL)
+        return ESP_ERR_INVALID_STATE;
+    source %= TX_SCHEDULER_MAX_SOURCES;
+    switch (msg->msg_type){
+        case ESPNOW_MSG_MOUSE:
+            err = submit_mouse(source, &msg->mouse_msg);
+            break;
+        case ESPNOW_MSG_GAMEPAD:
+            err = submit_gamepad(source, &msg->gamepad_msg);
+            break;
+        default: {
+            tx_frame_t edge = { .length = length, .lane = TX_LANE_EDGE, .source = source };
+            memcpy(&edge.msg, msg, length);
+            err = push_edge(&edge);
+            break;
+        }
+    }
+    if (tx_scheduler_task_handle)
+        xTaskNotifyGive(tx_scheduler_task_handle);
+    return err;
+}
+
+void tx_scheduler_forget_source(uint8_t source){
+    source %= TX_SCHEDULER_MAX_SOURCES;
+    portENTER_CRITICAL(&tx_lock);
+    mouse_buttons[source] = 0;
+    gamepads[source].dirty = false;
+    gamepads[source].buttons = 0;
+    gamepads[source].hat = 0;
+    portEXIT_CRITICAL(&tx_lock);
+}
+
+// Only this task takes from the queue, so the edge peeked at is the one received
+static bool HOT_PATH_ATTR pop_edge_if_fits(tx_frame_t* frame, size_t space){
+    if (xQueuePeek(edge_queue, frame, 0) != pdTRUE || frame->length + 1u > space)
+        return false;
+    xQueueReceive(edge_queue, frame, 0);
+    count_edge(frame, -1);
+    return true;
+}
+
+static bool HOT_PATH_ATTR push_edge_front(const tx_frame_t* frame){
+    count_edge(frame, 1);
+    if (xQueueSendToFront(edge_queue, frame, 0) == pdTRUE)
+        return true;
+    count_edge(frame, -1);
+    return false;
+}
+
+// Motion that is alone in a frame waits out the coalescing window; must be called with tx_lock held
+static inline bool HOT_PATH_ATTR motion_due(size_t count, int64_t* wait_us){
+    if (count > 0 || coalesce_window_us == 0)
+        return true;
+    *wait_us = mouse_acc.since_us + coalesce_window_us - esp_timer_get_time();
+    return *wait_us <= 0;
+}
+
+// Fill one radio frame: queued edges from every device in arrival order, then gamepad state
+// and mouse motion. State only rides along once no older edge of its class is still queued.
+static size_t HOT_PATH_ATTR next_bundle(tx_frame_t frames[TX_BUNDLE_MAX_FRAMES]){
+    size_t count = 0;
+    size_t space = ESPNOW_BUNDLE_MAX_LEN - sizeof(espnow_msg_bundle_t);
+    tx_frame_t frame;
+    // An edge that does not fit stays queued for the next frame
+    while (count < TX_BUNDLE_MAX_FRAMES && pop_edge_if_fits(&frame, space)){
+        frames[count++] = frame;
+        space -= frame.length + 1u;
+    }
+
+    portENTER_CRITICAL(&tx_lock);
+    // Rotate the first gamepad offered a place so none is starved of frames
+    for (int i = 0; i < TX_SCHEDULER_MAX_SOURCES; i++){
+        uint8_t source = (next_gamepad + i) % TX_SCHEDULER_MAX_SOURCES;
+        if (!gamepads[source].dirty || queued_gamepad_edges[source] != 0)
+            continue;
+        if (count >= TX_BUNDLE_MAX_FRAMES || sizeof(espnow_msg_gamepad_t) + 1u > space)
+            break;
+        tx_frame_t* state = &frames[count++];
+        state->msg.gamepad_msg = gamepads[source].pending;
+        state->length = sizeof(espnow_msg_gamepad_t);
+        state->lane = TX_LANE_GAMEPAD;
+        state->retries = 0;
+        state->source = source;
+        gamepads[source].dirty = false;
+        space -= sizeof(espnow_msg_gamepad_t) + 1u;
+    }
+    next_gamepad = (next_gamepad + 1) % TX_SCHEDULER_MAX_SOURCES;
+    int64_t wait_us = 0;
+    if (mouse_acc.dirty && queued_mouse_edges == 0 && count < TX_BUNDLE_MAX_FRAMES &&
+        MOUSE_FRAME_LEN + 1u <= space){
+        if (motion_due(count, &wait_us))
+            take_mouse_frame(&frames[count++]);
+    }
+    portEXIT_CRITICAL(&tx_lock);
+    if (wait_us > 0 && !service_timer_is_active(coalesce_timer))
+        service_timer_start_once(coalesce_timer, wait_us);
+    return count;
+}
+
+// A lone message goes out as-is; several share one ESPNOW_MSG_BUNDLE frame
+static esp_err_t HOT_PATH_ATTR send_bundle(const tx_frame_t* frames, size_t count, uint32_t token){
+    if (count == 1)
+        return send_message_tagged((const uint8_t*)&frames[0].msg, frames[0].length, token);
+    uint8_t buf[ESPNOW_BUNDLE_MAX_LEN];
+    espnow_msg_bundle_t* bundle = (espnow_msg_bundle_t*)buf;
+    bundle->msg_type = ESPNOW_MSG_BUNDLE;
+    bundle->count = count;
+    size_t length = sizeof(*bundle);
+    for (size_t i = 0; i < count; i++){
+        buf[length++] = frames[i].length;
+        memcpy(buf + length, &frames[i].msg, frames[i].length);
+        length += frames[i].length;
+    }
+    return send_message_tagged(buf, length, token);
+}
+
+// Put an unsent or failed frame back so its content is not lost
+static void HOT_PATH_ATTR requeue_frame(tx_frame_t* frame){
+    switch (frame->lane){
+        case TX_LANE_EDGE:
+            if (frame->retries++ < TX_MAX_RETRIES && !push_edge_front(frame))
+                DLOGW(TAG, "Edge queue full, dropping retried message %d", frame->msg.msg_type);
+            break;
+        case TX_LANE_GAMEPAD:
+            portENTER_CRITICAL(&tx_lock);
+            if (!gamepads[frame->source].dirty){
+                gamepads[frame->source].pending = frame->msg.gamepad_msg;
+                gamepads[frame->source].dirty = true;
+            }
+            portEXIT_CRITICAL(&tx_lock);
+            break;
+        case TX_LANE_MOTION:
+            portENTER_CRITICAL(&tx_lock);
+#if MOUSE_POSITION
+            // The motion is still in the counters; the next frame takes them as they are then
+            if (frame->msg.mouse_position_msg.buttons == mouse_acc.buttons)
+                mouse_acc.dirty = true;
+#else
+            if (frame->msg.mouse_msg.buttons == mouse_acc.buttons){
+                mouse_acc.x += frame->msg.mouse_msg.x;
+                mouse_acc.y += frame->msg.mouse_msg.y;
+                mouse_acc.wheel += frame->msg.mouse_msg.wheel;
+                mouse_acc.pan += frame->msg.mouse_msg.pan;
+                mouse_acc.dirty = true;
+            }
+#endif
+            portEXIT_CRITICAL(&tx_lock);
+            break;
+    }
+}
+
+// Requeue in reverse so edges return to the front in their original order
+static void HOT_PATH_ATTR requeue_bundle(tx_frame_t* frames, size_t count){
+    while (count > 0)
+        requeue_frame(&frames[--count]);
+}
+
+// Take the in-flight frame's outcome, if it has one; a frame whose completion is overdue
+// counts as failed so a lost send callback neither stalls the lanes nor loses its edges.
+// Returns true while the frame is still in flight.
+static bool HOT_PATH_ATTR take_completion(tx_completion_t* result){
+    portENTER_CRITICAL(&tx_lock);
+    *result = completion;
+    completion = TX_NONE;
+    if (in_flight && (esp_timer_get_time() - in_flight_since_us) >= TX_IN_FLIGHT_TIMEOUT_US){
+        in_flight = false;
+        *result = TX_FAILED;
+    }
+    bool busy = in_flight;
+    portEXIT_CRITICAL(&tx_lock);
+    return busy;
+}
+
+// Keeps at most one radio frame in flight; espnow_send_cb() paces the lanes
+static void HOT_PATH_ATTR tx_scheduler_task(void* arg){
+    tx_frame_t frames[TX_BUNDLE_MAX_FRAMES];
+    size_t count;
+    while (true){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (true){
+            // A completion may land at any point; it is taken before in_flight_frames is reused
+            tx_completion_t result;
+            bool busy = take_completion(&result);
+            if (result == TX_FAILED)
+                requeue_bundle(in_flight_frames, in_flight_count);
+            if (busy || (count = next_bundle(frames)) == 0)
+                break;
+
+            memcpy(in_flight_frames, frames, count * sizeof(tx_frame_t));
+            in_flight_count = count;
+            uint32_t token = new_send_token();
+            portENTER_CRITICAL(&tx_lock);
+            in_flight = true;
+            in_flight_token = token;
+            in_flight_since_us = esp_timer_get_time();
+            portEXIT_CRITICAL(&tx_lock);
+            service_timer_start_once(in_flight_timer, TX_IN_FLIGHT_TIMEOUT_US);
+
+            if (send_bundle(frames, count, token) != ESP_OK){
+                // Radio queue full: keep the frames and retry on the next completion
+                portENTER_CRITICAL(&tx_lock);
+                in_flight = false;
+                portEXIT_CRITICAL(&tx_lock);
+                requeue_bundle(frames, count);
+                break;
+            }
+        }
+    }
+}
+
+// Coalescing window over, or the in-flight frame's completion overdue
+static void wake_timer_cb(void* arg){
+    if (tx_scheduler_task_handle)
+        xTaskNotifyGive(tx_scheduler_task_handle);
+}
+
+// Takes effect on the next frame
+void tx_scheduler_set_coalesce_window(uint32_t window_us){
+    portENTER_CRITICAL(&tx_lock);
+    coalesce_window_us = window_us;
+    portEXIT_CRITICAL(&tx_lock);
+    if (tx_scheduler_task_handle)
+        xTaskNotifyGive(tx_scheduler_task_handle);
+}
+
+// send callback -- invoked by wifi.c for every frame to the peer; only the in-flight
+// frame's own completion, matched by its token, frees the lanes
+void HOT_PATH_ATTR send_status_cb(uint32_t token, bool success){
+    portENTER_CRITICAL(&tx_lock);
+    if (in_flight && token == in_flight_token){
+        in_flight = false;
+        completion = success ? TX_SENT : TX_FAILED;
+    }
+    portEXIT_CRITICAL(&tx_lock);
+    if (tx_scheduler_task_handle)
+        xTaskNotifyGive(tx_scheduler_task_handle);
+}
+
+esp_err_t begin_tx_scheduler(void){
+#if MOUSE_POSITION
+    mouse_position.epoch = esp_random();
+#endif
+    if (service_timer_create(&coalesce_timer, "tx_coalesce", wake_timer_cb, NULL) != ESP_OK ||
+        service_timer_create(&in_flight_timer, "tx_in_flight", wake_timer_cb, NULL) != ESP_OK)
+        return ESP_FAIL;
+    edge_queue = create_static_queue(&edge_queue_mem);
+    if (edge_queue == NULL)
+        return ESP_FAIL;
+    tx_scheduler_task_handle = create_static_task(&tx_scheduler_task_mem, tx_scheduler_task, NULL);
+    if (tx_scheduler_task_handle == NULL)
+        return ESP_FAIL;
+    return ESP_OK;
+}
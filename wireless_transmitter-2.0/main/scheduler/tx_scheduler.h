@@ -0,0 +1,29 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "wifi/msg_types.h"
+
+// Queue a formatted message for transmission.
+// Keyboard reports and button/hat changes are sent first, gamepad state next and
+// mouse motion last; motion and gamepad state are merged while a frame is in flight,
+// and everything waiting when the radio frees up shares the next frame.
+// With MOUSE_POSITION, mouse messages go out as ESPNOW_MSG_MOUSE_POSITION counters.
+esp_err_t tx_scheduler_submit(const espnow_message_t* msg, size_t length);
+
+// One per registry slot (MAX_INPUT_DEVICES)
+#define TX_SCHEDULER_MAX_SOURCES 8
+
+// As tx_scheduler_submit(), for an input report from the device in registry slot source:
+// each gamepad keeps its own pending state, and the mouse buttons sent are those every
+// mouse holds combined
+esp_err_t tx_scheduler_submit_input(uint8_t source, const espnow_message_t* msg, size_t length);
+
+// The device in registry slot source is gone: drop its buttons and pending gamepad state
+void tx_scheduler_forget_source(uint8_t source);
+
+// Let mouse motion that would go out alone wait up to window_us for more motion (0 = never wait)
+void tx_scheduler_set_coalesce_window(uint32_t window_us);
+
+esp_err_t begin_tx_scheduler(void);
@@ -1,26 +1,37 @@
 #include "esp_timer.h"
 #include "esp_log.h"
 #include "device_config.h"
+#include "sleep.h"
 
 #define US_IN_S 1000000ULL
 #define LIGHT_SLEEP_DUR_US (LIGHT_SLEEP_DUR_S * US_IN_S)
 #define DEEP_SLEEP_DUR_US (DEEP_SLEEP_DUR_S * US_IN_S)
 
+#if SLEEP
 static const char* TAG = "USB_TRANSMITTER // sleep.c";
 
-#if SLEEP
+static uint64_t light_sleep_us = LIGHT_SLEEP_DUR_US;
+static uint64_t deep_sleep_us = DEEP_SLEEP_DUR_US;
+
+// (Re)start a tier's countdown; a tier of 0 stays off
+static void arm_tier(esp_timer_handle_t timer, uint64_t timeout_us){
+    esp_timer_stop(timer);
+    if (timeout_us)
+        esp_timer_start_once(timer, timeout_us);
+}
+
 static esp_timer_handle_t lsm_timer;
-static void enter_lsm(void){
+static void enter_lsm(void* arg){
     ESP_LOGI(TAG, "Entering Light Sleep");
     ESP_LOGI(TAG, "Exiting Light Sleep");
-    esp_timer_start_once(lsm_timer, LIGHT_SLEEP_DUR_US);
+    arm_tier(lsm_timer, light_sleep_us);
 }
 #if DEEP_SLEEP
 static esp_timer_handle_t dsm_timer;
-static void enter_dsm(void){
+static void enter_dsm(void* arg){
     ESP_LOGI(TAG, "Entering Deep Sleep");
     ESP_LOGI(TAG, "Exiting Deep Sleep");
-    esp_timer_start_once(dsm_timer, DEEP_SLEEP_DUR_US);
+    arm_tier(dsm_timer, deep_sleep_us);
 }
 #endif
 #endif
@@ -29,20 +40,33 @@ void start_sleep_timers(void){
     #if SLEEP
     esp_timer_create_args_t lsm_timer_args = { .callback = enter_lsm };
     esp_timer_create(&lsm_timer_args, &lsm_timer);
-    esp_timer_start_once(lsm_timer, LIGHT_SLEEP_DUR_US);
+    arm_tier(lsm_timer, light_sleep_us);
     #if DEEP_SLEEP
     esp_timer_create_args_t dsm_timer_args = { .callback = enter_dsm };
     esp_timer_create(&dsm_timer_args, &dsm_timer);
-    esp_timer_start_once(dsm_timer, DEEP_SLEEP_DUR_US);
+    arm_tier(dsm_timer, deep_sleep_us);
     #endif
     #endif
 }
 
 void reset_timers(void){
     #if SLEEP
-    esp_timer_restart(lsm_timer, LIGHT_SLEEP_DUR_US);
+    if (lsm_timer == NULL)
+        return;
+    arm_tier(lsm_timer, light_sleep_us);
     #if DEEP_SLEEP
-    esp_timer_restart(dsm_timer, DEEP_SLEEP_DUR_US);
+    arm_tier(dsm_timer, deep_sleep_us);
     #endif
     #endif
+}
+
+void set_sleep_tiers(uint32_t light_s, uint32_t deep_s){
+    #if SLEEP
+    light_sleep_us = light_s * US_IN_S;
+    deep_sleep_us = deep_s * US_IN_S;
+    reset_timers();
+    #else
+    (void)light_s;
+    (void)deep_s;
+    #endif
 }
\ No newline at end of file
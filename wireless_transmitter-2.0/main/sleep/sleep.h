@@ -1,2 +1,7 @@
+#pragma once
+#include <stdint.h>
+
 void start_sleep_timers(void);
-void reset_timers(void);
\ No newline at end of file
+void reset_timers(void);
+// Idle time before each sleep tier, 0 = never (performance profiles); restarts the countdown
+void set_sleep_tiers(uint32_t light_s, uint32_t deep_s);
@@ -0,0 +1,244 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "device_config.h"
+#include "trace.h"
+#include "devices.h"
+#include <string.h>
+#include <inttypes.h>
+
+#if TRACE_CAPTURE || TRACE_REPLAY
+static const char* TAG = "USB_TRANSMITTER // trace.c";
+#endif
+
+#if TRACE_CAPTURE
+static uint8_t trace_buf[TRACE_BUFFER_SIZE];
+static size_t trace_len = 0;
+static bool trace_full = false;
+static int64_t last_report_us = 0;
+static hid_host_device_handle_t trace_devices[TRACE_MAX_DEVICES] = {0};
+static TaskHandle_t trace_dump_task_handle = NULL;
+
+static void trace_dump(void){
+    if (trace_dump_task_handle)
+        xTaskNotifyGive(trace_dump_task_handle);
+}
+
+// Stop capturing and dump the trace once the buffer cannot hold another entry
+static void trace_mark_full(void){
+    if (!trace_full){
+        trace_full = true;
+        ESP_LOGW(TAG, "Trace buffer full, capture stopped");
+        trace_dump();
+    }
+}
+
+// Append bytes to the capture buffer, marking the trace as full when they do not fit
+static bool trace_append(const void* data, size_t len){
+    if (trace_full)
+        return false;
+    if (trace_len + len > sizeof(trace_buf)){
+        trace_mark_full();
+        return false;
+    }
+    memcpy(&trace_buf[trace_len], data, len);
+    trace_len += len;
+    return true;
+}
+
+static int find_device(hid_host_device_handle_t handle){
+    for (int i = 0; i < TRACE_MAX_DEVICES; i++){
+        if (trace_devices[i] == handle)
+            return i;
+    }
+    return -1;
+}
+
+// Print the capture buffer between markers so trace_extract.py can rebuild the binary file
+static void trace_dump_task(void* arg){
+    while (true){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        ESP_LOGI(TAG, "TRACE BEGIN %u", (unsigned)trace_len);
+        for (size_t offset = 0; offset < trace_len; offset += 256){
+            size_t chunk = (trace_len - offset < 256) ? (trace_len - offset) : 256;
+            ESP_LOG_BUFFER_HEX(TAG, &trace_buf[offset], chunk);
+        }
+        ESP_LOGI(TAG, "TRACE END");
+    }
+}
+#endif
+
+void trace_record_device(hid_host_device_handle_t handle, device_type_t device_type){
+#if TRACE_CAPTURE
+    if (trace_len == 0){
+        const trace_header_t header = { .magic = TRACE_MAGIC, .version = TRACE_VERSION };
+        trace_append(&header, sizeof(header));
+    }
+    int dev_id = find_device(NULL);
+    if (dev_id < 0){
+        ESP_LOGW(TAG, "Too many devices to trace");
+        return;
+    }
+    hid_host_dev_info_t dev_info = {0};
+    hid_host_get_device_info(handle, &dev_info);
+    size_t desc_len = 0;
+    const uint8_t* desc = hid_host_get_report_descriptor(handle, &desc_len);
+    if (desc == NULL)
+        desc_len = 0;
+
+    const trace_device_t entry = {
+        .entry_type = TRACE_ENTRY_DEVICE,
+        .dev_id = dev_id,
+        .vid = dev_info.VID,
+        .pid = dev_info.PID,
+        .proto = device_type,
+        .desc_len = desc_len
+    };
+    if (trace_append(&entry, sizeof(entry)) && trace_append(desc, desc_len))
+        trace_devices[dev_id] = handle;
+#else
+    (void)handle;
+    (void)device_type;
+#endif
+}
+
+void trace_record_report(hid_host_device_handle_t handle, const uint8_t* data, size_t length){
+#if TRACE_CAPTURE
+    int dev_id = find_device(handle);
+    if (dev_id < 0 || length > UINT8_MAX)
+        return;
+    int64_t now_us = esp_timer_get_time();
+    const trace_report_t entry = {
+        .entry_type = TRACE_ENTRY_REPORT,
+        .dev_id = dev_id,
+        .len = length,
+        .delta_us = (last_report_us == 0) ? 0 : (uint32_t)(now_us - last_report_us)
+    };
+    // Never write a partial entry
+    if (trace_len + sizeof(entry) + length > sizeof(trace_buf)){
+        trace_mark_full();
+        return;
+    }
+    trace_append(&entry, sizeof(entry));
+    trace_append(data, length);
+    last_report_us = now_us;
+#else
+    (void)handle;
+    (void)data;
+    (void)length;
+#endif
+}
+
+void trace_forget_device(hid_host_device_handle_t handle){
+#if TRACE_CAPTURE
+    int dev_id = find_device(handle);
+    if (dev_id < 0)
+        return;
+    trace_devices[dev_id] = NULL;
+    // Dump what has been captured so far once the last device leaves
+    for (int i = 0; i < TRACE_MAX_DEVICES; i++){
+        if (trace_devices[i] != NULL)
+            return;
+    }
+    if (!trace_full)
+        trace_dump();
+#else
+    (void)handle;
+#endif
+}
+
+#if TRACE_REPLAY
+#define TICK_US (portTICK_PERIOD_MS * 1000LL)
+
+// Sleep for the bulk of the wait, then spin for sub-tick accuracy
+static void wait_until(int64_t deadline_us){
+    int64_t remaining_us = deadline_us - esp_timer_get_time();
+    if (remaining_us > 2 * TICK_US)
+        vTaskDelay((remaining_us / TICK_US) - 1);
+    while (esp_timer_get_time() < deadline_us) {}
+}
+
+esp_err_t trace_replay(const uint8_t* trace, size_t len, uint32_t speed, trace_replay_stats_t* stats){
+    const uint8_t* const end = trace + len;
+    const trace_header_t* header = (const trace_header_t*)trace;
+    *stats = (trace_replay_stats_t){0};
+    if (len < sizeof(*header) || header->magic != TRACE_MAGIC || header->version != TRACE_VERSION)
+        return ESP_ERR_INVALID_ARG;
+    input_device_t devices[TRACE_MAX_DEVICES] = {0};
+    int64_t start_us = esp_timer_get_time();
+    int64_t trace_time_us = 0;
+    const uint8_t* cursor = trace + sizeof(*header);
+
+    while (cursor < end){
+        if (*cursor == TRACE_ENTRY_DEVICE){
+            const trace_device_t* entry = (const trace_device_t*)cursor;
+            // A truncated trace ends at the last complete entry
+            if ((size_t)(end - cursor) < sizeof(*entry) ||
+                (size_t)(end - cursor) - sizeof(*entry) < entry->desc_len)
+                break;
+            if (entry->dev_id < TRACE_MAX_DEVICES){
+                devices[entry->dev_id].type = (device_type_t)entry->proto;
+                devices[entry->dev_id].index = entry->dev_id;
+                devices[entry->dev_id].profile = identify_controller(entry->vid, entry->pid);
+            }
+            ESP_LOGI(TAG, "Replaying device %d: %04X:%04X", entry->dev_id, entry->vid, entry->pid);
+            cursor += sizeof(*entry) + entry->desc_len;
+        }
+        else if (*cursor == TRACE_ENTRY_REPORT){
+            const trace_report_t* entry = (const trace_report_t*)cursor;
+            if ((size_t)(end - cursor) < sizeof(*entry))
+                break;
+            const uint8_t* data = cursor + sizeof(*entry);
+            if ((size_t)(end - data) < entry->len || entry->dev_id >= TRACE_MAX_DEVICES)
+                break;
+            trace_time_us += entry->delta_us;
+            if (speed > 0)
+                wait_until(start_us + trace_time_us / speed);
+            if (forward_input_report(&devices[entry->dev_id], data, entry->len) != ESP_OK)
+                stats->failed++;
+            stats->reports++;
+            cursor = data + entry->len;
+        }
+        else {
+            ESP_LOGW(TAG, "Corrupt trace entry at offset %d", (int)(cursor - trace));
+            break;
+        }
+    }
+    stats->elapsed_us = esp_timer_get_time() - start_us;
+    return ESP_OK;
+}
+#endif
+
+#if TRACE_REPLAY && defined(TRACE_EMBEDDED)
+extern const uint8_t replay_trc_start[] asm("_binary_replay_trc_start");
+extern const uint8_t replay_trc_end[]   asm("_binary_replay_trc_end");
+
+// Push the embedded trace through the live parsing and sending path
+static void trace_replay_task(void* arg){
+    for (int loop = 0; loop < TRACE_REPLAY_LOOPS; loop++){
+        trace_replay_stats_t stats;
+        if (trace_replay(replay_trc_start, replay_trc_end - replay_trc_start, TRACE_REPLAY_SPEED, &stats) != ESP_OK){
+            ESP_LOGW(TAG, "Embedded trace is not a valid trace file");
+            break;
+        }
+        ESP_LOGI(TAG, "Replay %d: %" PRIu32 " reports (%" PRIu32 " failed) in %" PRId64 " US, %" PRId64 " reports/s",
+                 loop, stats.reports, stats.failed, stats.elapsed_us,
+                 stats.elapsed_us ? (stats.reports * 1000000LL / stats.elapsed_us) : 0);
+    }
+    vTaskDelete(NULL);
+}
+#endif
+
+void begin_trace_tasks(void){
+#if TRACE_CAPTURE
+    xTaskCreate(trace_dump_task, "trace_dump", 4096, NULL, 1, &trace_dump_task_handle);
+#endif
+#if TRACE_REPLAY
+#if defined(TRACE_EMBEDDED)
+    xTaskCreate(trace_replay_task, "trace_replay", 4096, NULL, 4, NULL);
+#else
+    ESP_LOGW(TAG, "TRACE_REPLAY enabled but no trace/replay.trc was embedded");
+#endif
+#endif
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "usb/hid_host.h"
+#include "hardware.h"
+
+// Binary trace layout (little endian, packed):
+//   trace_header_t
+//   followed by any number of entries, each starting with its entry_type:
+//     trace_device_t + desc_len bytes of HID report descriptor
+//     trace_report_t + len bytes of raw input-report
+// Reports reference the device entry that precedes them through dev_id.
+// delta_us is the time since the previous report in the trace.
+
+#define TRACE_MAGIC 0x45435254 // "TRCE"
+#define TRACE_VERSION 1
+#define TRACE_MAX_DEVICES 8
+
+typedef enum {
+    TRACE_ENTRY_DEVICE,
+    TRACE_ENTRY_REPORT
+} trace_entry_type_t;
+
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t magic;     // TRACE_MAGIC
+    uint8_t version;    // TRACE_VERSION
+    uint8_t reserved[3];
+} trace_header_t;
+
+typedef struct {
+    uint8_t entry_type; // TRACE_ENTRY_DEVICE
+    uint8_t dev_id;     // Index referenced by subsequent reports
+    uint16_t vid;
+    uint16_t pid;
+    uint8_t proto;      // device_type_t the device was opened as
+    uint16_t desc_len;  // Length of the report descriptor that follows
+} trace_device_t;
+
+typedef struct {
+    uint8_t entry_type; // TRACE_ENTRY_REPORT
+    uint8_t dev_id;
+    uint8_t len;        // Length of the raw report that follows
+    uint32_t delta_us;  // Time since the previous report
+} trace_report_t;
+#pragma pack(pop)
+
+// Capture (TRACE_CAPTURE) -- no-ops when disabled
+void trace_record_device(hid_host_device_handle_t handle, device_type_t device_type);
+void trace_record_report(hid_host_device_handle_t handle, const uint8_t* data, size_t length);
+void trace_forget_device(hid_host_device_handle_t handle);
+
+typedef struct {
+    uint32_t reports;
+    uint32_t failed;    // reports forward_input_report() did not take
+    int64_t elapsed_us;
+} trace_replay_stats_t;
+
+// Replay (TRACE_REPLAY): push a trace through forward_input_report() as its devices sent
+// it, speed times faster than captured (0: as fast as possible). A truncated or corrupt
+// trace ends at its last good entry; ESP_ERR_INVALID_ARG if it is no trace at all.
+esp_err_t trace_replay(const uint8_t* trace, size_t len, uint32_t speed, trace_replay_stats_t* stats);
+
+// Starts the dump task (TRACE_CAPTURE) and the replay task (TRACE_REPLAY)
+void begin_trace_tasks(void);
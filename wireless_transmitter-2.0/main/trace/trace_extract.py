@@ -0,0 +1,45 @@
+"""Rebuild a binary input trace from an `idf.py monitor` log.
+
+Usage: python trace_extract.py monitor.log replay.trc
+
+The transmitter prints captured traces between "TRACE BEGIN" and "TRACE END"
+markers (see trace.c). Copy the output next to trace.c as replay.trc to embed
+it for TRACE_REPLAY.
+"""
+import re
+import sys
+
+ANSI_ESCAPE = re.compile(r"\x1b\[[0-9;]*m")
+HEX_LINE = re.compile(r"trace\.c: ((?:[0-9a-f]{2} ?)+)\s*$")
+
+
+def extract(lines):
+    traces, current = [], None
+    for line in lines:
+        line = ANSI_ESCAPE.sub("", line)
+        if "TRACE BEGIN" in line:
+            current = bytearray()
+        elif "TRACE END" in line and current is not None:
+            traces.append(bytes(current))
+            current = None
+        elif current is not None:
+            match = HEX_LINE.search(line)
+            if match:
+                current.extend(bytes.fromhex(match.group(1).replace(" ", "")))
+    return traces
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    with open(sys.argv[1], errors="ignore") as log:
+        traces = extract(log)
+    if not traces:
+        sys.exit("No trace found in log")
+    with open(sys.argv[2], "wb") as out:
+        out.write(traces[-1])
+    print(f"Wrote {len(traces[-1])} bytes from the last of {len(traces)} trace(s)")
+
+
+if __name__ == "__main__":
+    main()